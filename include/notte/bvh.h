@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Dynamic bounding volume hierarchy.
+ */
+
+#ifndef NOTTE_BVH_H
+#define NOTTE_BVH_H
+
+#include <notte/defs.h>
+#include <notte/memory.h>
+#include <notte/math.h>
+#include <notte/vector.h>
+
+#define BVH_NULL UINT32_MAX
+
+typedef struct
+{
+  Vec3 min, max;
+} Aabb;
+
+/* Leaves have no children and hold one item. */
+typedef struct
+{
+  Aabb box;
+  u32 parent;
+  u32 children[2];
+  u32 item;
+} Bvh_Node;
+
+/*
+ * AABB tree over items identified by small integers.  Leaves store their
+ * item's box grown by a margin, so items which move a little don't touch the
+ * tree.  Insertion picks the sibling which grows the surface area least,
+ * which degrades as items move around, so the tree is rebuilt from scratch
+ * with a binned SAH build once enough leaves have been reinserted.
+ */
+typedef struct
+{
+  Bvh_Node *nodes;
+  u32 nNodes, capacity;
+  u32 freeNode;
+  u32 root;
+
+  u32 *leaves; /* Leaf of each item, or BVH_NULL. */
+  u32 leavesCapacity;
+  u32 nLeaves;
+  u32 nReinserted; /* Since the last full build. */
+
+  Vector stack;
+  Allocator alloc;
+} Bvh;
+
+/*
+ * A full build, which can run away from the tree it will replace.  All
+ * memory is allocated by BvhBuildBegin, so BvhBuildRun can run on any
+ * thread.
+ */
+typedef struct
+{
+  u32 *items;
+  Aabb *boxes;
+  Vec3 *centroids;
+  u32 n;
+
+  Bvh_Node *nodes;
+  u32 nNodes, capacity;
+  u32 root;
+  Allocator alloc;
+} Bvh_Build;
+
+/*
+ * Returns the ray parameter at which item is hit, or a negative value for a
+ * miss.  The ray already hits the item's box before maxT.
+ */
+typedef f32 (*Bvh_Ray_Fn)(void *ud, u32 item, Vec3 origin, Vec3 dir,
+    f32 maxT);
+
+void BvhInit(Bvh *bvh, Allocator alloc);
+void BvhDeinit(Bvh *bvh);
+
+void BvhInsert(Bvh *bvh, u32 item, Aabb *box);
+void BvhRemove(Bvh *bvh, u32 item);
+bool BvhContains(Bvh *bvh, u32 item);
+
+/*
+ * Moves item to box.  The tree is untouched while box fits inside the
+ * leaf's margin, otherwise the leaf is reinserted.
+ */
+void BvhUpdate(Bvh *bvh, u32 item, Aabb *box);
+
+/*
+ * Appends every item whose box intersects the frustum given by planes, as
+ * from Mat4FrustumPlanes, to out, a Vector of u32.  Subtrees entirely
+ * inside the frustum are appended without further tests.
+ */
+void BvhQueryFrustum(Bvh *bvh, Vec4 planes[6], Vector *out);
+
+/*
+ * Finds the closest item hit along origin + t * dir for t in [0, maxT).  If
+ * fn is NULL, items are hit where the ray enters their box.  Returns false
+ * if nothing is hit.
+ */
+bool BvhRaycast(Bvh *bvh, Vec3 origin, Vec3 dir, f32 maxT, Bvh_Ray_Fn fn,
+    void *ud, u32 *itemOut, f32 *tOut);
+
+/* Whether enough leaves have been reinserted that a full build would pay. */
+bool BvhWantsRebuild(Bvh *bvh);
+
+/* Snapshots the current leaves into build. */
+void BvhBuildBegin(Bvh *bvh, Bvh_Build *build);
+void BvhBuildRun(Bvh_Build *build);
+
+/* Replaces the tree with the result of build, and frees the build. */
+void BvhBuildAdopt(Bvh *bvh, Bvh_Build *build);
+void BvhBuildCancel(Bvh_Build *build);
+
+/* World space AABB of a model space AABB, given by center and extent, under m. */
+void AabbTransform(Vec3 center, Vec3 extent, Mat4 m, Aabb *out);
+
+#endif /* NOTTE_BVH_H */
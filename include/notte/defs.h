@@ -18,7 +18,7 @@
 #define NOTTE_UNREACHABLE() LOG_FATAL("unreachable location reached");         \
   exit(EXIT_FAILURE)
 
-#define NOTTE_INLINE inline
+#define NOTTE_INLINE static inline
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -35,6 +35,8 @@ typedef double f64;
 
 typedef size_t usize;
 
+#define USIZE_MAX SIZE_MAX
+
 #define PARSE_RESULT_MAX_MSG 512
 
 typedef struct
@@ -45,6 +47,8 @@ typedef struct
 
 #if defined(WIN32) || defined(_WIN32)
 #define NOTTE_WINDOWS
+#elif defined(__linux__)
+#define NOTTE_LINUX
 #else
 #error Unsupported platform!
 #endif
@@ -52,9 +56,34 @@ typedef struct
 #ifdef NOTTE_WINDOWS
 #define NOTTE_MAX_ALIGN 8
 #else
-#define NOTTE_MAX_ALIGN alignof(max_align_t)
+#define NOTTE_MAX_ALIGN _Alignof(max_align_t)
+#endif
+
+/* Instruction sets the compiler is allowed to assume. */
+#if defined(__AVX__)
+#define NOTTE_AVX
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)                  \
+  || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOTTE_SSE2
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define NOTTE_NEON
+#endif
+
+#ifdef _MSC_VER
+#define NOTTE_ALIGN(_n) __declspec(align(_n))
+#define NOTTE_THREAD_LOCAL __declspec(thread)
+#else
+#define NOTTE_ALIGN(_n) __attribute__((aligned(_n)))
+#define NOTTE_THREAD_LOCAL _Thread_local
+#endif
+
+#define NOTTE_CONCAT_(_a, _b) _a##_b
+#define NOTTE_CONCAT(_a, _b) NOTTE_CONCAT_(_a, _b)
+
 #define OFFSETOF(_type, _memb) ((usize) (&((_type *) (NULL))->_memb))
 #define ELEMOF(_arr) ((usize) (sizeof(_arr) / sizeof(_arr[0])))
 
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Frame fenced deferred destruction of GPU resources.
+ */
+
+#ifndef NOTTE_DELETION_QUEUE_H
+#define NOTTE_DELETION_QUEUE_H
+
+#include <notte/renderer_priv.h>
+
+Err_Code DeletionQueueInit(Renderer *ren, Deletion_Queue *queue);
+
+/* Destroys everything still queued, the device must be idle. */
+void DeletionQueueDeinit(Renderer *ren, Deletion_Queue *queue);
+
+/* Called once 'frame' has finished on the GPU. */
+void DeletionQueueFlush(Renderer *ren, Deletion_Queue *queue, u32 frame);
+
+void DeletionQueuePush(Renderer *ren, Deletion_Queue *queue, Deletion *del);
+
+void DeferDestroyBuffer(Renderer *ren, VkBuffer buffer, VkDeviceMemory memory);
+void DeferDestroyImage(Renderer *ren, VkImage image, VkDeviceMemory memory);
+
+#endif /* NOTTE_DELETION_QUEUE_H */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Frame pacing histograms.
+ */
+
+#ifndef NOTTE_FRAME_STATS_H
+#define NOTTE_FRAME_STATS_H
+
+#include <notte/defs.h>
+
+/*
+ * Buckets are log-linear like an HDR histogram, FRAME_HISTOGRAM_SUB_BUCKETS
+ * per power of two, so every percentile is within about 3%.  Values are
+ * microseconds, up to 2^33us, about 2.4 hours.
+ */
+#define FRAME_HISTOGRAM_SUB_BUCKETS 64
+#define FRAME_HISTOGRAM_SHIFTS 27
+#define FRAME_HISTOGRAM_BUCKETS (FRAME_HISTOGRAM_SUB_BUCKETS                  \
+  + FRAME_HISTOGRAM_SHIFTS * (FRAME_HISTOGRAM_SUB_BUCKETS / 2))
+
+#define DEFAULT_FRAME_STATS_WINDOW 600
+
+/* Samples more than this times the last window's median are hitches. */
+#define FRAME_STATS_HITCH_FACTOR 2.0
+
+typedef enum
+{
+  FRAME_STAT_CPU_FRAME, /* Between the starts of consecutive frames. */
+  FRAME_STAT_FENCE_WAIT, /* For the frame in flight to be reusable. */
+  FRAME_STAT_ACQUIRE,
+  FRAME_STAT_PRESENT,
+  FRAME_STAT_GPU, /* From GPU timestamps, if the device has them. */
+  FRAME_STAT_COUNT,
+} Frame_Stat;
+
+typedef enum
+{
+  FRAME_STATS_WINDOW, /* The last full window. */
+  FRAME_STATS_TOTAL, /* Since the stats were created. */
+} Frame_Stats_Range;
+
+/* Milliseconds. */
+typedef struct
+{
+  f64 p50, p95, p99, max;
+  u32 hitches;
+  u64 nSamples;
+} Frame_Stat_Summary;
+
+typedef struct
+{
+  u32 counts[FRAME_HISTOGRAM_BUCKETS];
+  u64 nSamples, max;
+  u32 hitches;
+} Frame_Histogram;
+
+/*
+ * Every stat has a histogram filling up over the current window, one for the
+ * last full window and one for all time.  Windows are counted in frames.
+ */
+typedef struct
+{
+  u32 windowFrames, frame;
+  Frame_Histogram current[FRAME_STAT_COUNT];
+  Frame_Histogram window[FRAME_STAT_COUNT];
+  Frame_Histogram total[FRAME_STAT_COUNT];
+  u64 hitchThresholds[FRAME_STAT_COUNT]; /* 0 until a window is full. */
+} Frame_Stats;
+
+/* windowFrames of 0 picks DEFAULT_FRAME_STATS_WINDOW. */
+void FrameStatsInit(Frame_Stats *stats, u32 windowFrames);
+void FrameStatsRecord(Frame_Stats *stats, Frame_Stat stat, f64 seconds);
+
+/* Counts a frame, completing the window every windowFrames of them. */
+void FrameStatsEndFrame(Frame_Stats *stats);
+
+void FrameStatsGet(const Frame_Stats *stats, Frame_Stat stat,
+    Frame_Stats_Range range, Frame_Stat_Summary *summary);
+
+/* Writes a table of every stat like snprintf, returning its full length. */
+usize FrameStatsDump(const Frame_Stats *stats, char *buf, usize size);
+
+#endif /* NOTTE_FRAME_STATS_H */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Batched frustum culling of bounding volumes.
+ */
+
+#ifndef NOTTE_FRUSTUM_CULL_H
+#define NOTTE_FRUSTUM_CULL_H
+
+#include <notte/defs.h>
+#include <notte/memory.h>
+#include <notte/math.h>
+
+/* 
+ * World space bounds of a set of objects, stored as structure of arrays.
+ * Each object has an AABB given by its center and half extents, and a 
+ * bounding sphere around the same center.
+ */
+typedef struct
+{
+  f32 *centerX, *centerY, *centerZ;
+  f32 *extentX, *extentY, *extentZ;
+  f32 *radius;
+  u8 *visible;
+  usize count, capacity;
+  Allocator alloc;
+} Cull_Bounds;
+
+void CullBoundsInit(Cull_Bounds *bounds, Allocator alloc);
+void CullBoundsDeinit(Cull_Bounds *bounds);
+
+/* 
+ * Sets the number of objects, growing the arrays if needed.  Growing loses 
+ * the previous contents.
+ */
+void CullBoundsResize(Cull_Bounds *bounds, usize count);
+
+/* 
+ * Sets object i's bounds to the world space bounds of a model space AABB,
+ * with a sphere of the given radius around the same center, under m.
+ */
+void CullBoundsSetTransformed(Cull_Bounds *bounds, usize i, Vec3 center,
+    Vec3 extent, f32 radius, Mat4 m);
+
+/* Copies object src's bounds over object dst's. */
+void CullBoundsMove(Cull_Bounds *bounds, usize dst, usize src);
+
+/* 
+ * Sets visible[i] for every object which intersects the frustum given by 
+ * planes (as from Mat4FrustumPlanes), and returns how many do.  An object is
+ * culled if either its sphere or its AABB is entirely outside one plane.
+ */
+usize FrustumCull(Cull_Bounds *bounds, Vec4 planes[6]);
+
+#endif /* NOTTE_FRUSTUM_CULL_H */
@@ -20,6 +20,10 @@ typedef Err_Code (*Fs_File_Create_Fn)(Fs_Driver *driver, String path,
 typedef Err_Code (*Fs_File_Write_Fn)(Fs_Driver *driver, String path, 
     Membuf *buf);
 typedef void (*Fs_File_Destroy_Fn)(Fs_Driver *driver, Membuf *buf);
+typedef Err_Code (*Fs_File_Size_Fn)(Fs_Driver *driver, String path, 
+    usize *size);
+typedef Err_Code (*Fs_File_Read_Fn)(Fs_Driver *driver, String path, 
+    usize offset, void *dst, usize size);
 
 struct Fs_Driver
 {
@@ -30,6 +34,8 @@ struct Fs_Driver
   Fs_File_Create_Fn fileCreateFn;
   Fs_File_Write_Fn fileWriteFn;
   Fs_File_Destroy_Fn fileDestroyFn;
+  Fs_File_Size_Fn fileSizeFn;
+  Fs_File_Read_Fn fileReadFn;
 };
 
 Err_Code FsDiskDriverCreate(Fs_Driver *driverOut, Allocator alloc,
@@ -37,6 +43,15 @@ Err_Code FsDiskDriverCreate(Fs_Driver *driverOut, Allocator alloc,
 Err_Code FsFileLoad(Fs_Driver *driver, String path, Membuf *buf);
 Err_Code FsFileWrite(Fs_Driver *driver, String path, Membuf *out);
 void FsFileDestroy(Fs_Driver *driver, Membuf *buf);
+Err_Code FsFileSize(Fs_Driver *driver, String path, usize *size);
+
+/* 
+ * Reads 'size' bytes starting at 'offset' straight into 'dst', without 
+ * going through an intermediate Membuf.  Fails with ERR_FAILED_PARSE if the 
+ * file is too short.
+ */
+Err_Code FsFileRead(Fs_Driver *driver, String path, usize offset, void *dst, 
+    usize size);
 
 void FsDriverDestroy(Fs_Driver *driver);
 
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Shared vertex and index buffers for static geometry.
+ */
+
+#ifndef NOTTE_GEOMETRY_POOL_H
+#define NOTTE_GEOMETRY_POOL_H
+
+#include <notte/renderer_priv.h>
+
+Err_Code GeometryPoolInit(Renderer *ren, Geometry_Pool *pool, u32 maxVerts, 
+    u32 maxIndices);
+void GeometryPoolDeinit(Renderer *ren, Geometry_Pool *pool);
+
+/* Fails with ERR_NO_MEM if either pool has no free range large enough. */
+Err_Code GeometryPoolAlloc(Geometry_Pool *pool, u32 nVerts, u32 nIndices, 
+    u32 *vertexOffset, u32 *firstIndex);
+void GeometryPoolFree(Geometry_Pool *pool, u32 vertexOffset, u32 nVerts, 
+    u32 firstIndex, u32 nIndices);
+
+void GeometryPoolBind(Geometry_Pool *pool, VkCommandBuffer buf);
+
+#endif /* NOTTE_GEOMETRY_POOL_H */
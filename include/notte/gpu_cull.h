@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * GPU frustum culling and indirect draw generation.
+ */
+
+#ifndef NOTTE_GPU_CULL_H
+#define NOTTE_GPU_CULL_H
+
+#include <notte/renderer_priv.h>
+
+/* 
+ * Whether the physical device can draw with vkCmdDrawIndexedIndirectCount,
+ * checked before the logical device is created with the features enabled.
+ */
+bool GpuCullSupported(Renderer *ren);
+
+/* Does nothing unless cull->enabled is set. */
+Err_Code GpuCullInit(Renderer *ren, Gpu_Cull *cull);
+void GpuCullDeinit(Renderer *ren, Gpu_Cull *cull);
+
+/* Recreates the compute pipeline after its shader has been rebuilt. */
+Err_Code GpuCullRebuild(Renderer *ren, Gpu_Cull *cull);
+
+/*
+ * Fills the current frame's cull objects from ren->drawGroups and decides
+ * whether this frame is culled on the GPU.
+ */
+void GpuCullPrepare(Renderer *ren, Gpu_Cull *cull, Mat4 viewProj);
+
+/*
+ * Records the culling dispatch for the current frame, to be submitted before
+ * the frame's graphics commands.  Returns VK_NULL_HANDLE if the frame isn't
+ * GPU culled.
+ */
+VkCommandBuffer GpuCullRecord(Renderer *ren, Gpu_Cull *cull);
+
+/* Draws whatever survived culling in one group, inside a render pass. */
+void GpuCullDraw(Renderer *ren, Gpu_Cull *cull, VkCommandBuffer buf,
+    u32 group, Draw_Group *drawGroup);
+
+#endif /* NOTTE_GPU_CULL_H */
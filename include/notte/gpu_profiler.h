@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * GPU timestamps around render graph passes.
+ */
+
+#ifndef NOTTE_GPU_PROFILER_H
+#define NOTTE_GPU_PROFILER_H
+
+#include <notte/renderer_priv.h>
+
+/* Leaves prof disabled if no queue the render graph uses has timestamps. */
+Err_Code GpuProfilerInit(Renderer *ren, Gpu_Profiler *prof);
+void GpuProfilerDeinit(Renderer *ren, Gpu_Profiler *prof);
+
+/* 
+ * Adds the current frame's timestamps to the passes' windows and resets its
+ * queries.  Called once the frame's last submission has finished, so they 
+ * are never waited for, and any that aren't available are dropped.
+ */
+void GpuProfilerCollect(Renderer *ren, Gpu_Profiler *prof);
+
+/* 
+ * Writes timestamps around the commands recorded for pass in between.  
+ * Begin returns the slot to end, or -1 if the pass goes untimed.
+ */
+i32 GpuProfilerBegin(Renderer *ren, Gpu_Profiler *prof, VkCommandBuffer buf,
+    Render_Graph_Queue queue, Render_Graph_Pass *pass);
+void GpuProfilerEnd(Renderer *ren, Gpu_Profiler *prof, VkCommandBuffer buf,
+    i32 slot);
+
+/* Returns false if the window has no samples. */
+bool GpuTimingGet(const Gpu_Timing_Window *window, const char *name,
+    Gpu_Timing *timing);
+
+/* Back RendererGetGpuPassTimings and RendererDumpGpuTimings. */
+u32 GpuProfilerGetPassTimings(Renderer *ren, Gpu_Timing *timings, 
+    u32 maxTimings);
+usize GpuProfilerDump(Renderer *ren, char *buf, usize size);
+
+#endif /* NOTTE_GPU_PROFILER_H */
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Image reading and writing.
+ */
+
+#ifndef NOTTE_IMAGE_H
+#define NOTTE_IMAGE_H
+
+#include <notte/defs.h>
+#include <notte/error.h>
+#include <notte/memory.h>
+#include <notte/string.h>
+#include <notte/fs.h>
+
+/* 8 bit pixels with four channels, RGBA or BGRA, alpha being ignored. */
+typedef struct
+{
+  u32 w, h;
+  usize stride; /* Bytes from one row to the next. */
+  bool bgra;
+  const u8 *pixels;
+} Image_Pixels;
+
+/* Binary PPM, which is quick to write and most viewers can open. */
+Err_Code ImageWritePpm(Fs_Driver *fs, Allocator alloc, String path, 
+    const Image_Pixels *img);
+/* Fails with ERR_UNIMPLEMENTED_FUNCTIONALITY unless built with NOTTE_PNG. */
+Err_Code ImageWritePng(Fs_Driver *fs, Allocator alloc, String path, 
+    const Image_Pixels *img);
+
+#endif /* NOTTE_IMAGE_H */
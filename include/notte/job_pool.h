@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Fixed set of worker threads for fork/join style jobs.
+ */
+
+#ifndef NOTTE_JOB_POOL_H
+#define NOTTE_JOB_POOL_H
+
+#include <notte/defs.h>
+#include <notte/error.h>
+#include <notte/memory.h>
+
+/*
+ * Runs job number 'job' on worker 'worker', where worker 0 is the thread
+ * which called JobPoolRun.
+ */
+typedef void (*Job_Fn)(void *ud, u32 job, u32 worker);
+
+typedef struct Job_Pool Job_Pool;
+
+/* Starts nWorkers threads, which may be 0. */
+Err_Code JobPoolCreate(Allocator alloc, u32 nWorkers, Job_Pool **poolOut);
+void JobPoolDestroy(Allocator alloc, Job_Pool *pool);
+
+/* Threads available to JobPoolRun, counting the calling one. */
+u32 JobPoolThreadCount(Job_Pool *pool);
+
+/*
+ * Runs fn for every job in [0, nJobs) and returns once all of them are done.
+ * Job i always runs on worker i % JobPoolThreadCount, so jobs can use state
+ * owned by their worker without locking.  Must not be called concurrently.
+ */
+void JobPoolRun(Job_Pool *pool, Job_Fn fn, void *ud, u32 nJobs);
+
+#endif /* NOTTE_JOB_POOL_H */
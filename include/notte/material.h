@@ -29,4 +29,8 @@ Err_Code MaterialManagerOpen(Renderer *ren, Material_Manager *materials,
     String file);
 Material *MaterialManagerLookup(Material_Manager *mats, String name);
 
+/* The technique mat draws pass with, fallback if mat is NULL or has none. */
+Technique *MaterialTechnique(Material *mat, Render_Pass pass, 
+    Technique *fallback);
+
 #endif /* NOTTE_MATERIAL_H */
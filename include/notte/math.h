@@ -11,6 +11,20 @@
 
 #include <notte/defs.h>
 
+/* 
+ * Mat4 kernels are picked at compile time: AVX, SSE2, NEON, or scalar.  They
+ * use unaligned loads, so matrices in mapped or loosely aligned memory are
+ * fine, but Mat4 itself is 16 byte aligned so that the loads never split 
+ * cache lines.
+ */
+#if defined(NOTTE_AVX)
+#include <immintrin.h>
+#elif defined(NOTTE_SSE2)
+#include <emmintrin.h>
+#elif defined(NOTTE_NEON)
+#include <arm_neon.h>
+#endif
+
 #define MATH_PI 3.1415926535 
 
 /* === TYPES === */
@@ -19,7 +33,8 @@ typedef f32 Vec2[2];
 typedef f32 Vec3[3];
 typedef f32 Vec4[4];
 
-typedef Vec4 Mat4[4];
+/* Column major, m[column][row]. */
+typedef NOTTE_ALIGN(16) Vec4 Mat4[4];
 
 /* == CONSTANTS === */
 
@@ -329,6 +344,359 @@ Mat4Lookat(Vec3 eye,
   out[3][3] = 1.0f;
 }
 
+/* out = a * b.  out may alias either input. */
+NOTTE_INLINE void
+Mat4Mul(Mat4 a, 
+        Mat4 b, 
+        Mat4 out)
+{
+#if defined(NOTTE_AVX)
+  /* Two columns of the result at a time, one per 128 bit lane. */
+  __m256 a0 = _mm256_broadcast_ps((const __m128 *) a[0]);
+  __m256 a1 = _mm256_broadcast_ps((const __m128 *) a[1]);
+  __m256 a2 = _mm256_broadcast_ps((const __m128 *) a[2]);
+  __m256 a3 = _mm256_broadcast_ps((const __m128 *) a[3]);
+
+  for (usize i = 0; i < 4; i += 2)
+  {
+    __m256 bb = _mm256_loadu_ps(b[i]);
+    __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bb, 0x00));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bb, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bb, 0xAA)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bb, 0xFF)));
+    _mm256_storeu_ps(out[i], r);
+  }
+#elif defined(NOTTE_SSE2)
+  __m128 a0 = _mm_loadu_ps(a[0]);
+  __m128 a1 = _mm_loadu_ps(a[1]);
+  __m128 a2 = _mm_loadu_ps(a[2]);
+  __m128 a3 = _mm_loadu_ps(a[3]);
+
+  for (usize i = 0; i < 4; i++)
+  {
+    __m128 bi = _mm_loadu_ps(b[i]);
+    __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bi, bi, 0x00));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bi, bi, 0x55)));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bi, bi, 0xAA)));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bi, bi, 0xFF)));
+    _mm_storeu_ps(out[i], r);
+  }
+#elif defined(NOTTE_NEON)
+  float32x4_t a0 = vld1q_f32(a[0]);
+  float32x4_t a1 = vld1q_f32(a[1]);
+  float32x4_t a2 = vld1q_f32(a[2]);
+  float32x4_t a3 = vld1q_f32(a[3]);
+
+  for (usize i = 0; i < 4; i++)
+  {
+    float32x4_t bi = vld1q_f32(b[i]);
+    float32x4_t r = vmulq_lane_f32(a0, vget_low_f32(bi), 0);
+    r = vmlaq_lane_f32(r, a1, vget_low_f32(bi), 1);
+    r = vmlaq_lane_f32(r, a2, vget_high_f32(bi), 0);
+    r = vmlaq_lane_f32(r, a3, vget_high_f32(bi), 1);
+    vst1q_f32(out[i], r);
+  }
+#else
+  Mat4 res;
+
+  for (usize i = 0; i < 4; i++)
+  {
+    for (usize j = 0; j < 4; j++)
+    {
+      res[i][j] = a[0][j] * b[i][0] + a[1][j] * b[i][1] 
+        + a[2][j] * b[i][2] + a[3][j] * b[i][3];
+    }
+  }
+
+  Mat4Copy(res, out);
+#endif
+}
+
+/* out = m * v.  out may alias v. */
+NOTTE_INLINE void
+Mat4MulVec4(Mat4 m, 
+            Vec4 v, 
+            Vec4 out)
+{
+#if defined(NOTTE_SSE2)
+  __m128 vv = _mm_loadu_ps(v);
+  __m128 r = _mm_mul_ps(_mm_loadu_ps(m[0]), _mm_shuffle_ps(vv, vv, 0x00));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m[1]), 
+        _mm_shuffle_ps(vv, vv, 0x55)));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m[2]), 
+        _mm_shuffle_ps(vv, vv, 0xAA)));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m[3]), 
+        _mm_shuffle_ps(vv, vv, 0xFF)));
+  _mm_storeu_ps(out, r);
+#elif defined(NOTTE_NEON)
+  float32x4_t vv = vld1q_f32(v);
+  float32x4_t r = vmulq_lane_f32(vld1q_f32(m[0]), vget_low_f32(vv), 0);
+  r = vmlaq_lane_f32(r, vld1q_f32(m[1]), vget_low_f32(vv), 1);
+  r = vmlaq_lane_f32(r, vld1q_f32(m[2]), vget_high_f32(vv), 0);
+  r = vmlaq_lane_f32(r, vld1q_f32(m[3]), vget_high_f32(vv), 1);
+  vst1q_f32(out, r);
+#else
+  Vec4 res;
+
+  for (usize j = 0; j < 4; j++)
+  {
+    res[j] = m[0][j] * v[0] + m[1][j] * v[1] + m[2][j] * v[2] 
+      + m[3][j] * v[3];
+  }
+
+  MemoryCopy(out, res, sizeof(Vec4));
+#endif
+}
+
+/* Transforms a point, as if its w were 1, ignoring the projective row. */
+NOTTE_INLINE void
+Mat4MulPoint(Mat4 m, 
+             Vec3 p, 
+             Vec3 out)
+{
+  Vec4 v = {p[0], p[1], p[2], 1.0f};
+
+  Mat4MulVec4(m, v, v);
+  out[0] = v[0];
+  out[1] = v[1];
+  out[2] = v[2];
+}
+
+#if defined(NOTTE_SSE2)
+NOTTE_INLINE __m128
+Mat4CrossSse(__m128 a, 
+             __m128 b)
+{
+  __m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+  return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+NOTTE_INLINE f32
+Mat4Dot3Sse(__m128 a, 
+            __m128 b)
+{
+  NOTTE_ALIGN(16) f32 p[4];
+  _mm_store_ps(p, _mm_mul_ps(a, b));
+  return p[0] + p[1] + p[2];
+}
+#endif
+
+/* 
+ * General inverse, by the cross product formulation of the adjugate.  The
+ * result is undefined if m is singular.  out may alias m.
+ */
+NOTTE_INLINE void
+Mat4Inverse(Mat4 m, 
+            Mat4 out)
+{
+  f32 x = m[0][3], y = m[1][3], z = m[2][3], w = m[3][3];
+
+#if defined(NOTTE_SSE2)
+  __m128 a = _mm_loadu_ps(m[0]);
+  __m128 b = _mm_loadu_ps(m[1]);
+  __m128 c = _mm_loadu_ps(m[2]);
+  __m128 d = _mm_loadu_ps(m[3]);
+
+  __m128 s = Mat4CrossSse(a, b);
+  __m128 t = Mat4CrossSse(c, d);
+  __m128 u = _mm_sub_ps(_mm_mul_ps(a, _mm_set1_ps(y)), 
+      _mm_mul_ps(b, _mm_set1_ps(x)));
+  __m128 v = _mm_sub_ps(_mm_mul_ps(c, _mm_set1_ps(w)), 
+      _mm_mul_ps(d, _mm_set1_ps(z)));
+
+  __m128 invDet = _mm_set1_ps(1.0f / (Mat4Dot3Sse(s, v) + Mat4Dot3Sse(t, u)));
+  s = _mm_mul_ps(s, invDet);
+  t = _mm_mul_ps(t, invDet);
+  u = _mm_mul_ps(u, invDet);
+  v = _mm_mul_ps(v, invDet);
+
+  NOTTE_ALIGN(16) f32 rows[4][4];
+  _mm_store_ps(rows[0], _mm_add_ps(Mat4CrossSse(b, v), 
+        _mm_mul_ps(t, _mm_set1_ps(y))));
+  _mm_store_ps(rows[1], _mm_sub_ps(Mat4CrossSse(v, a), 
+        _mm_mul_ps(t, _mm_set1_ps(x))));
+  _mm_store_ps(rows[2], _mm_add_ps(Mat4CrossSse(d, u), 
+        _mm_mul_ps(s, _mm_set1_ps(w))));
+  _mm_store_ps(rows[3], _mm_sub_ps(Mat4CrossSse(u, c), 
+        _mm_mul_ps(s, _mm_set1_ps(z))));
+  rows[0][3] = -Mat4Dot3Sse(b, t);
+  rows[1][3] = Mat4Dot3Sse(a, t);
+  rows[2][3] = -Mat4Dot3Sse(d, s);
+  rows[3][3] = Mat4Dot3Sse(c, s);
+
+  __m128 r0 = _mm_load_ps(rows[0]);
+  __m128 r1 = _mm_load_ps(rows[1]);
+  __m128 r2 = _mm_load_ps(rows[2]);
+  __m128 r3 = _mm_load_ps(rows[3]);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  _mm_storeu_ps(out[0], r0);
+  _mm_storeu_ps(out[1], r1);
+  _mm_storeu_ps(out[2], r2);
+  _mm_storeu_ps(out[3], r3);
+#else
+  Vec3 a = {m[0][0], m[0][1], m[0][2]};
+  Vec3 b = {m[1][0], m[1][1], m[1][2]};
+  Vec3 c = {m[2][0], m[2][1], m[2][2]};
+  Vec3 d = {m[3][0], m[3][1], m[3][2]};
+  Vec3 s, t, u, v, r[4];
+
+  Vec3Cross(a, b, s);
+  Vec3Cross(c, d, t);
+  for (usize i = 0; i < 3; i++)
+  {
+    u[i] = a[i] * y - b[i] * x;
+    v[i] = c[i] * w - d[i] * z;
+  }
+
+  f32 invDet = 1.0f / (Vec3Dot(s, v) + Vec3Dot(t, u));
+  Vec3Scale(s, invDet, s);
+  Vec3Scale(t, invDet, t);
+  Vec3Scale(u, invDet, u);
+  Vec3Scale(v, invDet, v);
+
+  Vec3Cross(b, v, r[0]);
+  Vec3Cross(v, a, r[1]);
+  Vec3Cross(d, u, r[2]);
+  Vec3Cross(u, c, r[3]);
+  for (usize i = 0; i < 3; i++)
+  {
+    r[0][i] += t[i] * y;
+    r[1][i] -= t[i] * x;
+    r[2][i] += s[i] * w;
+    r[3][i] -= s[i] * z;
+  }
+
+  f32 rw[4] = {-Vec3Dot(b, t), Vec3Dot(a, t), -Vec3Dot(d, s), Vec3Dot(c, s)};
+
+  for (usize row = 0; row < 4; row++)
+  {
+    for (usize col = 0; col < 3; col++)
+    {
+      out[col][row] = r[row][col];
+    }
+    out[3][row] = rw[row];
+  }
+#endif
+}
+
+/* 
+ * Builds translate(pos) * rotX(rot[0]) * rotY(rot[1]) * rotZ(rot[2]), with
+ * angles in radians, directly instead of through three rotation multiplies.
+ */
+NOTTE_INLINE void
+Mat4Compose(Vec3 pos, 
+            Vec3 rot, 
+            Mat4 out)
+{
+  f32 sa = sinf(rot[0]), ca = cosf(rot[0]);
+  f32 sb = sinf(rot[1]), cb = cosf(rot[1]);
+  f32 sc = sinf(rot[2]), cc = cosf(rot[2]);
+
+  out[0][0] = cb * cc;
+  out[0][1] = ca * sc + sa * sb * cc;
+  out[0][2] = sa * sc - ca * sb * cc;
+  out[0][3] = 0.0f;
+
+  out[1][0] = -cb * sc;
+  out[1][1] = ca * cc - sa * sb * sc;
+  out[1][2] = sa * cc + ca * sb * sc;
+  out[1][3] = 0.0f;
+
+  out[2][0] = sb;
+  out[2][1] = -sa * cb;
+  out[2][2] = ca * cb;
+  out[2][3] = 0.0f;
+
+  out[3][0] = pos[0];
+  out[3][1] = pos[1];
+  out[3][2] = pos[2];
+  out[3][3] = 1.0f;
+}
+
+/* 
+ * Quaternions are Vec4s of (x, y, z, w).  Builds the rotation of
+ * rotX(rot[0]) * rotY(rot[1]) * rotZ(rot[2]), in radians, matching 
+ * Mat4Compose.
+ */
+NOTTE_INLINE void
+QuatFromEuler(Vec3 rot, 
+              Vec4 out)
+{
+  f32 sx = sinf(rot[0] * 0.5f), cx = cosf(rot[0] * 0.5f);
+  f32 sy = sinf(rot[1] * 0.5f), cy = cosf(rot[1] * 0.5f);
+  f32 sz = sinf(rot[2] * 0.5f), cz = cosf(rot[2] * 0.5f);
+
+  out[0] = sx * cy * cz + cx * sy * sz;
+  out[1] = cx * sy * cz - sx * cy * sz;
+  out[2] = cx * cy * sz + sx * sy * cz;
+  out[3] = cx * cy * cz - sx * sy * sz;
+}
+
+/* Builds translate(pos) * rotate(rot) * scale(scale), rot a unit quaternion. */
+NOTTE_INLINE void
+Mat4FromTrs(Vec3 pos, 
+            Vec4 rot, 
+            Vec3 scale, 
+            Mat4 out)
+{
+  f32 x = rot[0], y = rot[1], z = rot[2], w = rot[3];
+  f32 xx = x * x, yy = y * y, zz = z * z;
+  f32 xy = x * y, xz = x * z, yz = y * z;
+  f32 wx = w * x, wy = w * y, wz = w * z;
+
+  out[0][0] = (1.0f - 2.0f * (yy + zz)) * scale[0];
+  out[0][1] = 2.0f * (xy + wz) * scale[0];
+  out[0][2] = 2.0f * (xz - wy) * scale[0];
+  out[0][3] = 0.0f;
+
+  out[1][0] = 2.0f * (xy - wz) * scale[1];
+  out[1][1] = (1.0f - 2.0f * (xx + zz)) * scale[1];
+  out[1][2] = 2.0f * (yz + wx) * scale[1];
+  out[1][3] = 0.0f;
+
+  out[2][0] = 2.0f * (xz + wy) * scale[2];
+  out[2][1] = 2.0f * (yz - wx) * scale[2];
+  out[2][2] = (1.0f - 2.0f * (xx + yy)) * scale[2];
+  out[2][3] = 0.0f;
+
+  out[3][0] = pos[0];
+  out[3][1] = pos[1];
+  out[3][2] = pos[2];
+  out[3][3] = 1.0f;
+}
+
+/* 
+ * Extracts the six inward facing, normalized planes of the frustum of a view
+ * projection matrix with a [0, 1] depth range, in the order left, right, 
+ * bottom, top, near, far.  A point p is inside a plane if dot(n, p) + d >= 0.
+ */
+NOTTE_INLINE void
+Mat4FrustumPlanes(Mat4 m, 
+                  Vec4 planes[6])
+{
+  for (usize i = 0; i < 4; i++)
+  {
+    planes[0][i] = m[i][3] + m[i][0];
+    planes[1][i] = m[i][3] - m[i][0];
+    planes[2][i] = m[i][3] + m[i][1];
+    planes[3][i] = m[i][3] - m[i][1];
+    planes[4][i] = m[i][2];
+    planes[5][i] = m[i][3] - m[i][2];
+  }
+
+  for (usize i = 0; i < 6; i++)
+  {
+    f32 len = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1]
+        + planes[i][2] * planes[i][2]);
+    planes[i][0] /= len;
+    planes[i][1] /= len;
+    planes[i][2] /= len;
+    planes[i][3] /= len;
+  }
+}
+
 NOTTE_INLINE void
 Mat4Perspective(float fovy, 
                 float aspect, 
@@ -23,6 +23,7 @@ typedef enum
   MEMORY_TAG_FS,
   MEMORY_TAG_THREAD,
   MEMORY_TAG_ALLOC, /* For allocators. */
+  MEMORY_TAG_PROFILE,
   MEMORY_TAG_TAG_COUNT,
 } Memory_Tag;
 
@@ -52,6 +53,7 @@ void MemoryPrintUsage(void);
 
 void *MemoryZero(void *ptr, usize size);
 void *MemoryCopy(void *dest, const void *src, usize size);
+void *MemoryMove(void *dest, const void *src, usize size);
 void *MemorySet(void *dest, u8 val, usize size);
 
 #define NEW(_alloc, _type, _tag) ((_type *)                                   \
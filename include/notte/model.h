@@ -14,12 +14,20 @@
 #include <notte/memory.h>
 #include <notte/vector.h>
 #include <notte/renderer.h>
+#include <notte/fs.h>
 
 /* Loads a wavefront .OBJ file as a static model. */
 Err_Code StaticMeshLoadObj(Renderer *ren, Allocator alloc, 
     Static_Mesh **mesh, Parse_Result *result, Membuf buf);
 Err_Code ConvertObjToUStatic(Allocator alloc, Membuf inBuf, Membuf *outBuf);
-Err_Code StaticMeshLoadUStatic(Renderer *ren, Allocator alloc,
-    Static_Mesh **mesh, Parse_Result *result, Membuf buf);
+Err_Code StaticMeshLoadUStatic(Renderer *ren, Static_Mesh **mesh, 
+    Parse_Result *result, Membuf buf);
+/* 
+ * Reads a .ustatic file straight into mapped staging memory, skipping the 
+ * intermediate Membuf.
+ */
+Err_Code StaticMeshLoadUStaticFile(Renderer *ren, Fs_Driver *fs, 
+    Static_Mesh **mesh, Parse_Result *result, String path, 
+    Static_Mesh_Retention retention);
 
 #endif /* NOTTE_MODEL_H */
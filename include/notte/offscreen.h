@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Headless render targets and frame readback.
+ */
+
+#ifndef NOTTE_OFFSCREEN_H
+#define NOTTE_OFFSCREEN_H
+
+#include <notte/renderer_priv.h>
+
+/* 
+ * Fills ren->swapchain with an image of w by h for each frame in flight, 
+ * which the render graph draws into like the swapchain's.  fn may be NULL.
+ * On failure everything created so far is destroyed again.
+ */
+Err_Code OffscreenInit(Renderer *ren, Offscreen *off, u32 w, u32 h, 
+    Renderer_Readback_Fn fn, void *ud);
+void OffscreenDeinit(Renderer *ren, Offscreen *off);
+
+/* 
+ * Records copying the current frame's image into its buffer, to run after 
+ * the render graph.  Returns VK_NULL_HANDLE if nothing is read back.
+ */
+VkCommandBuffer OffscreenRecordReadback(Renderer *ren, Offscreen *off);
+
+/* Hands the current frame's last readback to fn, once it has finished. */
+void OffscreenCollect(Renderer *ren, Offscreen *off);
+
+/* Waits for every frame submitted, handing their readbacks to fn in order. */
+Err_Code OffscreenFlush(Renderer *ren, Offscreen *off);
+
+#endif /* NOTTE_OFFSCREEN_H */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * CPU instrumentation, exported as Chrome trace events.
+ */
+
+#ifndef NOTTE_PROFILE_H
+#define NOTTE_PROFILE_H
+
+#include <notte/defs.h>
+#include <notte/error.h>
+#include <notte/memory.h>
+#include <notte/fs.h>
+
+/* Events each thread keeps, older ones are overwritten. */
+#define PROFILE_RING_SIZE (16 * 1024)
+
+/* Threads which can record events, later ones are ignored. */
+#define PROFILE_MAX_THREADS 32
+
+#ifndef NOTTE_NO_PROFILE
+
+/*
+ * Times the statement or block after it, which must not be left with
+ * return, break or goto:
+ *
+ *   PROFILE_ZONE("compile shader")
+ *   {
+ *     ...
+ *   }
+ *
+ * Names must be string literals, or otherwise outlive the profiler.
+ */
+#define PROFILE_ZONE(_name)                                                    \
+  for (int NOTTE_CONCAT(_profileZone, __LINE__) = (ProfileBegin(_name), 1);   \
+      NOTTE_CONCAT(_profileZone, __LINE__);                                    \
+      NOTTE_CONCAT(_profileZone, __LINE__) = (ProfileEnd(), 0))
+
+/* For zones which don't fit a block, every begin needs an end. */
+#define PROFILE_BEGIN(_name) ProfileBegin(_name)
+#define PROFILE_END() ProfileEnd()
+
+/* Marks the start of a frame. */
+#define PROFILE_FRAME() ProfileFrame()
+
+/* Records a value to be plotted over time. */
+#define PROFILE_COUNTER(_name, _value) ProfileCounter(_name, (f64) (_value))
+
+#else
+
+#define PROFILE_ZONE(_name)
+#define PROFILE_BEGIN(_name)
+#define PROFILE_END()
+#define PROFILE_FRAME()
+#define PROFILE_COUNTER(_name, _value)
+
+#endif
+
+/*
+ * Allocates every thread's ring up front.  Events before this, or after
+ * ProfileDeinit, are dropped.  Not thread safe.
+ */
+Err_Code ProfileInit(Allocator alloc);
+void ProfileDeinit(void);
+
+/* Names the calling thread in exported traces. */
+void ProfileSetThreadName(const char *name);
+
+/*
+ * Writes every thread's events as Chrome trace_event JSON, which
+ * chrome://tracing and Perfetto open.  Can be called while other threads
+ * record, dropping events they overwrite meanwhile.
+ */
+Err_Code ProfileWriteChromeTrace(Fs_Driver *fs, String path);
+
+/* Use the macros, which compile out with NOTTE_NO_PROFILE. */
+void ProfileBegin(const char *name);
+void ProfileEnd(void);
+void ProfileFrame(void);
+void ProfileCounter(const char *name, f64 value);
+
+#endif /* NOTTE_PROFILE_H */
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * LSD radix sort over 64 bit keys.
+ */
+
+#ifndef NOTTE_RADIX_SORT_H
+#define NOTTE_RADIX_SORT_H
+
+#include <notte/defs.h>
+
+/* 
+ * Stably sorts keys in ascending order, applying the same permutation to 
+ * vals.  tmpKeys and tmpVals must hold n elements, and are clobbered.
+ */
+void RadixSort64(u64 *keys, u32 *vals, u64 *tmpKeys, u32 *tmpVals, usize n);
+
+#endif /* NOTTE_RADIX_SORT_H */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Free-list allocator over an abstract range of elements.
+ */
+
+#ifndef NOTTE_RANGE_ALLOCATOR_H
+#define NOTTE_RANGE_ALLOCATOR_H
+
+#include <notte/defs.h>
+#include <notte/error.h>
+#include <notte/memory.h>
+#include <notte/vector.h>
+
+typedef struct
+{
+  u32 offset, size;
+} Range;
+
+/* 
+ * Hands out sub-ranges of [0, capacity).  Free ranges are kept sorted by 
+ * offset and coalesced with their neighbours when released.
+ */
+typedef struct
+{
+  Allocator alloc;
+  u32 capacity, used;
+  Vector free;
+} Range_Allocator;
+
+Err_Code RangeAllocatorInit(Range_Allocator *ranges, Allocator alloc, 
+    u32 capacity);
+void RangeAllocatorDeinit(Range_Allocator *ranges);
+
+/* First fit, fails with ERR_NO_MEM if no free range is large enough. */
+Err_Code RangeAllocatorAlloc(Range_Allocator *ranges, u32 size, u32 *offsetOut);
+void RangeAllocatorFree(Range_Allocator *ranges, u32 offset, u32 size);
+
+#endif /* NOTTE_RANGE_ALLOCATOR_H */
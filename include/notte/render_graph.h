@@ -9,16 +9,79 @@
 
 #include <notte/renderer_priv.h>
 
-Err_Code RenderGraphInit(Renderer *ren, Render_Graph *graph);
+/* 
+ * Records with up to nThreads threads, counting the calling one, which is
+ * clamped to MAX_RECORD_THREADS.
+ */
+Err_Code RenderGraphInit(Renderer *ren, Render_Graph *graph, u32 nThreads);
 void RenderGraphDeinit(Render_Graph *graph);
-void RenderGraphRecord(Render_Graph *graph,
-                  u32 imageIndex);
+
+/* 
+ * Records every pass into the current frame's command buffers, with barriers
+ * between them.  Edits since the last call are compiled together, or reuse
+ * the cached plan for the same topology.  Fails with 
+ * ERR_CYCLICAL_RENDER_GRAPH if the passes can't be ordered.
+ */
+Err_Code RenderGraphRecord(Render_Graph *graph, u32 imageIndex);
+
+/* Waits until the current frame's previous submission has finished. */
+Err_Code RenderGraphWaitFrame(Render_Graph *graph);
+
+/* Waits until the last frame submitted has finished. */
+Err_Code RenderGraphWaitLast(Render_Graph *graph);
+
+/* 
+ * Submits what RenderGraphRecord recorded, with first ahead of the graphics
+ * passes and last after them, either of which may be VK_NULL_HANDLE.  Waits
+ * for the acquired image and signals the frame's renderFinished semaphore,
+ * unless headless, and each queue's timeline at its end.
+ */
+Err_Code RenderGraphSubmit(Render_Graph *graph, VkCommandBuffer first,
+    VkCommandBuffer last);
+
+/* Uses at most nThreads of the threads the graph was created with. */
+void RenderGraphSetThreads(Render_Graph *graph, u32 nThreads);
 
 Render_Graph_Texture *RenderGraphGetSwapchainTexture(Render_Graph *graph);
 Err_Code RenderGraphCreatePass(Render_Graph *graph, Render_Graph_Pass **passOut);
 Err_Code RenderGraphWriteTexture(Render_Graph *graph, Render_Graph_Pass *pass,
     Render_Graph_Texture *tex);
+Err_Code RenderGraphReadTexture(Render_Graph *graph, Render_Graph_Pass *pass,
+    Render_Graph_Texture *tex);
+
+/* Disabled passes are left out, as if they had never been created. */
+void RenderGraphSetPassEnabled(Render_Graph *graph, Render_Graph_Pass *pass,
+    bool enabled);
+
+/* 
+ * Compute passes only dispatch.  They write storage images in the general
+ * layout and sample what they read, and run on the async compute queue if
+ * the device has one.  Queue ownership moves with the textures.
+ */
+void RenderGraphSetPassCompute(Render_Graph *graph, Render_Graph_Pass *pass,
+    bool compute);
 
+/* Lets passes use an image which the caller keeps alive. */
+Err_Code RenderGraphImportTexture(Render_Graph *graph, VkFormat format, 
+    bool isDepth, VkImage image, VkImageView view, VkExtent2D extent, 
+    Render_Graph_Texture **texOut);
+void RenderGraphUpdateTexture(Render_Graph *graph, Render_Graph_Texture *tex,
+    VkImage image, VkImageView view, VkExtent2D extent);
+
+/* 
+ * Declares a texture the graph allocates, sized to the swapchain if size is
+ * {0, 0}.  Transient textures whose passes never overlap share memory, so 
+ * their contents don't survive between frames.
+ */
+Err_Code RenderGraphCreateTexture(Render_Graph *graph, VkFormat format,
+    bool isDepth, VkExtent2D size, Render_Graph_Texture **texOut);
+void RenderGraphSetTextureSize(Render_Graph *graph, Render_Graph_Texture *tex,
+    VkExtent2D size);
+
+/* 
+ * Called with the device idle after the swapchain is recreated.  Drops the
+ * cached plans which use the old swapchain.
+ */
 Err_Code RenderGraphRebuild(Render_Graph *graph);
 
 #endif /* NOTTE_RENDER_GRAPH_H */
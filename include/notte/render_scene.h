@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Retained scene of render objects.
+ */
+
+#ifndef NOTTE_RENDER_SCENE_H
+#define NOTTE_RENDER_SCENE_H
+
+#include <notte/renderer_priv.h>
+
+void RenderSceneInit(Renderer *ren, Render_Scene *scene);
+void RenderSceneDeinit(Renderer *ren, Render_Scene *scene);
+
+Err_Code RenderSceneAdd(Renderer *ren, Render_Scene *scene,
+    Render_Object_Info *info, Render_Object_Handle *handleOut);
+Err_Code RenderSceneUpdate(Renderer *ren, Render_Scene *scene,
+    Render_Object_Handle handle, Render_Object_Info *info);
+Err_Code RenderSceneRemove(Renderer *ren, Render_Scene *scene,
+    Render_Object_Handle handle);
+
+/*
+ * Refreshes the bounds of objects which moved since the last call, queries
+ * the BVH for those inside planes and fills order[0, nOrder) with them
+ * sorted by key.  With planes NULL every object is drawn.  Also adopts a
+ * finished background rebuild of the BVH, or starts one if it has degraded.
+ */
+void RenderScenePrepare(Renderer *ren, Render_Scene *scene,
+    Technique *defaultTech, Vec4 *planes);
+
+/*
+ * Finds the closest object hit by the ray from origin along dir, testing
+ * triangles of meshes which retain their data and bounds of the rest.
+ */
+bool RenderScenePick(Renderer *ren, Render_Scene *scene, Vec3 origin,
+    Vec3 dir, Render_Object_Handle *handleOut, f32 *distOut);
+
+#endif /* NOTTE_RENDER_SCENE_H */
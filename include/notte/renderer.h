@@ -12,15 +12,111 @@
 #include <notte/memory.h>
 #include <notte/fs.h>
 #include <notte/math.h>
+#include <notte/frame_stats.h>
+#include <notte/transform_store.h>
 
+#define MAX_FRAMES_IN_FLIGHT 3
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+
+typedef enum
+{
+  PRESENT_MODE_FIFO, /* Waits for vertical blank. */
+  PRESENT_MODE_MAILBOX, /* Replaces the queued image, never tears. */
+  PRESENT_MODE_IMMEDIATE, /* Doesn't wait, may tear. */
+} Present_Mode;
+
+/* A headless frame read back from the GPU, only valid during the callback. */
 typedef struct
 {
+  u64 frame; /* Counting draws from 0. */
+  u32 w, h;
+  usize stride; /* Bytes from one row to the next. */
+  const u8 *pixels; /* BGRA, 8 bits each and sRGB encoded. */
+} Renderer_Readback;
+
+typedef void (*Renderer_Readback_Fn)(void *ud, 
+    const Renderer_Readback *readback);
+
+typedef struct
+{
+  /* 
+   * NULL runs headless, drawing into offscreen images of width by height, 
+   * one per frame in flight, and never presenting.
+   */
   Plat_Window *win;
+  u32 width, height;
   Allocator alloc;
   Fs_Driver *fs;
+
+  /* Capacity of the shared static geometry buffers, 0 picks a default. */
+  u32 maxStaticVerts, maxStaticIndices;
+
+  /* 
+   * Cull and build draws on the GPU, drawing with 
+   * vkCmdDrawIndexedIndirectCount.  Ignored if the device can't.
+   */
+  bool gpuDriven;
+
+  /* 
+   * Threads recording draws into secondary command buffers, counting the
+   * one calling RendererDraw.  0 or 1 records everything on that thread.
+   */
+  u32 recordThreads;
+
+  /* Frames in each window of frame stats, 0 picks a default. */
+  u32 statsWindow;
+
+  /* 
+   * Frames the CPU may record ahead of the GPU, 0 picks 
+   * DEFAULT_FRAMES_IN_FLIGHT.  Clamped to MAX_FRAMES_IN_FLIGHT.
+   */
+  u32 framesInFlight;
+
+  /* 
+   * Falls back to PRESENT_MODE_FIFO if the surface can't.  Values outside
+   * Present_Mode fail with ERR_INVALID_USAGE.
+   */
+  Present_Mode presentMode;
+
+  /* 
+   * Makes RendererWaitForLatency wait for the last frame to finish, trading
+   * throughput for input latency.
+   */
+  bool lowLatency;
+
+  /* 
+   * Headless only, called with each frame once the GPU has finished it, at 
+   * the start of a later RendererDraw or in RendererFlushReadbacks.
+   */
+  Renderer_Readback_Fn readbackFn;
+  void *readbackUd;
 } Renderer_Create_Info;
 
+/* How the last frame was recorded, with CPU times in seconds. */
+typedef struct
+{
+  f64 recordTime;
+  f64 chunkTime; /* Summed over chunks, more than recordTime if parallel. */
+  f64 maxChunkTime;
+  u32 nChunks, nThreads;
+
+  /* 
+   * Passes enabled in the graph, left after culling those whose output is 
+   * never used, and render pass instances left after merging.
+   */
+  u32 nPasses, nLivePasses, nRenderPasses;
+} Record_Stats;
+
+/* GPU time of a pass or whole frames over the last few hundred frames. */
+typedef struct
+{
+  const char *name;
+  f64 min, avg, p99; /* Milliseconds. */
+  u32 nSamples;
+} Gpu_Timing;
+
 typedef struct Static_Mesh Static_Mesh;
+typedef struct Material Material;
 
 typedef struct
 {
@@ -35,30 +131,183 @@ typedef struct
   Vec3 rot;
 } Transform;
 
-/* The ownership of both verts and indices are taken. */
+/* How much of a static mesh is kept in CPU memory after it is uploaded. */
+typedef enum
+{
+  STATIC_MESH_RETAIN_NONE,
+  STATIC_MESH_RETAIN_ALL,
+  STATIC_MESH_RETAIN_POSITIONS, /* Positions and indices, for collision and
+                                   picking. */
+} Static_Mesh_Retention;
+
+/* 
+ * If takeOwnership is set, verts and indices must have been allocated with 
+ * the renderer's allocator using MEMORY_TAG_ARRAY, and are either kept as the
+ * mesh's CPU copy or freed, even if creating the mesh fails.  Otherwise they 
+ * are only read.
+ */
 typedef struct
 {
   const Static_Vert *verts;
   const u32 *indices;
   usize nVerts, nIndices;
+  Static_Mesh_Retention retention;
+  bool takeOwnership;
 } Static_Mesh_Create_Info;
 
+/* 
+ * Staged upload of a static mesh.  The caller fills in nVerts and nIndices,
+ * RendererBeginStaticMesh maps staging memory and sets verts and indices, the
+ * caller writes the mesh data through them, and RendererEndStaticMesh copies 
+ * it into device local memory.  Retained data is read back from staging 
+ * memory.  If the data can't be written, RendererAbortStaticMesh frees 
+ * everything RendererBeginStaticMesh created instead.
+ *
+ * Every vertex written must also be passed to RendererAddStaticMeshBounds,
+ * preferably from the caller's own copy, since staging memory may be slow 
+ * to read back.  A mesh without any bounds is never culled.
+ */
+typedef struct
+{
+  usize nVerts, nIndices;
+  Static_Mesh_Retention retention;
+  Static_Vert *verts;
+  u32 *indices;
+  Static_Mesh *mesh;
+  Vec3 min, max;
+} Static_Mesh_Upload;
+
+/* CPU side geometry of a mesh, positions are 'stride' bytes apart. */
+typedef struct
+{
+  const f32 *positions;
+  usize stride;
+  const u32 *indices;
+  usize nVerts, nIndices;
+} Static_Mesh_Cpu_Data;
+
+/* 
+ * Handle to an object in the renderer's retained scene.  Handles to removed
+ * objects are detected by their generation.
+ */
+typedef struct
+{
+  u32 idx, gen;
+} Render_Object_Handle;
+
+/* 
+ * The mesh, material and transform must outlive the object, or be replaced
+ * with RendererUpdateRenderObject first.
+ */
+typedef struct
+{
+  Static_Mesh *mesh;
+  Material *material;
+  Transform_Id transform;
+} Render_Object_Info;
+
 typedef struct Renderer Renderer;
 
 typedef struct Camera Camera;
-typedef struct Material Material;
 
 Err_Code RendererCreate(Renderer_Create_Info *create_info, Renderer **ren_out);
 Err_Code RendererDraw(Renderer *ren);
+
+/* 
+ * Call before sampling input for the next RendererDraw.  In low latency mode
+ * this waits for the GPU to finish the last frame, so the CPU never runs more
+ * than a frame ahead of it.  Otherwise it returns straight away.
+ */
+Err_Code RendererWaitForLatency(Renderer *ren);
+
+/* Waits for every frame drawn, handing any still unread to readbackFn. */
+Err_Code RendererFlushReadbacks(Renderer *ren);
 void RendererDestroy(Renderer *ren);
 
 Err_Code RendererCreateStaticMesh(Renderer *ren, 
     Static_Mesh_Create_Info *createInfo, Static_Mesh **mesh);
 void RendererDestroyStaticMesh(Renderer *ren, Static_Mesh *mesh);
+Err_Code RendererBeginStaticMesh(Renderer *ren, Static_Mesh_Upload *upload);
+Err_Code RendererEndStaticMesh(Renderer *ren, Static_Mesh_Upload *upload,
+    Static_Mesh **mesh);
+void RendererAbortStaticMesh(Renderer *ren, Static_Mesh_Upload *upload);
+void RendererAddStaticMeshBounds(Static_Mesh_Upload *upload, 
+    const Static_Vert *verts, usize nVerts);
+
+/* Fails with ERR_INVALID_USAGE if the mesh was created without retention. */
+Err_Code RendererGetStaticMeshCpuData(Renderer *ren, Static_Mesh *mesh,
+    Static_Mesh_Cpu_Data *data);
+
+/* Bytes of mesh data currently retained in CPU memory across all meshes. */
+usize RendererGetRetainedMeshBytes(Renderer *ren);
 
 void RendererDrawStaticMesh(Renderer *ren, Static_Mesh *mesh, 
     Transform transform, Material *mat);
 
+/* 
+ * parent may be TRANSFORM_ID_NONE.  Destroying a transform leaves its 
+ * children without a parent.  Ids of destroyed transforms are reported and
+ * ignored.
+ */
+Err_Code RendererCreateTransform(Renderer *ren, Transform_Id parent,
+    Transform_Id *idOut);
+void RendererDestroyTransform(Renderer *ren, Transform_Id id);
+void RendererSetTransform(Renderer *ren, Transform_Id id, Transform trans);
+void RendererSetTransformScale(Renderer *ren, Transform_Id id, Vec3 scale);
+
+/* Draws with the cached world matrix of a renderer owned transform. */
+void RendererDrawStaticMeshAt(Renderer *ren, Static_Mesh *mesh, 
+    Transform_Id id, Material *mat);
+
+/* 
+ * Retained objects are drawn every frame until removed, and only cost CPU
+ * time when added, changed or moved.  Stale handles fail with 
+ * ERR_INVALID_USAGE.
+ */
+Err_Code RendererAddRenderObject(Renderer *ren, Render_Object_Info *info,
+    Render_Object_Handle *handleOut);
+Err_Code RendererUpdateRenderObject(Renderer *ren, 
+    Render_Object_Handle handle, Render_Object_Info *info);
+Err_Code RendererRemoveRenderObject(Renderer *ren, 
+    Render_Object_Handle handle);
+
+/*
+ * Finds the closest retained object hit by the ray from origin along dir,
+ * and its distance along the ray.  Objects are where the last drawn frame
+ * put them.  Returns false if nothing is hit.
+ */
+bool RendererPickRenderObject(Renderer *ren, Vec3 origin, Vec3 dir,
+    Render_Object_Handle *handleOut, f32 *distOut);
+
+/* How many of the last frame's draw calls survived frustum culling. */
+void RendererGetCullStats(Renderer *ren, u32 *visible, u32 *culled);
+
+/* 
+ * Limits recording to nThreads threads, clamped between 1 and 
+ * Renderer_Create_Info.recordThreads.
+ */
+void RendererSetRecordThreads(Renderer *ren, u32 nThreads);
+void RendererGetRecordStats(Renderer *ren, Record_Stats *stats);
+
+/* 
+ * GPU timings, lagging by the frames in flight.  Returns false, or 0 timings,
+ * if the device has no timestamps.  Passes come in order of creation, those
+ * never timed left out, and merged passes are timed with the one before them.
+ * Dumping writes a table of both like snprintf, returning its full length.
+ */
+bool RendererGetGpuFrameTiming(Renderer *ren, Gpu_Timing *timing);
+u32 RendererGetGpuPassTimings(Renderer *ren, Gpu_Timing *timings, 
+    u32 maxTimings);
+usize RendererDumpGpuTimings(Renderer *ren, char *buf, usize size);
+
+/* 
+ * Frame pacing over the last window of frames, or since creation.  Dumping
+ * writes a table of every stat like snprintf, returning its full length.
+ */
+void RendererGetFrameStats(Renderer *ren, Frame_Stat stat, 
+    Frame_Stats_Range range, Frame_Stat_Summary *summary);
+usize RendererDumpFrameStats(Renderer *ren, char *buf, usize size);
+
 Err_Code RendererCreateCamera(Renderer *ren, Camera **cameraOut);
 void RendererDestroyCamera(Renderer *ren, Camera *cam);
 void RendererSetCameraActive(Renderer *ren, Camera *cam);
@@ -13,10 +13,56 @@
 #include <notte/renderer.h>
 #include <notte/dict.h>
 #include <notte/vector.h>
+#include <notte/range_allocator.h>
+#include <notte/frustum_cull.h>
+#include <notte/transform_store.h>
+#include <notte/bvh.h>
+#include <notte/thread.h>
+#include <notte/job_pool.h>
 
 /* === MACROS === */
 
-#define MAX_FRAMES_IN_FLIGHT 2
+#define FRAME_UNIFORM_ARENA_SIZE (256 * 1024)
+#define DEFAULT_MAX_STATIC_VERTS (1024 * 1024)
+#define DEFAULT_MAX_STATIC_INDICES (4 * 1024 * 1024)
+#define MAX_INSTANCES_PER_FRAME (16 * 1024)
+
+/* Threads recording a pass, counting the one driving the frame. */
+#define MAX_RECORD_THREADS 16
+
+/* Work units a pass needs per chunk before splitting it up pays off. */
+#define MIN_RECORD_CHUNK_UNITS 64
+
+/* Descriptor binding of the per-frame Instance_Data array. */
+#define INSTANCE_DATA_BINDING 2
+
+/* Techniques the GPU culling pass can keep separate draw counts for. */
+#define MAX_CULL_GROUPS 64
+
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 10.0f
+
+/* 
+ * Layout of a Draw_Call sort key, most significant field first.  Ids wider
+ * than their field wrap, which only costs a redundant state change.
+ */
+#define SORT_KEY_PASS_BITS 4
+#define SORT_KEY_TECH_BITS 10
+#define SORT_KEY_MATERIAL_BITS 14
+#define SORT_KEY_MESH_BITS 20
+#define SORT_KEY_DEPTH_BITS 16
+
+#define SORT_KEY_DEPTH_SHIFT 0
+#define SORT_KEY_MESH_SHIFT (SORT_KEY_DEPTH_SHIFT + SORT_KEY_DEPTH_BITS)
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS)
+#define SORT_KEY_TECH_SHIFT (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+#define SORT_KEY_PASS_SHIFT (SORT_KEY_TECH_SHIFT + SORT_KEY_TECH_BITS)
+
+#define SORT_KEY_FIELD(_val, _field)                                           \
+  (((u64) (_val) & ((1ull << SORT_KEY_##_field##_BITS) - 1))                   \
+   << SORT_KEY_##_field##_SHIFT)
+
+#define SORT_KEY_DEPTH_MASK SORT_KEY_FIELD(~0ull, DEPTH)
 
 /* === TYPES === */
 
@@ -28,18 +74,110 @@ typedef enum
 
 struct Static_Mesh
 {
+  /* CPU copies, which of these are set depends on retention. */
   const Static_Vert *verts;
+  const Vec3 *positions;
   const u32 *indices;
   usize nVerts, nIndices;
-  VkBuffer vertexBuffer, indexBuffer;
-  VkDeviceMemory vertexMemory, indexMemory;
+  Static_Mesh_Retention retention;
+  bool retained;
+  usize retainedBytes;
+
+  /* Location of the mesh's geometry in the renderer's Geometry_Pool. */
+  u32 vertexOffset, firstIndex;
+
+  u32 id; /* For draw sort keys. */
+
+  /* 
+   * Model space bounding sphere, center in xyz and radius in w, and the half
+   * extents of the AABB around the same center.
+   */
+  Vec4 sphere;
+  Vec3 extent;
+
+  /* Only valid between RendererBeginStaticMesh and RendererEndStaticMesh. */
+  VkBuffer stagingBuffer;
+  VkDeviceMemory stagingMemory;
 };
 
 typedef struct
 {
   u32 graphicsFamily, presentFamily;
+  u32 computeFamily; /* Compute without graphics, if hasAsyncCompute. */
+  bool hasAsyncCompute;
 } Queue_Family_Info;
 
+typedef enum
+{
+  DELETION_BUFFER,
+  DELETION_IMAGE,
+  DELETION_IMAGE_VIEW,
+  DELETION_MEMORY,
+  DELETION_PIPELINE,
+  DELETION_PIPELINE_LAYOUT,
+  DELETION_RENDER_PASS,
+  DELETION_FRAMEBUFFER,
+  DELETION_DESCRIPTOR_SET_LAYOUT,
+  DELETION_DESCRIPTOR_SET, /* Allocated from the renderer's descriptor pool. */
+  DELETION_STATIC_GEOMETRY, /* Ranges of the renderer's Geometry_Pool. */
+} Deletion_Type;
+
+typedef struct
+{
+  Deletion_Type t;
+  union
+  {
+    VkBuffer buffer;
+    VkImage image;
+    VkImageView imageView;
+    VkDeviceMemory memory;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorSet descriptorSet;
+    struct
+    {
+      u32 vertexOffset, nVerts, firstIndex, nIndices;
+    } geometry;
+  };
+} Deletion;
+
+/* 
+ * Static meshes are sub-allocated from one vertex and one index buffer, so 
+ * they can all be drawn with the buffers bound once.
+ */
+typedef struct
+{
+  VkBuffer vertexBuffer, indexBuffer;
+  VkDeviceMemory vertexMemory, indexMemory;
+  Range_Allocator vertexRanges, indexRanges;
+} Geometry_Pool;
+
+/* 
+ * Linear allocator over one persistently mapped uniform buffer, reset every
+ * time its frame comes around.  Sub-allocations are bound with dynamic 
+ * offsets.
+ */
+typedef struct
+{
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  u8 *mapped;
+  VkDeviceSize size, used, alignment;
+} Uniform_Arena;
+
+/* 
+ * GPU resources waiting for the frames that might still use them.  Entries 
+ * are queued under the most recently submitted frame, and destroyed once that
+ * frame has finished.
+ */
+typedef struct
+{
+  Vector deletions[MAX_FRAMES_IN_FLIGHT];
+} Deletion_Queue;
+
 typedef struct
 {
   VkSurfaceFormatKHR format;
@@ -55,6 +193,7 @@ typedef enum
 {
   SHADER_VERT,
   SHADER_FRAG,
+  SHADER_COMP,
 } Shader_Type;
 
 typedef struct Shader
@@ -82,11 +221,13 @@ typedef struct
   VkRenderPass fakePass;
   VkDescriptorSetLayout descriptorLayout;
   VkDescriptorSet descriptorSets[MAX_FRAMES_IN_FLIGHT];
+  u32 id; /* For draw sort keys. */
 } Technique;
 
 typedef struct
 {
   Dict *dict;
+  u32 nextId;
 } Technique_Manager;
 
 typedef struct
@@ -103,39 +244,244 @@ struct Material
 {
   Effect *effect;
   VkDescriptorSet descriptors[RENDER_PASS_COUNT];
+  u32 id; /* For draw sort keys. */
 };
 
 typedef struct
 {
   Dict *dict;
+  u32 nextId;
 } Material_Manager;
 
+/* Attachments one render graph pass can write, counting depth. */
+#define MAX_PASS_ATTACHMENTS 8
+
+/* Submissions a compiled render graph is split into each frame. */
+#define MAX_RENDER_GRAPH_BATCHES 8
+
+typedef enum
+{
+  RENDER_GRAPH_QUEUE_GRAPHICS,
+  RENDER_GRAPH_QUEUE_COMPUTE, /* The async compute queue. */
+  RENDER_GRAPH_QUEUE_COUNT,
+} Render_Graph_Queue;
+
+/* 
+ * Either the swapchain, whose view depends on the acquired image, an image
+ * owned outside the graph and imported with RenderGraphImportTexture, or a
+ * transient one the graph allocates for as long as its passes need it.
+ */
+typedef struct Render_Graph_Texture Render_Graph_Texture;
+
+struct Render_Graph_Texture
+{
+  bool isSwapchain, isDepth, isTransient;
+  VkFormat format;
+  VkImage image;
+  VkImageView view;
+  VkExtent2D extent;
+  VkClearValue clear;
+
+  /* Transient textures only, the image and view are the current plan's. */
+  VkExtent2D size; /* {0, 0} follows the swapchain. */
+  VkDeviceMemory memory; /* Unless it aliases one of the plan's blocks. */
+  u32 firstUse, lastUse; /* Baked pass indices, firstUse > lastUse if unused. */
+  VkImageUsageFlags usage;
+  VkPipelineStageFlags2 useStages;
+  VkAccessFlags2 useWriteAccess;
+  Render_Graph_Texture *aliasPrev; /* Used the same memory before this. */
+  bool usedAsync; /* On the compute queue, so never aliased. */
+
+  /* State after the passes baked so far, for barrier synthesis. */
+  VkImageLayout bakeLayout;
+  VkPipelineStageFlags2 writeStages, readStages;
+  VkAccessFlags2 writeAccess;
+  i32 readBarrier; /* Made the last write visible to readers, or -1. */
+  bool needed; /* Read by a pass which is kept, or outside the graph. */
+  Render_Graph_Queue bakeQueue;
+  u32 bakeBatch; /* Last used in, released from it to change queues. */
+};
+
+/* Memory shared by transient textures whose lifetimes don't overlap. */
+typedef struct
+{
+  VkDeviceMemory memory;
+  VkMemoryRequirements reqs;
+  Render_Graph_Texture *first, *last;
+} Render_Graph_Memory;
+
+/* The swapchain's image is filled in when recording. */
+typedef struct
+{
+  Render_Graph_Texture *tex;
+  VkImageMemoryBarrier2 barrier;
+} Render_Graph_Barrier;
+
+/* Hands a texture to the other queue at the end of a batch. */
 typedef struct
 {
-  bool isSwapchain;
-  VkFramebuffer fbs[MAX_FRAMES_IN_FLIGHT];
-} Render_Graph_Texture;
+  u32 batch;
+  Render_Graph_Barrier release;
+} Render_Graph_Release;
+
+/* Frames of GPU time kept for each pass. */
+#define GPU_TIMING_WINDOW 256
+
+/* Passes timed in one frame, the rest go untimed. */
+#define MAX_GPU_TIMED_PASSES 64
+
+/* The last GPU_TIMING_WINDOW samples of one timer, in milliseconds. */
+typedef struct
+{
+  f32 samples[GPU_TIMING_WINDOW];
+  u32 nSamples, next;
+} Gpu_Timing_Window;
 
 typedef void (*Render_Graph_Record_Fn)(Renderer *ren, VkCommandBuffer buffer);
 
+/*
+ * Records chunk of nChunks parts of a pass.  Chunks run concurrently on
+ * different threads, each into its own secondary command buffer, so they may
+ * only write to state indexed by chunk.
+ */
+typedef void (*Render_Graph_Record_Chunk_Fn)(Renderer *ren,
+    VkCommandBuffer buffer, u32 chunk, u32 nChunks);
+
+/* Amount of work a pass has this frame, used to pick its chunk count. */
+typedef u32 (*Render_Graph_Count_Fn)(Renderer *ren);
+
+/* A pass either records with fn, or in parallel with chunkFn and countFn. */
 typedef struct
 {
   Vector writes, reads;
   Render_Graph_Record_Fn fn;
+  Render_Graph_Record_Chunk_Fn chunkFn;
+  Render_Graph_Count_Fn countFn;
+  u32 idx; /* In order of creation. */
+  const char *name; /* For profiling, may be NULL. */
+  bool disabled; /* Left out of the graph until enabled again. */
+  bool compute; /* Only dispatches, so it may run on the async queue. */
   int mark; /* For topological sort. */
+  Gpu_Timing_Window gpuTime; /* Of its run, if merged into the pass before. */
 } Render_Graph_Pass;
 
+/* 
+ * One pass of a plan, with what was derived from its writes.  Merged passes
+ * record in the same render pass instance as the pass before them, so only
+ * the first of a run owns the render pass and framebuffers.
+ */
+typedef struct
+{
+  Render_Graph_Pass *pass;
+  Render_Graph_Texture *texs[MAX_PASS_ATTACHMENTS]; /* Colors, then depth. */
+  VkAttachmentLoadOp loadOps[MAX_PASS_ATTACHMENTS];
+  u32 nColors;
+  Render_Graph_Queue queue;
+  u32 batch;
+  bool merged;
+  VkRenderPass renderPass;
+  VkFramebuffer *fbs; /* One per swapchain image if it writes the swapchain. */
+  u32 nFbs, nAttachments;
+  VkClearValue clears[MAX_PASS_ATTACHMENTS];
+  VkExtent2D extent;
+  u32 firstBarrier, nBarriers; /* Recorded as one batch before the pass. */
+  u32 nChunks; /* This frame's, while recording. */
+} Render_Graph_Plan_Pass;
+
+/* 
+ * Consecutive passes of a plan submitted together to one queue.  Batches are
+ * in submission order, and a batch only waits for ones before it.
+ */
+typedef struct
+{
+  Render_Graph_Queue queue;
+  u32 firstPass, nPasses;
+  i32 wait; /* Batch on the other queue this one waits for, or -1. */
+  bool signals; /* Waited for by a batch on the other queue. */
+  u32 firstBarrier, nBarriers; /* Release textures to the other queue. */
+} Render_Graph_Batch;
+
+/* A transient texture's objects in one plan. */
+typedef struct
+{
+  Render_Graph_Texture *tex;
+  VkImage image;
+  VkImageView view;
+  VkDeviceMemory memory;
+} Render_Graph_Plan_Texture;
+
+/* 
+ * Everything compiled from one topology of the graph.  Plans are cached by a
+ * hash of the topology, so switching back to one doesn't compile it again.
+ */
+typedef struct
+{
+  u64 hash;
+  Vector key; /* Of u64, the topology the hash was made from. */
+  Vector passes; /* Of Render_Graph_Plan_Pass, in submission order. */
+  Render_Graph_Batch batches[MAX_RENDER_GRAPH_BATCHES];
+  u32 nBatches, acquireBatch; /* Waits for the swapchain image. */
+  Vector barriers; /* Of Render_Graph_Barrier. */
+  u32 firstFinalBarrier, nFinalBarriers; /* Hand the swapchain to present. */
+  Vector textures; /* Of Render_Graph_Plan_Texture. */
+  Vector memories; /* Of Render_Graph_Memory. */
+  bool usesSwapchain; /* Its framebuffers hold the swapchain's views. */
+  u32 nDeclared, nRenderPasses; /* Enabled passes, render pass instances. */
+  u64 lastUsed; /* Frame it was last recorded in. */
+} Render_Graph_Plan;
+
+/* Compiled plans kept around, each holding its transient textures' memory. */
+#define MAX_RENDER_GRAPH_PLANS 4
+
+/* 
+ * Secondary command buffers of one recording thread for one frame in 
+ * flight, reset together once the frame has finished.
+ */
+typedef struct
+{
+  VkCommandPool pool;
+  Vector buffers;
+  u32 used;
+} Render_Graph_Thread_Pool;
+
 typedef struct
 {
   Renderer *ren;
-  VkCommandPool commandPool;
-  VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkCommandPool commandPools[RENDER_GRAPH_QUEUE_COUNT];
+  VkCommandBuffer commandBuffers[RENDER_GRAPH_QUEUE_COUNT]
+    [MAX_FRAMES_IN_FLIGHT][MAX_RENDER_GRAPH_BATCHES]; /* One per batch. */
   VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
   VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
-  VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
+
+  /* 
+   * Each queue's timeline counts its signaling batches.  The end of each 
+   * queue's last frame is waited for by the other, and both queues' ends of
+   * each frame in flight before its buffers are reused.  0 waits for nothing.
+   */
+  bool asyncCompute;
+  VkSemaphore timelines[RENDER_GRAPH_QUEUE_COUNT];
+  u64 timelineValues[RENDER_GRAPH_QUEUE_COUNT];
+  u64 frameEndValues[RENDER_GRAPH_QUEUE_COUNT];
+  u64 frameValues[MAX_FRAMES_IN_FLIGHT][RENDER_GRAPH_QUEUE_COUNT];
   Render_Graph_Texture swap;
-  VkFramebuffer *swapFbs;
-  Vector passes, bakedPasses;
+  Vector passes; /* Of Render_Graph_Pass *. */
+  Vector textures; /* Imported and transient, of Render_Graph_Texture *. */
+  bool dirty; /* Edited since the current plan was picked. */
+
+  Render_Graph_Plan *plan; /* Being recorded. */
+  Render_Graph_Plan *plans[MAX_RENDER_GRAPH_PLANS];
+  u32 nPlans;
+  u64 frame;
+
+  /* Scratch state while compiling a plan. */
+  Vector key, bakedPasses, barriers, memories;
+  Vector releases; /* Of Render_Graph_Release. */
+
+  Job_Pool *jobs;
+  u32 nThreads; /* In use, at most JobPoolThreadCount(jobs). */
+  Render_Graph_Thread_Pool threadPools[MAX_FRAMES_IN_FLIGHT]
+    [MAX_RECORD_THREADS];
+  Record_Stats stats;
 } Render_Graph;
 
 struct Camera 
@@ -153,41 +499,261 @@ typedef enum
 typedef struct
 {
   Draw_Call_Type t;
+  u64 key;
   union
   {
     struct
     {
       Static_Mesh *staticMesh;
-      Transform transform;
+      Transform transform; /* Only used if transformId is TRANSFORM_ID_NONE. */
+      u32 transformId;
       Material *material;
     };
   };
 } Draw_Call;
 
+/* 
+ * Scratch space for preparing draw calls: each call's model matrix, and for
+ * sorting, keys and the index of the draw call each came from.
+ */
+typedef struct
+{
+  Mat4 *models;
+  u64 *keys, *tmpKeys;
+  u32 *indices, *tmpIndices;
+  usize capacity;
+} Draw_Sort;
+
+typedef struct
+{
+  u32 drawCalls, visible, culled;
+  u32 draws, pipelineBinds, descriptorBinds;
+} Draw_Stats;
+
+/* Draw calls of one mesh with one technique, drawn as a single instanced draw. */
+typedef struct
+{
+  Technique *tech;
+  Static_Mesh *mesh;
+  Material *material;
+  u32 firstInstance, nInstances;
+} Draw_Batch;
+
+/* Consecutive batches sharing a technique, and so a pipeline bind. */
+typedef struct
+{
+  Technique *tech;
+  u32 firstBatch, nBatches;
+  u32 firstInstance, nInstances;
+} Draw_Group;
+
+/* 
+ * A retained object, kept densely in Render_Scene.objects.  Its slot is 
+ * also its item in the scene's BVH.
+ */
+typedef struct
+{
+  Static_Mesh *mesh;
+  Material *material;
+  Technique *tech; /* Resolved with the key. */
+  u64 key; /* Sort key without depth. */
+  u32 transform;
+  u32 slot;
+  u32 nextShared; /* Slot of the next object with the same transform. */
+  Aabb box; /* World space. */
+  bool boundsStale;
+} Render_Object;
+
+/* 
+ * Where a handle points.  Holds the object's dense index while it is alive, 
+ * or the next free slot.  The generation is bumped on removal.
+ */
+typedef struct
+{
+  u32 dense, gen;
+} Render_Object_Slot;
+
+/* 
+ * Retained objects, indexed spatially by a BVH.  Each frame, order holds the
+ * dense indices of the nOrder visible objects sorted by keys.  Without CPU
+ * culling that is every object, and it is only re-sorted after the scene
+ * changes.
+ *
+ * Full BVH rebuilds run on buildThread.  Objects moved or removed meanwhile
+ * are recorded in buildTouched and patched into the new tree when it is 
+ * adopted.
+ */
+typedef struct
+{
+  Vector slots;
+  u32 freeSlot;
+  Vector objects;
+  bool keysStale;
+
+  /* 
+   * First object slot using each transform, so moved transforms lead 
+   * straight to their objects, and slots whose bounds need refreshing.
+   */
+  u32 *transformObjects;
+  u32 nTransformObjects;
+  Vector stale;
+
+  /* 
+   * Rebuilds run one at a time on a worker kept for the scene's lifetime, 
+   * or on the calling thread if it couldn't be started.
+   */
+  Bvh bvh;
+  Bvh_Build build;
+  Thread *buildThread;
+  Semaphore *buildStart;
+  Mutex *buildMutex;
+  bool building, buildDone, buildQuit; /* buildDone is under buildMutex. */
+  Vector buildTouched;
+  Vector visible;
+
+  u64 *keys, *tmpKeys;
+  u32 *order, *tmpOrder;
+  u32 orderCapacity, nOrder;
+  bool orderAll; /* order holds every object. */
+} Render_Scene;
+
+/* 
+ * One instance as seen by the culling shader, indexed like Instance_Data.  
+ * Must match CullObject in cull.comp.
+ */
+typedef struct
+{
+  Vec4 sphere;
+  u32 firstIndex, nIndices;
+  i32 vertexOffset;
+  u32 group;
+  u32 firstCommand; /* Start of the group's VkDrawIndexedIndirectCommands. */
+  u32 pad[3];
+} Gpu_Cull_Object;
+
+typedef struct
+{
+  Vec4 planes[6];
+  u32 nObjects;
+} Gpu_Cull_Push_Constant;
+
+/* 
+ * GPU driven drawing.  A compute pass frustum culls every instance and 
+ * appends a draw command for each visible one to its group's range of the 
+ * command buffer, counting them per group for vkCmdDrawIndexedIndirectCount.
+ */
+typedef struct
+{
+  bool enabled; /* Requested and supported by the device. */
+  bool active; /* Used for the current frame. */
+  Shader *shader;
+  VkDescriptorSetLayout descriptorLayout;
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+  VkDescriptorSet descriptorSets[MAX_FRAMES_IN_FLIGHT];
+  VkCommandPool commandPool;
+  VkCommandBuffer cmds[MAX_FRAMES_IN_FLIGHT];
+
+  VkBuffer objectBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory objectMemory[MAX_FRAMES_IN_FLIGHT];
+  Gpu_Cull_Object *objects[MAX_FRAMES_IN_FLIGHT];
+  VkBuffer drawBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory drawMemory[MAX_FRAMES_IN_FLIGHT];
+  VkBuffer countBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory countMemory[MAX_FRAMES_IN_FLIGHT];
+
+  u32 nObjects;
+  Vec4 planes[6];
+} Gpu_Cull;
+
+/* 
+ * Timestamps written around the render graph's passes.  Each frame in flight
+ * has its own query pool, read back once the frame has finished.
+ */
+typedef struct
+{
+  bool enabled; /* Some queue the graph uses has timestamps. */
+  f64 period; /* Nanoseconds per tick. */
+  u64 masks[RENDER_GRAPH_QUEUE_COUNT]; /* Valid bits, 0 if not supported. */
+  VkQueryPool pools[MAX_FRAMES_IN_FLIGHT];
+
+  /* Query 2 * i begins passes[frame][i] and 2 * i + 1 ends it. */
+  Render_Graph_Pass *passes[MAX_FRAMES_IN_FLIGHT][MAX_GPU_TIMED_PASSES];
+  Render_Graph_Queue queues[MAX_FRAMES_IN_FLIGHT][MAX_GPU_TIMED_PASSES];
+  u32 nPasses[MAX_FRAMES_IN_FLIGHT];
+
+  Gpu_Timing_Window frame; /* First pass beginning to the last one ending. */
+} Gpu_Profiler;
+
+/* 
+ * Headless rendering's stand in for the swapchain, with an image for each 
+ * frame in flight.  Frames are copied into mapped buffers after they're 
+ * drawn, and handed to fn once the frame has finished.
+ */
+typedef struct
+{
+  VkDeviceMemory imageMemory[MAX_FRAMES_IN_FLIGHT];
+
+  Renderer_Readback_Fn fn; /* NULL if nothing is read back. */
+  void *ud;
+  VkCommandPool commandPool;
+  VkCommandBuffer cmds[MAX_FRAMES_IN_FLIGHT];
+  VkBuffer buffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory bufferMemory[MAX_FRAMES_IN_FLIGHT];
+  const u8 *mapped[MAX_FRAMES_IN_FLIGHT];
+  bool coherent; /* Otherwise reads need invalidating first. */
+  bool pending[MAX_FRAMES_IN_FLIGHT];
+  u64 frames[MAX_FRAMES_IN_FLIGHT]; /* Drawn into each frame's buffer. */
+  u64 nextFrame;
+} Offscreen;
+
 typedef struct
 {
   Mat4 view, proj;
 } Camera_Uniform;
 
+/* 
+ * Per-instance data, read by vertex shaders from a readonly std430 storage 
+ * buffer at INSTANCE_DATA_BINDING, indexed with gl_InstanceIndex.  Each 
+ * instanced draw passes the index of its first element as firstInstance.
+ * Must match InstanceData in the shaders.
+ */
 typedef struct
 {
   Mat4 model;
-} Mesh_Push_Constant;
+} Instance_Data;
+
+/* 
+ * Persistently mapped array of Instance_Data, one per frame in flight, 
+ * refilled every frame.
+ */
+typedef struct
+{
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  Instance_Data *mapped;
+  u32 capacity, used;
+} Instance_Buffer;
 
 struct Renderer
 {
-  uint32_t currentFrame;
+  uint32_t currentFrame, framesInFlight;
+  VkPresentModeKHR presentMode; /* Asked for, the swapchain's may differ. */
+  bool lowLatency;
+  f64 latencyWait; /* Spent in RendererWaitForLatency this frame. */
   Plat_Window *win;
   VkAllocationCallbacks *allocCbs;
   VkInstance vk;
+  u32 nLayers; /* Of requiredLayers, 0 if any are missing. */
   VkPhysicalDevice pDev;
   VkDevice dev;
-  VkQueue graphicsQueue, presentQueue;
+  VkQueue graphicsQueue, presentQueue, computeQueue;
   VkSurfaceKHR surface;
   Queue_Family_Info queueInfo;
   Swapchain swapchain;
   Allocator alloc;
   VkDescriptorPool descriptorPool;
+  Deletion_Queue deletions;
 
   Fs_Driver *fs;
 
@@ -198,22 +764,38 @@ struct Renderer
   Render_Graph graph;
 
   Static_Mesh *mesh;
+  Geometry_Pool geometry;
 
   VkCommandPool utilPool;
 
-  VkBuffer uniformBuffers[MAX_FRAMES_IN_FLIGHT];
-  VkDeviceMemory uniformMemory[MAX_FRAMES_IN_FLIGHT];
+  Uniform_Arena uniforms[MAX_FRAMES_IN_FLIGHT];
+  Instance_Buffer instances[MAX_FRAMES_IN_FLIGHT];
 
   VkImage texture;
   VkDeviceMemory textureMemory;
   VkImageView textureView;
   VkSampler textureSampler;
 
-  VkImage depthImage;
-  VkDeviceMemory depthMemory;
-  VkImageView depthView;
+  Render_Graph_Texture *depthTex; /* Owned by the graph. */
 
   Vector drawCalls;
+  Draw_Sort drawSort;
+  Draw_Stats drawStats;
+  Draw_Stats chunkStats[MAX_RECORD_THREADS];
+  Vector drawBatches, drawGroups;
+  Cull_Bounds cullBounds;
+  Transform_Store transforms;
+  Render_Scene scene;
+  u32 camOffset;
+  Gpu_Cull cull;
+  Gpu_Profiler gpuProfiler;
+  Frame_Stats frameStats;
+  f64 lastDrawTime;
+  bool headless;
+  Offscreen offscreen;
+  u32 nextMeshId;
+
+  usize retainedMeshBytes;
 
   Camera *cam;
 };
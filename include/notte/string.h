@@ -30,4 +30,10 @@ void StringDestroy(Allocator alloc, String str);
 
 u32 StringHash(String str);
 
+/* 
+ * Like snprintf at buf + len, but keeps counting once buf is full, so 
+ * appends can be chained and the result compared against size.
+ */
+usize StringAppendFmt(char *buf, usize size, usize len, const char *fmt, ...);
+
 #endif /* NOTTE_STRING_H */
@@ -12,6 +12,7 @@
 
 typedef struct Thread Thread;
 typedef struct Mutex Mutex;
+typedef struct Semaphore Semaphore;
 
 typedef void (*Thread_Fn)(void *ud);
 
@@ -19,10 +20,21 @@ Err_Code ThreadCreate(Allocator alloc, void *ud, Thread_Fn fn,
     Thread **threadOut);
 void ThreadDestroy(Allocator alloc, Thread *thread);
 
+/* Blocks until the thread's function has returned. */
+void ThreadJoin(Thread *thread);
+
+/* Whether the thread's function has returned, without blocking. */
+bool ThreadIsDone(Thread *thread);
+
 Err_Code MutexCreate(Allocator alloc, Mutex **mutexOut);
 void MutexDestroy(Allocator alloc, Mutex *mutex);
 void MutexAcquire(Mutex *mutex);
 bool MutexTryAcquire(Mutex *mutex);
 void MutexRelease(Mutex *mutex);
 
+Err_Code SemaphoreCreate(Allocator alloc, Semaphore **semOut);
+void SemaphoreDestroy(Allocator alloc, Semaphore *sem);
+void SemaphoreWait(Semaphore *sem);
+void SemaphoreSignal(Semaphore *sem);
+
 #endif /* NOTTE_THREAD_H */
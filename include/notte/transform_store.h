@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Batched storage of object transforms and their world matrices.
+ */
+
+#ifndef NOTTE_TRANSFORM_STORE_H
+#define NOTTE_TRANSFORM_STORE_H
+
+#include <notte/defs.h>
+#include <notte/memory.h>
+#include <notte/math.h>
+#include <notte/vector.h>
+
+#define TRANSFORM_FLAG_ALIVE 0x1
+#define TRANSFORM_FLAG_DIRTY 0x2
+
+/* 
+ * A transform kept by the renderer, whose world matrix is cached and only
+ * rebuilt after it or its parent changes.
+ */
+typedef u32 Transform_Id;
+
+#define TRANSFORM_ID_NONE UINT32_MAX
+
+/*
+ * Translation, rotation quaternion and scale of a set of transforms, stored
+ * as structure of arrays, with each one's world matrix cached until it is
+ * changed.  A transform may have a parent, which always has a lower index,
+ * and keeps a list of its children, so a change is only pushed down the 
+ * subtree under it.
+ *
+ * An update is split into TransformStoreUpdateRange, which rebuilds the
+ * local matrices of dirty transforms and can run on disjoint ranges from
+ * several threads at once, and TransformStoreEndUpdate, which multiplies
+ * in parent matrices on one thread.
+ */
+typedef struct
+{
+  f32 *posX, *posY, *posZ;
+  f32 *rotX, *rotY, *rotZ, *rotW;
+  f32 *scaleX, *scaleY, *scaleZ;
+  u32 *parents;
+  u32 *firstChild, *nextSibling; /* TRANSFORM_ID_NONE terminated. */
+  u8 *flags;
+  u32 *changed; /* Update which last changed the world matrix. */
+  Mat4 *local, *world; /* local is only used by transforms with parents. */
+
+  u32 count; /* One past the highest slot in use. */
+  u32 capacity;
+  u32 nDirty, nParented;
+  u32 update;
+  Vector freeSlots;
+  Vector dirtyIds; /* Marked dirty since the last update began. */
+  Vector moved; /* Whose world matrix the latest update changed. */
+  Allocator alloc;
+} Transform_Store;
+
+void TransformStoreInit(Transform_Store *store, Allocator alloc);
+void TransformStoreDeinit(Transform_Store *store);
+
+/*
+ * Adds an identity transform, under parent unless that is TRANSFORM_ID_NONE,
+ * and returns its id.
+ */
+u32 TransformStoreAdd(Transform_Store *store, u32 parent);
+
+/* Children of a removed transform are left without a parent. */
+void TransformStoreRemove(Transform_Store *store, u32 id);
+bool TransformStoreIsAlive(const Transform_Store *store, u32 id);
+
+void TransformStoreSet(Transform_Store *store, u32 id, Vec3 pos, Vec4 rot);
+void TransformStoreSetScale(Transform_Store *store, u32 id, Vec3 scale);
+
+/*
+ * Starts an update, after which TransformStoreChanged only reports what the
+ * update changes.  Returns false if no transform is dirty, otherwise the 
+ * caller must update [0, count) with TransformStoreUpdateRange and then call
+ * TransformStoreEndUpdate.
+ */
+bool TransformStoreBeginUpdate(Transform_Store *store);
+void TransformStoreUpdateRange(Transform_Store *store, u32 first, u32 n);
+void TransformStoreEndUpdate(Transform_Store *store);
+
+/* Runs a whole update on the calling thread, visiting only dirty ids. */
+void TransformStoreUpdate(Transform_Store *store);
+
+/* 
+ * Every id TransformStoreChanged reports for the latest update, so callers 
+ * needn't check them all.  An id may appear more than once.
+ */
+NOTTE_INLINE const u32 *
+TransformStoreMoved(Transform_Store *store,
+                    usize *nOut)
+{
+  *nOut = store->moved.elemsUsed;
+  return (const u32 *) store->moved.buf;
+}
+
+/* Whether id's world matrix changed in the latest update. */
+NOTTE_INLINE bool
+TransformStoreChanged(Transform_Store *store,
+                      u32 id)
+{
+  return store->changed[id] == store->update;
+}
+
+#endif /* NOTTE_TRANSFORM_STORE_H */
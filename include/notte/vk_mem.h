@@ -20,5 +20,38 @@ Err_Code CreateImage(Renderer *ren, u32 w, u32 h, VkFormat format,
     VkMemoryPropertyFlags properties, VkImage *image, 
     VkDeviceMemory *imageMemory);
 void DestroyImage(Renderer *ren, VkImage image, VkDeviceMemory memory);
+Err_Code CreateImageView(Renderer *ren, VkImage image, VkFormat format, 
+    VkImageAspectFlags aspectFlags, VkImageView *view);
+
+/* 
+ * Allocates memory for reqs with the first type which has properties, and 
+ * fails with ERR_NO_SUITABLE_HARDWARE if there is none.
+ */
+Err_Code AllocateMemory(Renderer *ren, const VkMemoryRequirements *reqs,
+    VkMemoryPropertyFlags properties, VkDeviceMemory *memoryOut);
+
+Err_Code UniformArenaCreate(Renderer *ren, VkDeviceSize size, 
+    Uniform_Arena *arena);
+void UniformArenaDestroy(Renderer *ren, Uniform_Arena *arena);
+void UniformArenaReset(Uniform_Arena *arena);
+
+/* 
+ * Returns a pointer into mapped memory, and the offset to bind it at.  
+ * Returns NULL if the arena is full.
+ */
+void *UniformArenaPush(Uniform_Arena *arena, VkDeviceSize size, 
+    u32 *offsetOut);
+
+Err_Code InstanceBufferCreate(Renderer *ren, u32 capacity, 
+    Instance_Buffer *instances);
+void InstanceBufferDestroy(Renderer *ren, Instance_Buffer *instances);
+void InstanceBufferReset(Instance_Buffer *instances);
+
+/* 
+ * Reserves n contiguous instances, returning a pointer to the first and its
+ * index.  Returns NULL if the buffer is full.
+ */
+Instance_Data *InstanceBufferPush(Instance_Buffer *instances, u32 n, 
+    u32 *firstOut);
 
 #endif  /* NOTTE_VK_MEM_H */
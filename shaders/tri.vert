@@ -5,19 +5,27 @@ layout (binding = 0) uniform CameraUniform {
   mat4 proj;
 } cam;
 
+/* Must match Instance_Data in renderer_priv.h. */
+struct InstanceData
+{
+  mat4 model;
+};
+
+/* Indexed with gl_InstanceIndex, which includes the draw's firstInstance. */
+layout (std430, binding = 2) readonly buffer InstanceBuffer
+{
+  InstanceData instances[];
+};
+
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNor;
 layout (location = 2) in vec2 inTex;
 
 layout (location = 0) out vec4 fragColor;
 
-layout (push_constant) uniform constants
-{
-  mat4 model;
-} mesh;
-
 void main()
 {
-  gl_Position = cam.proj * cam.view * mesh.model * vec4(inPos, 1.0);
+  mat4 model = instances[gl_InstanceIndex].model;
+  gl_Position = cam.proj * cam.view * model * vec4(inPos, 1.0);
   fragColor = vec4(inNor, 1.0);
 }
@@ -8,6 +8,7 @@
 #include <notte/memory.h>
 #include <notte/vector.h>
 #include <notte/linear_allocator.h>
+#include <notte/profile.h>
 
 /* === TYPES === */
 
@@ -93,6 +94,7 @@ BsonAstParse(Bson_Ast **astOut,
     .ast = ast,
   };
 
+  PROFILE_BEGIN("parse bson");
   while (!IS_EOF(&parser))
   {
     int c;
@@ -119,6 +121,7 @@ BsonAstParse(Bson_Ast **astOut,
     ParseValue(&parser, &value);
     AddEntry(&parser, &parser.ast->value.dict, str, value);
   }
+  PROFILE_END();
 
   *astOut = ast;
 
@@ -0,0 +1,832 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Dynamic bounding volume hierarchy.
+ */
+
+#include <notte/bvh.h>
+
+/* === MACROS === */
+
+/* Leaves are grown by this fraction of their size, plus a minimum. */
+#define BVH_MARGIN_SCALE 0.1f
+#define BVH_MARGIN_MIN 0.05f
+
+#define BVH_SAH_BINS 16
+#define BVH_REBUILD_MIN_LEAVES 64
+
+#define IS_LEAF(_node) ((_node)->children[0] == BVH_NULL)
+
+/* === PROTOTYPES === */
+
+static u32 AllocNode(Bvh *bvh);
+static void FreeNode(Bvh *bvh, u32 node);
+static void InsertLeaf(Bvh *bvh, u32 leaf);
+static void RemoveLeaf(Bvh *bvh, u32 leaf);
+static void Refit(Bvh *bvh, u32 node);
+static void AppendSubtree(Bvh *bvh, u32 node, Vector *out);
+static u32 BuildRange(Bvh_Build *build, u32 start, u32 count, u32 parent);
+
+static void AabbUnion(Aabb *a, Aabb *b, Aabb *out);
+static f32 AabbArea(Aabb *box);
+static bool AabbContains(Aabb *outer, Aabb *inner);
+static bool AabbRay(Aabb *box, Vec3 origin, Vec3 invDir, f32 maxT, f32 *tOut);
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+BvhInit(Bvh *bvh,
+        Allocator alloc)
+{
+  MemorySet(bvh, 0, sizeof(*bvh));
+  bvh->alloc = alloc;
+  bvh->root = BVH_NULL;
+  bvh->freeNode = BVH_NULL;
+  bvh->stack = VECTOR_CREATE(alloc, u32);
+}
+
+void
+BvhDeinit(Bvh *bvh)
+{
+  VectorDestroy(&bvh->stack, bvh->alloc);
+  if (bvh->capacity)
+  {
+    FREE_ARR(bvh->alloc, bvh->nodes, Bvh_Node, bvh->capacity,
+        MEMORY_TAG_ARRAY);
+  }
+  if (bvh->leavesCapacity)
+  {
+    FREE_ARR(bvh->alloc, bvh->leaves, u32, bvh->leavesCapacity,
+        MEMORY_TAG_ARRAY);
+  }
+}
+
+void
+BvhInsert(Bvh *bvh,
+          u32 item,
+          Aabb *box)
+{
+  if (item >= bvh->leavesCapacity)
+  {
+    u32 capacity = bvh->leavesCapacity ? bvh->leavesCapacity : 64;
+
+    while (capacity <= item)
+    {
+      capacity *= 2;
+    }
+
+    if (bvh->leavesCapacity == 0)
+    {
+      bvh->leaves = NEW_ARR(bvh->alloc, u32, capacity, MEMORY_TAG_ARRAY);
+    } else
+    {
+      bvh->leaves = RESIZE_ARR(bvh->alloc, bvh->leaves, u32,
+          bvh->leavesCapacity, capacity, MEMORY_TAG_ARRAY);
+    }
+
+    for (u32 i = bvh->leavesCapacity; i < capacity; i++)
+    {
+      bvh->leaves[i] = BVH_NULL;
+    }
+    bvh->leavesCapacity = capacity;
+  }
+
+  u32 leaf = AllocNode(bvh);
+  Bvh_Node *node = &bvh->nodes[leaf];
+
+  for (usize i = 0; i < 3; i++)
+  {
+    f32 margin = (box->max[i] - box->min[i]) * BVH_MARGIN_SCALE
+      + BVH_MARGIN_MIN;
+    node->box.min[i] = box->min[i] - margin;
+    node->box.max[i] = box->max[i] + margin;
+  }
+  node->item = item;
+  bvh->leaves[item] = leaf;
+  bvh->nLeaves++;
+
+  InsertLeaf(bvh, leaf);
+}
+
+void
+BvhRemove(Bvh *bvh,
+          u32 item)
+{
+  u32 leaf = bvh->leaves[item];
+
+  RemoveLeaf(bvh, leaf);
+  FreeNode(bvh, leaf);
+  bvh->leaves[item] = BVH_NULL;
+  bvh->nLeaves--;
+}
+
+bool
+BvhContains(Bvh *bvh,
+            u32 item)
+{
+  return item < bvh->leavesCapacity && bvh->leaves[item] != BVH_NULL;
+}
+
+void
+BvhUpdate(Bvh *bvh,
+          u32 item,
+          Aabb *box)
+{
+  if (!BvhContains(bvh, item))
+  {
+    BvhInsert(bvh, item, box);
+    return;
+  }
+
+  if (AabbContains(&bvh->nodes[bvh->leaves[item]].box, box))
+  {
+    return;
+  }
+
+  BvhRemove(bvh, item);
+  BvhInsert(bvh, item, box);
+  bvh->nReinserted++;
+}
+
+/*
+ * Each stack entry carries the planes its node's parent still straddled, so
+ * planes which already contain a subtree aren't tested again below it.
+ */
+void
+BvhQueryFrustum(Bvh *bvh,
+                Vec4 planes[6],
+                Vector *out)
+{
+  Vector *stack = &bvh->stack;
+
+  if (bvh->root == BVH_NULL)
+  {
+    return;
+  }
+
+  u32 entry[2] = {bvh->root, 0x3F};
+  VectorEmpty(stack);
+  VectorPush(stack, bvh->alloc, &entry[0]);
+  VectorPush(stack, bvh->alloc, &entry[1]);
+
+  while (stack->elemsUsed)
+  {
+    u32 *top = (u32 *) VectorIdx(stack, stack->elemsUsed - 2);
+    u32 idx = top[0], mask = top[1];
+    Bvh_Node *node = &bvh->nodes[idx];
+    bool outside = false;
+
+    stack->elemsUsed -= 2;
+
+    for (u32 p = 0; p < 6 && !outside; p++)
+    {
+      if (!(mask & (1u << p)))
+      {
+        continue;
+      }
+
+      f32 d = planes[p][3], r = 0.0f;
+      for (usize i = 0; i < 3; i++)
+      {
+        f32 c = (node->box.min[i] + node->box.max[i]) * 0.5f;
+        f32 e = (node->box.max[i] - node->box.min[i]) * 0.5f;
+        d += planes[p][i] * c;
+        r += fabsf(planes[p][i]) * e;
+      }
+
+      if (d + r < 0.0f)
+      {
+        outside = true;
+      } else if (d - r >= 0.0f)
+      {
+        mask &= ~(1u << p);
+      }
+    }
+
+    if (outside)
+    {
+      continue;
+    }
+
+    if (mask == 0)
+    {
+      AppendSubtree(bvh, idx, out);
+    } else if (IS_LEAF(node))
+    {
+      VectorPush(out, bvh->alloc, &node->item);
+    } else
+    {
+      for (usize c = 0; c < 2; c++)
+      {
+        entry[0] = node->children[c];
+        entry[1] = mask;
+        VectorPush(stack, bvh->alloc, &entry[0]);
+        VectorPush(stack, bvh->alloc, &entry[1]);
+      }
+    }
+  }
+}
+
+bool
+BvhRaycast(Bvh *bvh,
+           Vec3 origin,
+           Vec3 dir,
+           f32 maxT,
+           Bvh_Ray_Fn fn,
+           void *ud,
+           u32 *itemOut,
+           f32 *tOut)
+{
+  Vector *stack = &bvh->stack;
+  Vec3 invDir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+  u32 best = BVH_NULL;
+  f32 t;
+
+  if (bvh->root == BVH_NULL)
+  {
+    return false;
+  }
+
+  VectorEmpty(stack);
+  VectorPush(stack, bvh->alloc, &bvh->root);
+
+  while (stack->elemsUsed)
+  {
+    u32 idx = *(u32 *) VectorIdx(stack, --stack->elemsUsed);
+    Bvh_Node *node = &bvh->nodes[idx];
+
+    if (!AabbRay(&node->box, origin, invDir, maxT, &t))
+    {
+      continue;
+    }
+
+    if (!IS_LEAF(node))
+    {
+      VectorPush(stack, bvh->alloc, &node->children[0]);
+      VectorPush(stack, bvh->alloc, &node->children[1]);
+      continue;
+    }
+
+    if (fn != NULL)
+    {
+      t = fn(ud, node->item, origin, dir, maxT);
+      if (t < 0.0f || t >= maxT)
+      {
+        continue;
+      }
+    }
+
+    best = node->item;
+    maxT = t;
+  }
+
+  if (best == BVH_NULL)
+  {
+    return false;
+  }
+
+  *itemOut = best;
+  *tOut = maxT;
+  return true;
+}
+
+bool
+BvhWantsRebuild(Bvh *bvh)
+{
+  return bvh->nLeaves >= BVH_REBUILD_MIN_LEAVES
+    && bvh->nReinserted > bvh->nLeaves / 4;
+}
+
+void
+BvhBuildBegin(Bvh *bvh,
+              Bvh_Build *build)
+{
+  Allocator alloc = bvh->alloc;
+  u32 n = bvh->nLeaves, i = 0;
+
+  MemorySet(build, 0, sizeof(*build));
+  build->alloc = alloc;
+  build->n = n;
+  build->root = BVH_NULL;
+  if (n == 0)
+  {
+    return;
+  }
+
+  build->items = NEW_ARR(alloc, u32, n, MEMORY_TAG_ARRAY);
+  build->boxes = NEW_ARR(alloc, Aabb, n, MEMORY_TAG_ARRAY);
+  build->centroids = NEW_ARR(alloc, Vec3, n, MEMORY_TAG_ARRAY);
+  build->capacity = 2 * n - 1;
+  build->nodes = NEW_ARR(alloc, Bvh_Node, build->capacity, MEMORY_TAG_ARRAY);
+
+  for (u32 item = 0; item < bvh->leavesCapacity; item++)
+  {
+    u32 leaf = bvh->leaves[item];
+
+    if (leaf == BVH_NULL)
+    {
+      continue;
+    }
+
+    build->items[i] = item;
+    build->boxes[i] = bvh->nodes[leaf].box;
+    for (usize j = 0; j < 3; j++)
+    {
+      build->centroids[i][j] = (build->boxes[i].min[j]
+          + build->boxes[i].max[j]) * 0.5f;
+    }
+    i++;
+  }
+}
+
+void
+BvhBuildRun(Bvh_Build *build)
+{
+  if (build->n == 0)
+  {
+    return;
+  }
+
+  build->root = BuildRange(build, 0, build->n, BVH_NULL);
+}
+
+void
+BvhBuildAdopt(Bvh *bvh,
+              Bvh_Build *build)
+{
+  for (u32 i = 0; i < bvh->leavesCapacity; i++)
+  {
+    bvh->leaves[i] = BVH_NULL;
+  }
+
+  if (bvh->capacity)
+  {
+    FREE_ARR(bvh->alloc, bvh->nodes, Bvh_Node, bvh->capacity,
+        MEMORY_TAG_ARRAY);
+  }
+
+  bvh->nodes = build->nodes;
+  bvh->nNodes = build->nNodes;
+  bvh->capacity = build->capacity;
+  bvh->root = build->root;
+  bvh->freeNode = BVH_NULL;
+  bvh->nLeaves = build->n;
+  bvh->nReinserted = 0;
+
+  for (u32 i = 0; i < bvh->nNodes; i++)
+  {
+    if (IS_LEAF(&bvh->nodes[i]))
+    {
+      bvh->leaves[bvh->nodes[i].item] = i;
+    }
+  }
+
+  build->nodes = NULL;
+  build->capacity = 0;
+  BvhBuildCancel(build);
+}
+
+void
+BvhBuildCancel(Bvh_Build *build)
+{
+  Allocator alloc = build->alloc;
+  u32 n = build->n;
+
+  if (build->capacity)
+  {
+    FREE_ARR(alloc, build->nodes, Bvh_Node, build->capacity,
+        MEMORY_TAG_ARRAY);
+  }
+
+  if (n)
+  {
+    FREE_ARR(alloc, build->items, u32, n, MEMORY_TAG_ARRAY);
+    FREE_ARR(alloc, build->boxes, Aabb, n, MEMORY_TAG_ARRAY);
+    FREE_ARR(alloc, build->centroids, Vec3, n, MEMORY_TAG_ARRAY);
+  }
+
+  build->n = 0;
+  build->capacity = 0;
+}
+
+/* The AABB of a transformed AABB takes the absolute of the rotation. */
+void
+AabbTransform(Vec3 center,
+              Vec3 extent,
+              Mat4 m,
+              Aabb *out)
+{
+  for (usize j = 0; j < 3; j++)
+  {
+    f32 c = m[0][j] * center[0] + m[1][j] * center[1] + m[2][j] * center[2]
+      + m[3][j];
+    f32 e = fabsf(m[0][j]) * extent[0] + fabsf(m[1][j]) * extent[1]
+      + fabsf(m[2][j]) * extent[2];
+
+    out->min[j] = c - e;
+    out->max[j] = c + e;
+  }
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static u32
+AllocNode(Bvh *bvh)
+{
+  u32 idx;
+
+  if (bvh->freeNode != BVH_NULL)
+  {
+    idx = bvh->freeNode;
+    bvh->freeNode = bvh->nodes[idx].parent;
+  } else
+  {
+    if (bvh->nNodes == bvh->capacity)
+    {
+      u32 capacity = bvh->capacity ? bvh->capacity * 2 : 64;
+
+      if (bvh->capacity == 0)
+      {
+        bvh->nodes = NEW_ARR(bvh->alloc, Bvh_Node, capacity,
+            MEMORY_TAG_ARRAY);
+      } else
+      {
+        bvh->nodes = RESIZE_ARR(bvh->alloc, bvh->nodes, Bvh_Node,
+            bvh->capacity, capacity, MEMORY_TAG_ARRAY);
+      }
+      bvh->capacity = capacity;
+    }
+    idx = bvh->nNodes++;
+  }
+
+  Bvh_Node *node = &bvh->nodes[idx];
+  node->parent = BVH_NULL;
+  node->children[0] = node->children[1] = BVH_NULL;
+  node->item = BVH_NULL;
+  return idx;
+}
+
+/* Free nodes are linked through their parent. */
+static void
+FreeNode(Bvh *bvh,
+         u32 node)
+{
+  bvh->nodes[node].parent = bvh->freeNode;
+  bvh->freeNode = node;
+}
+
+/*
+ * Descends towards the sibling which adds the least surface area, paying at
+ * each level for the growth of the node being descended through, then
+ * pairs the leaf with it under a new parent.
+ */
+static void
+InsertLeaf(Bvh *bvh,
+           u32 leaf)
+{
+  Aabb box = bvh->nodes[leaf].box;
+  u32 idx = bvh->root;
+
+  if (idx == BVH_NULL)
+  {
+    bvh->root = leaf;
+    return;
+  }
+
+  while (!IS_LEAF(&bvh->nodes[idx]))
+  {
+    Bvh_Node *node = &bvh->nodes[idx];
+    Aabb combined;
+    f32 childCost[2];
+
+    AabbUnion(&node->box, &box, &combined);
+    f32 combinedArea = AabbArea(&combined);
+    f32 cost = 2.0f * combinedArea;
+    f32 inherited = 2.0f * (combinedArea - AabbArea(&node->box));
+
+    for (usize c = 0; c < 2; c++)
+    {
+      Bvh_Node *child = &bvh->nodes[node->children[c]];
+      Aabb grown;
+
+      AabbUnion(&child->box, &box, &grown);
+      childCost[c] = AabbArea(&grown) + inherited;
+      if (!IS_LEAF(child))
+      {
+        childCost[c] -= AabbArea(&child->box);
+      }
+    }
+
+    if (cost < childCost[0] && cost < childCost[1])
+    {
+      break;
+    }
+
+    idx = node->children[childCost[0] < childCost[1] ? 0 : 1];
+  }
+
+  u32 sibling = idx;
+  u32 oldParent = bvh->nodes[sibling].parent;
+  u32 newParent = AllocNode(bvh);
+  Bvh_Node *parent = &bvh->nodes[newParent];
+
+  parent->parent = oldParent;
+  parent->children[0] = sibling;
+  parent->children[1] = leaf;
+  AabbUnion(&bvh->nodes[sibling].box, &box, &parent->box);
+  bvh->nodes[sibling].parent = newParent;
+  bvh->nodes[leaf].parent = newParent;
+
+  if (oldParent == BVH_NULL)
+  {
+    bvh->root = newParent;
+    return;
+  }
+
+  Bvh_Node *grand = &bvh->nodes[oldParent];
+  grand->children[grand->children[0] == sibling ? 0 : 1] = newParent;
+  Refit(bvh, oldParent);
+}
+
+/* Replaces the leaf's parent with the leaf's sibling. */
+static void
+RemoveLeaf(Bvh *bvh,
+           u32 leaf)
+{
+  if (leaf == bvh->root)
+  {
+    bvh->root = BVH_NULL;
+    return;
+  }
+
+  u32 parent = bvh->nodes[leaf].parent;
+  Bvh_Node *parentNode = &bvh->nodes[parent];
+  u32 grand = parentNode->parent;
+  u32 sibling = parentNode->children[parentNode->children[0] == leaf ? 1 : 0];
+
+  bvh->nodes[sibling].parent = grand;
+  FreeNode(bvh, parent);
+
+  if (grand == BVH_NULL)
+  {
+    bvh->root = sibling;
+    return;
+  }
+
+  Bvh_Node *grandNode = &bvh->nodes[grand];
+  grandNode->children[grandNode->children[0] == parent ? 0 : 1] = sibling;
+  Refit(bvh, grand);
+}
+
+static void
+Refit(Bvh *bvh,
+      u32 idx)
+{
+  while (idx != BVH_NULL)
+  {
+    Bvh_Node *node = &bvh->nodes[idx];
+
+    AabbUnion(&bvh->nodes[node->children[0]].box,
+        &bvh->nodes[node->children[1]].box, &node->box);
+    idx = node->parent;
+  }
+}
+
+/* Uses the top of the traversal stack, leaving it as it was. */
+static void
+AppendSubtree(Bvh *bvh,
+              u32 idx,
+              Vector *out)
+{
+  Vector *stack = &bvh->stack;
+  usize base = stack->elemsUsed;
+
+  VectorPush(stack, bvh->alloc, &idx);
+  while (stack->elemsUsed > base)
+  {
+    Bvh_Node *node = &bvh->nodes[*(u32 *) VectorIdx(stack,
+        --stack->elemsUsed)];
+
+    if (IS_LEAF(node))
+    {
+      VectorPush(out, bvh->alloc, &node->item);
+    } else
+    {
+      VectorPush(stack, bvh->alloc, &node->children[0]);
+      VectorPush(stack, bvh->alloc, &node->children[1]);
+    }
+  }
+}
+
+/*
+ * Binned SAH split along the axis where centroids spread furthest, falling
+ * back to a median split if every centroid lands on one side.
+ */
+static u32
+BuildRange(Bvh_Build *build,
+           u32 start,
+           u32 count,
+           u32 parent)
+{
+  u32 idx = build->nNodes++;
+  Bvh_Node *node = &build->nodes[idx];
+  Vec3 cMin, cMax;
+
+  node->parent = parent;
+  node->children[0] = node->children[1] = BVH_NULL;
+  node->item = BVH_NULL;
+
+  if (count == 1)
+  {
+    node->box = build->boxes[start];
+    node->item = build->items[start];
+    return idx;
+  }
+
+  Vec3Copy(build->centroids[start], cMin);
+  Vec3Copy(build->centroids[start], cMax);
+  for (u32 i = start + 1; i < start + count; i++)
+  {
+    for (usize j = 0; j < 3; j++)
+    {
+      cMin[j] = fminf(cMin[j], build->centroids[i][j]);
+      cMax[j] = fmaxf(cMax[j], build->centroids[i][j]);
+    }
+  }
+
+  usize axis = 0;
+  for (usize j = 1; j < 3; j++)
+  {
+    if (cMax[j] - cMin[j] > cMax[axis] - cMin[axis])
+    {
+      axis = j;
+    }
+  }
+
+  f32 extent = cMax[axis] - cMin[axis];
+  u32 mid = start + count / 2;
+
+  if (extent > 0.0f)
+  {
+    Aabb binBoxes[BVH_SAH_BINS];
+    u32 binCounts[BVH_SAH_BINS] = {0};
+    f32 rightCost[BVH_SAH_BINS];
+    f32 scale = BVH_SAH_BINS / extent;
+
+    for (u32 i = start; i < start + count; i++)
+    {
+      u32 bin = (u32) ((build->centroids[i][axis] - cMin[axis]) * scale);
+      bin = bin < BVH_SAH_BINS ? bin : BVH_SAH_BINS - 1;
+
+      if (binCounts[bin]++ == 0)
+      {
+        binBoxes[bin] = build->boxes[i];
+      } else
+      {
+        AabbUnion(&binBoxes[bin], &build->boxes[i], &binBoxes[bin]);
+      }
+    }
+
+    /* rightCost[b] is the cost of everything in bins after b. */
+    Aabb acc;
+    u32 n = 0;
+    for (u32 b = BVH_SAH_BINS - 1; b > 0; b--)
+    {
+      if (binCounts[b])
+      {
+        if (n == 0)
+        {
+          acc = binBoxes[b];
+        } else
+        {
+          AabbUnion(&acc, &binBoxes[b], &acc);
+        }
+        n += binCounts[b];
+      }
+      rightCost[b - 1] = n ? AabbArea(&acc) * n : 0.0f;
+    }
+
+    f32 bestCost = INFINITY;
+    u32 bestBin = 0;
+    n = 0;
+    for (u32 b = 0; b < BVH_SAH_BINS - 1; b++)
+    {
+      if (binCounts[b])
+      {
+        if (n == 0)
+        {
+          acc = binBoxes[b];
+        } else
+        {
+          AabbUnion(&acc, &binBoxes[b], &acc);
+        }
+        n += binCounts[b];
+      }
+
+      f32 cost = (n ? AabbArea(&acc) * n : 0.0f) + rightCost[b];
+      if (n > 0 && n < count && cost < bestCost)
+      {
+        bestCost = cost;
+        bestBin = b;
+      }
+    }
+
+    if (bestCost < INFINITY)
+    {
+      u32 i = start, j = start + count;
+
+      while (i < j)
+      {
+        u32 bin = (u32) ((build->centroids[i][axis] - cMin[axis]) * scale);
+        bin = bin < BVH_SAH_BINS ? bin : BVH_SAH_BINS - 1;
+
+        if (bin <= bestBin)
+        {
+          i++;
+          continue;
+        }
+
+        j--;
+        u32 item = build->items[i];
+        Aabb box = build->boxes[i];
+        Vec3 centroid;
+        Vec3Copy(build->centroids[i], centroid);
+
+        build->items[i] = build->items[j];
+        build->boxes[i] = build->boxes[j];
+        Vec3Copy(build->centroids[j], build->centroids[i]);
+        build->items[j] = item;
+        build->boxes[j] = box;
+        Vec3Copy(centroid, build->centroids[j]);
+      }
+      mid = i;
+    }
+  }
+
+  node->children[0] = BuildRange(build, start, mid - start, idx);
+  node->children[1] = BuildRange(build, mid, start + count - mid, idx);
+
+  AabbUnion(&build->nodes[node->children[0]].box,
+      &build->nodes[node->children[1]].box, &node->box);
+  return idx;
+}
+
+static void
+AabbUnion(Aabb *a,
+          Aabb *b,
+          Aabb *out)
+{
+  for (usize i = 0; i < 3; i++)
+  {
+    out->min[i] = fminf(a->min[i], b->min[i]);
+    out->max[i] = fmaxf(a->max[i], b->max[i]);
+  }
+}
+
+static f32
+AabbArea(Aabb *box)
+{
+  f32 x = box->max[0] - box->min[0];
+  f32 y = box->max[1] - box->min[1];
+  f32 z = box->max[2] - box->min[2];
+
+  return 2.0f * (x * y + y * z + z * x);
+}
+
+static bool
+AabbContains(Aabb *outer,
+             Aabb *inner)
+{
+  for (usize i = 0; i < 3; i++)
+  {
+    if (inner->min[i] < outer->min[i] || inner->max[i] > outer->max[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Slab test, giving where the ray enters the box, or 0 if it starts inside. */
+static bool
+AabbRay(Aabb *box,
+        Vec3 origin,
+        Vec3 invDir,
+        f32 maxT,
+        f32 *tOut)
+{
+  f32 tMin = 0.0f, tMax = maxT;
+
+  for (usize i = 0; i < 3; i++)
+  {
+    f32 t0 = (box->min[i] - origin[i]) * invDir[i];
+    f32 t1 = (box->max[i] - origin[i]) * invDir[i];
+
+    tMin = fmaxf(tMin, fminf(t0, t1));
+    tMax = fminf(tMax, fmaxf(t0, t1));
+  }
+
+  *tOut = tMin;
+  return tMin <= tMax;
+}
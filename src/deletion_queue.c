@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Frame fenced deferred destruction of GPU resources.
+ */
+
+#include <notte/deletion_queue.h>
+#include <notte/geometry_pool.h>
+
+/* === PROTOTYPES === */
+
+static void DestroyDeletion(Renderer *ren, Deletion *del);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code 
+DeletionQueueInit(Renderer *ren, 
+                  Deletion_Queue *queue)
+{
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    queue->deletions[i] = VECTOR_CREATE(ren->alloc, Deletion);
+  }
+
+  return ERR_OK;
+}
+
+void 
+DeletionQueueDeinit(Renderer *ren, 
+                    Deletion_Queue *queue)
+{
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    DeletionQueueFlush(ren, queue, i);
+    VectorDestroy(&queue->deletions[i], ren->alloc);
+  }
+}
+
+void 
+DeletionQueueFlush(Renderer *ren, 
+                   Deletion_Queue *queue, 
+                   u32 frame)
+{
+  Vector *deletions = &queue->deletions[frame];
+
+  for (usize i = 0; i < deletions->elemsUsed; i++)
+  {
+    DestroyDeletion(ren, VectorIdx(deletions, i));
+  }
+
+  VectorEmpty(deletions);
+}
+
+void 
+DeletionQueuePush(Renderer *ren, 
+                  Deletion_Queue *queue, 
+                  Deletion *del)
+{
+  /* 
+   * Every frame up to the last one submitted might reference the resource, 
+   * and the last submitted frame is the last of them to finish.
+   */
+  u32 frame = (ren->currentFrame + ren->framesInFlight - 1) 
+    % ren->framesInFlight;
+
+  VectorPush(&queue->deletions[frame], ren->alloc, del);
+}
+
+void 
+DeferDestroyBuffer(Renderer *ren, 
+                   VkBuffer buffer, 
+                   VkDeviceMemory memory)
+{
+  Deletion bufferDel = 
+  {
+    .t = DELETION_BUFFER,
+    .buffer = buffer,
+  };
+
+  Deletion memoryDel = 
+  {
+    .t = DELETION_MEMORY,
+    .memory = memory,
+  };
+
+  DeletionQueuePush(ren, &ren->deletions, &bufferDel);
+  DeletionQueuePush(ren, &ren->deletions, &memoryDel);
+}
+
+void 
+DeferDestroyImage(Renderer *ren, 
+                  VkImage image, 
+                  VkDeviceMemory memory)
+{
+  Deletion imageDel = 
+  {
+    .t = DELETION_IMAGE,
+    .image = image,
+  };
+
+  Deletion memoryDel = 
+  {
+    .t = DELETION_MEMORY,
+    .memory = memory,
+  };
+
+  DeletionQueuePush(ren, &ren->deletions, &imageDel);
+  DeletionQueuePush(ren, &ren->deletions, &memoryDel);
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static void 
+DestroyDeletion(Renderer *ren, 
+                Deletion *del)
+{
+  switch (del->t)
+  {
+    case DELETION_BUFFER:
+      vkDestroyBuffer(ren->dev, del->buffer, ren->allocCbs);
+      break;
+    case DELETION_IMAGE:
+      vkDestroyImage(ren->dev, del->image, ren->allocCbs);
+      break;
+    case DELETION_IMAGE_VIEW:
+      vkDestroyImageView(ren->dev, del->imageView, ren->allocCbs);
+      break;
+    case DELETION_MEMORY:
+      vkFreeMemory(ren->dev, del->memory, ren->allocCbs);
+      break;
+    case DELETION_PIPELINE:
+      vkDestroyPipeline(ren->dev, del->pipeline, ren->allocCbs);
+      break;
+    case DELETION_PIPELINE_LAYOUT:
+      vkDestroyPipelineLayout(ren->dev, del->pipelineLayout, ren->allocCbs);
+      break;
+    case DELETION_RENDER_PASS:
+      vkDestroyRenderPass(ren->dev, del->renderPass, ren->allocCbs);
+      break;
+    case DELETION_FRAMEBUFFER:
+      vkDestroyFramebuffer(ren->dev, del->framebuffer, ren->allocCbs);
+      break;
+    case DELETION_DESCRIPTOR_SET_LAYOUT:
+      vkDestroyDescriptorSetLayout(ren->dev, del->descriptorSetLayout, 
+          ren->allocCbs);
+      break;
+    case DELETION_DESCRIPTOR_SET:
+      vkFreeDescriptorSets(ren->dev, ren->descriptorPool, 1, 
+          &del->descriptorSet);
+      break;
+    case DELETION_STATIC_GEOMETRY:
+      GeometryPoolFree(&ren->geometry, del->geometry.vertexOffset, 
+          del->geometry.nVerts, del->geometry.firstIndex, 
+          del->geometry.nIndices);
+      break;
+  }
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Frame pacing histograms.
+ */
+
+#include <notte/frame_stats.h>
+#include <notte/memory.h>
+#include <notte/string.h>
+
+/* === CONSTANTS === */
+
+#define SUB_BUCKET_BITS 6 /* log2(FRAME_HISTOGRAM_SUB_BUCKETS) */
+#define HALF_SUB_BUCKETS (FRAME_HISTOGRAM_SUB_BUCKETS / 2)
+
+static const char *statNames[FRAME_STAT_COUNT] =
+{
+  [FRAME_STAT_CPU_FRAME] = "cpu frame",
+  [FRAME_STAT_FENCE_WAIT] = "fence wait",
+  [FRAME_STAT_ACQUIRE] = "acquire",
+  [FRAME_STAT_PRESENT] = "present",
+  [FRAME_STAT_GPU] = "gpu",
+};
+
+/* === PROTOTYPES === */
+
+static u32 BucketIdx(u64 us);
+static u64 BucketValue(u32 idx);
+static u64 Percentile(const Frame_Histogram *hist, f64 p);
+static void HistogramAdd(Frame_Histogram *dst, const Frame_Histogram *src);
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+FrameStatsInit(Frame_Stats *stats,
+               u32 windowFrames)
+{
+  MemorySet(stats, 0, sizeof(*stats));
+  stats->windowFrames = windowFrames != 0
+    ? windowFrames : DEFAULT_FRAME_STATS_WINDOW;
+}
+
+void
+FrameStatsRecord(Frame_Stats *stats,
+                 Frame_Stat stat,
+                 f64 seconds)
+{
+  Frame_Histogram *hist = &stats->current[stat];
+  u64 us = seconds > 0.0 ? (u64) (seconds * 1e6 + 0.5) : 0;
+
+  hist->counts[BucketIdx(us)]++;
+  hist->nSamples++;
+  hist->max = us > hist->max ? us : hist->max;
+
+  if (stats->hitchThresholds[stat] != 0 && us > stats->hitchThresholds[stat])
+  {
+    hist->hitches++;
+  }
+}
+
+/*
+ * The next window's hitches are judged against this one's median, so a
+ * steady slow frame rate doesn't count as hitching.
+ */
+void
+FrameStatsEndFrame(Frame_Stats *stats)
+{
+  if (++stats->frame < stats->windowFrames)
+  {
+    return;
+  }
+
+  stats->frame = 0;
+  for (u32 i = 0; i < FRAME_STAT_COUNT; i++)
+  {
+    Frame_Histogram *current = &stats->current[i];
+
+    HistogramAdd(&stats->total[i], current);
+    stats->window[i] = *current;
+    stats->hitchThresholds[i] = (u64) (FRAME_STATS_HITCH_FACTOR
+        * (f64) Percentile(current, 0.5));
+    MemorySet(current, 0, sizeof(*current));
+  }
+}
+
+/* The current window is included in the total straight away. */
+void
+FrameStatsGet(const Frame_Stats *stats,
+              Frame_Stat stat,
+              Frame_Stats_Range range,
+              Frame_Stat_Summary *summary)
+{
+  Frame_Histogram total;
+  const Frame_Histogram *hist = &stats->window[stat];
+
+  if (range == FRAME_STATS_TOTAL)
+  {
+    total = stats->total[stat];
+    HistogramAdd(&total, &stats->current[stat]);
+    hist = &total;
+  }
+
+  summary->p50 = Percentile(hist, 0.50) / 1e3;
+  summary->p95 = Percentile(hist, 0.95) / 1e3;
+  summary->p99 = Percentile(hist, 0.99) / 1e3;
+  summary->max = hist->max / 1e3;
+  summary->hitches = hist->hitches;
+  summary->nSamples = hist->nSamples;
+}
+
+usize
+FrameStatsDump(const Frame_Stats *stats,
+               char *buf,
+               usize size)
+{
+  static const char *rangeNames[] = {"window", "total"};
+  usize len = 0;
+
+  if (size > 0)
+  {
+    buf[0] = '\0';
+  }
+
+  len = StringAppendFmt(buf, size, len, "%-20s %8s %9s %9s %9s %9s %8s\n",
+      "frame stats (ms)", "", "p50", "p95", "p99", "max", "hitches");
+
+  for (u32 i = 0; i < FRAME_STAT_COUNT; i++)
+  {
+    for (u32 range = FRAME_STATS_WINDOW; range <= FRAME_STATS_TOTAL; range++)
+    {
+      Frame_Stat_Summary summary;
+
+      FrameStatsGet(stats, i, range, &summary);
+      if (summary.nSamples == 0)
+      {
+        continue;
+      }
+
+      len = StringAppendFmt(buf, size, len,
+          "%-20s %8s %9.3f %9.3f %9.3f %9.3f %8u\n",
+          range == FRAME_STATS_WINDOW ? statNames[i] : "", rangeNames[range],
+          summary.p50, summary.p95, summary.p99, summary.max,
+          summary.hitches);
+    }
+  }
+
+  return len;
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+/*
+ * Values below FRAME_HISTOGRAM_SUB_BUCKETS get a bucket each.  Above that,
+ * each power of two is split into HALF_SUB_BUCKETS.
+ */
+static u32
+BucketIdx(u64 us)
+{
+  u32 msb = 0, shift;
+
+  if (us < FRAME_HISTOGRAM_SUB_BUCKETS)
+  {
+    return (u32) us;
+  }
+
+  for (u64 v = us; v > 1; v >>= 1)
+  {
+    msb++;
+  }
+
+  shift = msb - SUB_BUCKET_BITS + 1;
+  if (shift > FRAME_HISTOGRAM_SHIFTS)
+  {
+    return FRAME_HISTOGRAM_BUCKETS - 1;
+  }
+
+  return FRAME_HISTOGRAM_SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS
+    + (u32) (us >> shift) - HALF_SUB_BUCKETS;
+}
+
+/* The middle of the values landing in bucket idx. */
+static u64
+BucketValue(u32 idx)
+{
+  u32 shift;
+  u64 sub;
+
+  if (idx < FRAME_HISTOGRAM_SUB_BUCKETS)
+  {
+    return idx;
+  }
+
+  shift = (idx - FRAME_HISTOGRAM_SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+  sub = (idx - FRAME_HISTOGRAM_SUB_BUCKETS) % HALF_SUB_BUCKETS
+    + HALF_SUB_BUCKETS;
+  return (sub << shift) + (1ull << (shift - 1));
+}
+
+/* Never more than the exact maximum. */
+static u64
+Percentile(const Frame_Histogram *hist,
+           f64 p)
+{
+  u64 rank, seen = 0;
+
+  if (hist->nSamples == 0)
+  {
+    return 0;
+  }
+
+  rank = (u64) (p * (f64) hist->nSamples + 0.999999);
+  rank = rank == 0 ? 1 : rank;
+
+  for (u32 i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++)
+  {
+    seen += hist->counts[i];
+    if (seen >= rank)
+    {
+      u64 value = BucketValue(i);
+      return value < hist->max ? value : hist->max;
+    }
+  }
+
+  return hist->max;
+}
+
+static void
+HistogramAdd(Frame_Histogram *dst,
+             const Frame_Histogram *src)
+{
+  for (u32 i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++)
+  {
+    dst->counts[i] += src->counts[i];
+  }
+  dst->nSamples += src->nSamples;
+  dst->max = src->max > dst->max ? src->max : dst->max;
+  dst->hitches += src->hitches;
+}
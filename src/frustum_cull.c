@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Batched frustum culling of bounding volumes.
+ */
+
+#include <notte/frustum_cull.h>
+
+#if defined(NOTTE_AVX)
+#include <immintrin.h>
+#elif defined(NOTTE_SSE2)
+#include <emmintrin.h>
+#endif
+
+/* === MACROS === */
+
+#if defined(NOTTE_AVX)
+#define CULL_LANES 8
+#elif defined(NOTTE_SSE2)
+#define CULL_LANES 4
+#else
+#define CULL_LANES 1
+#endif
+
+/* === PROTOTYPES === */
+
+static usize CullScalar(Cull_Bounds *bounds, Vec4 planes[6], usize start);
+static void FreeArrays(Cull_Bounds *bounds);
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+CullBoundsInit(Cull_Bounds *bounds,
+               Allocator alloc)
+{
+  MemorySet(bounds, 0, sizeof(*bounds));
+  bounds->alloc = alloc;
+}
+
+void
+CullBoundsDeinit(Cull_Bounds *bounds)
+{
+  FreeArrays(bounds);
+}
+
+void
+CullBoundsResize(Cull_Bounds *bounds,
+                 usize count)
+{
+  usize capacity = bounds->capacity ? bounds->capacity : 64;
+
+  bounds->count = count;
+  if (count <= bounds->capacity)
+  {
+    return;
+  }
+
+  while (capacity < count)
+  {
+    capacity *= 2;
+  }
+
+  /* Previous contents are always rewritten before the next cull. */
+  FreeArrays(bounds);
+  bounds->centerX = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->centerY = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->centerZ = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->extentX = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->extentY = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->extentZ = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->radius = NEW_ARR(bounds->alloc, f32, capacity, MEMORY_TAG_ARRAY);
+  bounds->visible = NEW_ARR(bounds->alloc, u8, capacity, MEMORY_TAG_ARRAY);
+  bounds->capacity = capacity;
+}
+
+/* 
+ * The AABB of a transformed AABB takes the absolute of the rotation, and the
+ * sphere grows by the largest axis scale.
+ */
+void
+CullBoundsSetTransformed(Cull_Bounds *bounds,
+                         usize i,
+                         Vec3 center,
+                         Vec3 extent,
+                         f32 radius,
+                         Mat4 m)
+{
+  Vec3 c, e;
+  f32 scale2 = 0.0f;
+
+  for (usize j = 0; j < 3; j++)
+  {
+    c[j] = m[0][j] * center[0] + m[1][j] * center[1] + m[2][j] * center[2] 
+      + m[3][j];
+    e[j] = fabsf(m[0][j]) * extent[0] + fabsf(m[1][j]) * extent[1] 
+      + fabsf(m[2][j]) * extent[2];
+
+    f32 axis2 = m[j][0] * m[j][0] + m[j][1] * m[j][1] + m[j][2] * m[j][2];
+    scale2 = axis2 > scale2 ? axis2 : scale2;
+  }
+
+  bounds->centerX[i] = c[0];
+  bounds->centerY[i] = c[1];
+  bounds->centerZ[i] = c[2];
+  bounds->extentX[i] = e[0];
+  bounds->extentY[i] = e[1];
+  bounds->extentZ[i] = e[2];
+  bounds->radius[i] = radius * sqrtf(scale2);
+}
+
+void
+CullBoundsMove(Cull_Bounds *bounds,
+               usize dst,
+               usize src)
+{
+  bounds->centerX[dst] = bounds->centerX[src];
+  bounds->centerY[dst] = bounds->centerY[src];
+  bounds->centerZ[dst] = bounds->centerZ[src];
+  bounds->extentX[dst] = bounds->extentX[src];
+  bounds->extentY[dst] = bounds->extentY[src];
+  bounds->extentZ[dst] = bounds->extentZ[src];
+  bounds->radius[dst] = bounds->radius[src];
+  bounds->visible[dst] = bounds->visible[src];
+}
+
+/*
+ * Per plane, an object's center is at signed distance d, and the AABB
+ * reaches |n.x| * e.x + |n.y| * e.y + |n.z| * e.z towards the plane.  Both
+ * volumes share the center, so the object is outside if d is below minus
+ * the smaller of that and the radius.
+ */
+usize
+FrustumCull(Cull_Bounds *bounds,
+            Vec4 planes[6])
+{
+  usize i = 0, nVisible = 0;
+
+#if defined(NOTTE_AVX)
+  for (; i + CULL_LANES <= bounds->count; i += CULL_LANES)
+  {
+    __m256 cx = _mm256_loadu_ps(bounds->centerX + i);
+    __m256 cy = _mm256_loadu_ps(bounds->centerY + i);
+    __m256 cz = _mm256_loadu_ps(bounds->centerZ + i);
+    __m256 ex = _mm256_loadu_ps(bounds->extentX + i);
+    __m256 ey = _mm256_loadu_ps(bounds->extentY + i);
+    __m256 ez = _mm256_loadu_ps(bounds->extentZ + i);
+    __m256 r = _mm256_loadu_ps(bounds->radius + i);
+    __m256 outside = _mm256_setzero_ps();
+
+    for (usize p = 0; p < 6; p++)
+    {
+      __m256 nx = _mm256_set1_ps(planes[p][0]);
+      __m256 ny = _mm256_set1_ps(planes[p][1]);
+      __m256 nz = _mm256_set1_ps(planes[p][2]);
+      __m256 nw = _mm256_set1_ps(planes[p][3]);
+
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx),
+            _mm256_mul_ps(ny, cy)), _mm256_add_ps(_mm256_mul_ps(nz, cz), nw));
+      __m256 reach = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p][0])), ex),
+            _mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p][1])), ey)),
+          _mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p][2])), ez));
+      reach = _mm256_min_ps(reach, r);
+
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, reach),
+            _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+
+    int mask = _mm256_movemask_ps(outside);
+    for (usize lane = 0; lane < CULL_LANES; lane++)
+    {
+      u8 visible = !(mask & (1 << lane));
+      bounds->visible[i + lane] = visible;
+      nVisible += visible;
+    }
+  }
+#elif defined(NOTTE_SSE2)
+  for (; i + CULL_LANES <= bounds->count; i += CULL_LANES)
+  {
+    __m128 cx = _mm_loadu_ps(bounds->centerX + i);
+    __m128 cy = _mm_loadu_ps(bounds->centerY + i);
+    __m128 cz = _mm_loadu_ps(bounds->centerZ + i);
+    __m128 ex = _mm_loadu_ps(bounds->extentX + i);
+    __m128 ey = _mm_loadu_ps(bounds->extentY + i);
+    __m128 ez = _mm_loadu_ps(bounds->extentZ + i);
+    __m128 r = _mm_loadu_ps(bounds->radius + i);
+    __m128 outside = _mm_setzero_ps();
+
+    for (usize p = 0; p < 6; p++)
+    {
+      __m128 nx = _mm_set1_ps(planes[p][0]);
+      __m128 ny = _mm_set1_ps(planes[p][1]);
+      __m128 nz = _mm_set1_ps(planes[p][2]);
+      __m128 nw = _mm_set1_ps(planes[p][3]);
+
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+          _mm_add_ps(_mm_mul_ps(nz, cz), nw));
+      __m128 reach = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][0])), ex),
+            _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][1])), ey)),
+          _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][2])), ez));
+      reach = _mm_min_ps(reach, r);
+
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, reach),
+            _mm_setzero_ps()));
+    }
+
+    int mask = _mm_movemask_ps(outside);
+    for (usize lane = 0; lane < CULL_LANES; lane++)
+    {
+      u8 visible = !(mask & (1 << lane));
+      bounds->visible[i + lane] = visible;
+      nVisible += visible;
+    }
+  }
+#endif
+
+  return nVisible + CullScalar(bounds, planes, i);
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+/* Culls objects from start onwards, one at a time. */
+static usize
+CullScalar(Cull_Bounds *bounds,
+           Vec4 planes[6],
+           usize start)
+{
+  usize nVisible = 0;
+
+  for (usize i = start; i < bounds->count; i++)
+  {
+    bool outside = false;
+
+    for (usize p = 0; p < 6 && !outside; p++)
+    {
+      f32 d = planes[p][0] * bounds->centerX[i]
+        + planes[p][1] * bounds->centerY[i]
+        + planes[p][2] * bounds->centerZ[i] + planes[p][3];
+      f32 reach = fabsf(planes[p][0]) * bounds->extentX[i]
+        + fabsf(planes[p][1]) * bounds->extentY[i]
+        + fabsf(planes[p][2]) * bounds->extentZ[i];
+      reach = reach < bounds->radius[i] ? reach : bounds->radius[i];
+
+      outside = d + reach < 0.0f;
+    }
+
+    bounds->visible[i] = !outside;
+    nVisible += !outside;
+  }
+
+  return nVisible;
+}
+
+static void
+FreeArrays(Cull_Bounds *bounds)
+{
+  usize capacity = bounds->capacity;
+
+  if (capacity == 0)
+  {
+    return;
+  }
+
+  FREE_ARR(bounds->alloc, bounds->centerX, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->centerY, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->centerZ, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->extentX, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->extentY, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->extentZ, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->radius, f32, capacity, MEMORY_TAG_ARRAY);
+  FREE_ARR(bounds->alloc, bounds->visible, u8, capacity, MEMORY_TAG_ARRAY);
+  bounds->capacity = 0;
+}
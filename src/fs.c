@@ -47,6 +47,25 @@ struct Fs_Dir_Monitor
   DWORD notifyFilter;
 };
 
+#elif defined(NOTTE_LINUX)
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+struct Fs_Dir_Monitor
+{
+  String rootPath;
+  Allocator alloc;
+  Thread *thread;
+  Mutex *mutex;
+  Fs_Dir_Monitor_Event events[MAX_DIR_MONITOR_EVENTS];
+  usize eventsUsed;
+  int fd;
+  bool shouldQuit;
+  _Alignas(struct inotify_event) u8 buffer[4096];
+};
+
 #endif
 
 /* === PROTOTYPES === */
@@ -57,9 +76,16 @@ static Err_Code FsDiskFileCreate(Fs_Driver *driver, String path,
 static Err_Code FsDiskFileWrite(Fs_Driver *driver, String path, 
     Membuf *buf);
 static void FsDiskFileDestroy(Fs_Driver *driver, Membuf *buf);
+static Err_Code FsDiskFileSize(Fs_Driver *driver, String path, usize *size);
+static Err_Code FsDiskFileRead(Fs_Driver *driver, String path, usize offset,
+    void *dst, usize size);
 static void FsDirMonitorThread(void *ud);
+#ifdef NOTTE_WINDOWS
 static void ProcessRawEvents(Fs_Dir_Monitor *mon);
 static int RefreshWatches(Fs_Dir_Monitor *mon);
+#elif defined(NOTTE_LINUX)
+static void PushModify(Fs_Dir_Monitor *mon, const char *filepath);
+#endif
 
 /* === PUBLIC FUNCTIONS === */
 
@@ -79,6 +105,8 @@ FsDiskDriverCreate(Fs_Driver *driverOut,
   driverOut->fileCreateFn = FsDiskFileCreate;;
   driverOut->fileDestroyFn = FsDiskFileDestroy;
   driverOut->fileWriteFn = FsDiskFileWrite;
+  driverOut->fileSizeFn = FsDiskFileSize;
+  driverOut->fileReadFn = FsDiskFileRead;
 
   return ERR_OK;
 }
@@ -112,6 +140,26 @@ FsFileDestroy(Fs_Driver *driver,
   driver->fileDestroyFn(driver, buf);
 }
 
+Err_Code
+FsFileSize(Fs_Driver *driver, 
+           String path, 
+           usize *size)
+{
+  return driver->fileSizeFn(driver, path, size);
+}
+
+Err_Code
+FsFileRead(Fs_Driver *driver, 
+           String path, 
+           usize offset, 
+           void *dst, 
+           usize size)
+{
+  return driver->fileReadFn(driver, path, offset, dst, size);
+}
+
+
+#ifdef NOTTE_WINDOWS
 
 Err_Code 
 FsDirMonitorCreate(Allocator alloc, 
@@ -165,6 +213,54 @@ FsDirMonitorCreate(Allocator alloc,
   return ERR_OK;
 }
 
+#elif defined(NOTTE_LINUX)
+
+/* Only watches files directly in rootPath, which is all shaders need. */
+Err_Code 
+FsDirMonitorCreate(Allocator alloc, 
+                   String rootPath, 
+                   Fs_Dir_Monitor **monOut)
+{
+  Err_Code err;
+  char *cRootPath;
+  Fs_Dir_Monitor *mon = NEW(alloc, Fs_Dir_Monitor, MEMORY_TAG_FS);
+  mon->alloc = alloc;
+  mon->rootPath = StringClone(alloc, rootPath);
+  mon->eventsUsed = 0;
+  mon->shouldQuit = false;
+
+  err = MutexCreate(alloc, &mon->mutex);
+  if (err)
+  {
+    return err;
+  }
+
+  mon->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (mon->fd < 0)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  cRootPath = StringMakeCString(alloc, rootPath);
+  if (inotify_add_watch(mon->fd, cRootPath, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    FREE_ARR(alloc, cRootPath, char, rootPath.len + 1, MEMORY_TAG_STRING);
+    return ERR_NO_FILE;
+  }
+  FREE_ARR(alloc, cRootPath, char, rootPath.len + 1, MEMORY_TAG_STRING);
+
+  err = ThreadCreate(alloc, mon, FsDirMonitorThread, &mon->thread);
+  if (err)
+  {
+    return err;
+  }
+
+  *monOut = mon;
+  return ERR_OK;
+}
+
+#endif
+
 void 
 FsDirMonitorDestroy(Fs_Dir_Monitor *mon)
 {
@@ -203,6 +299,11 @@ FsDiskFileWrite(Fs_Driver *driver,
       path, &pathSize);
 
   FILE *file = fopen(cPath, "wb");
+  FREE_ARR(driver->alloc, (char *) cPath, u8, pathSize, MEMORY_TAG_STRING);
+  if (file == NULL)
+  {
+    return ERR_NO_FILE;
+  }
 
   fwrite(buf->data, 1, buf->size, file);
 
@@ -259,6 +360,68 @@ FsDiskFileDestroy(Fs_Driver *driver,
   FREE_ARR(driver->alloc, (u8 *) buf->data, u8, buf->size + 1, MEMORY_TAG_FS);
 }
 
+static Err_Code 
+FsDiskFileSize(Fs_Driver *driver, 
+               String path, 
+               usize *size)
+{
+  usize pathSize;
+  Fs_Disk_Driver *disk = driver->ud;
+
+  const char *cPath = StringConcatIntoCString(driver->alloc, disk->root, 
+      path, &pathSize);
+
+  FILE *file = fopen(cPath, "rb");
+  FREE_ARR(driver->alloc, (char *) cPath, u8, pathSize, MEMORY_TAG_STRING);
+  if (file == NULL)
+  {
+    return ERR_NO_FILE;
+  }
+
+  long end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+  fclose(file);
+  if (end < 0)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  *size = (usize) end;
+  return ERR_OK;
+}
+
+static Err_Code 
+FsDiskFileRead(Fs_Driver *driver, 
+               String path, 
+               usize offset, 
+               void *dst, 
+               usize size)
+{
+  usize pathSize, nRead;
+  Fs_Disk_Driver *disk = driver->ud;
+
+  const char *cPath = StringConcatIntoCString(driver->alloc, disk->root, 
+      path, &pathSize);
+
+  FILE *file = fopen(cPath, "rb");
+  FREE_ARR(driver->alloc, (char *) cPath, u8, pathSize, MEMORY_TAG_STRING);
+  if (file == NULL)
+  {
+    return ERR_NO_FILE;
+  }
+
+  if (fseek(file, (long) offset, SEEK_SET) != 0)
+  {
+    fclose(file);
+    return ERR_LIBRARY_FAILURE;
+  }
+  nRead = fread(dst, 1, size, file);
+
+  fclose(file);
+  return nRead == size ? ERR_OK : ERR_FAILED_PARSE;
+}
+
+#ifdef NOTTE_WINDOWS
+
 static void 
 FsDirMonitorThread(void *ud)
 {
@@ -375,3 +538,80 @@ RefreshWatches(Fs_Dir_Monitor *mon)
   return ReadDirectoryChangesW(mon->dirHandle, mon->buffer, sizeof(mon->buffer),
       TRUE, mon->notifyFilter, NULL, &mon->overlapped, NULL) != 0;
 }
+
+#elif defined(NOTTE_LINUX)
+
+/* 
+ * Editors save by writing in place or by moving a new file over the old one,
+ * which inotify reports as a close after writing or a move respectively.
+ */
+static void 
+FsDirMonitorThread(void *ud)
+{
+  Fs_Dir_Monitor *mon = (Fs_Dir_Monitor *) ud;
+  struct pollfd pollFd = {.fd = mon->fd, .events = POLLIN};
+
+  while (!mon->shouldQuit)
+  {
+    ssize_t nRead;
+
+    if (poll(&pollFd, 1, 10) <= 0)
+    {
+      continue;
+    }
+
+    nRead = read(mon->fd, mon->buffer, sizeof(mon->buffer));
+    if (nRead <= 0)
+    {
+      continue;
+    }
+
+    MutexAcquire(mon->mutex);
+    for (ssize_t offset = 0; offset < nRead; )
+    {
+      struct inotify_event *notify = 
+        (struct inotify_event *) &mon->buffer[offset];
+
+      if (notify->len > 0)
+      {
+        PushModify(mon, notify->name);
+      }
+      offset += sizeof(struct inotify_event) + notify->len;
+    }
+    MutexRelease(mon->mutex);
+  }
+
+  close(mon->fd);
+  StringDestroy(mon->alloc, mon->rootPath);
+  MutexDestroy(mon->alloc, mon->mutex);
+  ThreadDestroy(mon->alloc, mon->thread);
+  FREE(mon->alloc, mon, Fs_Dir_Monitor, MEMORY_TAG_FS);
+}
+
+/* Merges repeated modifications of the same file, like ProcessRawEvents. */
+static void
+PushModify(Fs_Dir_Monitor *mon,
+           const char *filepath)
+{
+  String path = STRING_CSTR((const u8 *) filepath);
+  Fs_Dir_Monitor_Event *ev;
+
+  for (usize i = 0; i < mon->eventsUsed; i++)
+  {
+    if (StringEqual(mon->events[i].path, path))
+    {
+      return;
+    }
+  }
+
+  if (mon->eventsUsed == MAX_DIR_MONITOR_EVENTS)
+  {
+    return;
+  }
+
+  ev = &mon->events[mon->eventsUsed++];
+  ev->t = FS_DIR_MONITOR_EVENT_MODIFY;
+  ev->path = StringClone(mon->alloc, path);
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Shared vertex and index buffers for static geometry.
+ */
+
+#include <notte/geometry_pool.h>
+#include <notte/vk_mem.h>
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code 
+GeometryPoolInit(Renderer *ren, 
+                 Geometry_Pool *pool, 
+                 u32 maxVerts, 
+                 u32 maxIndices)
+{
+  Err_Code err;
+
+  err = CreateBuffer(ren, sizeof(Static_Vert) * (VkDeviceSize) maxVerts, 
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &pool->vertexBuffer, 
+      &pool->vertexMemory);
+  if (err)
+  {
+    return err;
+  }
+
+  err = CreateBuffer(ren, sizeof(u32) * (VkDeviceSize) maxIndices, 
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &pool->indexBuffer, 
+      &pool->indexMemory);
+  if (err)
+  {
+    goto failIndexBuffer;
+  }
+
+  err = RangeAllocatorInit(&pool->vertexRanges, ren->alloc, maxVerts);
+  if (err)
+  {
+    goto failVertexRanges;
+  }
+
+  err = RangeAllocatorInit(&pool->indexRanges, ren->alloc, maxIndices);
+  if (err)
+  {
+    goto failIndexRanges;
+  }
+
+  return ERR_OK;
+
+failIndexRanges:
+  RangeAllocatorDeinit(&pool->vertexRanges);
+failVertexRanges:
+  DestroyBuffer(ren, pool->indexBuffer, pool->indexMemory);
+failIndexBuffer:
+  DestroyBuffer(ren, pool->vertexBuffer, pool->vertexMemory);
+  return err;
+}
+
+void 
+GeometryPoolDeinit(Renderer *ren, 
+                   Geometry_Pool *pool)
+{
+  RangeAllocatorDeinit(&pool->vertexRanges);
+  RangeAllocatorDeinit(&pool->indexRanges);
+  DestroyBuffer(ren, pool->vertexBuffer, pool->vertexMemory);
+  DestroyBuffer(ren, pool->indexBuffer, pool->indexMemory);
+}
+
+Err_Code 
+GeometryPoolAlloc(Geometry_Pool *pool, 
+                  u32 nVerts, 
+                  u32 nIndices, 
+                  u32 *vertexOffset, 
+                  u32 *firstIndex)
+{
+  Err_Code err;
+
+  err = RangeAllocatorAlloc(&pool->vertexRanges, nVerts, vertexOffset);
+  if (err)
+  {
+    return err;
+  }
+
+  err = RangeAllocatorAlloc(&pool->indexRanges, nIndices, firstIndex);
+  if (err)
+  {
+    RangeAllocatorFree(&pool->vertexRanges, *vertexOffset, nVerts);
+    return err;
+  }
+
+  return ERR_OK;
+}
+
+void 
+GeometryPoolFree(Geometry_Pool *pool, 
+                 u32 vertexOffset, 
+                 u32 nVerts, 
+                 u32 firstIndex, 
+                 u32 nIndices)
+{
+  RangeAllocatorFree(&pool->vertexRanges, vertexOffset, nVerts);
+  RangeAllocatorFree(&pool->indexRanges, firstIndex, nIndices);
+}
+
+void 
+GeometryPoolBind(Geometry_Pool *pool, 
+                 VkCommandBuffer buf)
+{
+  VkDeviceSize offset = 0;
+
+  vkCmdBindVertexBuffers(buf, 0, 1, &pool->vertexBuffer, &offset);
+  vkCmdBindIndexBuffer(buf, pool->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * GPU frustum culling and indirect draw generation.
+ */
+
+#include <notte/gpu_cull.h>
+#include <notte/material.h>
+#include <notte/vk_mem.h>
+#include <notte/deletion_queue.h>
+
+/* === MACROS === */
+
+#define CULL_GROUP_SIZE 64
+
+/* === PROTOTYPES === */
+
+static Err_Code CreatePipeline(Renderer *ren, Gpu_Cull *cull);
+static Err_Code CreateBuffers(Renderer *ren, Gpu_Cull *cull);
+static Err_Code CreateDescriptors(Renderer *ren, Gpu_Cull *cull);
+
+/* === PUBLIC FUNCTIONS === */
+
+bool
+GpuCullSupported(Renderer *ren)
+{
+  VkPhysicalDeviceProperties properties;
+
+  vkGetPhysicalDeviceProperties(ren->pDev, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_2)
+  {
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Features features12 =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+  };
+
+  VkPhysicalDeviceFeatures2 features =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &features12,
+  };
+
+  vkGetPhysicalDeviceFeatures2(ren->pDev, &features);
+
+  return features12.drawIndirectCount
+    && features.features.multiDrawIndirect
+    && features.features.drawIndirectFirstInstance;
+}
+
+Err_Code
+GpuCullInit(Renderer *ren,
+            Gpu_Cull *cull)
+{
+  Err_Code err;
+  VkResult vkErr;
+  bool enabled = cull->enabled;
+
+  /* So the failure path only destroys what was created. */
+  MemorySet(cull, 0, sizeof(*cull));
+  cull->enabled = enabled;
+
+  if (!cull->enabled)
+  {
+    return ERR_OK;
+  }
+
+  cull->shader = ShaderManagerOpen(ren, &ren->shaders,
+      STRING_CSTR("cull.comp"), SHADER_COMP);
+  if (cull->shader == NULL)
+  {
+    return ERR_INVALID_SHADER;
+  }
+
+  VkDescriptorSetLayoutBinding bindings[4];
+  for (u32 i = 0; i < ELEMOF(bindings); i++)
+  {
+    bindings[i] = (VkDescriptorSetLayoutBinding)
+    {
+      .binding = i,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = ELEMOF(bindings),
+    .pBindings = bindings,
+  };
+
+  vkErr = vkCreateDescriptorSetLayout(ren->dev, &layoutInfo, ren->allocCbs,
+      &cull->descriptorLayout);
+  if (vkErr)
+  {
+    err = ERR_LIBRARY_FAILURE;
+    goto fail;
+  }
+
+  VkPushConstantRange pushConstant =
+  {
+    .offset = 0,
+    .size = sizeof(Gpu_Cull_Push_Constant),
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+  };
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &cull->descriptorLayout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &pushConstant,
+  };
+
+  vkErr = vkCreatePipelineLayout(ren->dev, &pipelineLayoutInfo, ren->allocCbs,
+      &cull->layout);
+  if (vkErr)
+  {
+    err = ERR_LIBRARY_FAILURE;
+    goto fail;
+  }
+
+  err = CreatePipeline(ren, cull);
+  if (err)
+  {
+    goto fail;
+  }
+
+  err = CreateBuffers(ren, cull);
+  if (err)
+  {
+    goto fail;
+  }
+
+  err = CreateDescriptors(ren, cull);
+  if (err)
+  {
+    goto fail;
+  }
+
+  VkCommandPoolCreateInfo poolInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = ren->queueInfo.graphicsFamily,
+  };
+
+  vkErr = vkCreateCommandPool(ren->dev, &poolInfo, ren->allocCbs,
+      &cull->commandPool);
+  if (vkErr)
+  {
+    err = ERR_LIBRARY_FAILURE;
+    goto fail;
+  }
+
+  VkCommandBufferAllocateInfo allocInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = cull->commandPool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = ren->framesInFlight,
+  };
+
+  vkErr = vkAllocateCommandBuffers(ren->dev, &allocInfo, cull->cmds);
+  if (vkErr)
+  {
+    err = ERR_LIBRARY_FAILURE;
+    goto fail;
+  }
+
+  return ERR_OK;
+
+  /* Destroying null handles does nothing. */
+fail:
+  GpuCullDeinit(ren, cull);
+  return err;
+}
+
+void
+GpuCullDeinit(Renderer *ren,
+              Gpu_Cull *cull)
+{
+  if (!cull->enabled)
+  {
+    return;
+  }
+
+  vkDestroyCommandPool(ren->dev, cull->commandPool, ren->allocCbs);
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    if (cull->objects[i] != NULL)
+    {
+      vkUnmapMemory(ren->dev, cull->objectMemory[i]);
+    }
+    DestroyBuffer(ren, cull->objectBuffers[i], cull->objectMemory[i]);
+    DestroyBuffer(ren, cull->drawBuffers[i], cull->drawMemory[i]);
+    DestroyBuffer(ren, cull->countBuffers[i], cull->countMemory[i]);
+  }
+
+  vkFreeDescriptorSets(ren->dev, ren->descriptorPool, ren->framesInFlight,
+      cull->descriptorSets);
+  vkDestroyPipeline(ren->dev, cull->pipeline, ren->allocCbs);
+  vkDestroyPipelineLayout(ren->dev, cull->layout, ren->allocCbs);
+  vkDestroyDescriptorSetLayout(ren->dev, cull->descriptorLayout,
+      ren->allocCbs);
+}
+
+Err_Code
+GpuCullRebuild(Renderer *ren,
+               Gpu_Cull *cull)
+{
+  Deletion del =
+  {
+    .t = DELETION_PIPELINE,
+    .pipeline = cull->pipeline,
+  };
+
+  DeletionQueuePush(ren, &ren->deletions, &del);
+  return CreatePipeline(ren, cull);
+}
+
+void
+GpuCullPrepare(Renderer *ren,
+               Gpu_Cull *cull,
+               Mat4 viewProj)
+{
+  Gpu_Cull_Object *objects = cull->objects[ren->currentFrame];
+
+  cull->active = false;
+  cull->nObjects = 0;
+
+  if (!cull->enabled || ren->drawGroups.elemsUsed == 0)
+  {
+    return;
+  }
+
+  if (ren->drawGroups.elemsUsed > MAX_CULL_GROUPS)
+  {
+    LOG_WARN("too many techniques for GPU culling, drawing on the CPU");
+    return;
+  }
+
+  for (u32 g = 0; g < ren->drawGroups.elemsUsed; g++)
+  {
+    Draw_Group *group = VectorIdx(&ren->drawGroups, g);
+
+    for (u32 b = group->firstBatch; b < group->firstBatch + group->nBatches;
+         b++)
+    {
+      Draw_Batch *batch = VectorIdx(&ren->drawBatches, b);
+      Static_Mesh *mesh = batch->mesh;
+
+      for (u32 i = 0; i < batch->nInstances; i++)
+      {
+        Gpu_Cull_Object *obj = &objects[batch->firstInstance + i];
+
+        MemoryCopy(obj->sphere, mesh->sphere, sizeof(Vec4));
+        obj->firstIndex = mesh->firstIndex;
+        obj->nIndices = (u32) mesh->nIndices;
+        obj->vertexOffset = (i32) mesh->vertexOffset;
+        obj->group = g;
+        obj->firstCommand = group->firstInstance;
+      }
+    }
+
+    if (group->firstInstance + group->nInstances > cull->nObjects)
+    {
+      cull->nObjects = group->firstInstance + group->nInstances;
+    }
+  }
+
+  Mat4FrustumPlanes(viewProj, cull->planes);
+  cull->active = true;
+}
+
+VkCommandBuffer
+GpuCullRecord(Renderer *ren,
+              Gpu_Cull *cull)
+{
+  VkResult vkErr;
+  u32 frame = ren->currentFrame;
+  VkCommandBuffer cmd = cull->cmds[frame];
+
+  if (!cull->active)
+  {
+    return VK_NULL_HANDLE;
+  }
+
+  vkResetCommandBuffer(cmd, 0);
+
+  VkCommandBufferBeginInfo beginInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+
+  vkErr = vkBeginCommandBuffer(cmd, &beginInfo);
+  if (vkErr)
+  {
+    LOG_ERROR("failed to begin cull command buffer");
+    cull->active = false;
+    return VK_NULL_HANDLE;
+  }
+
+  vkCmdFillBuffer(cmd, cull->countBuffers[frame], 0,
+      sizeof(u32) * MAX_CULL_GROUPS, 0);
+
+  VkMemoryBarrier clearBarrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, NULL, 0,
+      NULL);
+
+  Gpu_Cull_Push_Constant constants;
+  MemoryCopy(constants.planes, cull->planes, sizeof(constants.planes));
+  constants.nObjects = cull->nObjects;
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->layout,
+      0, 1, &cull->descriptorSets[frame], 0, NULL);
+  vkCmdPushConstants(cmd, cull->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+      sizeof(constants), &constants);
+  vkCmdDispatch(cmd, (cull->nObjects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE,
+      1, 1);
+
+  VkMemoryBarrier drawBarrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &drawBarrier, 0, NULL, 0,
+      NULL);
+
+  vkErr = vkEndCommandBuffer(cmd);
+  if (vkErr)
+  {
+    LOG_ERROR("failed to end cull command buffer");
+    cull->active = false;
+    return VK_NULL_HANDLE;
+  }
+
+  return cmd;
+}
+
+void
+GpuCullDraw(Renderer *ren,
+            Gpu_Cull *cull,
+            VkCommandBuffer buf,
+            u32 group,
+            Draw_Group *drawGroup)
+{
+  u32 frame = ren->currentFrame;
+
+  vkCmdDrawIndexedIndirectCount(buf, cull->drawBuffers[frame],
+      sizeof(VkDrawIndexedIndirectCommand) * (VkDeviceSize)
+      drawGroup->firstInstance, cull->countBuffers[frame],
+      sizeof(u32) * (VkDeviceSize) group, drawGroup->nInstances,
+      sizeof(VkDrawIndexedIndirectCommand));
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static Err_Code
+CreatePipeline(Renderer *ren,
+               Gpu_Cull *cull)
+{
+  VkResult vkErr;
+
+  VkComputePipelineCreateInfo pipelineInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage =
+    {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = cull->shader->mod,
+      .pName = "main",
+    },
+    .layout = cull->layout,
+  };
+
+  vkErr = vkCreateComputePipelines(ren->dev, VK_NULL_HANDLE, 1, &pipelineInfo,
+      ren->allocCbs, &cull->pipeline);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  return ERR_OK;
+}
+
+static Err_Code
+CreateBuffers(Renderer *ren,
+              Gpu_Cull *cull)
+{
+  Err_Code err;
+  VkResult vkErr;
+  void *data;
+  VkDeviceSize objectSize = sizeof(Gpu_Cull_Object) * MAX_INSTANCES_PER_FRAME;
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    err = CreateBuffer(ren, objectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &cull->objectBuffers[i], &cull->objectMemory[i]);
+    if (err)
+    {
+      return err;
+    }
+
+    vkErr = vkMapMemory(ren->dev, cull->objectMemory[i], 0, objectSize, 0,
+        &data);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+    cull->objects[i] = data;
+
+    /* At worst every instance survives, and gets its own command. */
+    err = CreateBuffer(ren,
+        sizeof(VkDrawIndexedIndirectCommand) * MAX_INSTANCES_PER_FRAME,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->drawBuffers[i],
+        &cull->drawMemory[i]);
+    if (err)
+    {
+      return err;
+    }
+
+    err = CreateBuffer(ren, sizeof(u32) * MAX_CULL_GROUPS,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+        | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->countBuffers[i],
+        &cull->countMemory[i]);
+    if (err)
+    {
+      return err;
+    }
+  }
+
+  return ERR_OK;
+}
+
+static Err_Code
+CreateDescriptors(Renderer *ren,
+                  Gpu_Cull *cull)
+{
+  VkResult vkErr;
+  VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT];
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    layouts[i] = cull->descriptorLayout;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = ren->descriptorPool,
+    .descriptorSetCount = ren->framesInFlight,
+    .pSetLayouts = layouts,
+  };
+
+  vkErr = vkAllocateDescriptorSets(ren->dev, &allocInfo,
+      cull->descriptorSets);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    /* Same order as the bindings in cull.comp. */
+    VkDescriptorBufferInfo bufferInfos[4] =
+    {
+      {cull->objectBuffers[i], 0, VK_WHOLE_SIZE},
+      {ren->instances[i].buffer, 0, VK_WHOLE_SIZE},
+      {cull->drawBuffers[i], 0, VK_WHOLE_SIZE},
+      {cull->countBuffers[i], 0, VK_WHOLE_SIZE},
+    };
+
+    VkWriteDescriptorSet writes[4];
+    for (u32 j = 0; j < ELEMOF(writes); j++)
+    {
+      writes[j] = (VkWriteDescriptorSet)
+      {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = cull->descriptorSets[i],
+        .dstBinding = j,
+        .dstArrayElement = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .pBufferInfo = &bufferInfos[j],
+      };
+    }
+
+    vkUpdateDescriptorSets(ren->dev, ELEMOF(writes), writes, 0, NULL);
+  }
+
+  return ERR_OK;
+}
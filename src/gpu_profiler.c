@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * GPU timestamps around render graph passes.
+ */
+
+#include <stdio.h>
+
+#include <notte/gpu_profiler.h>
+#include <notte/string.h>
+
+/* === PROTOTYPES === */
+
+static void TimingPush(Gpu_Timing_Window *window, f32 ms);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+GpuProfilerInit(Renderer *ren,
+                Gpu_Profiler *prof)
+{
+  VkPhysicalDeviceProperties properties;
+  VkQueueFamilyProperties *families;
+  u32 nFamilies, bits[RENDER_GRAPH_QUEUE_COUNT] = {0};
+  VkResult vkErr;
+
+  MemorySet(prof, 0, sizeof(*prof));
+
+  vkGetPhysicalDeviceProperties(ren->pDev, &properties);
+  prof->period = properties.limits.timestampPeriod;
+
+  vkGetPhysicalDeviceQueueFamilyProperties(ren->pDev, &nFamilies, NULL);
+  families = NEW_ARR(ren->alloc, VkQueueFamilyProperties, nFamilies, 
+      MEMORY_TAG_ARRAY);
+  vkGetPhysicalDeviceQueueFamilyProperties(ren->pDev, &nFamilies, families);
+
+  bits[RENDER_GRAPH_QUEUE_GRAPHICS] = 
+    families[ren->queueInfo.graphicsFamily].timestampValidBits;
+  if (ren->queueInfo.hasAsyncCompute)
+  {
+    bits[RENDER_GRAPH_QUEUE_COMPUTE] = 
+      families[ren->queueInfo.computeFamily].timestampValidBits;
+  }
+
+  FREE_ARR(ren->alloc, families, VkQueueFamilyProperties, nFamilies, 
+      MEMORY_TAG_ARRAY);
+
+  for (u32 i = 0; i < RENDER_GRAPH_QUEUE_COUNT; i++)
+  {
+    prof->masks[i] = bits[i] >= 64 ? UINT64_MAX : (1ull << bits[i]) - 1;
+    prof->enabled |= prof->masks[i] != 0;
+  }
+
+  if (!prof->enabled)
+  {
+    LOG_WARN("device has no timestamps, not profiling the GPU");
+    return ERR_OK;
+  }
+
+  VkQueryPoolCreateInfo poolInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+    .queryCount = 2 * MAX_GPU_TIMED_PASSES,
+  };
+
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    vkErr = vkCreateQueryPool(ren->dev, &poolInfo, ren->allocCbs, 
+        &prof->pools[i]);
+    if (vkErr)
+    {
+      GpuProfilerDeinit(ren, prof);
+      return ERR_LIBRARY_FAILURE;
+    }
+
+    /* Queries start out undefined, and are reset from the host after. */
+    vkResetQueryPool(ren->dev, prof->pools[i], 0, poolInfo.queryCount);
+  }
+
+  return ERR_OK;
+}
+
+void
+GpuProfilerDeinit(Renderer *ren,
+                  Gpu_Profiler *prof)
+{
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    vkDestroyQueryPool(ren->dev, prof->pools[i], ren->allocCbs);
+    prof->pools[i] = VK_NULL_HANDLE;
+  }
+  prof->enabled = false;
+}
+
+void
+GpuProfilerCollect(Renderer *ren,
+                   Gpu_Profiler *prof)
+{
+  u32 frame = ren->currentFrame;
+  u32 nPasses = prof->nPasses[frame];
+  u64 results[2 * MAX_GPU_TIMED_PASSES][2]; /* Value, then availability. */
+  u64 frameStart = UINT64_MAX, frameEnd = 0;
+  bool complete = true;
+  VkResult vkErr;
+
+  if (nPasses == 0)
+  {
+    return;
+  }
+
+  /* Without VK_QUERY_RESULT_WAIT_BIT this returns VK_NOT_READY, not stalls. */
+  vkErr = vkGetQueryPoolResults(ren->dev, prof->pools[frame], 0, 2 * nPasses,
+      sizeof(results), results, sizeof(results[0]), 
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (vkErr && vkErr != VK_NOT_READY)
+  {
+    nPasses = 0;
+  }
+
+  for (u32 i = 0; i < nPasses; i++)
+  {
+    u64 *begin = results[2 * i], *end = results[2 * i + 1];
+    u64 mask = prof->masks[prof->queues[frame][i]];
+    f64 ticks;
+
+    if (!begin[1] || !end[1])
+    {
+      complete = false;
+      continue;
+    }
+
+    ticks = (f64) ((end[0] - begin[0]) & mask);
+    TimingPush(&prof->passes[frame][i]->gpuTime, 
+        (f32) (ticks * prof->period / 1e6));
+
+    frameStart = begin[0] < frameStart ? begin[0] : frameStart;
+    frameEnd = end[0] > frameEnd ? end[0] : frameEnd;
+  }
+
+  if (complete && frameEnd > frameStart)
+  {
+    f64 seconds = (f64) (frameEnd - frameStart) * prof->period / 1e9;
+
+    TimingPush(&prof->frame, (f32) (seconds * 1e3));
+    FrameStatsRecord(&ren->frameStats, FRAME_STAT_GPU, seconds);
+  }
+
+  vkResetQueryPool(ren->dev, prof->pools[frame], 0, 
+      2 * prof->nPasses[frame]);
+  prof->nPasses[frame] = 0;
+}
+
+/* Barriers before the pass count towards it. */
+i32
+GpuProfilerBegin(Renderer *ren,
+                 Gpu_Profiler *prof,
+                 VkCommandBuffer buf,
+                 Render_Graph_Queue queue,
+                 Render_Graph_Pass *pass)
+{
+  u32 frame = ren->currentFrame;
+  u32 slot = prof->nPasses[frame];
+
+  if (prof->masks[queue] == 0 || slot == MAX_GPU_TIMED_PASSES)
+  {
+    return -1;
+  }
+
+  prof->passes[frame][slot] = pass;
+  prof->queues[frame][slot] = queue;
+  prof->nPasses[frame]++;
+
+  vkCmdWriteTimestamp2(buf, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, 
+      prof->pools[frame], 2 * slot);
+  return (i32) slot;
+}
+
+void
+GpuProfilerEnd(Renderer *ren,
+               Gpu_Profiler *prof,
+               VkCommandBuffer buf,
+               i32 slot)
+{
+  if (slot < 0)
+  {
+    return;
+  }
+
+  vkCmdWriteTimestamp2(buf, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 
+      prof->pools[ren->currentFrame], 2 * (u32) slot + 1);
+}
+
+/* Sorts a copy of the window, which is small and only read on request. */
+bool
+GpuTimingGet(const Gpu_Timing_Window *window,
+             const char *name,
+             Gpu_Timing *timing)
+{
+  f32 sorted[GPU_TIMING_WINDOW];
+  u32 n = window->nSamples;
+  f64 sum = 0.0;
+
+  if (n == 0)
+  {
+    return false;
+  }
+
+  for (u32 i = 0; i < n; i++)
+  {
+    f32 sample = window->samples[i];
+    u32 j = i;
+
+    for (; j > 0 && sorted[j - 1] > sample; j--)
+    {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = sample;
+    sum += sample;
+  }
+
+  timing->name = name;
+  timing->min = sorted[0];
+  timing->avg = sum / n;
+  timing->p99 = sorted[(n * 99 + 99) / 100 - 1];
+  timing->nSamples = n;
+  return true;
+}
+
+u32
+GpuProfilerGetPassTimings(Renderer *ren,
+                          Gpu_Timing *timings,
+                          u32 maxTimings)
+{
+  Vector *passes = &ren->graph.passes;
+  u32 nTimings = 0;
+
+  for (usize i = 0; i < passes->elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) VectorIdx(passes, i));
+    Gpu_Timing timing;
+
+    if (!GpuTimingGet(&pass->gpuTime, pass->name, &timing))
+    {
+      continue;
+    }
+
+    if (nTimings < maxTimings)
+    {
+      timings[nTimings] = timing;
+    }
+    nTimings++;
+  }
+
+  return nTimings;
+}
+
+usize
+GpuProfilerDump(Renderer *ren,
+                char *buf,
+                usize size)
+{
+  Vector *passes = &ren->graph.passes;
+  Gpu_Timing timing;
+  usize len = 0;
+
+  if (size > 0)
+  {
+    buf[0] = '\0';
+  }
+
+  if (!GpuTimingGet(&ren->gpuProfiler.frame, "frame", &timing))
+  {
+    return StringAppendFmt(buf, size, len, "no GPU timings\n");
+  }
+
+  len = StringAppendFmt(buf, size, len, "%-24s %9s %9s %9s\n", "gpu (ms)", 
+      "min", "avg", "p99");
+  len = StringAppendFmt(buf, size, len, "%-24s %9.3f %9.3f %9.3f\n", 
+      timing.name, timing.min, timing.avg, timing.p99);
+
+  for (usize i = 0; i < passes->elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) VectorIdx(passes, i));
+    char unnamed[24];
+
+    if (!GpuTimingGet(&pass->gpuTime, pass->name, &timing))
+    {
+      continue;
+    }
+
+    if (timing.name == NULL)
+    {
+      snprintf(unnamed, sizeof(unnamed), "pass %u", pass->idx);
+      timing.name = unnamed;
+    }
+
+    len = StringAppendFmt(buf, size, len, "  %-22s %9.3f %9.3f %9.3f\n", 
+        timing.name, timing.min, timing.avg, timing.p99);
+  }
+
+  return len;
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static void
+TimingPush(Gpu_Timing_Window *window,
+           f32 ms)
+{
+  window->samples[window->next] = ms;
+  window->next = (window->next + 1) % GPU_TIMING_WINDOW;
+  if (window->nSamples < GPU_TIMING_WINDOW)
+  {
+    window->nSamples++;
+  }
+}
@@ -4,5 +4,140 @@
  * Image reading and writing.
  */
 
+#include <stdio.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#ifdef NOTTE_PNG
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#endif
+
+#include <notte/image.h>
+#include <notte/log.h>
+
+/* === TYPES === */
+
+typedef struct
+{
+  Fs_Driver *fs;
+  String path;
+  Err_Code err;
+} Png_Write;
+
+/* === PROTOTYPES === */
+
+static void PackRgb(const Image_Pixels *img, u8 *dst);
+#ifdef NOTTE_PNG
+static void WritePng(void *ud, void *data, int size);
+#endif
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+ImageWritePpm(Fs_Driver *fs,
+              Allocator alloc,
+              String path,
+              const Image_Pixels *img)
+{
+  char header[64];
+  int headerSize = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", 
+      img->w, img->h);
+  usize size = (usize) headerSize + (usize) img->w * img->h * 3;
+  u8 *data = NEW_ARR(alloc, u8, size, MEMORY_TAG_ARRAY);
+  Err_Code err;
+
+  if (data == NULL)
+  {
+    return ERR_NO_MEM;
+  }
+
+  MemoryCopy(data, header, headerSize);
+  PackRgb(img, data + headerSize);
+
+  Membuf buf =
+  {
+    .data = data,
+    .size = size,
+  };
+
+  err = FsFileWrite(fs, path, &buf);
+  FREE_ARR(alloc, data, u8, size, MEMORY_TAG_ARRAY);
+  return err;
+}
+
+Err_Code
+ImageWritePng(Fs_Driver *fs,
+              Allocator alloc,
+              String path,
+              const Image_Pixels *img)
+{
+#ifdef NOTTE_PNG
+  usize size = (usize) img->w * img->h * 3;
+  u8 *rgb = NEW_ARR(alloc, u8, size, MEMORY_TAG_ARRAY);
+  Png_Write write =
+  {
+    .fs = fs,
+    .path = path,
+    .err = ERR_NO_MEM, /* Unless stb gets as far as writing. */
+  };
+
+  if (rgb == NULL)
+  {
+    return ERR_NO_MEM;
+  }
+
+  PackRgb(img, rgb);
+  stbi_write_png_to_func(WritePng, &write, (int) img->w, (int) img->h, 3, 
+      rgb, (int) img->w * 3);
+
+  FREE_ARR(alloc, rgb, u8, size, MEMORY_TAG_ARRAY);
+  return write.err;
+#else
+  (void) fs;
+  (void) alloc;
+  (void) path;
+  (void) img;
+  LOG_ERROR("built without stb_image_write.h, can't write PNGs");
+  return ERR_UNIMPLEMENTED_FUNCTIONALITY;
+#endif
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static void
+PackRgb(const Image_Pixels *img,
+        u8 *dst)
+{
+  u32 r = img->bgra ? 2 : 0, b = img->bgra ? 0 : 2;
+
+  for (u32 y = 0; y < img->h; y++)
+  {
+    const u8 *src = img->pixels + y * img->stride;
+
+    for (u32 x = 0; x < img->w; x++, src += 4, dst += 3)
+    {
+      dst[0] = src[r];
+      dst[1] = src[1];
+      dst[2] = src[b];
+    }
+  }
+}
+
+#ifdef NOTTE_PNG
+/* stb encodes the whole file in memory, then writes it in one go. */
+static void
+WritePng(void *ud,
+         void *data,
+         int size)
+{
+  Png_Write *write = ud;
+  Membuf buf =
+  {
+    .data = data,
+    .size = (usize) size,
+  };
+
+  write->err = FsFileWrite(write->fs, write->path, &buf);
+}
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Fixed set of worker threads for fork/join style jobs.
+ */
+
+#include <notte/job_pool.h>
+#include <notte/thread.h>
+#include <notte/profile.h>
+
+/* === TYPES === */
+
+typedef struct
+{
+  Job_Pool *pool;
+  u32 idx;
+  Thread *thread;
+  Semaphore *start; /* Each worker has its own, so none can steal a wakeup. */
+} Job_Worker;
+
+struct Job_Pool
+{
+  Job_Worker *workers;
+  u32 nWorkers, capacity;
+  Semaphore *done;
+  bool quit;
+
+  Job_Fn fn;
+  void *ud;
+  u32 nJobs;
+};
+
+/* === PROTOTYPES === */
+
+static void WorkerRun(void *ud);
+static void RunJobs(Job_Pool *pool, u32 worker);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+JobPoolCreate(Allocator alloc,
+              u32 nWorkers,
+              Job_Pool **poolOut)
+{
+  Err_Code err;
+  Job_Pool *pool = NEW(alloc, Job_Pool, MEMORY_TAG_THREAD);
+
+  MemorySet(pool, 0, sizeof(*pool));
+
+  err = SemaphoreCreate(alloc, &pool->done);
+  if (err)
+  {
+    FREE(alloc, pool, Job_Pool, MEMORY_TAG_THREAD);
+    return err;
+  }
+
+  if (nWorkers != 0)
+  {
+    pool->workers = NEW_ARR(alloc, Job_Worker, nWorkers, MEMORY_TAG_THREAD);
+    pool->capacity = nWorkers;
+  }
+
+  for (u32 i = 0; i < nWorkers; i++)
+  {
+    Job_Worker *worker = &pool->workers[i];
+
+    worker->pool = pool;
+    worker->idx = i + 1;
+
+    err = SemaphoreCreate(alloc, &worker->start);
+    if (err)
+    {
+      break;
+    }
+
+    err = ThreadCreate(alloc, worker, WorkerRun, &worker->thread);
+    if (err)
+    {
+      SemaphoreDestroy(alloc, worker->start);
+      break;
+    }
+
+    pool->nWorkers++;
+  }
+
+  if (err)
+  {
+    JobPoolDestroy(alloc, pool);
+    return err;
+  }
+
+  *poolOut = pool;
+  return ERR_OK;
+}
+
+void
+JobPoolDestroy(Allocator alloc,
+               Job_Pool *pool)
+{
+  pool->quit = true;
+  for (u32 i = 0; i < pool->nWorkers; i++)
+  {
+    SemaphoreSignal(pool->workers[i].start);
+  }
+
+  for (u32 i = 0; i < pool->nWorkers; i++)
+  {
+    Job_Worker *worker = &pool->workers[i];
+
+    ThreadJoin(worker->thread);
+    ThreadDestroy(alloc, worker->thread);
+    SemaphoreDestroy(alloc, worker->start);
+  }
+
+  if (pool->capacity != 0)
+  {
+    FREE_ARR(alloc, pool->workers, Job_Worker, pool->capacity,
+        MEMORY_TAG_THREAD);
+  }
+  SemaphoreDestroy(alloc, pool->done);
+  FREE(alloc, pool, Job_Pool, MEMORY_TAG_THREAD);
+}
+
+u32
+JobPoolThreadCount(Job_Pool *pool)
+{
+  return pool->nWorkers + 1;
+}
+
+void
+JobPoolRun(Job_Pool *pool,
+           Job_Fn fn,
+           void *ud,
+           u32 nJobs)
+{
+  u32 nWoken;
+
+  if (nJobs == 0)
+  {
+    return;
+  }
+
+  /* Only wake workers which have a job. */
+  nWoken = nJobs - 1 < pool->nWorkers ? nJobs - 1 : pool->nWorkers;
+
+  pool->fn = fn;
+  pool->ud = ud;
+  pool->nJobs = nJobs;
+
+  for (u32 i = 0; i < nWoken; i++)
+  {
+    SemaphoreSignal(pool->workers[i].start);
+  }
+
+  RunJobs(pool, 0);
+
+  for (u32 i = 0; i < nWoken; i++)
+  {
+    SemaphoreWait(pool->done);
+  }
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static void
+WorkerRun(void *ud)
+{
+  Job_Worker *worker = (Job_Worker *) ud;
+  Job_Pool *pool = worker->pool;
+
+  ProfileSetThreadName("job worker");
+  while (true)
+  {
+    SemaphoreWait(worker->start);
+    if (pool->quit)
+    {
+      break;
+    }
+
+    RunJobs(pool, worker->idx);
+    SemaphoreSignal(pool->done);
+  }
+}
+
+static void
+RunJobs(Job_Pool *pool,
+        u32 worker)
+{
+  u32 nThreads = pool->nWorkers + 1;
+
+  for (u32 job = worker; job < pool->nJobs; job += nThreads)
+  {
+    pool->fn(pool->ud, job, worker);
+  }
+}
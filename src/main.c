@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <notte/log.h>
 #include <notte/model.h>
@@ -15,6 +16,24 @@
 #include <notte/renderer.h>
 #include <notte/bson.h>
 #include <notte/fs.h>
+#include <notte/profile.h>
+#include <notte/image.h>
+
+/* Headless frames are animated at this rate, whatever they take to draw. */
+#define HEADLESS_FRAME_TIME (1.0 / 60.0)
+
+/* === TYPES === */
+
+typedef struct
+{
+  Fs_Driver *fs;
+  Allocator alloc;
+  bool png;
+} Frame_Dump;
+
+/* === PROTOTYPES === */
+
+static void DumpFrame(void *ud, const Renderer_Readback *readback);
 
 /* === GLOBALS === */
 
@@ -32,11 +51,18 @@ u32 indices[] =
 
 /* === PUBLIC FUNCTIONS === */
 
+/* 
+ * Usage: notte [--headless FRAMES] [--dump ppm|png]
+ *
+ * Headless runs draw FRAMES frames offscreen without a window, optionally 
+ * dumping each one.
+ */
 int
-main()
+main(int argc, 
+     char **argv)
 {
   Err_Code err;
-  Plat_Window *win;
+  Plat_Window *win = NULL;
   Plat_Event ev;
   Renderer *ren;
   Bson_Ast *ast;
@@ -44,15 +70,57 @@ main()
   Parse_Result result;
   Fs_Driver fs;
   Static_Mesh *bunny;
+  bool headless = false, dumpFrames = false;
+  u64 headlessFrames = 0;
+  Frame_Dump dump;
 
   LogSetLevel(LOG_LEVEL_DEBUG);
 
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+    {
+      headless = true;
+      headlessFrames = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+    {
+      const char *format = argv[++i];
+
+      dumpFrames = true;
+      dump.png = strcmp(format, "png") == 0;
+      if (!dump.png && strcmp(format, "ppm") != 0)
+      {
+        LOG_FATAL_FMT("unknown dump format '%s', expected ppm or png", format);
+        return EXIT_FAILURE;
+      }
+#ifndef NOTTE_PNG
+      if (dump.png)
+      {
+        LOG_FATAL("built without stb_image_write.h, use --dump ppm");
+        return EXIT_FAILURE;
+      }
+#endif
+    } else
+    {
+      LOG_FATAL_FMT("unknown argument '%s'", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
   LOG_DEBUG("entering main function");
 
   MemoryInit();
 
   Allocator libcAlloc = MemoryLoadLibcAllocator();
 
+  err = ProfileInit(libcAlloc);
+  if (err)
+  {
+    LOG_FATAL_CODE("failed to init profiler", err);
+    return EXIT_FAILURE;
+  }
+  ProfileSetThreadName("main");
+
   err = PlatInit();
   if (err)
   {
@@ -74,21 +142,36 @@ main()
     .alloc = libcAlloc,
   };
 
-  err = PlatWindowCreate(&createInfo, &win);
-  if (err)
+  if (!headless)
   {
-    LOG_FATAL_CODE("failed to create platform window", err);
-    return EXIT_FAILURE;
+    err = PlatWindowCreate(&createInfo, &win);
+    if (err)
+    {
+      LOG_FATAL_CODE("failed to create platform window", err);
+      return EXIT_FAILURE;
+    }
   }
 
+  dump.fs = &fs;
+  dump.alloc = libcAlloc;
+
   Renderer_Create_Info rendererCreateInfo =
   {
     .win = win,
+    .width = createInfo.w,
+    .height = createInfo.h,
     .alloc = libcAlloc,
     .fs = &fs,
+    .recordThreads = 4,
+    .presentMode = PRESENT_MODE_MAILBOX,
+    .readbackFn = dumpFrames ? DumpFrame : NULL,
+    .readbackUd = &dump,
   };
 
-  err = RendererCreate(&rendererCreateInfo, &ren);
+  PROFILE_ZONE("create renderer")
+  {
+    err = RendererCreate(&rendererCreateInfo, &ren);
+  }
   if (err)
   {
     LOG_FATAL_CODE("failed to create renderer", err);
@@ -96,16 +179,12 @@ main()
   }
 
   f64 startTime = PlatGetTime();
-  Membuf modelBuf;
-  err = FsFileLoad(&fs, STRING_CSTR("assets/bunny.ustatic"), &modelBuf);
-  if (err)
+  Parse_Result meshResult;
+  PROFILE_ZONE("load bunny")
   {
-    LOG_FATAL_CODE("failed to load model buffer", err);
-    return EXIT_FAILURE;
+    err = StaticMeshLoadUStaticFile(ren, &fs, &bunny, &meshResult, 
+        STRING_CSTR("assets/bunny.ustatic"), STATIC_MESH_RETAIN_NONE);
   }
-
-  Parse_Result meshResult;
-  err = StaticMeshLoadUStatic(ren, libcAlloc, &bunny, &meshResult, modelBuf);
   if (err)
   {
     LOG_FATAL_CODE("failed to load bunny model", err);
@@ -113,8 +192,8 @@ main()
   }
   f64 endTime = PlatGetTime();
   LOG_DEBUG_FMT("Loaded model in %f", endTime - startTime);
-
-  FsFileDestroy(&fs, &modelBuf);
+  LOG_DEBUG_FMT("retaining %zu bytes of mesh data", 
+      RendererGetRetainedMeshBytes(ren));
 
   Camera *cam;
   err = RendererCreateCamera(ren, &cam);
@@ -133,7 +212,7 @@ main()
   RendererSetCameraTransform(ren, cam, camTrans);
   RendererSetCameraActive(ren, cam);
 
-  f64 baseTime = PlatGetTime();
+  f64 baseTime = headless ? 0.0 : PlatGetTime();
 
   Transform trans = 
   {
@@ -143,41 +222,96 @@ main()
 
   Material *mat = RendererLookupMaterial(ren, STRING_CSTR("tri"));
 
-  while (1)
+  Transform_Id bunnyTrans;
+  err = RendererCreateTransform(ren, TRANSFORM_ID_NONE, &bunnyTrans);
+  if (err)
   {
-    f64 nowTime = PlatGetTime();
+    LOG_FATAL_CODE("failed to create transform", err);
+    return EXIT_FAILURE;
+  }
+
+  Render_Object_Info bunnyInfo = 
+  {
+    .mesh = bunny,
+    .material = mat,
+    .transform = bunnyTrans,
+  };
+  Render_Object_Handle bunnyObj;
+  err = RendererAddRenderObject(ren, &bunnyInfo, &bunnyObj);
+  if (err)
+  {
+    LOG_FATAL_CODE("failed to add render object", err);
+    return EXIT_FAILURE;
+  }
+
+  for (u64 frame = 0; !headless || frame < headlessFrames; frame++)
+  {
+    PROFILE_FRAME();
+    err = RendererWaitForLatency(ren);
+    if (err)
+    {
+      LOG_FATAL_CODE("failed to wait for last frame", err);
+      return EXIT_FAILURE;
+    }
+    f64 nowTime = headless ? frame * HEADLESS_FRAME_TIME : PlatGetTime();
     f64 delta = nowTime - baseTime;
     baseTime = nowTime;
-    PlatWindowPumpEvents(win);
-    while (PlatWindowGetEvent(win, &ev))
+    if (!headless)
     {
-      switch (ev.t)
+      PlatWindowPumpEvents(win);
+      while (PlatWindowGetEvent(win, &ev))
       {
-        case PLAT_EVENT_CLOSE:
-          goto close;
+        switch (ev.t)
+        {
+          case PLAT_EVENT_CLOSE:
+            goto close;
+        }
       }
     }
     trans.rot[0] = 45 * sin(nowTime);
     trans.rot[1] = 30 + 90 * sin(nowTime / 2.0f);
     trans.rot[2] = 45 + 30 * sin(nowTime * 2.0f);
-    RendererDrawStaticMesh(ren, bunny, trans, mat);
+    RendererSetTransform(ren, bunnyTrans, trans);
     err = RendererDraw(ren);
     if (err)
     {
       LOG_FATAL_CODE("failed to draw", err);
       return EXIT_FAILURE;
     }
-    f64 afterTime = PlatGetTime();
-    LOG_DEBUG_FMT("Drew frame in %f", afterTime - nowTime);
-
   }
 
 close:
 
+  err = RendererFlushReadbacks(ren);
+  if (err)
+  {
+    LOG_ERROR_CODE("failed to flush readbacks", err);
+  }
+
+  char gpuTimings[2048];
+  RendererDumpGpuTimings(ren, gpuTimings, sizeof(gpuTimings));
+  LOG_DEBUG_FMT("GPU timings:\n%s", gpuTimings);
+
+  char frameStats[2048];
+  RendererDumpFrameStats(ren, frameStats, sizeof(frameStats));
+  LOG_DEBUG_FMT("Frame stats:\n%s", frameStats);
+
+  RendererRemoveRenderObject(ren, bunnyObj);
+  RendererDestroyTransform(ren, bunnyTrans);
   RendererDestroyCamera(ren, cam);
   RendererDestroyStaticMesh(ren, bunny);
-  PlatWindowDestroy(win);
+  if (win != NULL)
+  {
+    PlatWindowDestroy(win);
+  }
   RendererDestroy(ren);
+
+  err = ProfileWriteChromeTrace(&fs, STRING_CSTR("trace.json"));
+  if (err)
+  {
+    LOG_ERROR_CODE("failed to write trace", err);
+  }
+  ProfileDeinit();
   FsDriverDestroy(&fs);
 
   MemoryPrintUsage();
@@ -186,3 +320,35 @@ close:
   LOG_DEBUG("exiting main function successfully");
   return EXIT_SUCCESS;
 }
+
+/* === PRIVATE FUNCTIONS === */
+
+static void
+DumpFrame(void *ud, 
+          const Renderer_Readback *readback)
+{
+  Frame_Dump *dump = ud;
+  char path[64];
+  Err_Code err;
+
+  snprintf(path, sizeof(path), "frame_%04llu.%s", 
+      (unsigned long long) readback->frame, dump->png ? "png" : "ppm");
+
+  /* Offscreen images are BGRA like a swapchain's. */
+  Image_Pixels img =
+  {
+    .w = readback->w,
+    .h = readback->h,
+    .stride = readback->stride,
+    .bgra = true,
+    .pixels = readback->pixels,
+  };
+
+  err = dump->png 
+    ? ImageWritePng(dump->fs, dump->alloc, STRING_CSTR(path), &img)
+    : ImageWritePpm(dump->fs, dump->alloc, STRING_CSTR(path), &img);
+  if (err)
+  {
+    LOG_ERROR_CODE("failed to dump frame", err);
+  }
+}
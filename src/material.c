@@ -5,7 +5,10 @@
  */
 
 #include <notte/material.h>
+#include <notte/gpu_cull.h>
 #include <notte/bson.h>
+#include <notte/deletion_queue.h>
+#include <notte/profile.h>
 
 /* === GLOBALS === */
 
@@ -41,6 +44,7 @@ VkVertexInputAttributeDescription vertexAttributeDescription[] =
 /* === PROTOTYPES === */
 
 static void TechDestroy(void *ud, String name, void *ptr);
+static void TechDeferDestroy(Renderer *ren, Technique *tech);
 static void ShaderDestroy(void *ud, String name, void *item);
 static void ShaderMonitorEvent(void *ud, String root, String path);
 static Err_Code ShaderRebuild(Renderer *ren, Shader_Manager *shaders, 
@@ -48,6 +52,7 @@ static Err_Code ShaderRebuild(Renderer *ren, Shader_Manager *shaders,
 static Err_Code ShaderInit(Renderer *ren, Shader_Manager *shaders,
     Shader *shader);
 static Err_Code TechniqueInit(Renderer *ren, Technique *tech);
+static shaderc_shader_kind ShaderKind(Shader_Type type);
 
 /* === PUBLIC FUNCTIONS === */
 
@@ -142,6 +147,7 @@ TechniqueManagerInit(Renderer *ren,
                      Technique_Manager *techs)
 {
   techs->dict = DICT_CREATE(ren->alloc, Technique, false);
+  techs->nextId = 0;
   return ERR_OK;
 }
 
@@ -216,6 +222,7 @@ TechniqueManagerOpen(Renderer *ren,
 
     tech->vert = vertShader;
     tech->frag = fragShader;
+    tech->id = techs->nextId++;
 
     err = TechniqueInit(ren, tech);
     if (err)
@@ -265,6 +272,7 @@ MaterialManagerInit(Renderer *ren,
                     Material_Manager *materials)
 {
   materials->dict = DICT_CREATE(ren->alloc, Material, false);
+  materials->nextId = 0;
 
   return ERR_OK;
 }
@@ -375,6 +383,7 @@ MaterialManagerOpen(Renderer *ren,
 
     Effect *effect = EffectManagerLookup(&ren->effects, effectName);
     material->effect = effect;
+    material->id = materials->nextId++;
 
     LOG_DEBUG_FMT("loaded material '%.*s'", (int) effectName.len, effectName.buf);
   }
@@ -394,6 +403,19 @@ MaterialManagerLookup(Material_Manager *mats,
   return DictFind(mats->dict, name);
 }
 
+Technique *
+MaterialTechnique(Material *mat, 
+                  Render_Pass pass, 
+                  Technique *fallback)
+{
+  if (mat == NULL || mat->effect == NULL || mat->effect->techs[pass] == NULL)
+  {
+    return fallback;
+  }
+
+  return mat->effect->techs[pass];
+}
+
 /* === PRIVATE_FUNCTIONS === */
 
 static void
@@ -419,6 +441,37 @@ TechDestroy(void *ud,
   vkDestroyRenderPass(ren->dev, tech->fakePass, ren->allocCbs);
 }
 
+static void
+TechDeferDestroy(Renderer *ren,
+                 Technique *tech)
+{
+  Deletion dels[] = 
+  {
+    {.t = DELETION_PIPELINE, .pipeline = tech->pipeline},
+    {.t = DELETION_PIPELINE_LAYOUT, .pipelineLayout = tech->layout},
+    {.t = DELETION_RENDER_PASS, .renderPass = tech->fakePass},
+    {
+      .t = DELETION_DESCRIPTOR_SET_LAYOUT, 
+      .descriptorSetLayout = tech->descriptorLayout
+    },
+  };
+
+  for (usize i = 0; i < ELEMOF(dels); i++)
+  {
+    DeletionQueuePush(ren, &ren->deletions, &dels[i]);
+  }
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    Deletion setDel = 
+    {
+      .t = DELETION_DESCRIPTOR_SET,
+      .descriptorSet = tech->descriptorSets[i],
+    };
+    DeletionQueuePush(ren, &ren->deletions, &setDel);
+  }
+}
+
 static Err_Code
 ShaderRebuild(Renderer *ren, 
               Shader_Manager *shaders, 
@@ -429,8 +482,10 @@ ShaderRebuild(Renderer *ren,
   Technique *tech;
   Err_Code err;
 
-  vkDeviceWaitIdle(ren->dev);
-
+  /* 
+   * Pipelines built from the old module stay valid after it is destroyed,
+   * only the pipelines themselves have to wait for in flight frames.
+   */
   vkDestroyShaderModule(ren->dev, shader->mod, ren->allocCbs);
   err = ShaderInit(ren, shaders, shader);
   if (err)
@@ -443,11 +498,20 @@ ShaderRebuild(Renderer *ren,
   {
     if (tech->vert == shader || tech->frag == shader)
     {
-      TechDestroy(ren, techName, tech);
+      TechDeferDestroy(ren, tech);
       TechniqueInit(ren, tech);
     }
   }
 
+  if (ren->cull.enabled && ren->cull.shader == shader)
+  {
+    err = GpuCullRebuild(ren, &ren->cull);
+    if (err)
+    {
+      return err;
+    }
+  }
+
   return ERR_OK;
 }
 
@@ -470,11 +534,12 @@ ShaderInit(Renderer *ren,
     return err;
   }
 
-  shaderc_compilation_result_t result = 
-    shaderc_compile_into_spv(shaders->compiler, buf.data, buf.size, 
-        shader->type == SHADER_VERT ? shaderc_glsl_vertex_shader 
-                            : shaderc_glsl_fragment_shader, 
-        name.buf, "main", NULL);
+  shaderc_compilation_result_t result;
+  PROFILE_ZONE("compile shader")
+  {
+    result = shaderc_compile_into_spv(shaders->compiler, buf.data, buf.size,
+        ShaderKind(shader->type), name.buf, "main", NULL);
+  }
 
   if (shaderc_result_get_compilation_status(result))
   {
@@ -516,7 +581,7 @@ TechniqueInit(Renderer *ren,
   VkDescriptorSetLayoutBinding uboBinding = 
   {
     .binding = 0,
-    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
     .descriptorCount = 1,
     .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
   };
@@ -529,14 +594,22 @@ TechniqueInit(Renderer *ren,
     .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
   };
 
-  VkDescriptorSetLayoutBinding bindings[2] = {
-    uboBinding, samplerBinding,
+  VkDescriptorSetLayoutBinding instanceBinding = 
+  {
+    .binding = INSTANCE_DATA_BINDING,
+    .descriptorCount = 1,
+    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+  };
+
+  VkDescriptorSetLayoutBinding bindings[3] = {
+    uboBinding, samplerBinding, instanceBinding,
   };
 
   VkDescriptorSetLayoutCreateInfo layoutInfo = 
   {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-    .bindingCount = 2,
+    .bindingCount = 3,
     .pBindings = bindings,
   };
 
@@ -547,7 +620,7 @@ TechniqueInit(Renderer *ren,
     return ERR_LIBRARY_FAILURE;
   }
 
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (usize i = 0; i < ren->framesInFlight; i++)
   {
     descriptorLayouts[i] = tech->descriptorLayout;
   }
@@ -556,7 +629,7 @@ TechniqueInit(Renderer *ren,
   {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
     .descriptorPool = ren->descriptorPool,
-    .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+    .descriptorSetCount = ren->framesInFlight,
     .pSetLayouts = descriptorLayouts,
   };
 
@@ -566,11 +639,11 @@ TechniqueInit(Renderer *ren,
   {
     return ERR_LIBRARY_FAILURE;
   }
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (usize i = 0; i < ren->framesInFlight; i++)
   {
     VkDescriptorBufferInfo bufferInfo = 
     {
-      .buffer = ren->uniformBuffers[i],
+      .buffer = ren->uniforms[i].buffer,
       .offset = 0,
       .range = sizeof(Camera_Uniform),
     };
@@ -582,14 +655,21 @@ TechniqueInit(Renderer *ren,
       .sampler = ren->textureSampler,
     };
 
-    VkWriteDescriptorSet descriptorWrites[2] =
+    VkDescriptorBufferInfo instanceInfo = 
+    {
+      .buffer = ren->instances[i].buffer,
+      .offset = 0,
+      .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet descriptorWrites[3] =
     {
       {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = tech->descriptorSets[i],
         .dstBinding = 0,
         .dstArrayElement = 0,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
         .pBufferInfo = &bufferInfo,
       },
@@ -602,9 +682,18 @@ TechniqueInit(Renderer *ren,
         .descriptorCount = 1,
         .pImageInfo = &imageInfo,
       },
+      {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = tech->descriptorSets[i],
+        .dstBinding = INSTANCE_DATA_BINDING,
+        .dstArrayElement = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .pBufferInfo = &instanceInfo,
+      },
     };
 
-    vkUpdateDescriptorSets(ren->dev, 2, descriptorWrites, 0, NULL);
+    vkUpdateDescriptorSets(ren->dev, 3, descriptorWrites, 0, NULL);
   }
 
   VkDynamicState dynamicStates[] =
@@ -695,20 +784,11 @@ TechniqueInit(Renderer *ren,
     .pAttachments = &colorBlendAttachment,
   };
 
-  VkPushConstantRange pushConstant = 
-  {
-    .offset = 0,
-    .size = sizeof(Mesh_Push_Constant),
-    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-  };
-
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = 
   {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
     .setLayoutCount = 1,
     .pSetLayouts = &tech->descriptorLayout,
-    .pushConstantRangeCount = 1,
-    .pPushConstantRanges = &pushConstant,
   };
 
   vkErr = vkCreatePipelineLayout(ren->dev, &pipelineLayoutInfo, ren->allocCbs, 
@@ -854,3 +934,18 @@ TechniqueInit(Renderer *ren,
   return ERR_OK;
 }
 
+static shaderc_shader_kind
+ShaderKind(Shader_Type type)
+{
+  switch (type)
+  {
+    case SHADER_VERT:
+      return shaderc_glsl_vertex_shader;
+    case SHADER_FRAG:
+      return shaderc_glsl_fragment_shader;
+    case SHADER_COMP:
+      return shaderc_glsl_compute_shader;
+  }
+
+  NOTTE_UNREACHABLE();
+}
@@ -36,6 +36,7 @@ memoryTagToStr[] = {
   [MEMORY_TAG_BSON]     = "BSON    ",
   [MEMORY_TAG_THREAD]   = "THREAD  ",
   [MEMORY_TAG_FS]       = "FS      ",
+  [MEMORY_TAG_PROFILE]  = "PROFILE ",
 };
 
 Allocator libcAllocator;
@@ -109,6 +110,15 @@ MemoryCopy(void *dest,
   return dest;
 }
 
+void *
+MemoryMove(void *dest, 
+           const void *src, 
+           usize size)
+{
+  memmove(dest, src, size);
+  return dest;
+}
+
 void *
 MemorySet(void *dest, 
           u8 val, 
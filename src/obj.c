@@ -4,13 +4,20 @@
  * Obj file loading.
  */
 
+#include <stdio.h>
+
 #include <notte/model.h>
 #include <notte/error.h>
 #include <notte/vector.h>
+#include <notte/profile.h>
 
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include <tinyobj_loader_c.h>
 
+/* === MACROS === */
+
+#define USTATIC_HEADER_SIZE (2 * sizeof(u64))
+
 /* === TYPES === */
 
 typedef struct
@@ -27,6 +34,8 @@ static void GetFileData(void *ctx, const char *filename, const int is_mtl,
     const char *obj_filename, char **data, size_t *len);
 static Err_Code CreateStaticMeshFromData(Static_Mesh **mesh, Mesh_Data *data, 
     Renderer *ren, Allocator alloc);
+static Err_Code UStaticReadHeader(Parse_Result *result, const u8 *header, 
+    usize size, Static_Mesh_Upload *upload);
 
 /* === PUBLIC FUNCTION === */
 
@@ -123,45 +132,97 @@ ConvertObjToUStatic(Allocator alloc,
 
 Err_Code 
 StaticMeshLoadUStatic(Renderer *ren, 
-                      Allocator alloc,
                       Static_Mesh **mesh, 
                       Parse_Result *result, 
                       Membuf buf)
 {
   Err_Code err;
+  Static_Mesh_Upload upload;
 
   const u8 *ptr = buf.data;
 
-  u64 vertCount = *((u64*) ptr);
-  ptr += sizeof(u64);
-  u64 indexCount = *((u64*) ptr);
-  ptr += sizeof(u64);
+  err = UStaticReadHeader(result, ptr, buf.size, &upload);
+  if (err)
+  {
+    return err;
+  }
+  ptr += USTATIC_HEADER_SIZE;
 
-  Static_Vert *verts = NEW_ARR(alloc, Static_Vert, vertCount, MEMORY_TAG_ARRAY);
-  u32 *indices = NEW_ARR(alloc, u32, indexCount, MEMORY_TAG_ARRAY);
+  err = RendererBeginStaticMesh(ren, &upload);
+  if (err)
+  {
+    return err;
+  }
 
-  MemoryCopy(verts, ptr, sizeof(Static_Vert) * vertCount);
-  ptr += sizeof(Static_Vert) * vertCount;
-  MemoryCopy(indices, ptr, sizeof(u32) * indexCount);
+  MemoryCopy(upload.verts, ptr, sizeof(Static_Vert) * upload.nVerts);
+  RendererAddStaticMeshBounds(&upload, (const Static_Vert *) ptr, 
+      upload.nVerts);
+  ptr += sizeof(Static_Vert) * upload.nVerts;
+  MemoryCopy(upload.indices, ptr, sizeof(u32) * upload.nIndices);
 
-  Static_Mesh_Create_Info createInfo = 
+  return RendererEndStaticMesh(ren, &upload, mesh);
+}
+
+Err_Code 
+StaticMeshLoadUStaticFile(Renderer *ren, 
+                          Fs_Driver *fs,
+                          Static_Mesh **mesh, 
+                          Parse_Result *result, 
+                          String path,
+                          Static_Mesh_Retention retention)
+{
+  Err_Code err;
+  usize size;
+  u8 header[USTATIC_HEADER_SIZE];
+  Static_Mesh_Upload upload;
+
+  err = FsFileSize(fs, path, &size);
+  if (err)
   {
-    .verts = verts,
-    .nVerts = vertCount,
-    .indices = indices,
-    .nIndices = indexCount, 
-  };
+    return err;
+  }
 
-  err = RendererCreateStaticMesh(ren, &createInfo, mesh);
+  err = FsFileRead(fs, path, 0, header, sizeof(header));
   if (err)
-  { 
+  {
+    return err;
+  }
+
+  err = UStaticReadHeader(result, header, size, &upload);
+  if (err)
+  {
     return err;
   }
+  upload.retention = retention;
 
-  FREE_ARR(alloc, verts, Static_Vert, vertCount, MEMORY_TAG_ARRAY);
-  FREE_ARR(alloc, indices, u32, indexCount, MEMORY_TAG_ARRAY);
+  err = RendererBeginStaticMesh(ren, &upload);
+  if (err)
+  {
+    return err;
+  }
 
-  return ERR_OK;
+  /* 
+   * Staging memory holds the vertices then the indices, just like the file,
+   * so the whole payload is one read.  Walking the vertices afterwards for 
+   * the bounds is cheaper than going through a second buffer.
+   */
+  PROFILE_ZONE("read ustatic")
+  {
+    err = FsFileRead(fs, path, USTATIC_HEADER_SIZE, upload.verts, 
+        size - USTATIC_HEADER_SIZE);
+  }
+  if (err)
+  {
+    RendererAbortStaticMesh(ren, &upload);
+    return err;
+  }
+  RendererAddStaticMeshBounds(&upload, upload.verts, upload.nVerts);
+
+  PROFILE_ZONE("upload static mesh")
+  {
+    err = RendererEndStaticMesh(ren, &upload, mesh);
+  }
+  return err;
 }
 
 /* === PRIVATE FUNCTION === */
@@ -180,6 +241,45 @@ GetFileData(void *ctx,
   *len = buf->size;
 }
 
+static Err_Code
+UStaticReadHeader(Parse_Result *result,
+                  const u8 *header,
+                  usize size,
+                  Static_Mesh_Upload *upload)
+{
+  u64 vertCount, indexCount;
+  usize payload;
+
+  if (size < USTATIC_HEADER_SIZE)
+  {
+    snprintf(result->msg, PARSE_RESULT_MAX_MSG, "truncated ustatic header");
+    return ERR_FAILED_PARSE;
+  }
+
+  MemoryCopy(&vertCount, header, sizeof(u64));
+  MemoryCopy(&indexCount, header + sizeof(u64), sizeof(u64));
+
+  /* 
+   * The counts come from the file, so bound them by the payload before 
+   * multiplying, or a crafted header could wrap the sizes.
+   */
+  payload = size - USTATIC_HEADER_SIZE;
+  if (vertCount > payload / sizeof(Static_Vert) 
+      || indexCount > payload / sizeof(u32)
+      || payload - vertCount * sizeof(Static_Vert) 
+      != indexCount * sizeof(u32))
+  {
+    snprintf(result->msg, PARSE_RESULT_MAX_MSG, 
+        "ustatic payload does not match header counts");
+    return ERR_FAILED_PARSE;
+  }
+
+  upload->nVerts = vertCount;
+  upload->nIndices = indexCount;
+  upload->retention = STATIC_MESH_RETAIN_NONE;
+  return ERR_OK;
+}
+
 static Err_Code 
 ObjLoadMeshData(Allocator alloc, 
                 Parse_Result *result, 
@@ -192,8 +292,13 @@ ObjLoadMeshData(Allocator alloc,
   tinyobj_material_t *materials = NULL;
   Err_Code err;
 
-  int ret = tinyobj_parse_obj(&attrib, &shapes, &numShapes, &materials,
-      &numMaterials, "bunny2.obj", GetFileData, &inBuf, TINYOBJ_FLAG_TRIANGULATE);
+  int ret;
+  PROFILE_ZONE("parse obj")
+  {
+    ret = tinyobj_parse_obj(&attrib, &shapes, &numShapes, &materials,
+        &numMaterials, "bunny2.obj", GetFileData, &inBuf, 
+        TINYOBJ_FLAG_TRIANGULATE);
+  }
   if (ret != TINYOBJ_SUCCESS)
   {
     return ERR_LIBRARY_FAILURE;
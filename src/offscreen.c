@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Headless render targets and frame readback.
+ */
+
+#include <notte/offscreen.h>
+#include <notte/render_graph.h>
+#include <notte/vk_mem.h>
+
+/* === CONSTANTS === */
+
+/* Encoded like a typical swapchain's, so readbacks are ready to display. */
+#define OFFSCREEN_FORMAT VK_FORMAT_B8G8R8A8_SRGB
+
+/* === PROTOTYPES === */
+
+static Err_Code CreateReadbacks(Renderer *ren, Offscreen *off);
+static Err_Code AllocateReadbackMemory(Renderer *ren, Offscreen *off, 
+    VkBuffer buffer, VkDeviceMemory *memory);
+static void Deliver(Renderer *ren, Offscreen *off, u32 frame);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+OffscreenInit(Renderer *ren,
+              Offscreen *off,
+              u32 w,
+              u32 h,
+              Renderer_Readback_Fn fn,
+              void *ud)
+{
+  Swapchain *swapchain = &ren->swapchain;
+  Err_Code err;
+
+  MemorySet(off, 0, sizeof(*off));
+  off->fn = fn;
+  off->ud = ud;
+
+  MemorySet(swapchain, 0, sizeof(*swapchain));
+  swapchain->format = (VkSurfaceFormatKHR)
+  {
+    .format = OFFSCREEN_FORMAT,
+    .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+  };
+  swapchain->extent = (VkExtent2D) {w, h};
+  swapchain->nImages = ren->framesInFlight;
+  swapchain->images = NEW_ARR(ren->alloc, VkImage, swapchain->nImages,
+      MEMORY_TAG_ARRAY);
+  swapchain->imageViews = NEW_ARR(ren->alloc, VkImageView, swapchain->nImages,
+      MEMORY_TAG_ARRAY);
+  MemorySet(swapchain->images, 0, sizeof(VkImage) * swapchain->nImages);
+  MemorySet(swapchain->imageViews, 0, 
+      sizeof(VkImageView) * swapchain->nImages);
+
+  for (u32 i = 0; i < swapchain->nImages; i++)
+  {
+    err = CreateImage(ren, w, h, OFFSCREEN_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &swapchain->images[i],
+        &off->imageMemory[i]);
+    if (err)
+    {
+      goto fail;
+    }
+
+    err = CreateImageView(ren, swapchain->images[i], OFFSCREEN_FORMAT,
+        VK_IMAGE_ASPECT_COLOR_BIT, &swapchain->imageViews[i]);
+    if (err)
+    {
+      goto fail;
+    }
+  }
+
+  if (fn != NULL)
+  {
+    err = CreateReadbacks(ren, off);
+    if (err)
+    {
+      goto fail;
+    }
+  }
+
+  return ERR_OK;
+
+  /* Everything not yet created is still null, which destroys as nothing. */
+fail:
+  OffscreenDeinit(ren, off);
+  return err;
+}
+
+void
+OffscreenDeinit(Renderer *ren,
+                Offscreen *off)
+{
+  Swapchain *swapchain = &ren->swapchain;
+
+  for (u32 i = 0; i < swapchain->nImages; i++)
+  {
+    vkDestroyImageView(ren->dev, swapchain->imageViews[i], ren->allocCbs);
+    DestroyImage(ren, swapchain->images[i], off->imageMemory[i]);
+  }
+
+  FREE_ARR(ren->alloc, swapchain->imageViews, VkImageView, swapchain->nImages,
+      MEMORY_TAG_ARRAY);
+  FREE_ARR(ren->alloc, swapchain->images, VkImage, swapchain->nImages,
+      MEMORY_TAG_ARRAY);
+
+  if (off->fn == NULL)
+  {
+    return;
+  }
+
+  vkDestroyCommandPool(ren->dev, off->commandPool, ren->allocCbs);
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    if (off->mapped[i] != NULL)
+    {
+      vkUnmapMemory(ren->dev, off->bufferMemory[i]);
+    }
+    DestroyBuffer(ren, off->buffers[i], off->bufferMemory[i]);
+  }
+}
+
+/*
+ * The render graph leaves the image in the transfer source layout, so only
+ * the copy's writes need making visible to the host.
+ */
+VkCommandBuffer
+OffscreenRecordReadback(Renderer *ren,
+                        Offscreen *off)
+{
+  u32 frame = ren->currentFrame;
+  VkCommandBuffer buf = off->cmds[frame];
+
+  if (off->fn == NULL)
+  {
+    return VK_NULL_HANDLE;
+  }
+
+  VkCommandBufferBeginInfo beginInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+
+  vkBeginCommandBuffer(buf, &beginInfo);
+
+  VkBufferImageCopy region =
+  {
+    .imageSubresource =
+    {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .layerCount = 1,
+    },
+    .imageExtent =
+    {
+      ren->swapchain.extent.width,
+      ren->swapchain.extent.height,
+      1,
+    },
+  };
+
+  vkCmdCopyImageToBuffer(buf, ren->swapchain.images[frame],
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, off->buffers[frame], 1, &region);
+
+  VkBufferMemoryBarrier2 barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+    .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+    .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+    .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+    .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = off->buffers[frame],
+    .size = VK_WHOLE_SIZE,
+  };
+
+  VkDependencyInfo dependencyInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .bufferMemoryBarrierCount = 1,
+    .pBufferMemoryBarriers = &barrier,
+  };
+
+  vkCmdPipelineBarrier2(buf, &dependencyInfo);
+  vkEndCommandBuffer(buf);
+
+  off->pending[frame] = true;
+  off->frames[frame] = off->nextFrame++;
+  return buf;
+}
+
+void
+OffscreenCollect(Renderer *ren,
+                 Offscreen *off)
+{
+  Deliver(ren, off, ren->currentFrame);
+}
+
+/* The current frame's buffer holds the oldest readback, if any. */
+Err_Code
+OffscreenFlush(Renderer *ren,
+               Offscreen *off)
+{
+  Err_Code err;
+
+  err = RenderGraphWaitLast(&ren->graph);
+  if (err)
+  {
+    return err;
+  }
+
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    Deliver(ren, off, (ren->currentFrame + i) % ren->framesInFlight);
+  }
+
+  return ERR_OK;
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static Err_Code
+CreateReadbacks(Renderer *ren,
+                Offscreen *off)
+{
+  VkDeviceSize size = (VkDeviceSize) ren->swapchain.extent.width
+    * ren->swapchain.extent.height * 4;
+  VkResult vkErr;
+  Err_Code err;
+  void *data;
+
+  VkCommandPoolCreateInfo poolInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = ren->queueInfo.graphicsFamily,
+  };
+
+  vkErr = vkCreateCommandPool(ren->dev, &poolInfo, ren->allocCbs,
+      &off->commandPool);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  VkCommandBufferAllocateInfo allocInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = off->commandPool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = ren->framesInFlight,
+  };
+
+  vkErr = vkAllocateCommandBuffers(ren->dev, &allocInfo, off->cmds);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  for (u32 i = 0; i < ren->framesInFlight; i++)
+  {
+    VkBufferCreateInfo bufferInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    vkErr = vkCreateBuffer(ren->dev, &bufferInfo, ren->allocCbs, 
+        &off->buffers[i]);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+
+    err = AllocateReadbackMemory(ren, off, off->buffers[i], 
+        &off->bufferMemory[i]);
+    if (err)
+    {
+      return err;
+    }
+    vkBindBufferMemory(ren->dev, off->buffers[i], off->bufferMemory[i], 0);
+
+    vkErr = vkMapMemory(ren->dev, off->bufferMemory[i], 0, size, 0, &data);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+    off->mapped[i] = data;
+  }
+
+  return ERR_OK;
+}
+
+/* 
+ * The CPU reads every pixel back, so cached memory is preferred over the 
+ * write-combined kind, even if it then needs invalidating before each read.
+ */
+static Err_Code
+AllocateReadbackMemory(Renderer *ren,
+                       Offscreen *off,
+                       VkBuffer buffer,
+                       VkDeviceMemory *memory)
+{
+  static const VkMemoryPropertyFlags preferred[] =
+  {
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+  VkMemoryRequirements reqs;
+  Err_Code err = ERR_NO_SUITABLE_HARDWARE;
+
+  vkGetBufferMemoryRequirements(ren->dev, buffer, &reqs);
+  for (u32 i = 0; i < ELEMOF(preferred); i++)
+  {
+    err = AllocateMemory(ren, &reqs, preferred[i], memory);
+    if (err != ERR_NO_SUITABLE_HARDWARE)
+    {
+      off->coherent = preferred[i] & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      break;
+    }
+  }
+
+  return err;
+}
+
+/* Only called once frame has finished. */
+static void
+Deliver(Renderer *ren,
+        Offscreen *off,
+        u32 frame)
+{
+  if (!off->pending[frame])
+  {
+    return;
+  }
+
+  if (!off->coherent)
+  {
+    VkMappedMemoryRange range =
+    {
+      .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+      .memory = off->bufferMemory[frame],
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+    };
+
+    vkInvalidateMappedMemoryRanges(ren->dev, 1, &range);
+  }
+
+  Renderer_Readback readback =
+  {
+    .frame = off->frames[frame],
+    .w = ren->swapchain.extent.width,
+    .h = ren->swapchain.extent.height,
+    .stride = (usize) ren->swapchain.extent.width * 4,
+    .pixels = off->mapped[frame],
+  };
+
+  off->pending[frame] = false;
+  off->fn(off->ud, &readback);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Linux backend for plat.h, without windows so far.
+ */
+
+#define _POSIX_C_SOURCE 199309L /* For clock_gettime. */
+#include <time.h>
+
+#include <notte/plat.h>
+#include <notte/memory.h>
+#include <notte/log.h>
+
+/* === TYPES === */
+
+struct Plat_Window
+{
+  Allocator alloc;
+};
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+PlatInit(void)
+{
+  return ERR_OK;
+}
+
+/* Renderers can still run headless. */
+Err_Code
+PlatWindowCreate(Plat_Window_Create_Info *info,
+                 Plat_Window **winOut)
+{
+  (void) info;
+  (void) winOut;
+
+  LOG_ERROR("windows aren't implemented on linux");
+  return ERR_UNIMPLEMENTED_FUNCTIONALITY;
+}
+
+void
+PlatWindowDestroy(Plat_Window *win)
+{
+  FREE(win->alloc, win, Plat_Window, MEMORY_TAG_PLATFORM);
+}
+
+bool
+PlatWindowShouldClose(Plat_Window *win)
+{
+  (void) win;
+  return true;
+}
+
+void
+PlatWindowPumpEvents(Plat_Window *win)
+{
+  (void) win;
+}
+
+bool
+PlatWindowGetEvent(Plat_Window *win,
+                   Plat_Event *event)
+{
+  (void) win;
+  (void) event;
+  return false;
+}
+
+Err_Code
+PlatWindowGetInstanceExtensions(Plat_Window *win,
+                                u32 *nNames,
+                                const char **names)
+{
+  (void) win;
+  (void) names;
+
+  *nNames = 0;
+  return true;
+}
+
+Err_Code
+PlatWindowCreateVulkanSurface(Plat_Window *win,
+                              VkInstance vk,
+                              VkAllocationCallbacks *alloc,
+                              VkSurfaceKHR *surfaceOut)
+{
+  (void) win;
+  (void) vk;
+  (void) alloc;
+  (void) surfaceOut;
+  return ERR_UNIMPLEMENTED_FUNCTIONALITY;
+}
+
+void
+PlatWindowGetFramebufferSize(Plat_Window *win,
+                             u32 *w,
+                             u32 *h)
+{
+  (void) win;
+  if (w != NULL)
+  {
+    *w = 0;
+  }
+  if (h != NULL)
+  {
+    *h = 0;
+  }
+}
+
+f64
+PlatGetTime(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64) now.tv_sec + (f64) now.tv_nsec / 1e9;
+}
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * CPU instrumentation, exported as Chrome trace events.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <notte/profile.h>
+#include <notte/plat.h>
+
+/* === TYPES === */
+
+typedef enum
+{
+  PROFILE_EVENT_BEGIN,
+  PROFILE_EVENT_END,
+  PROFILE_EVENT_FRAME,
+  PROFILE_EVENT_COUNTER,
+} Profile_Event_Type;
+
+typedef struct
+{
+  u64 ticks;
+  const char *name;
+  f64 value; /* Counters and frame numbers. */
+  Profile_Event_Type t;
+} Profile_Event;
+
+/*
+ * Only its thread writes to a ring, publishing each event by bumping head
+ * after it is written, so the exporter can read without locking.
+ */
+typedef struct
+{
+  Profile_Event *events;
+  volatile u64 head; /* Events ever written. */
+  char name[32];
+} Profile_Thread;
+
+/* Growing JSON output. */
+typedef struct
+{
+  char *data;
+  usize len, cap;
+  bool failed;
+} Text;
+
+/* === GLOBALS === */
+
+static struct
+{
+  bool enabled;
+  Allocator alloc;
+  Profile_Thread threads[PROFILE_MAX_THREADS];
+  volatile u32 nThreads; /* Claimed, may be more than PROFILE_MAX_THREADS. */
+  u32 generation; /* Bumped by ProfileInit, invalidating claimed threads. */
+  u64 startTicks;
+  f64 startTime;
+  u64 frame;
+} profileState;
+
+static NOTTE_THREAD_LOCAL Profile_Thread *thisThread;
+static NOTTE_THREAD_LOCAL u32 thisGeneration;
+
+/* === PROTOTYPES === */
+
+static u64 ReadTicks(void);
+static u32 ClaimThread(void);
+static void PublishHead(Profile_Thread *thread, u64 head);
+static u64 ReadHead(Profile_Thread *thread);
+static Profile_Thread *ThisThread(void);
+static void Push(Profile_Event_Type t, const char *name, f64 value);
+static usize CopyEvents(Profile_Thread *thread, Profile_Event *events);
+static void TextAppend(Text *text, const char *fmt, ...);
+static void TextAppendString(Text *text, const char *str);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code
+ProfileInit(Allocator alloc)
+{
+  u32 i;
+
+  profileState.alloc = alloc;
+  for (i = 0; i < PROFILE_MAX_THREADS; i++)
+  {
+    Profile_Thread *thread = &profileState.threads[i];
+
+    thread->events = NEW_ARR(alloc, Profile_Event, PROFILE_RING_SIZE,
+        MEMORY_TAG_PROFILE);
+    if (thread->events == NULL)
+    {
+      break;
+    }
+    thread->head = 0;
+    thread->name[0] = '\0';
+  }
+
+  if (i < PROFILE_MAX_THREADS)
+  {
+    while (i > 0)
+    {
+      i--;
+      FREE_ARR(alloc, profileState.threads[i].events, Profile_Event,
+          PROFILE_RING_SIZE, MEMORY_TAG_PROFILE);
+    }
+    return ERR_NO_MEM;
+  }
+
+  profileState.nThreads = 0;
+  profileState.generation++;
+  profileState.frame = 0;
+  profileState.startTime = PlatGetTime();
+  profileState.startTicks = ReadTicks();
+  profileState.enabled = true;
+  return ERR_OK;
+}
+
+void
+ProfileDeinit(void)
+{
+  if (!profileState.enabled)
+  {
+    return;
+  }
+
+  profileState.enabled = false;
+  for (u32 i = 0; i < PROFILE_MAX_THREADS; i++)
+  {
+    FREE_ARR(profileState.alloc, profileState.threads[i].events,
+        Profile_Event, PROFILE_RING_SIZE, MEMORY_TAG_PROFILE);
+    profileState.threads[i].events = NULL;
+  }
+}
+
+void
+ProfileSetThreadName(const char *name)
+{
+  Profile_Thread *thread = ThisThread();
+
+  if (thread != NULL)
+  {
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+  }
+}
+
+void
+ProfileBegin(const char *name)
+{
+  Push(PROFILE_EVENT_BEGIN, name, 0.0);
+}
+
+void
+ProfileEnd(void)
+{
+  Push(PROFILE_EVENT_END, NULL, 0.0);
+}
+
+void
+ProfileFrame(void)
+{
+  Push(PROFILE_EVENT_FRAME, "frame", (f64) profileState.frame++);
+}
+
+void
+ProfileCounter(const char *name,
+               f64 value)
+{
+  Push(PROFILE_EVENT_COUNTER, name, value);
+}
+
+/*
+ * Ticks are converted with a rate measured against PlatGetTime since
+ * ProfileInit, since the TSC's frequency isn't reported anywhere portable.
+ */
+Err_Code
+ProfileWriteChromeTrace(Fs_Driver *fs,
+                        String path)
+{
+  Allocator alloc = profileState.alloc;
+  Text text = {0};
+  Profile_Event *events;
+  f64 elapsed, ticksPerUs;
+  u32 nThreads;
+  Err_Code err;
+
+  if (!profileState.enabled)
+  {
+    return ERR_INVALID_USAGE;
+  }
+
+  elapsed = PlatGetTime() - profileState.startTime;
+  ticksPerUs = elapsed > 0.0
+    ? (f64) (ReadTicks() - profileState.startTicks) / (elapsed * 1e6) : 1.0;
+  if (ticksPerUs <= 0.0)
+  {
+    ticksPerUs = 1.0;
+  }
+
+  events = NEW_ARR(alloc, Profile_Event, PROFILE_RING_SIZE,
+      MEMORY_TAG_PROFILE);
+  if (events == NULL)
+  {
+    return ERR_NO_MEM;
+  }
+
+  nThreads = profileState.nThreads < PROFILE_MAX_THREADS
+    ? profileState.nThreads : PROFILE_MAX_THREADS;
+
+  TextAppend(&text, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (u32 tid = 0; tid < nThreads; tid++)
+  {
+    Profile_Thread *thread = &profileState.threads[tid];
+    usize nEvents = CopyEvents(thread, events);
+    u32 depth = 0;
+
+    TextAppend(&text, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+        "\"tid\":%u,\"args\":{\"name\":", tid);
+    if (thread->name[0] != '\0')
+    {
+      TextAppendString(&text, thread->name);
+    } else
+    {
+      TextAppend(&text, "\"thread %u\"", tid);
+    }
+    TextAppend(&text, "}}");
+
+    for (usize i = 0; i < nEvents; i++)
+    {
+      Profile_Event *ev = &events[i];
+      f64 ts = (f64) (i64) (ev->ticks - profileState.startTicks) / ticksPerUs;
+
+      switch (ev->t)
+      {
+        case PROFILE_EVENT_BEGIN:
+          depth++;
+          TextAppend(&text, ",\n{\"ph\":\"B\",\"pid\":0,\"tid\":%u,"
+              "\"ts\":%.3f,\"name\":", tid, ts);
+          TextAppendString(&text, ev->name);
+          TextAppend(&text, "}");
+          break;
+        case PROFILE_EVENT_END:
+          /* Its begin may have been overwritten. */
+          if (depth == 0)
+          {
+            break;
+          }
+          depth--;
+          TextAppend(&text, ",\n{\"ph\":\"E\",\"pid\":0,\"tid\":%u,"
+              "\"ts\":%.3f}", tid, ts);
+          break;
+        case PROFILE_EVENT_FRAME:
+          TextAppend(&text, ",\n{\"ph\":\"i\",\"s\":\"g\",\"pid\":0,"
+              "\"tid\":%u,\"ts\":%.3f,\"name\":\"frame\","
+              "\"args\":{\"frame\":%.0f}}", tid, ts, ev->value);
+          break;
+        case PROFILE_EVENT_COUNTER:
+          TextAppend(&text, ",\n{\"ph\":\"C\",\"pid\":0,\"tid\":%u,"
+              "\"ts\":%.3f,\"name\":", tid, ts);
+          TextAppendString(&text, ev->name);
+          TextAppend(&text, ",\"args\":{\"value\":%g}}", ev->value);
+          break;
+      }
+    }
+    TextAppend(&text, tid + 1 < nThreads ? ",\n" : "\n");
+  }
+  TextAppend(&text, "]}\n");
+
+  FREE_ARR(alloc, events, Profile_Event, PROFILE_RING_SIZE,
+      MEMORY_TAG_PROFILE);
+
+  if (text.failed)
+  {
+    err = ERR_NO_MEM;
+  } else
+  {
+    Membuf buf =
+    {
+      .data = (const u8 *) text.data,
+      .size = text.len,
+    };
+
+    err = FsFileWrite(fs, path, &buf);
+  }
+
+  if (text.cap != 0)
+  {
+    FREE_ARR(alloc, text.data, char, text.cap, MEMORY_TAG_PROFILE);
+  }
+  return err;
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+/* Falls back to PlatGetTime's clock where there's no TSC. */
+static u64
+ReadTicks(void)
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__)                \
+  || defined(__i386__)
+  return __rdtsc();
+#else
+  return (u64) (PlatGetTime() * 1e9);
+#endif
+}
+
+static u32
+ClaimThread(void)
+{
+#if defined(_MSC_VER)
+  return (u32) _InterlockedIncrement((volatile long *)
+      &profileState.nThreads) - 1;
+#else
+  return __atomic_fetch_add(&profileState.nThreads, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Stores are ordered on x86, so MSVC there only needs the compiler held. */
+static void
+PublishHead(Profile_Thread *thread,
+            u64 head)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _ReadWriteBarrier();
+  thread->head = head;
+#elif defined(_MSC_VER)
+  _InterlockedExchange64((volatile __int64 *) &thread->head, (__int64) head);
+#else
+  __atomic_store_n(&thread->head, head, __ATOMIC_RELEASE);
+#endif
+}
+
+static u64
+ReadHead(Profile_Thread *thread)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  u64 head = thread->head;
+  _ReadWriteBarrier();
+  return head;
+#elif defined(_MSC_VER)
+  return (u64) _InterlockedOr64((volatile __int64 *) &thread->head, 0);
+#else
+  return __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* Threads claim a ring the first time they record after ProfileInit. */
+static Profile_Thread *
+ThisThread(void)
+{
+  if (thisGeneration != profileState.generation)
+  {
+    u32 idx = ClaimThread();
+
+    thisGeneration = profileState.generation;
+    thisThread = idx < PROFILE_MAX_THREADS
+      ? &profileState.threads[idx] : NULL;
+  }
+
+  return thisThread;
+}
+
+static void
+Push(Profile_Event_Type t,
+     const char *name,
+     f64 value)
+{
+  Profile_Thread *thread;
+  Profile_Event *ev;
+  u64 head;
+
+  if (!profileState.enabled)
+  {
+    return;
+  }
+
+  thread = ThisThread();
+  if (thread == NULL)
+  {
+    return;
+  }
+
+  head = thread->head;
+  ev = &thread->events[head % PROFILE_RING_SIZE];
+  ev->t = t;
+  ev->name = name;
+  ev->value = value;
+  ev->ticks = ReadTicks();
+  PublishHead(thread, head + 1);
+}
+
+/*
+ * Copies the thread's surviving events in order.  Those the thread wrote
+ * over while they were copied are dropped from the front.
+ */
+static usize
+CopyEvents(Profile_Thread *thread,
+           Profile_Event *events)
+{
+  u64 head = ReadHead(thread);
+  u64 first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+  u64 after;
+  usize skip;
+
+  for (u64 i = first; i < head; i++)
+  {
+    events[i - first] = thread->events[i % PROFILE_RING_SIZE];
+  }
+
+  /* The slot of event 'after' is being written, so it's torn too. */
+  after = ReadHead(thread);
+  skip = after + 1 > first + PROFILE_RING_SIZE
+    ? (usize) (after + 1 - first - PROFILE_RING_SIZE) : 0;
+  if (skip >= head - first)
+  {
+    return 0;
+  }
+
+  MemoryMove(events, events + skip, (head - first - skip) * sizeof(*events));
+  return (usize) (head - first - skip);
+}
+
+static void
+TextAppend(Text *text,
+           const char *fmt,
+           ...)
+{
+  va_list args;
+  int len;
+
+  va_start(args, fmt);
+  len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  if (len < 0 || text->failed)
+  {
+    text->failed = true;
+    return;
+  }
+
+  if (text->len + len + 1 > text->cap)
+  {
+    usize cap = text->cap ? text->cap : 64 * 1024;
+    char *data;
+
+    while (text->len + len + 1 > cap)
+    {
+      cap *= 2;
+    }
+
+    data = text->cap
+      ? RESIZE_ARR(profileState.alloc, text->data, char, text->cap, cap,
+          MEMORY_TAG_PROFILE)
+      : NEW_ARR(profileState.alloc, char, cap, MEMORY_TAG_PROFILE);
+    if (data == NULL)
+    {
+      text->failed = true;
+      return;
+    }
+    text->data = data;
+    text->cap = cap;
+  }
+
+  va_start(args, fmt);
+  vsnprintf(text->data + text->len, text->cap - text->len, fmt, args);
+  va_end(args);
+  text->len += len;
+}
+
+/* Names are literals, but a quote or backslash would still break the JSON. */
+static void
+TextAppendString(Text *text,
+                 const char *str)
+{
+  TextAppend(text, "\"");
+  for (const char *c = str; *c != '\0'; c++)
+  {
+    if (*c == '"' || *c == '\\')
+    {
+      TextAppend(text, "\\%c", *c);
+    } else if ((u8) *c < 0x20)
+    {
+      TextAppend(text, "\\u%04x", (u8) *c);
+    } else
+    {
+      TextAppend(text, "%c", *c);
+    }
+  }
+  TextAppend(text, "\"");
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * LSD radix sort over 64 bit keys.
+ */
+
+#include <notte/radix_sort.h>
+#include <notte/memory.h>
+
+/* === MACROS === */
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+RadixSort64(u64 *keys, 
+            u32 *vals, 
+            u64 *tmpKeys, 
+            u32 *tmpVals, 
+            usize n)
+{
+  usize counts[RADIX_PASSES][RADIX_BUCKETS];
+  u64 *srcKeys = keys, *dstKeys = tmpKeys;
+  u32 *srcVals = vals, *dstVals = tmpVals;
+
+  if (n < 2)
+  {
+    return;
+  }
+
+  /* Build every histogram in one read of the keys. */
+  MemorySet(counts, 0, sizeof(counts));
+  for (usize i = 0; i < n; i++)
+  {
+    u64 key = keys[i];
+    for (usize pass = 0; pass < RADIX_PASSES; pass++)
+    {
+      counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  for (usize pass = 0; pass < RADIX_PASSES; pass++)
+  {
+    usize shift = pass * RADIX_BITS;
+    usize *count = counts[pass];
+    usize offset = 0;
+
+    /* All keys share this digit, so the pass wouldn't move anything. */
+    if (count[(srcKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == n)
+    {
+      continue;
+    }
+
+    for (usize i = 0; i < RADIX_BUCKETS; i++)
+    {
+      usize c = count[i];
+      count[i] = offset;
+      offset += c;
+    }
+
+    for (usize i = 0; i < n; i++)
+    {
+      usize dst = count[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+      dstKeys[dst] = srcKeys[i];
+      dstVals[dst] = srcVals[i];
+    }
+
+    u64 *swapKeys = srcKeys;
+    srcKeys = dstKeys;
+    dstKeys = swapKeys;
+
+    u32 *swapVals = srcVals;
+    srcVals = dstVals;
+    dstVals = swapVals;
+  }
+
+  if (srcKeys != keys)
+  {
+    MemoryCopy(keys, srcKeys, sizeof(u64) * n);
+    MemoryCopy(vals, srcVals, sizeof(u32) * n);
+  }
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Free-list allocator over an abstract range of elements.
+ */
+
+#include <notte/range_allocator.h>
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code 
+RangeAllocatorInit(Range_Allocator *ranges, 
+                   Allocator alloc, 
+                   u32 capacity)
+{
+  Range whole = 
+  {
+    .offset = 0,
+    .size = capacity,
+  };
+
+  ranges->alloc = alloc;
+  ranges->capacity = capacity;
+  ranges->used = 0;
+  ranges->free = VECTOR_CREATE(alloc, Range);
+  VectorPush(&ranges->free, alloc, &whole);
+
+  return ERR_OK;
+}
+
+void 
+RangeAllocatorDeinit(Range_Allocator *ranges)
+{
+  VectorDestroy(&ranges->free, ranges->alloc);
+}
+
+Err_Code 
+RangeAllocatorAlloc(Range_Allocator *ranges, 
+                    u32 size, 
+                    u32 *offsetOut)
+{
+  Range *freeRanges = (Range *) ranges->free.buf;
+
+  if (size == 0)
+  {
+    *offsetOut = 0;
+    return ERR_OK;
+  }
+
+  for (usize i = 0; i < ranges->free.elemsUsed; i++)
+  {
+    Range *range = &freeRanges[i];
+    if (range->size < size)
+    {
+      continue;
+    }
+
+    *offsetOut = range->offset;
+    range->offset += size;
+    range->size -= size;
+    ranges->used += size;
+
+    if (range->size == 0)
+    {
+      MemoryMove(range, range + 1, 
+          (ranges->free.elemsUsed - i - 1) * sizeof(Range));
+      ranges->free.elemsUsed--;
+    }
+
+    return ERR_OK;
+  }
+
+  return ERR_NO_MEM;
+}
+
+void 
+RangeAllocatorFree(Range_Allocator *ranges, 
+                   u32 offset, 
+                   u32 size)
+{
+  Range *freeRanges;
+  usize idx, nFree;
+  bool mergePrev, mergeNext;
+
+  if (size == 0)
+  {
+    return;
+  }
+
+  ranges->used -= size;
+
+  /* Find the first free range after the one being released. */
+  freeRanges = (Range *) ranges->free.buf;
+  nFree = ranges->free.elemsUsed;
+  for (idx = 0; idx < nFree; idx++)
+  {
+    if (freeRanges[idx].offset > offset)
+    {
+      break;
+    }
+  }
+
+  mergePrev = idx > 0 && 
+    freeRanges[idx - 1].offset + freeRanges[idx - 1].size == offset;
+  mergeNext = idx < nFree && offset + size == freeRanges[idx].offset;
+
+  if (mergePrev && mergeNext)
+  {
+    freeRanges[idx - 1].size += size + freeRanges[idx].size;
+    MemoryMove(&freeRanges[idx], &freeRanges[idx + 1], 
+        (nFree - idx - 1) * sizeof(Range));
+    ranges->free.elemsUsed--;
+  } else if (mergePrev)
+  {
+    freeRanges[idx - 1].size += size;
+  } else if (mergeNext)
+  {
+    freeRanges[idx].offset = offset;
+    freeRanges[idx].size += size;
+  } else
+  {
+    Range range = 
+    {
+      .offset = offset,
+      .size = size,
+    };
+
+    /* Grow the vector, then shift the tail up to make room at idx. */
+    VectorPush(&ranges->free, ranges->alloc, &range);
+    freeRanges = (Range *) ranges->free.buf;
+    MemoryMove(&freeRanges[idx + 1], &freeRanges[idx], 
+        (nFree - idx) * sizeof(Range));
+    freeRanges[idx] = range;
+  }
+}
@@ -5,140 +5,311 @@
  */
 
 #include <notte/render_graph.h>
-#include <notte/material.h>
+#include <notte/deletion_queue.h>
+#include <notte/vk_mem.h>
+#include <notte/gpu_profiler.h>
+#include <notte/profile.h>
 
 /* === TYPES === */
 
+/* One pass being recorded in chunks by the job pool. */
+typedef struct
+{
+  Render_Graph *graph;
+  Render_Graph_Pass *pass;
+  VkCommandBufferInheritanceInfo inheritance;
+  u32 nChunks;
+  VkCommandBuffer buffers[MAX_RECORD_THREADS];
+  VkResult results[MAX_RECORD_THREADS];
+  f64 times[MAX_RECORD_THREADS];
+} Record_Job;
+
 /* === CONSTANTS === */
 
 #define MARK_NONE 0
 #define MARK_TEMP 1
 #define MARK_PERM 2
 
+/* Where passes touch their textures. */
+#define COLOR_STAGES VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+#define DEPTH_STAGES (VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT \
+    | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT)
+#define READ_STAGES VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT
+#define COMPUTE_STAGES VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+
+#define NO_BATCH UINT32_MAX
+
 /* === PROTOTYPES === */
 
-static Err_Code CreateSwapchainFramebuffers(Render_Graph *graph);
-static Err_Code Rebake(Render_Graph *graph);
+static Err_Code SelectPlan(Render_Graph *graph);
+static u64 BuildKey(Render_Graph *graph);
+static void KeyPush(Render_Graph *graph, u64 word);
+static void KeyPushHandle(Render_Graph *graph, const void *handle, 
+    usize size);
+static bool KeysEqual(Vector *a, Vector *b);
+static void ActivatePlan(Render_Graph *graph, Render_Graph_Plan *plan);
+static Err_Code CompilePlan(Render_Graph *graph, Render_Graph_Plan *plan);
+static void TakeTransients(Render_Graph *graph, Render_Graph_Plan *plan);
+static void DetachTransients(Render_Graph *graph);
 static Err_Code TopoSortVisit(Render_Graph *graph, Render_Graph_Pass *pass);
+static void CullPasses(Render_Graph *graph);
+static Err_Code ScheduleBatches(Render_Graph *graph, Render_Graph_Plan *plan,
+    bool async);
+static void OrderBatches(Render_Graph *graph, Render_Graph_Plan *plan, 
+    u32 *passBatches, u32 *lastPasses);
+static u32 QueueFamily(Render_Graph *graph, Render_Graph_Queue queue);
+static Err_Code VisitWriters(Render_Graph *graph, Render_Graph_Texture *tex,
+    usize before);
+static void ResetBakeState(Render_Graph_Texture *tex);
+static Render_Graph_Texture *NewTexture(Render_Graph *graph, VkFormat format,
+    bool isDepth);
+static void ComputeLifetimes(Render_Graph *graph, Render_Graph_Plan *plan);
+static Err_Code CreateTransients(Render_Graph *graph);
+static Err_Code CreateTransientImage(Render_Graph *graph, 
+    Render_Graph_Texture *tex, VkMemoryRequirements *reqsOut);
+static void AliasTransient(Render_Graph *graph, Render_Graph_Texture *tex,
+    VkMemoryRequirements *reqs, u32 *blockOut);
+static void FindLaterUses(Render_Graph *graph, usize idx, 
+    Render_Graph_Texture *tex, bool *readLater, bool *writtenLater);
+static Err_Code BakePass(Render_Graph *graph, usize idx, 
+    Render_Graph_Plan_Pass *baked);
+static void TryMergePass(Render_Graph *graph, Render_Graph_Plan_Pass *prev,
+    Render_Graph_Plan_Pass *baked);
+static Err_Code CreatePassObjects(Render_Graph *graph, Render_Graph_Plan *plan,
+    usize first, usize end);
+static Render_Graph_Barrier *PushBarrier(Render_Graph *graph, 
+    Render_Graph_Texture *tex, VkImageLayout layout, 
+    VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+static bool ChangeQueue(Render_Graph *graph, Render_Graph_Plan_Pass *baked,
+    Render_Graph_Texture *tex, VkImageLayout layout, 
+    VkPipelineStageFlags2 stages, VkAccessFlags2 access);
+static void UseForRead(Render_Graph *graph, Render_Graph_Plan_Pass *baked,
+    Render_Graph_Texture *tex, VkImageLayout layout, 
+    VkPipelineStageFlags2 stages, VkAccessFlags2 access);
+static void UseForWrite(Render_Graph *graph, Render_Graph_Plan_Pass *baked,
+    Render_Graph_Texture *tex, VkImageLayout layout, 
+    VkPipelineStageFlags2 stages, VkAccessFlags2 readAccess, 
+    VkAccessFlags2 writeAccess);
+static void RecordBarriers(Render_Graph *graph, Render_Graph_Plan *plan, 
+    VkCommandBuffer buf, u32 imageIndex, u32 first, u32 count);
+static void RecordBatch(Render_Graph *graph, Render_Graph_Plan *plan, 
+    u32 batch, VkCommandBuffer buf, u32 imageIndex);
+static void EvictPlan(Render_Graph *graph, u32 idx, bool deferred);
+static void ReleasePlan(Render_Graph *graph, Render_Graph_Plan *plan, 
+    bool deferred);
+static void ReleasePlanPass(Render_Graph *graph, Render_Graph_Plan_Pass *baked,
+    bool deferred);
+static Err_Code CreateThreadPools(Render_Graph *graph);
+static void ResetThreadPools(Render_Graph *graph);
+static Err_Code WaitTimelines(Render_Graph *graph, 
+    const u64 values[RENDER_GRAPH_QUEUE_COUNT]);
+static VkCommandBuffer AcquireSecondary(Render_Graph *graph, u32 thread);
+static u32 CountChunks(Render_Graph *graph, Render_Graph_Pass *pass);
+static void RecordRenderPass(Render_Graph *graph, Render_Graph_Plan *plan,
+    usize first, usize end, VkCommandBuffer buf, u32 imageIndex);
+static void RecordInline(Render_Graph *graph, Render_Graph_Pass *pass,
+    VkCommandBuffer buf);
+static void RecordChunks(Render_Graph *graph, Render_Graph_Pass *pass,
+    VkCommandBuffer buf, const VkCommandBufferInheritanceInfo *inheritance,
+    u32 nChunks);
+static void RecordChunk(void *ud, u32 job, u32 worker);
 
 /* === PUBLIC FUNCTIONS === */
 
 Err_Code 
 RenderGraphInit(Renderer *ren, 
-                Render_Graph *graph)
+                Render_Graph *graph,
+                u32 nThreads)
 {
   Err_Code err;
   VkResult vkErr;
 
-  graph->swapFbs = NEW_ARR(ren->alloc, VkFramebuffer, ren->swapchain.nImages, 
-      MEMORY_TAG_RENDERER);
-
   graph->ren = ren;
+  graph->asyncCompute = ren->queueInfo.hasAsyncCompute;
 
-  err = CreateSwapchainFramebuffers(graph);
-  if (err)
+  VkSemaphoreTypeCreateInfo timelineInfo =
   {
-    return err;
-  }
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
 
-  VkCommandPoolCreateInfo poolInfo =
-  {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-    .queueFamilyIndex = ren->queueInfo.graphicsFamily,
+  VkSemaphoreCreateInfo timelineSemaphoreInfo = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timelineInfo,
   };
 
-  vkErr = vkCreateCommandPool(ren->dev, &poolInfo, ren->allocCbs, 
-      &graph->commandPool);
-  if (vkErr)
+  for (u32 i = 0; i < RENDER_GRAPH_QUEUE_COUNT; i++)
   {
-    return ERR_LIBRARY_FAILURE;
-  }
+    if (i == RENDER_GRAPH_QUEUE_COMPUTE && !graph->asyncCompute)
+    {
+      continue;
+    }
 
-  VkCommandBufferAllocateInfo allocInfo =
-  {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-    .commandPool = graph->commandPool,
-    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
-  };
+    VkCommandPoolCreateInfo poolInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = QueueFamily(graph, i),
+    };
 
-  vkErr = vkAllocateCommandBuffers(ren->dev, &allocInfo, graph->commandBuffers);
-  if (vkErr)
-  {
-    return ERR_LIBRARY_FAILURE;
+    vkErr = vkCreateCommandPool(ren->dev, &poolInfo, ren->allocCbs, 
+        &graph->commandPools[i]);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = graph->commandPools[i],
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = ren->framesInFlight * MAX_RENDER_GRAPH_BATCHES,
+    };
+
+    vkErr = vkAllocateCommandBuffers(ren->dev, &allocInfo, 
+        &graph->commandBuffers[i][0][0]);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+
+    vkErr = vkCreateSemaphore(ren->dev, &timelineSemaphoreInfo, ren->allocCbs,
+        &graph->timelines[i]);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
   }
 
   VkSemaphoreCreateInfo semaphoreInfo = {
     .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
   };
 
-  VkFenceCreateInfo fenceInfo =
-  {
-    .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-  };
-
-
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (usize i = 0; i < ren->framesInFlight; i++)
   {
     vkErr = vkCreateSemaphore(ren->dev, &semaphoreInfo, ren->allocCbs, 
         &graph->imageAvailableSemaphores[i]);
     vkErr = vkCreateSemaphore(ren->dev, &semaphoreInfo, ren->allocCbs, 
         &graph->renderFinishedSemaphores[i]);
-    vkErr = vkCreateFence(ren->dev, &fenceInfo, ren->allocCbs, 
-        &graph->inFlightFences[i]);
     if (vkErr)
     {
       return ERR_LIBRARY_FAILURE;
     }
   }
 
-  /* 
-   * We don't need to initialize the fbs in graph->swap, because we will use 
-   * graph->swapFbs. 
-   */
-  graph->swap.isSwapchain = true;
+  /* The view is picked per swapchain image when framebuffers are made. */
+  graph->swap = (Render_Graph_Texture)
+  {
+    .isSwapchain = true,
+    .format = ren->swapchain.format.format,
+    .extent = ren->swapchain.extent,
+    .clear = {{{0.0f, 0.0f, 0.0f, 1.0f}}},
+  };
 
-  graph->passes = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Pass);
+  graph->passes = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Pass *);
   graph->bakedPasses = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Pass *);
+  graph->textures = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Texture *);
+  graph->key = VECTOR_CREATE(graph->ren->alloc, u64);
+  graph->barriers = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Barrier);
+  graph->memories = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Memory);
+  graph->releases = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Release);
+  graph->plan = NULL;
+  graph->nPlans = 0;
+  graph->frame = 0;
+  graph->dirty = true;
+
+  nThreads = nThreads == 0 ? 1 : nThreads;
+  nThreads = nThreads > MAX_RECORD_THREADS ? MAX_RECORD_THREADS : nThreads;
+
+  err = JobPoolCreate(ren->alloc, nThreads - 1, &graph->jobs);
+  if (err)
+  {
+    return err;
+  }
+  graph->nThreads = nThreads;
+
+  err = CreateThreadPools(graph);
+  if (err)
+  {
+    return err;
+  }
 
   return ERR_OK;
 }
 
+void
+RenderGraphSetThreads(Render_Graph *graph,
+                      u32 nThreads)
+{
+  u32 maxThreads = JobPoolThreadCount(graph->jobs);
+
+  nThreads = nThreads == 0 ? 1 : nThreads;
+  graph->nThreads = nThreads > maxThreads ? maxThreads : nThreads;
+}
+
 void 
 RenderGraphDeinit(Render_Graph *graph)
 {
   Renderer *ren = graph->ren;
 
-  vkDestroyCommandPool(ren->dev, graph->commandPool, ren->allocCbs);
+  for (usize i = 0; i < RENDER_GRAPH_QUEUE_COUNT; i++)
+  {
+    vkDestroyCommandPool(ren->dev, graph->commandPools[i], ren->allocCbs);
+    vkDestroySemaphore(ren->dev, graph->timelines[i], ren->allocCbs);
+  }
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    for (usize j = 0; j < JobPoolThreadCount(graph->jobs); j++)
+    {
+      Render_Graph_Thread_Pool *pool = &graph->threadPools[i][j];
+
+      vkDestroyCommandPool(ren->dev, pool->pool, ren->allocCbs);
+      VectorDestroy(&pool->buffers, ren->alloc);
+    }
+  }
+  JobPoolDestroy(ren->alloc, graph->jobs);
 
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (usize i = 0; i < ren->framesInFlight; i++)
   {
     vkDestroySemaphore(ren->dev, graph->imageAvailableSemaphores[i], 
         ren->allocCbs);
     vkDestroySemaphore(ren->dev, graph->renderFinishedSemaphores[i], 
         ren->allocCbs);
-    vkDestroyFence(ren->dev, graph->inFlightFences[i], ren->allocCbs);
   }
 
-  for (usize i = 0; i < ren->swapchain.nImages; i++)
+  while (graph->nPlans != 0)
   {
-    vkDestroyFramebuffer(ren->dev, ren->graph.swapFbs[i], ren->allocCbs);
+    EvictPlan(graph, graph->nPlans - 1, false);
   }
 
   for (usize i = 0; i < graph->passes.elemsUsed; i++)
   {
-    Render_Graph_Pass *pass = VectorIdx(&graph->passes, i);
-    VectorDestroy(&pass->reads, graph->ren->alloc);
-    VectorDestroy(&pass->writes, graph->ren->alloc);
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->passes, i));
+
+    VectorDestroy(&pass->reads, ren->alloc);
+    VectorDestroy(&pass->writes, ren->alloc);
+    FREE(ren->alloc, pass, Render_Graph_Pass, MEMORY_TAG_RENDERER);
   }
 
-  VectorDestroy(&graph->passes, graph->ren->alloc);
-  VectorDestroy(&graph->bakedPasses, graph->ren->alloc);
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    FREE(ren->alloc, tex, Render_Graph_Texture, MEMORY_TAG_RENDERER);
+  }
 
-  FREE_ARR(ren->alloc, ren->graph.swapFbs, VkFramebuffer, ren->swapchain.nImages, 
-      MEMORY_TAG_RENDERER);
+  VectorDestroy(&graph->passes, ren->alloc);
+  VectorDestroy(&graph->bakedPasses, ren->alloc);
+  VectorDestroy(&graph->textures, ren->alloc);
+  VectorDestroy(&graph->key, ren->alloc);
+  VectorDestroy(&graph->barriers, ren->alloc);
+  VectorDestroy(&graph->memories, ren->alloc);
+  VectorDestroy(&graph->releases, ren->alloc);
 }
 
 
@@ -147,85 +318,364 @@ RenderGraphWriteTexture(Render_Graph *graph,
                         Render_Graph_Pass *pass,
                         Render_Graph_Texture *tex)
 {
+  if (pass->writes.elemsUsed == MAX_PASS_ATTACHMENTS)
+  {
+    return ERR_INVALID_USAGE;
+  }
+
   VectorPush(&pass->writes, graph->ren->alloc, &tex);
+  graph->dirty = true;
+  return ERR_OK;
+}
+
+Err_Code 
+RenderGraphReadTexture(Render_Graph *graph, 
+                       Render_Graph_Pass *pass,
+                       Render_Graph_Texture *tex)
+{
+  if (pass->reads.elemsUsed == MAX_PASS_ATTACHMENTS)
+  {
+    return ERR_INVALID_USAGE;
+  }
 
-  Rebake(graph);
+  VectorPush(&pass->reads, graph->ren->alloc, &tex);
+  graph->dirty = true;
   return ERR_OK;
 }
 
-void 
+Err_Code
+RenderGraphImportTexture(Render_Graph *graph,
+                         VkFormat format,
+                         bool isDepth,
+                         VkImage image,
+                         VkImageView view,
+                         VkExtent2D extent,
+                         Render_Graph_Texture **texOut)
+{
+  Render_Graph_Texture *tex = NewTexture(graph, format, isDepth);
+
+  tex->image = image;
+  tex->view = view;
+  tex->extent = extent;
+
+  *texOut = tex;
+  return ERR_OK;
+}
+
+/* 
+ * Its image and memory are made when the graph is baked, once it is known
+ * which passes use it.
+ */
+Err_Code
+RenderGraphCreateTexture(Render_Graph *graph,
+                         VkFormat format,
+                         bool isDepth,
+                         VkExtent2D size,
+                         Render_Graph_Texture **texOut)
+{
+  Render_Graph_Texture *tex = NewTexture(graph, format, isDepth);
+
+  tex->isTransient = true;
+  tex->size = size;
+  graph->dirty = true;
+
+  *texOut = tex;
+  return ERR_OK;
+}
+
+void
+RenderGraphUpdateTexture(Render_Graph *graph,
+                         Render_Graph_Texture *tex,
+                         VkImage image,
+                         VkImageView view,
+                         VkExtent2D extent)
+{
+  tex->image = image;
+  tex->view = view;
+  tex->extent = extent;
+  graph->dirty = true;
+}
+
+void
+RenderGraphSetTextureSize(Render_Graph *graph,
+                          Render_Graph_Texture *tex,
+                          VkExtent2D size)
+{
+  tex->size = size;
+  graph->dirty = true;
+}
+
+void
+RenderGraphSetPassEnabled(Render_Graph *graph,
+                          Render_Graph_Pass *pass,
+                          bool enabled)
+{
+  if (pass->disabled == !enabled)
+  {
+    return;
+  }
+
+  pass->disabled = !enabled;
+  graph->dirty = true;
+}
+
+void
+RenderGraphSetPassCompute(Render_Graph *graph,
+                          Render_Graph_Pass *pass,
+                          bool compute)
+{
+  pass->compute = compute;
+  graph->dirty = true;
+}
+
+/* Until both queues finish it, the frame's command buffers may be in use. */
+Err_Code
+RenderGraphWaitFrame(Render_Graph *graph)
+{
+  return WaitTimelines(graph, graph->frameValues[graph->ren->currentFrame]);
+}
+
+Err_Code
+RenderGraphWaitLast(Render_Graph *graph)
+{
+  return WaitTimelines(graph, graph->frameEndValues);
+}
+
+/*
+ * Each batch goes into its own command buffer, pass by pass in topological
+ * order.  Passes with a chunkFn and enough work are split into 
+ * chunks recorded in parallel into secondary command buffers, which the pass 
+ * then executes.
+ */
+Err_Code 
 RenderGraphRecord(Render_Graph *graph,
                   u32 imageIndex)
 {
   Renderer *ren = graph->ren;
-  Technique *tech = TechniqueManagerLookup(&ren->techs, STRING_CSTR("tri"));
-  VkCommandBuffer buf = graph->commandBuffers[ren->currentFrame];
-
+  f64 startTime = PlatGetTime();
+  Render_Graph_Plan *plan;
+  Err_Code err;
   VkResult vkErr;
 
-  for (usize i = 0; i < graph->bakedPasses.elemsUsed; i++)
+  graph->frame++;
+  if (graph->dirty)
   {
-    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
-        VectorIdx(&graph->bakedPasses, i));
-
-    VkCommandBufferBeginInfo beginInfo =
+    err = SelectPlan(graph);
+    if (err)
     {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    };
+      return err;
+    }
+  }
+
+  plan = graph->plan;
+  plan->lastUsed = graph->frame;
+
+  MemorySet(&graph->stats, 0, sizeof(graph->stats));
+  graph->stats.nThreads = graph->nThreads;
+  graph->stats.nPasses = plan->nDeclared;
+  graph->stats.nLivePasses = plan->passes.elemsUsed;
+  graph->stats.nRenderPasses = plan->nRenderPasses;
+  ResetThreadPools(graph);
+
+  VkCommandBufferBeginInfo beginInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    VkCommandBuffer buf = 
+      graph->commandBuffers[plan->batches[i].queue][ren->currentFrame][i];
 
     vkErr = vkBeginCommandBuffer(buf, &beginInfo);
     if (vkErr)
     {
       LOG_ERROR("failed to begin command buffer");
-      return;
+      return ERR_LIBRARY_FAILURE;
     }
 
-    VkClearValue clearValues[2] = {
-      {{{0.0f, 0.0f, 0.0f, 1.0f}}},
-      {1.0f, 0},
-    };
+    RecordBatch(graph, plan, i, buf, imageIndex);
 
-    VkRenderPassBeginInfo renderPassInfo =
+    vkErr = vkEndCommandBuffer(buf);
+    if (vkErr)
     {
-      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-      .renderPass = tech->fakePass,
-      .framebuffer = graph->swapFbs[imageIndex],
-      .renderArea =
-        {
-          .offset = {0, 0},
-          .extent = ren->swapchain.extent,
-        },
-      .clearValueCount = 2,
-      .pClearValues = clearValues,
+      LOG_ERROR("failed to end command buffer");
+      return ERR_LIBRARY_FAILURE;
+    }
+  }
+
+  graph->stats.recordTime = PlatGetTime() - startTime;
+  return ERR_OK;
+}
+
+/* 
+ * Batches go in the plan's order, so every batch is submitted after those
+ * it waits for.  Each queue's first batch also waits for the other queue's 
+ * last frame, since both use the same transient images.
+ */
+Err_Code
+RenderGraphSubmit(Render_Graph *graph,
+                  VkCommandBuffer first,
+                  VkCommandBuffer last)
+{
+  Renderer *ren = graph->ren;
+  Render_Graph_Plan *plan = graph->plan;
+  u32 frame = ren->currentFrame;
+  u64 values[MAX_RENDER_GRAPH_BATCHES];
+  i32 lastBatches[RENDER_GRAPH_QUEUE_COUNT] = {-1, -1};
+  bool started[RENDER_GRAPH_QUEUE_COUNT] = {false, false};
+  VkResult vkErr;
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    lastBatches[plan->batches[i].queue] = i;
+  }
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    Render_Graph_Batch *batch = &plan->batches[i];
+    Render_Graph_Queue queue = batch->queue;
+    Render_Graph_Queue other = queue == RENDER_GRAPH_QUEUE_GRAPHICS 
+      ? RENDER_GRAPH_QUEUE_COMPUTE : RENDER_GRAPH_QUEUE_GRAPHICS;
+    VkSemaphoreSubmitInfo waits[2], signals[2];
+    VkCommandBufferSubmitInfo cmds[3];
+    u32 nWaits = 0, nSignals = 0, nCmds = 0;
+    u64 waitValue = batch->wait >= 0 ? values[batch->wait] : 0;
+
+    if (!started[queue])
+    {
+      started[queue] = true;
+      if (graph->frameEndValues[other] > waitValue)
+      {
+        waitValue = graph->frameEndValues[other];
+      }
+    }
+
+    if (waitValue != 0)
+    {
+      waits[nWaits++] = (VkSemaphoreSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = graph->timelines[other],
+        .value = waitValue,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+      };
+    }
+
+    if (i == plan->acquireBatch && !ren->headless)
+    {
+      waits[nWaits++] = (VkSemaphoreSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = graph->imageAvailableSemaphores[frame],
+        .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+      };
+    }
+
+    /* Work recorded outside the graph runs before any of it. */
+    if (first != VK_NULL_HANDLE && queue == RENDER_GRAPH_QUEUE_GRAPHICS)
+    {
+      cmds[nCmds++] = (VkCommandBufferSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+        .commandBuffer = first,
+      };
+      first = VK_NULL_HANDLE;
+    }
+
+    cmds[nCmds++] = (VkCommandBufferSubmitInfo)
+    {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+      .commandBuffer = graph->commandBuffers[queue][frame][i],
     };
 
-    vkCmdBeginRenderPass(buf, &renderPassInfo, 
-        VK_SUBPASS_CONTENTS_INLINE);
+    /* And work recorded after it runs once all of it is done. */
+    if (last != VK_NULL_HANDLE 
+        && (i32) i == lastBatches[RENDER_GRAPH_QUEUE_GRAPHICS])
+    {
+      cmds[nCmds++] = (VkCommandBufferSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+        .commandBuffer = last,
+      };
+    }
 
-    pass->fn(graph->ren, buf);
+    values[i] = 0;
+    if (batch->signals || (i32) i == lastBatches[queue])
+    {
+      values[i] = ++graph->timelineValues[queue];
+      signals[nSignals++] = (VkSemaphoreSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = graph->timelines[queue],
+        .value = values[i],
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+      };
+    }
+
+    if ((i32) i == lastBatches[RENDER_GRAPH_QUEUE_GRAPHICS] && !ren->headless)
+    {
+      signals[nSignals++] = (VkSemaphoreSubmitInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = graph->renderFinishedSemaphores[frame],
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+      };
+    }
+
+    VkSubmitInfo2 submitInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+      .waitSemaphoreInfoCount = nWaits,
+      .pWaitSemaphoreInfos = waits,
+      .commandBufferInfoCount = nCmds,
+      .pCommandBufferInfos = cmds,
+      .signalSemaphoreInfoCount = nSignals,
+      .pSignalSemaphoreInfos = signals,
+    };
 
-    vkCmdEndRenderPass(buf);
+    vkErr = vkQueueSubmit2(queue == RENDER_GRAPH_QUEUE_GRAPHICS 
+        ? ren->graphicsQueue : ren->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (vkErr)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+  }
 
-    vkEndCommandBuffer(buf);
+  for (u32 i = 0; i < RENDER_GRAPH_QUEUE_COUNT; i++)
+  {
+    graph->frameValues[frame][i] = 0;
+    if (lastBatches[i] >= 0)
+    {
+      graph->frameEndValues[i] = values[lastBatches[i]];
+      graph->frameValues[frame][i] = values[lastBatches[i]];
+    }
   }
+
+  return ERR_OK;
 }
 
+/* 
+ * The device is idle, so plans holding the old swapchain's views can go right
+ * away.  Plans which don't touch the swapchain are kept.
+ */
 Err_Code
 RenderGraphRebuild(Render_Graph *graph)
 {
-  Err_Code err;
   Renderer *ren = graph->ren;
 
-  for (usize i = 0; i < ren->swapchain.nImages; i++)
+  for (u32 i = graph->nPlans; i > 0; i--)
   {
-    vkDestroyFramebuffer(ren->dev, graph->swapFbs[i], ren->allocCbs);
-  }
-  err = CreateSwapchainFramebuffers(graph);
-  LOG_DEBUG("here");
-  if (err)
-  {
-    return err;
+    if (graph->plans[i - 1]->usesSwapchain)
+    {
+      EvictPlan(graph, i - 1, false);
+    }
   }
+
+  graph->swap.format = ren->swapchain.format.format;
+  graph->swap.extent = ren->swapchain.extent;
+  graph->dirty = true;
   return ERR_OK;
 }
 
@@ -239,82 +689,462 @@ Err_Code
 RenderGraphCreatePass(Render_Graph *graph, 
                       Render_Graph_Pass **passOut)
 {
-  Render_Graph_Pass pass = 
-  {
-    .writes = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Texture *),
-    .reads = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Texture *),
-  };
+  Render_Graph_Pass *pass = NEW(graph->ren->alloc, Render_Graph_Pass, 
+      MEMORY_TAG_RENDERER);
+
+  MemorySet(pass, 0, sizeof(*pass));
+  pass->writes = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Texture *);
+  pass->reads = VECTOR_CREATE(graph->ren->alloc, Render_Graph_Texture *);
+  pass->idx = graph->passes.elemsUsed;
+
+  VectorPush(&graph->passes, graph->ren->alloc, &pass);
+  graph->dirty = true;
 
-  *passOut = VectorPush(&graph->passes, graph->ren->alloc, &pass);
+  *passOut = pass;
   return ERR_OK;
 }
 
 /* === PRIVATE FUNCTIONS === */
 
-static Err_Code 
-CreateSwapchainFramebuffers(Render_Graph *graph)
+/* 
+ * Reuses the cached plan for the graph's topology, or compiles one, evicting
+ * the least recently used plan if the cache is full.
+ */
+static Err_Code
+SelectPlan(Render_Graph *graph)
 {
-  VkResult vkErr;
-  Technique *tech;
   Renderer *ren = graph->ren;
+  Render_Graph_Plan *plan, *prev = graph->plan;
+  u64 hash = BuildKey(graph);
+  u32 lru = 0;
+  Err_Code err;
 
-  tech = TechniqueManagerLookup(&ren->techs, STRING_CSTR("tri"));
-  for (usize i = 0; i < ren->swapchain.nImages; i++)
+  for (u32 i = 0; i < graph->nPlans; i++)
   {
-    VkImageView attachments[] =
+    plan = graph->plans[i];
+    if (plan->hash == hash && KeysEqual(&plan->key, &graph->key))
     {
-      ren->swapchain.imageViews[i],
-      ren->depthView,
-    };
+      LOG_DEBUG_FMT("reusing render graph plan %016llx", 
+          (unsigned long long) hash);
+      ActivatePlan(graph, plan);
+      graph->dirty = false;
+      return ERR_OK;
+    }
 
-    VkFramebufferCreateInfo framebufferInfo = 
+    if (plan->lastUsed < graph->plans[lru]->lastUsed)
     {
-      .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-      .renderPass = tech->fakePass,
-      .attachmentCount = 2,
-      .pAttachments = attachments,
-      .width = ren->swapchain.extent.width,
-      .height = ren->swapchain.extent.height,
-      .layers = 1,
-    };
+      lru = i;
+    }
+  }
 
-    vkErr = vkCreateFramebuffer(ren->dev, &framebufferInfo, ren->allocCbs, 
-        &graph->swapFbs[i]);
-    if (vkErr)
+  if (graph->nPlans == MAX_RENDER_GRAPH_PLANS)
+  {
+    if (graph->plans[lru] == prev)
     {
-      return ERR_LIBRARY_FAILURE;
+      prev = NULL;
     }
+    EvictPlan(graph, lru, true);
   }
 
-  return ERR_OK;
-}
-
-static Err_Code 
-Rebake(Render_Graph *graph)
-{
-  graph->bakedPasses.elemsUsed = 0;
+  plan = NEW(ren->alloc, Render_Graph_Plan, MEMORY_TAG_RENDERER);
+  MemorySet(plan, 0, sizeof(*plan));
+  plan->hash = hash;
+  plan->key = VECTOR_CREATE(ren->alloc, u64);
+  plan->passes = VECTOR_CREATE(ren->alloc, Render_Graph_Plan_Pass);
+  plan->barriers = VECTOR_CREATE(ren->alloc, Render_Graph_Barrier);
+  plan->textures = VECTOR_CREATE(ren->alloc, Render_Graph_Plan_Texture);
+  plan->memories = VECTOR_CREATE(ren->alloc, Render_Graph_Memory);
 
-  for (usize i = 0; i < graph->passes.elemsUsed; i++)
+  for (usize i = 0; i < graph->key.elemsUsed; i++)
   {
-    Render_Graph_Pass *pass = VectorIdx(&graph->passes, i);
-    pass->mark = MARK_NONE;
+    VectorPush(&plan->key, ren->alloc, VectorIdx(&graph->key, i));
   }
 
-  for (usize i = 0; i < graph->passes.elemsUsed; i++)
+  PROFILE_ZONE("compile render graph")
   {
-    Render_Graph_Pass *pass = VectorIdx(&graph->passes, i);
-    TopoSortVisit(graph, pass);
+    err = CompilePlan(graph, plan);
   }
-
-  for (usize i = 0; i < graph->bakedPasses.elemsUsed; i++)
+  if (err)
   {
-    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
-        VectorIdx(&graph->bakedPasses, i));
-  }
-
+    ReleasePlan(graph, plan, true);
+    /* Compiling left the transients pointing at the failed plan's objects. */
+    if (prev != NULL)
+    {
+      ActivatePlan(graph, prev);
+    }
+    return err;
+  }
+
+  LOG_DEBUG_FMT("compiled render graph plan %016llx: %u passes, %u barriers", 
+      (unsigned long long) hash, (u32) plan->passes.elemsUsed, 
+      (u32) plan->barriers.elemsUsed);
+
+  graph->plans[graph->nPlans++] = plan;
+  ActivatePlan(graph, plan);
+  graph->dirty = false;
+  return ERR_OK;
+}
+
+/* 
+ * Serializes everything a plan is compiled from into graph->key, and returns
+ * its FNV-1a hash.
+ */
+static u64
+BuildKey(Render_Graph *graph)
+{
+  Renderer *ren = graph->ren;
+  u64 hash = 0xcbf29ce484222325ULL;
+  u8 *bytes;
+
+  graph->key.elemsUsed = 0;
+
+  KeyPush(graph, (u64) graph->swap.format);
+  KeyPush(graph, graph->swap.extent.width);
+  KeyPush(graph, graph->swap.extent.height);
+  KeyPush(graph, ren->swapchain.nImages);
+
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    KeyPush(graph, (u64) tex->format);
+    KeyPush(graph, tex->isDepth | tex->isTransient << 1);
+    if (tex->isTransient)
+    {
+      KeyPush(graph, tex->size.width);
+      KeyPush(graph, tex->size.height);
+    } else
+    {
+      KeyPushHandle(graph, &tex->image, sizeof(tex->image));
+      KeyPushHandle(graph, &tex->view, sizeof(tex->view));
+      KeyPush(graph, tex->extent.width);
+      KeyPush(graph, tex->extent.height);
+    }
+  }
+
+  for (usize i = 0; i < graph->passes.elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->passes, i));
+
+    if (pass->disabled)
+    {
+      continue;
+    }
+
+    KeyPush(graph, pass->idx | (u64) pass->compute << 32);
+    KeyPush(graph, pass->writes.elemsUsed);
+    for (usize j = 0; j < pass->writes.elemsUsed; j++)
+    {
+      KeyPush(graph, (u64) (usize) 
+          *((Render_Graph_Texture **) VectorIdx(&pass->writes, j)));
+    }
+
+    KeyPush(graph, pass->reads.elemsUsed);
+    for (usize j = 0; j < pass->reads.elemsUsed; j++)
+    {
+      KeyPush(graph, (u64) (usize) 
+          *((Render_Graph_Texture **) VectorIdx(&pass->reads, j)));
+    }
+  }
+
+  bytes = graph->key.buf;
+  for (usize i = 0; i < graph->key.elemsUsed * sizeof(u64); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+static void
+KeyPush(Render_Graph *graph,
+        u64 word)
+{
+  VectorPush(&graph->key, graph->ren->alloc, &word);
+}
+
+/* Non-dispatchable handles are 64 bit integers on some platforms. */
+static void
+KeyPushHandle(Render_Graph *graph,
+              const void *handle,
+              usize size)
+{
+  u64 word = 0;
+
+  MemoryCopy(&word, handle, size);
+  KeyPush(graph, word);
+}
+
+static bool
+KeysEqual(Vector *a,
+          Vector *b)
+{
+  if (a->elemsUsed != b->elemsUsed)
+  {
+    return false;
+  }
+
+  for (usize i = 0; i < a->elemsUsed; i++)
+  {
+    if (*((u64 *) VectorIdx(a, i)) != *((u64 *) VectorIdx(b, i)))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Points the transient textures at the plan's objects. */
+static void
+ActivatePlan(Render_Graph *graph,
+             Render_Graph_Plan *plan)
+{
+  DetachTransients(graph);
+
+  for (usize i = 0; i < plan->textures.elemsUsed; i++)
+  {
+    Render_Graph_Plan_Texture *planTex = VectorIdx(&plan->textures, i);
+
+    planTex->tex->image = planTex->image;
+    planTex->tex->view = planTex->view;
+    planTex->tex->memory = planTex->memory;
+  }
+
+  graph->plan = plan;
+}
+
+static Err_Code 
+CompilePlan(Render_Graph *graph,
+            Render_Graph_Plan *plan)
+{
+  Err_Code err;
+  Render_Graph_Barrier *final;
+  Vector tmp;
+
+  graph->bakedPasses.elemsUsed = 0;
+  graph->barriers.elemsUsed = 0;
+  graph->memories.elemsUsed = 0;
+
+  for (usize i = 0; i < graph->passes.elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->passes, i));
+    pass->mark = MARK_NONE;
+  }
+
+  for (usize i = 0; i < graph->passes.elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->passes, i));
+
+    if (pass->disabled)
+    {
+      continue;
+    }
+
+    err = TopoSortVisit(graph, pass);
+    if (err)
+    {
+      LOG_ERROR("render graph has a cycle");
+      return err;
+    }
+  }
+
+  plan->nDeclared = graph->bakedPasses.elemsUsed;
+  CullPasses(graph);
+
+  err = ScheduleBatches(graph, plan, graph->asyncCompute);
+  if (err == ERR_NO_MEM)
+  {
+    LOG_WARN("render graph needs too many batches, not using async compute");
+    err = ScheduleBatches(graph, plan, false);
+  }
+  if (err)
+  {
+    return err;
+  }
+
+  /* The previous plan keeps its objects, these get new ones. */
+  DetachTransients(graph);
+  ComputeLifetimes(graph, plan);
+  err = CreateTransients(graph);
+  TakeTransients(graph, plan);
+  if (err)
+  {
+    return err;
+  }
+
+  /* Nothing has been used at the start of the frame. */
+  ResetBakeState(&graph->swap);
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    ResetBakeState(*((Render_Graph_Texture **) 
+          VectorIdx(&graph->textures, i)));
+  }
+
+  graph->releases.elemsUsed = 0;
+  plan->acquireBatch = NO_BATCH;
+  for (usize i = 0; i < plan->passes.elemsUsed; i++)
+  {
+    Render_Graph_Plan_Pass *planPass = VectorIdx(&plan->passes, i);
+
+    err = BakePass(graph, i, planPass);
+    if (err)
+    {
+      return err;
+    }
+
+    if (i > 0)
+    {
+      TryMergePass(graph, VectorIdx(&plan->passes, i - 1), planPass);
+    }
+
+    if (plan->acquireBatch == NO_BATCH 
+        && graph->swap.bakeLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+    {
+      plan->acquireBatch = planPass->batch;
+    }
+  }
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    Render_Graph_Batch *batch = &plan->batches[i];
+
+    batch->firstBarrier = graph->barriers.elemsUsed;
+    for (usize j = 0; j < graph->releases.elemsUsed; j++)
+    {
+      Render_Graph_Release *release = VectorIdx(&graph->releases, j);
+
+      if (release->batch == i)
+      {
+        VectorPush(&graph->barriers, graph->ren->alloc, &release->release);
+      }
+    }
+    batch->nBarriers = graph->barriers.elemsUsed - batch->firstBarrier;
+
+    /* The image must still be acquired if no pass uses it. */
+    if (plan->acquireBatch == NO_BATCH 
+        && batch->queue == RENDER_GRAPH_QUEUE_GRAPHICS)
+    {
+      plan->acquireBatch = i;
+    }
+  }
+
+  /* Store ops depend on where each run of merged passes ends. */
+  for (usize i = 0, end; i < plan->passes.elemsUsed; i = end)
+  {
+    Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, i);
+
+    for (end = i + 1; end < plan->passes.elemsUsed; end++)
+    {
+      if (!((Render_Graph_Plan_Pass *) VectorIdx(&plan->passes, end))->merged)
+      {
+        break;
+      }
+    }
+
+    if (baked->nAttachments == 0)
+    {
+      continue;
+    }
+
+    err = CreatePassObjects(graph, plan, i, end);
+    if (err)
+    {
+      return err;
+    }
+    plan->usesSwapchain |= baked->nFbs > 1;
+    plan->nRenderPasses++;
+  }
+
+  LOG_DEBUG_FMT("render graph: %u passes, %u after culling, %u render "
+      "passes after merging, in %u batches", plan->nDeclared, 
+      (u32) plan->passes.elemsUsed, plan->nRenderPasses, plan->nBatches);
+
+  /* 
+   * Present waits on a semaphore, which needs no destination stage.  
+   * Headless frames are copied out for readback instead.
+   */
+  plan->firstFinalBarrier = graph->barriers.elemsUsed;
+  plan->nFinalBarriers = 0;
+  if (graph->swap.bakeLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+  {
+    final = graph->ren->headless
+      ? PushBarrier(graph, &graph->swap, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 
+          VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT)
+      : PushBarrier(graph, &graph->swap, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 
+          VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+    final->barrier.srcStageMask |= graph->swap.readStages;
+    plan->nFinalBarriers = 1;
+  }
+
+  /* The plan keeps the scratch barriers, and the graph its empty vector. */
+  tmp = plan->barriers;
+  plan->barriers = graph->barriers;
+  graph->barriers = tmp;
   return ERR_OK;
 }
 
+/* 
+ * Hands the transient objects CreateTransients made over to the plan, even
+ * if it failed part way, so they're released with it.
+ */
+static void
+TakeTransients(Render_Graph *graph,
+               Render_Graph_Plan *plan)
+{
+  Vector tmp;
+
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+    Render_Graph_Plan_Texture planTex = 
+    {
+      .tex = tex,
+      .image = tex->image,
+      .view = tex->view,
+      .memory = tex->memory,
+    };
+
+    if (tex->isTransient && tex->image != VK_NULL_HANDLE)
+    {
+      VectorPush(&plan->textures, graph->ren->alloc, &planTex);
+    }
+  }
+
+  tmp = plan->memories;
+  plan->memories = graph->memories;
+  graph->memories = tmp;
+}
+
+/* Transient textures belong to whichever plan is active. */
+static void
+DetachTransients(Render_Graph *graph)
+{
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    if (tex->isTransient)
+    {
+      tex->image = VK_NULL_HANDLE;
+      tex->view = VK_NULL_HANDLE;
+      tex->memory = VK_NULL_HANDLE;
+      tex->aliasPrev = NULL;
+    }
+  }
+}
+
+/*
+ * Readers come after every writer of what they read, and writers of the same
+ * texture stay in the order they were created.
+ */
 static Err_Code
 TopoSortVisit(Render_Graph *graph, Render_Graph_Pass *pass)
 {
@@ -336,27 +1166,1786 @@ TopoSortVisit(Render_Graph *graph, Render_Graph_Pass *pass)
     Render_Graph_Texture *read = *((Render_Graph_Texture **) 
         VectorIdx(&pass->reads, i));
 
-    for (usize j = 0; j < graph->passes.elemsUsed; j++)
+    err = VisitWriters(graph, read, graph->passes.elemsUsed);
+    if (err)
+    {
+      return err;
+    }
+  }
+
+  for (usize i = 0; i < pass->writes.elemsUsed; i++)
+  {
+    Render_Graph_Texture *write = *((Render_Graph_Texture **) 
+        VectorIdx(&pass->writes, i));
+
+    err = VisitWriters(graph, write, pass->idx);
+    if (err)
+    {
+      return err;
+    }
+  }
+
+  pass->mark = MARK_PERM;
+  VectorPush(&graph->bakedPasses, graph->ren->alloc, &pass);
+  return ERR_OK;
+}
+
+/* Visits the passes created before 'before' which write tex. */
+static Err_Code
+VisitWriters(Render_Graph *graph,
+             Render_Graph_Texture *tex,
+             usize before)
+{
+  Err_Code err;
+
+  for (usize i = 0; i < before; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->passes, i));
+
+    if (pass->disabled)
+    {
+      continue;
+    }
+
+    for (usize j = 0; j < pass->writes.elemsUsed; j++)
     {
-      Render_Graph_Pass *tmpPass = VectorIdx(&graph->passes, j);
-      for (usize k = 0; k < tmpPass->writes.elemsUsed; k++)
+      if (*((Render_Graph_Texture **) VectorIdx(&pass->writes, j)) == tex)
       {
-        Render_Graph_Texture *write = *((Render_Graph_Texture **) 
-            VectorIdx(&tmpPass->writes, k));
-        if (write == read)
+        err = TopoSortVisit(graph, pass);
+        if (err)
         {
-          err = TopoSortVisit(graph, tmpPass);
-          if (err)
-          {
-            return err;
-          }
+          return err;
         }
+        break;
       }
-      
     }
   }
 
-  pass->mark = MARK_PERM;
-  VectorPush(&graph->bakedPasses, graph->ren->alloc, &pass);
   return ERR_OK;
 }
+
+/* 
+ * Drops baked passes whose writes nothing kept reads.  The swapchain and
+ * imported textures are read outside the graph, and passes which write no
+ * textures have effects the graph can't see, so those are always kept.  A
+ * kept pass needs every earlier write to what it writes too, since it loads
+ * rather than clears them.
+ */
+static void
+CullPasses(Render_Graph *graph)
+{
+  usize nKept = 0;
+
+  graph->swap.needed = true;
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+    tex->needed = !tex->isTransient;
+  }
+
+  for (usize i = graph->bakedPasses.elemsUsed; i > 0; i--)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->bakedPasses, i - 1));
+    bool keep = pass->writes.elemsUsed == 0;
+
+    for (usize j = 0; j < pass->writes.elemsUsed && !keep; j++)
+    {
+      keep = (*((Render_Graph_Texture **) VectorIdx(&pass->writes, j)))->needed;
+    }
+
+    /* Culled passes are marked so the kept ones can be compacted after. */
+    pass->mark = keep ? MARK_PERM : MARK_NONE;
+    if (!keep)
+    {
+      continue;
+    }
+
+    nKept++;
+    for (usize j = 0; j < pass->reads.elemsUsed; j++)
+    {
+      (*((Render_Graph_Texture **) VectorIdx(&pass->reads, j)))->needed = true;
+    }
+  }
+
+  for (usize i = 0, kept = 0; i < graph->bakedPasses.elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->bakedPasses, i));
+
+    if (pass->mark == MARK_PERM)
+    {
+      *((Render_Graph_Pass **) VectorIdx(&graph->bakedPasses, kept++)) = pass;
+    }
+  }
+  graph->bakedPasses.elemsUsed = nKept;
+}
+
+/* 
+ * Splits the culled passes into batches, one queue's passes each, and pushes
+ * them into plan->passes in submission order.  A pass which uses a texture 
+ * last used on the other queue waits for the batch which used it, which ends
+ * there, and starts a new batch unless its own already waits for as much.
+ * Fails with ERR_NO_MEM if that takes more than MAX_RENDER_GRAPH_BATCHES.
+ */
+static Err_Code
+ScheduleBatches(Render_Graph *graph,
+                Render_Graph_Plan *plan,
+                bool async)
+{
+  Renderer *ren = graph->ren;
+  usize nPasses = graph->bakedPasses.elemsUsed;
+  i32 open[RENDER_GRAPH_QUEUE_COUNT] = {-1, -1};
+  u32 *passBatches, *lastPasses;
+  Err_Code err = ERR_OK;
+
+  plan->nBatches = 0;
+  plan->passes.elemsUsed = 0;
+
+  graph->swap.bakeBatch = NO_BATCH;
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+    tex->bakeBatch = NO_BATCH;
+  }
+
+  passBatches = NEW_ARR(ren->alloc, u32, nPasses + 1, MEMORY_TAG_ARRAY);
+  lastPasses = NEW_ARR(ren->alloc, u32, MAX_RENDER_GRAPH_BATCHES, 
+      MEMORY_TAG_ARRAY);
+
+  for (usize i = 0; i < nPasses; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->bakedPasses, i));
+    Render_Graph_Queue queue = pass->compute && async 
+      ? RENDER_GRAPH_QUEUE_COMPUTE : RENDER_GRAPH_QUEUE_GRAPHICS;
+    Render_Graph_Queue other = queue == RENDER_GRAPH_QUEUE_GRAPHICS 
+      ? RENDER_GRAPH_QUEUE_COMPUTE : RENDER_GRAPH_QUEUE_GRAPHICS;
+    Vector *uses[] = {&pass->reads, &pass->writes};
+    i32 wait = -1;
+
+    for (u32 j = 0; j < 2; j++)
+    {
+      for (usize k = 0; k < uses[j]->elemsUsed; k++)
+      {
+        Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+            VectorIdx(uses[j], k));
+
+        if (tex->bakeBatch != NO_BATCH 
+            && plan->batches[tex->bakeBatch].queue != queue
+            && (i32) tex->bakeBatch > wait)
+        {
+          wait = tex->bakeBatch;
+        }
+      }
+    }
+
+    if (wait >= 0)
+    {
+      plan->batches[wait].signals = true;
+      if (open[other] == wait)
+      {
+        open[other] = -1;
+      }
+      if (open[queue] >= 0 && plan->batches[open[queue]].wait < wait)
+      {
+        open[queue] = -1;
+      }
+    }
+
+    if (open[queue] < 0)
+    {
+      if (plan->nBatches == MAX_RENDER_GRAPH_BATCHES)
+      {
+        err = ERR_NO_MEM;
+        goto done;
+      }
+
+      open[queue] = plan->nBatches++;
+      plan->batches[open[queue]] = (Render_Graph_Batch)
+      {
+        .queue = queue,
+        .wait = wait,
+      };
+    }
+
+    passBatches[i] = open[queue];
+    lastPasses[open[queue]] = i;
+    plan->batches[open[queue]].nPasses++;
+
+    for (u32 j = 0; j < 2; j++)
+    {
+      for (usize k = 0; k < uses[j]->elemsUsed; k++)
+      {
+        (*((Render_Graph_Texture **) VectorIdx(uses[j], k)))->bakeBatch = 
+          open[queue];
+      }
+    }
+  }
+
+  /* The graphics queue always gets a batch, which presents the frame. */
+  if (open[RENDER_GRAPH_QUEUE_GRAPHICS] < 0)
+  {
+    bool found = false;
+
+    for (u32 i = 0; i < plan->nBatches; i++)
+    {
+      found |= plan->batches[i].queue == RENDER_GRAPH_QUEUE_GRAPHICS;
+    }
+
+    if (!found)
+    {
+      if (plan->nBatches == MAX_RENDER_GRAPH_BATCHES)
+      {
+        err = ERR_NO_MEM;
+        goto done;
+      }
+
+      plan->batches[plan->nBatches] = (Render_Graph_Batch)
+      {
+        .queue = RENDER_GRAPH_QUEUE_GRAPHICS,
+        .wait = plan->nBatches > 0 ? (i32) plan->nBatches - 1 : -1,
+      };
+      if (plan->nBatches > 0)
+      {
+        plan->batches[plan->nBatches - 1].signals = true;
+      }
+      lastPasses[plan->nBatches++] = nPasses;
+    }
+  }
+
+  OrderBatches(graph, plan, passBatches, lastPasses);
+
+done:
+  FREE_ARR(ren->alloc, passBatches, u32, nPasses + 1, MEMORY_TAG_ARRAY);
+  FREE_ARR(ren->alloc, lastPasses, u32, MAX_RENDER_GRAPH_BATCHES, 
+      MEMORY_TAG_ARRAY);
+  return err;
+}
+
+/* 
+ * Sorts the batches by their last pass, which puts every batch after the 
+ * ones it waits for, and lays out the passes and bakedPasses to match.
+ */
+static void
+OrderBatches(Render_Graph *graph,
+             Render_Graph_Plan *plan,
+             u32 *passBatches,
+             u32 *lastPasses)
+{
+  Render_Graph_Batch sorted[MAX_RENDER_GRAPH_BATCHES];
+  u32 order[MAX_RENDER_GRAPH_BATCHES], remap[MAX_RENDER_GRAPH_BATCHES];
+  usize nPasses = graph->bakedPasses.elemsUsed;
+  u32 j;
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    for (j = i; j > 0 && lastPasses[order[j - 1]] > lastPasses[i]; j--)
+    {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    remap[order[i]] = i;
+  }
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    sorted[i] = plan->batches[order[i]];
+    if (sorted[i].wait >= 0)
+    {
+      sorted[i].wait = remap[sorted[i].wait];
+    }
+    sorted[i].firstPass = plan->passes.elemsUsed;
+
+    for (usize k = 0; k < nPasses; k++)
+    {
+      Render_Graph_Plan_Pass baked = 
+      {
+        .pass = *((Render_Graph_Pass **) VectorIdx(&graph->bakedPasses, k)),
+        .queue = sorted[i].queue,
+        .batch = i,
+      };
+
+      if (passBatches[k] == order[i])
+      {
+        VectorPush(&plan->passes, graph->ren->alloc, &baked);
+      }
+    }
+  }
+
+  for (u32 i = 0; i < plan->nBatches; i++)
+  {
+    plan->batches[i] = sorted[i];
+  }
+
+  for (usize i = 0; i < nPasses; i++)
+  {
+    Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, i);
+    *((Render_Graph_Pass **) VectorIdx(&graph->bakedPasses, i)) = baked->pass;
+  }
+}
+
+static u32
+QueueFamily(Render_Graph *graph,
+            Render_Graph_Queue queue)
+{
+  return queue == RENDER_GRAPH_QUEUE_GRAPHICS 
+    ? graph->ren->queueInfo.graphicsFamily 
+    : graph->ren->queueInfo.computeFamily;
+}
+
+static void
+ResetBakeState(Render_Graph_Texture *tex)
+{
+  tex->bakeLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  tex->writeStages = 0;
+  tex->readStages = 0;
+  tex->writeAccess = 0;
+  tex->readBarrier = -1;
+  tex->bakeQueue = RENDER_GRAPH_QUEUE_GRAPHICS;
+  tex->bakeBatch = 0;
+}
+
+static Render_Graph_Texture *
+NewTexture(Render_Graph *graph,
+           VkFormat format,
+           bool isDepth)
+{
+  Render_Graph_Texture *tex = NEW(graph->ren->alloc, Render_Graph_Texture, 
+      MEMORY_TAG_RENDERER);
+
+  MemorySet(tex, 0, sizeof(*tex));
+  tex->isDepth = isDepth;
+  tex->format = format;
+  if (isDepth)
+  {
+    tex->clear.depthStencil.depth = 1.0f;
+  } else
+  {
+    tex->clear.color.float32[3] = 1.0f;
+  }
+
+  VectorPush(&graph->textures, graph->ren->alloc, &tex);
+  return tex;
+}
+
+/* 
+ * Finds which baked passes use each transient texture, and how.  Ones which
+ * never leave a single pass can live in lazily allocated memory.
+ */
+static void
+ComputeLifetimes(Render_Graph *graph,
+                 Render_Graph_Plan *plan)
+{
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    tex->firstUse = UINT32_MAX;
+    tex->lastUse = 0;
+    tex->usage = 0;
+    tex->useStages = 0;
+    tex->useWriteAccess = 0;
+    tex->usedAsync = false;
+  }
+
+  for (u32 i = 0; i < plan->passes.elemsUsed; i++)
+  {
+    Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, i);
+    Render_Graph_Pass *pass = baked->pass;
+    bool async = baked->queue == RENDER_GRAPH_QUEUE_COMPUTE;
+
+    for (usize j = 0; j < pass->writes.elemsUsed; j++)
+    {
+      Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+          VectorIdx(&pass->writes, j));
+
+      tex->firstUse = i < tex->firstUse ? i : tex->firstUse;
+      tex->lastUse = i > tex->lastUse ? i : tex->lastUse;
+      tex->usedAsync |= async;
+      if (pass->compute)
+      {
+        tex->usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        tex->useStages |= COMPUTE_STAGES;
+        tex->useWriteAccess |= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+      } else if (tex->isDepth)
+      {
+        tex->usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        tex->useStages |= DEPTH_STAGES;
+        tex->useWriteAccess |= VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      } else
+      {
+        tex->usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        tex->useStages |= COLOR_STAGES;
+        tex->useWriteAccess |= VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+      }
+    }
+
+    for (usize j = 0; j < pass->reads.elemsUsed; j++)
+    {
+      Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+          VectorIdx(&pass->reads, j));
+
+      tex->firstUse = i < tex->firstUse ? i : tex->firstUse;
+      tex->lastUse = i > tex->lastUse ? i : tex->lastUse;
+      tex->usedAsync |= async;
+      tex->usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+      tex->useStages |= pass->compute ? COMPUTE_STAGES : READ_STAGES;
+    }
+  }
+
+  for (usize i = 0; i < graph->textures.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    if (tex->firstUse == tex->lastUse && !(tex->usage 
+          & (VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT)))
+    {
+      tex->usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+  }
+}
+
+/*
+ * Makes images for the transient textures which are used.  Those which can 
+ * be lazily allocated get their own memory, if the device has such memory.  
+ * The rest share blocks with textures whose lifetimes don't overlap theirs.
+ */
+static Err_Code
+CreateTransients(Render_Graph *graph)
+{
+  Renderer *ren = graph->ren;
+  Render_Graph_Texture **aliased;
+  VkMemoryRequirements *reqs;
+  u32 *blocks;
+  u32 nAliased = 0, nLazy = 0;
+  usize nTextures = graph->textures.elemsUsed;
+  VkDeviceSize unaliasedSize = 0, aliasedSize = 0;
+  Err_Code err = ERR_OK;
+
+  if (nTextures == 0)
+  {
+    return ERR_OK;
+  }
+
+  aliased = NEW_ARR(ren->alloc, Render_Graph_Texture *, nTextures, 
+      MEMORY_TAG_ARRAY);
+  reqs = NEW_ARR(ren->alloc, VkMemoryRequirements, nTextures, 
+      MEMORY_TAG_ARRAY);
+  blocks = NEW_ARR(ren->alloc, u32, nTextures, MEMORY_TAG_ARRAY);
+
+  for (usize i = 0; i < nTextures; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+    VkMemoryRequirements texReqs;
+    u32 j;
+
+    if (!tex->isTransient || tex->firstUse > tex->lastUse)
+    {
+      continue;
+    }
+
+    err = CreateTransientImage(graph, tex, &texReqs);
+    if (err)
+    {
+      goto done;
+    }
+
+    if (tex->usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+    {
+      err = AllocateMemory(ren, &texReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT 
+          | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &tex->memory);
+      if (err == ERR_OK)
+      {
+        vkBindImageMemory(ren->dev, tex->image, tex->memory, 0);
+        nLazy++;
+        continue;
+      } else if (err != ERR_NO_SUITABLE_HARDWARE)
+      {
+        goto done;
+      }
+      err = ERR_OK;
+    }
+
+    /* 
+     * Aliasing barriers can't wait for the other queue, so textures used on
+     * the compute queue get memory of their own.
+     */
+    if (tex->usedAsync)
+    {
+      err = AllocateMemory(ren, &texReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          &tex->memory);
+      if (err)
+      {
+        goto done;
+      }
+      vkBindImageMemory(ren->dev, tex->image, tex->memory, 0);
+      continue;
+    }
+
+    /* Sorted by first use, so each block's last user is its latest. */
+    for (j = nAliased; j > 0 && aliased[j - 1]->firstUse > tex->firstUse; j--)
+    {
+      aliased[j] = aliased[j - 1];
+      reqs[j] = reqs[j - 1];
+    }
+    aliased[j] = tex;
+    reqs[j] = texReqs;
+    nAliased++;
+  }
+
+  for (u32 i = 0; i < nAliased; i++)
+  {
+    AliasTransient(graph, aliased[i], &reqs[i], &blocks[i]);
+    unaliasedSize += reqs[i].size;
+  }
+
+  for (usize i = 0; i < graph->memories.elemsUsed; i++)
+  {
+    Render_Graph_Memory *block = VectorIdx(&graph->memories, i);
+
+    /* The first user waits for the last one, from the previous frame. */
+    if (block->first != block->last)
+    {
+      block->first->aliasPrev = block->last;
+    }
+
+    err = AllocateMemory(ren, &block->reqs, 
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &block->memory);
+    if (err)
+    {
+      block->memory = VK_NULL_HANDLE;
+      goto done;
+    }
+    aliasedSize += block->reqs.size;
+  }
+
+  for (u32 i = 0; i < nAliased; i++)
+  {
+    Render_Graph_Memory *block = VectorIdx(&graph->memories, blocks[i]);
+    vkBindImageMemory(ren->dev, aliased[i]->image, block->memory, 0);
+  }
+
+  for (usize i = 0; i < nTextures; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&graph->textures, i));
+
+    if (tex->image == VK_NULL_HANDLE || !tex->isTransient)
+    {
+      continue;
+    }
+
+    err = CreateImageView(ren, tex->image, tex->format, tex->isDepth 
+        ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT, &tex->view);
+    if (err)
+    {
+      tex->view = VK_NULL_HANDLE;
+      goto done;
+    }
+  }
+
+  LOG_DEBUG_FMT("transient textures: %u lazily allocated, %llu bytes in %u "
+      "blocks, %llu without aliasing", nLazy, 
+      (unsigned long long) aliasedSize, (u32) graph->memories.elemsUsed,
+      (unsigned long long) unaliasedSize);
+
+done:
+  FREE_ARR(ren->alloc, aliased, Render_Graph_Texture *, nTextures, 
+      MEMORY_TAG_ARRAY);
+  FREE_ARR(ren->alloc, reqs, VkMemoryRequirements, nTextures, 
+      MEMORY_TAG_ARRAY);
+  FREE_ARR(ren->alloc, blocks, u32, nTextures, MEMORY_TAG_ARRAY);
+  return err;
+}
+
+static Err_Code
+CreateTransientImage(Render_Graph *graph,
+                     Render_Graph_Texture *tex,
+                     VkMemoryRequirements *reqsOut)
+{
+  Renderer *ren = graph->ren;
+  VkResult vkErr;
+
+  tex->extent = tex->size.width != 0 ? tex->size : ren->swapchain.extent;
+  tex->aliasPrev = NULL;
+
+  VkImageCreateInfo imageInfo = 
+  {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .extent = 
+    {
+      .width = tex->extent.width,
+      .height = tex->extent.height,
+      .depth = 1,
+    },
+    .mipLevels = 1,
+    .arrayLayers = 1,
+    .format = tex->format,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    .usage = tex->usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+  };
+
+  vkErr = vkCreateImage(ren->dev, &imageInfo, ren->allocCbs, &tex->image);
+  if (vkErr)
+  {
+    tex->image = VK_NULL_HANDLE;
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  vkGetImageMemoryRequirements(ren->dev, tex->image, reqsOut);
+  return ERR_OK;
+}
+
+/*
+ * Puts tex in a block whose last user is done before tex is first used,
+ * preferring the smallest one which is already large enough, then the 
+ * largest one, which then grows.  Makes a new block if none are free.
+ */
+static void
+AliasTransient(Render_Graph *graph,
+               Render_Graph_Texture *tex,
+               VkMemoryRequirements *reqs,
+               u32 *blockOut)
+{
+  Render_Graph_Memory *best = NULL;
+  u32 bestIdx = 0;
+
+  for (u32 i = 0; i < graph->memories.elemsUsed; i++)
+  {
+    Render_Graph_Memory *block = VectorIdx(&graph->memories, i);
+    bool fits, bestFits;
+
+    if (block->last->lastUse >= tex->firstUse 
+        || !(block->reqs.memoryTypeBits & reqs->memoryTypeBits))
+    {
+      continue;
+    }
+
+    if (best == NULL)
+    {
+      best = block;
+      bestIdx = i;
+      continue;
+    }
+
+    fits = block->reqs.size >= reqs->size;
+    bestFits = best->reqs.size >= reqs->size;
+    if ((fits && (!bestFits || block->reqs.size < best->reqs.size))
+        || (!fits && !bestFits && block->reqs.size > best->reqs.size))
+    {
+      best = block;
+      bestIdx = i;
+    }
+  }
+
+  if (best == NULL)
+  {
+    Render_Graph_Memory block = 
+    {
+      .reqs = *reqs,
+      .first = tex,
+      .last = tex,
+    };
+
+    VectorPush(&graph->memories, graph->ren->alloc, &block);
+    *blockOut = graph->memories.elemsUsed - 1;
+    return;
+  }
+
+  best->reqs.size = reqs->size > best->reqs.size ? reqs->size 
+    : best->reqs.size;
+  best->reqs.alignment = reqs->alignment > best->reqs.alignment 
+    ? reqs->alignment : best->reqs.alignment;
+  best->reqs.memoryTypeBits &= reqs->memoryTypeBits;
+  tex->aliasPrev = best->last;
+  best->last = tex;
+  *blockOut = bestIdx;
+}
+
+/* How baked passes after idx use tex. */
+static void
+FindLaterUses(Render_Graph *graph,
+              usize idx,
+              Render_Graph_Texture *tex,
+              bool *readLater,
+              bool *writtenLater)
+{
+  *readLater = false;
+  *writtenLater = false;
+
+  for (usize i = idx + 1; i < graph->bakedPasses.elemsUsed; i++)
+  {
+    Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+        VectorIdx(&graph->bakedPasses, i));
+
+    for (usize j = 0; j < pass->reads.elemsUsed; j++)
+    {
+      if (*((Render_Graph_Texture **) VectorIdx(&pass->reads, j)) == tex)
+      {
+        *readLater = true;
+      }
+    }
+
+    for (usize j = 0; j < pass->writes.elemsUsed; j++)
+    {
+      if (*((Render_Graph_Texture **) VectorIdx(&pass->writes, j)) == tex)
+      {
+        *writtenLater = true;
+      }
+    }
+  }
+}
+
+/*
+ * Picks the attachments of the idx'th baked pass, and makes the barriers 
+ * which go before it.  Color attachments come in the order they were 
+ * written, then depth.  The first writer of a texture clears it.  Layouts 
+ * only change in barriers, never inside the render pass.
+ */
+static Err_Code
+BakePass(Render_Graph *graph,
+         usize idx,
+         Render_Graph_Plan_Pass *baked)
+{
+  Renderer *ren = graph->ren;
+  Render_Graph_Pass *pass = *((Render_Graph_Pass **) 
+      VectorIdx(&graph->bakedPasses, idx));
+  Render_Graph_Texture *depth = NULL;
+
+  baked->firstBarrier = graph->barriers.elemsUsed;
+
+  for (usize i = 0; i < pass->reads.elemsUsed; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&pass->reads, i));
+
+    for (usize j = 0; j < pass->writes.elemsUsed; j++)
+    {
+      if (*((Render_Graph_Texture **) VectorIdx(&pass->writes, j)) == tex)
+      {
+        LOG_ERROR("render graph pass reads a texture it writes");
+        return ERR_INVALID_USAGE;
+      }
+    }
+
+    if (tex->bakeLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+    {
+      LOG_ERROR("render graph pass reads a texture no pass writes");
+      return ERR_INVALID_USAGE;
+    }
+
+    UseForRead(graph, baked, tex, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        pass->compute ? COMPUTE_STAGES : READ_STAGES, 
+        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+  }
+
+  /* Compute passes write storage images, outside of any render pass. */
+  for (usize i = 0; i < pass->writes.elemsUsed && pass->compute; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&pass->writes, i));
+
+    if (tex->isSwapchain)
+    {
+      LOG_ERROR("render graph compute pass writes the swapchain");
+      return ERR_INVALID_USAGE;
+    }
+
+    UseForWrite(graph, baked, tex, VK_IMAGE_LAYOUT_GENERAL, COMPUTE_STAGES,
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT, 
+        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+  }
+
+  for (usize i = 0; i < pass->writes.elemsUsed && !pass->compute; i++)
+  {
+    Render_Graph_Texture *tex = *((Render_Graph_Texture **) 
+        VectorIdx(&pass->writes, i));
+
+    if (!tex->isDepth)
+    {
+      baked->texs[baked->nColors++] = tex;
+    } else if (depth == NULL)
+    {
+      depth = tex;
+    } else
+    {
+      LOG_ERROR("render graph pass writes more than one depth texture");
+      return ERR_INVALID_USAGE;
+    }
+  }
+
+  baked->nAttachments = baked->nColors;
+  if (depth != NULL)
+  {
+    baked->texs[baked->nAttachments++] = depth;
+  }
+
+  for (u32 i = 0; i < baked->nAttachments; i++)
+  {
+    Render_Graph_Texture *tex = baked->texs[i];
+
+    baked->loadOps[i] = tex->bakeLayout == VK_IMAGE_LAYOUT_UNDEFINED 
+      ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    baked->clears[i] = tex->clear;
+
+    if (tex->isDepth)
+    {
+      UseForWrite(graph, baked, tex, 
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, DEPTH_STAGES, 
+          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 
+          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    } else
+    {
+      UseForWrite(graph, baked, tex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
+          COLOR_STAGES, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT, 
+          VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+    }
+  }
+
+  if (baked->nAttachments != 0)
+  {
+    baked->extent = baked->texs[0]->isSwapchain ? ren->swapchain.extent 
+      : baked->texs[0]->extent;
+  }
+
+  baked->nBarriers = graph->barriers.elemsUsed - baked->firstBarrier;
+  return ERR_OK;
+}
+
+/* 
+ * Pipelines are made against single subpass render passes, so a pass only
+ * merges into the one before it if it writes exactly the same attachments, 
+ * and then shares its subpass.  Draws in one subpass are already ordered on
+ * the attachments, so that is only possible if the only barriers the pass 
+ * needs are ones between writes to them.  Its contents then stay on chip 
+ * instead of being stored and loaded again.
+ */
+static void
+TryMergePass(Render_Graph *graph,
+             Render_Graph_Plan_Pass *prev,
+             Render_Graph_Plan_Pass *baked)
+{
+  if (baked->nAttachments == 0 || baked->nAttachments != prev->nAttachments
+      || baked->nColors != prev->nColors || baked->batch != prev->batch)
+  {
+    return;
+  }
+
+  for (u32 i = 0; i < baked->nAttachments; i++)
+  {
+    if (baked->texs[i] != prev->texs[i])
+    {
+      return;
+    }
+  }
+
+  for (u32 i = 0; i < baked->nBarriers; i++)
+  {
+    Render_Graph_Barrier *barrier = VectorIdx(&graph->barriers, 
+        baked->firstBarrier + i);
+    bool isAttachment = false;
+
+    for (u32 j = 0; j < baked->nAttachments; j++)
+    {
+      isAttachment |= barrier->tex == baked->texs[j];
+    }
+
+    if (!isAttachment 
+        || barrier->barrier.oldLayout != barrier->barrier.newLayout)
+    {
+      return;
+    }
+  }
+
+  /* Its barriers were the last pushed, so they can simply be dropped. */
+  graph->barriers.elemsUsed = baked->firstBarrier;
+  baked->nBarriers = 0;
+  baked->merged = true;
+}
+
+/* 
+ * Makes the render pass and framebuffers shared by the baked passes in 
+ * [first, end), which all write the same attachments.  An attachment is only
+ * stored if a later pass uses it or it is presented.
+ */
+static Err_Code
+CreatePassObjects(Render_Graph *graph,
+                  Render_Graph_Plan *plan,
+                  usize first,
+                  usize end)
+{
+  Renderer *ren = graph->ren;
+  Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, first);
+  VkAttachmentDescription attachments[MAX_PASS_ATTACHMENTS];
+  VkAttachmentReference colorRefs[MAX_PASS_ATTACHMENTS];
+  VkAttachmentReference depthRef;
+  VkImageView views[MAX_PASS_ATTACHMENTS];
+  bool writesSwapchain = false;
+  VkResult vkErr;
+
+  for (u32 i = 0; i < baked->nAttachments; i++)
+  {
+    Render_Graph_Texture *tex = baked->texs[i];
+    VkImageLayout layout = tex->isDepth 
+      ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL 
+      : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    bool readLater, writtenLater;
+
+    FindLaterUses(graph, end - 1, tex, &readLater, &writtenLater);
+
+    attachments[i] = (VkAttachmentDescription)
+    {
+      .format = tex->format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = baked->loadOps[i],
+      .storeOp = tex->isSwapchain || readLater || writtenLater 
+        ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = layout,
+      .finalLayout = layout,
+    };
+
+    if (tex->isDepth)
+    {
+      depthRef = (VkAttachmentReference) {.attachment = i, .layout = layout};
+    } else
+    {
+      colorRefs[i] = (VkAttachmentReference) {.attachment = i, .layout = layout};
+    }
+
+    writesSwapchain |= tex->isSwapchain;
+  }
+
+  VkSubpassDescription subpass =
+  {
+    .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+    .colorAttachmentCount = baked->nColors,
+    .pColorAttachments = colorRefs,
+    .pDepthStencilAttachment = baked->nColors < baked->nAttachments 
+      ? &depthRef : NULL,
+  };
+
+  VkRenderPassCreateInfo renderPassInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+    .attachmentCount = baked->nAttachments,
+    .pAttachments = attachments,
+    .subpassCount = 1,
+    .pSubpasses = &subpass,
+  };
+
+  vkErr = vkCreateRenderPass(ren->dev, &renderPassInfo, ren->allocCbs, 
+      &baked->renderPass);
+  if (vkErr)
+  {
+    baked->renderPass = VK_NULL_HANDLE;
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  baked->nFbs = writesSwapchain ? ren->swapchain.nImages : 1;
+  baked->fbs = NEW_ARR(ren->alloc, VkFramebuffer, baked->nFbs, 
+      MEMORY_TAG_RENDERER);
+  MemorySet(baked->fbs, 0, sizeof(VkFramebuffer) * baked->nFbs);
+
+  for (u32 i = 0; i < baked->nFbs; i++)
+  {
+    for (u32 j = 0; j < baked->nAttachments; j++)
+    {
+      views[j] = baked->texs[j]->isSwapchain ? ren->swapchain.imageViews[i] 
+        : baked->texs[j]->view;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo = 
+    {
+      .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+      .renderPass = baked->renderPass,
+      .attachmentCount = baked->nAttachments,
+      .pAttachments = views,
+      .width = baked->extent.width,
+      .height = baked->extent.height,
+      .layers = 1,
+    };
+
+    vkErr = vkCreateFramebuffer(ren->dev, &framebufferInfo, ren->allocCbs, 
+        &baked->fbs[i]);
+    if (vkErr)
+    {
+      baked->fbs[i] = VK_NULL_HANDLE;
+      return ERR_LIBRARY_FAILURE;
+    }
+  }
+
+  return ERR_OK;
+}
+
+/*
+ * Transitions tex to layout after what was done to it so far, waiting for
+ * earlier writes.  Earlier reads only need an execution dependency.
+ */
+static Render_Graph_Barrier *
+PushBarrier(Render_Graph *graph,
+            Render_Graph_Texture *tex,
+            VkImageLayout layout,
+            VkPipelineStageFlags2 dstStages,
+            VkAccessFlags2 dstAccess)
+{
+  Render_Graph_Barrier barrier =
+  {
+    .tex = tex,
+    .barrier = 
+    {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = tex->writeStages,
+      .srcAccessMask = tex->writeAccess,
+      .dstStageMask = dstStages,
+      .dstAccessMask = dstAccess,
+      .oldLayout = tex->bakeLayout,
+      .newLayout = layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .subresourceRange =
+      {
+        .aspectMask = tex->isDepth 
+          ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+    },
+  };
+
+  return VectorPush(&graph->barriers, graph->ren->alloc, &barrier);
+}
+
+/* 
+ * Moves tex to the queue baked runs on if it was last used on the other one,
+ * returning whether it did.  The batch which last used it releases it, and 
+ * the barriers before baked acquire it, with the same layout transition.  
+ * The semaphore between the batches orders everything before the release.
+ * Old contents needn't move, so the first use of the frame doesn't either.
+ */
+static bool
+ChangeQueue(Render_Graph *graph,
+            Render_Graph_Plan_Pass *baked,
+            Render_Graph_Texture *tex,
+            VkImageLayout layout,
+            VkPipelineStageFlags2 stages,
+            VkAccessFlags2 access)
+{
+  Render_Graph_Barrier *acquire;
+  Render_Graph_Release release;
+
+  if (tex->bakeQueue == baked->queue)
+  {
+    tex->bakeBatch = baked->batch;
+    return false;
+  }
+
+  if (tex->bakeLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+  {
+    tex->bakeQueue = baked->queue;
+    tex->bakeBatch = baked->batch;
+    return false;
+  }
+
+  acquire = PushBarrier(graph, tex, layout, stages, access);
+  acquire->barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+  acquire->barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  acquire->barrier.srcQueueFamilyIndex = QueueFamily(graph, tex->bakeQueue);
+  acquire->barrier.dstQueueFamilyIndex = QueueFamily(graph, baked->queue);
+
+  release.batch = tex->bakeBatch;
+  release.release = *acquire;
+  release.release.barrier.srcStageMask = tex->writeStages | tex->readStages;
+  release.release.barrier.srcAccessMask = tex->writeAccess;
+  release.release.barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+  release.release.barrier.dstAccessMask = VK_ACCESS_2_NONE;
+  VectorPush(&graph->releases, graph->ren->alloc, &release);
+
+  /* Stages of the other queue may not exist on this one. */
+  tex->bakeQueue = baked->queue;
+  tex->bakeBatch = baked->batch;
+  tex->bakeLayout = layout;
+  tex->writeStages = 0;
+  tex->writeAccess = 0;
+  tex->readStages = 0;
+  tex->readBarrier = graph->barriers.elemsUsed - 1;
+  return true;
+}
+
+/* 
+ * Reads after the same write in the same layout share one barrier, which 
+ * waits for the union of their stages.
+ */
+static void
+UseForRead(Render_Graph *graph,
+           Render_Graph_Plan_Pass *baked,
+           Render_Graph_Texture *tex,
+           VkImageLayout layout,
+           VkPipelineStageFlags2 stages,
+           VkAccessFlags2 access)
+{
+  Render_Graph_Barrier *barrier;
+
+  if (ChangeQueue(graph, baked, tex, layout, stages, access))
+  {
+    tex->readStages = stages;
+    return;
+  }
+
+  if (tex->readBarrier >= 0 && tex->bakeLayout == layout)
+  {
+    barrier = VectorIdx(&graph->barriers, tex->readBarrier);
+    barrier->barrier.dstStageMask |= stages;
+    barrier->barrier.dstAccessMask |= access;
+    tex->readStages |= stages;
+    return;
+  }
+
+  barrier = PushBarrier(graph, tex, layout, stages, access);
+  barrier->barrier.srcStageMask |= tex->readStages;
+
+  tex->readBarrier = graph->barriers.elemsUsed - 1;
+  tex->readStages |= stages;
+  tex->bakeLayout = layout;
+}
+
+/* 
+ * The first write of the frame discards the old contents, but still waits 
+ * for the same stages of the previous frame, which used the same image, and
+ * for whatever used the memory last if it is aliased.
+ */
+static void
+UseForWrite(Render_Graph *graph,
+            Render_Graph_Plan_Pass *baked,
+            Render_Graph_Texture *tex,
+            VkImageLayout layout,
+            VkPipelineStageFlags2 stages,
+            VkAccessFlags2 readAccess,
+            VkAccessFlags2 writeAccess)
+{
+  Render_Graph_Barrier *barrier;
+
+  if (ChangeQueue(graph, baked, tex, layout, stages, 
+        readAccess | writeAccess))
+  {
+    tex->writeStages = stages;
+    tex->writeAccess = writeAccess;
+    tex->readBarrier = -1;
+    return;
+  }
+
+  barrier = PushBarrier(graph, tex, layout, stages, readAccess | writeAccess);
+  if (tex->bakeLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+  {
+    barrier->barrier.srcStageMask = stages;
+    barrier->barrier.srcAccessMask = writeAccess;
+    if (tex->aliasPrev != NULL)
+    {
+      barrier->barrier.srcStageMask |= tex->aliasPrev->useStages;
+      barrier->barrier.srcAccessMask |= tex->aliasPrev->useWriteAccess;
+    }
+  } else
+  {
+    barrier->barrier.srcStageMask |= tex->readStages;
+  }
+
+  tex->bakeLayout = layout;
+  tex->writeStages = stages;
+  tex->writeAccess = writeAccess;
+  tex->readStages = 0;
+  tex->readBarrier = -1;
+}
+
+/* Every barrier before one pass goes in a single vkCmdPipelineBarrier2. */
+static void
+RecordBarriers(Render_Graph *graph,
+               Render_Graph_Plan *plan,
+               VkCommandBuffer buf,
+               u32 imageIndex,
+               u32 first,
+               u32 count)
+{
+  Render_Graph_Barrier *barriers;
+
+  if (count == 0)
+  {
+    return;
+  }
+
+  /* 
+   * A pass has at most one barrier per texture it reads or writes, but a 
+   * batch can release any number of textures to the other queue, so those
+   * are recorded in chunks.
+   */
+  VkImageMemoryBarrier2 imageBarriers[MAX_PASS_ATTACHMENTS * 2];
+
+  barriers = VectorIdx(&plan->barriers, first);
+  for (u32 done = 0; done < count; done += ELEMOF(imageBarriers))
+  {
+    u32 n = count - done < ELEMOF(imageBarriers) 
+      ? count - done : (u32) ELEMOF(imageBarriers);
+
+    for (u32 i = 0; i < n; i++)
+    {
+      Render_Graph_Texture *tex = barriers[done + i].tex;
+
+      imageBarriers[i] = barriers[done + i].barrier;
+      imageBarriers[i].image = tex->isSwapchain 
+        ? graph->ren->swapchain.images[imageIndex] : tex->image;
+    }
+
+    VkDependencyInfo dependencyInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .imageMemoryBarrierCount = n,
+      .pImageMemoryBarriers = imageBarriers,
+    };
+
+    vkCmdPipelineBarrier2(buf, &dependencyInfo);
+  }
+}
+
+static void
+EvictPlan(Render_Graph *graph,
+          u32 idx,
+          bool deferred)
+{
+  if (graph->plan == graph->plans[idx])
+  {
+    graph->plan = NULL;
+    graph->dirty = true;
+  }
+
+  ReleasePlan(graph, graph->plans[idx], deferred);
+  graph->plans[idx] = graph->plans[--graph->nPlans];
+}
+
+/* 
+ * A plan's objects may still be used by frames in flight, unless the device 
+ * is known to be idle.
+ */
+static void
+ReleasePlan(Render_Graph *graph,
+            Render_Graph_Plan *plan,
+            bool deferred)
+{
+  Renderer *ren = graph->ren;
+
+  for (usize i = 0; i < plan->passes.elemsUsed; i++)
+  {
+    ReleasePlanPass(graph, VectorIdx(&plan->passes, i), deferred);
+  }
+
+  for (usize i = 0; i < plan->textures.elemsUsed; i++)
+  {
+    Render_Graph_Plan_Texture *planTex = VectorIdx(&plan->textures, i);
+
+    /* The view and memory may be null, which Vulkan ignores. */
+    if (deferred)
+    {
+      Deletion viewDel = 
+        {.t = DELETION_IMAGE_VIEW, .imageView = planTex->view};
+
+      DeletionQueuePush(ren, &ren->deletions, &viewDel);
+      DeferDestroyImage(ren, planTex->image, planTex->memory);
+    } else
+    {
+      vkDestroyImageView(ren->dev, planTex->view, ren->allocCbs);
+      vkDestroyImage(ren->dev, planTex->image, ren->allocCbs);
+      vkFreeMemory(ren->dev, planTex->memory, ren->allocCbs);
+    }
+
+    if (planTex->tex->image == planTex->image)
+    {
+      planTex->tex->image = VK_NULL_HANDLE;
+      planTex->tex->view = VK_NULL_HANDLE;
+      planTex->tex->memory = VK_NULL_HANDLE;
+    }
+  }
+
+  for (usize i = 0; i < plan->memories.elemsUsed; i++)
+  {
+    Render_Graph_Memory *block = VectorIdx(&plan->memories, i);
+
+    if (block->memory == VK_NULL_HANDLE)
+    {
+      continue;
+    }
+
+    if (deferred)
+    {
+      Deletion del = {.t = DELETION_MEMORY, .memory = block->memory};
+      DeletionQueuePush(ren, &ren->deletions, &del);
+    } else
+    {
+      vkFreeMemory(ren->dev, block->memory, ren->allocCbs);
+    }
+  }
+
+  VectorDestroy(&plan->key, ren->alloc);
+  VectorDestroy(&plan->passes, ren->alloc);
+  VectorDestroy(&plan->barriers, ren->alloc);
+  VectorDestroy(&plan->textures, ren->alloc);
+  VectorDestroy(&plan->memories, ren->alloc);
+  FREE(ren->alloc, plan, Render_Graph_Plan, MEMORY_TAG_RENDERER);
+}
+
+static void
+ReleasePlanPass(Render_Graph *graph,
+                Render_Graph_Plan_Pass *baked,
+                bool deferred)
+{
+  Renderer *ren = graph->ren;
+
+  for (u32 i = 0; i < baked->nFbs; i++)
+  {
+    if (baked->fbs[i] == VK_NULL_HANDLE)
+    {
+      continue;
+    }
+
+    if (deferred)
+    {
+      Deletion del = {.t = DELETION_FRAMEBUFFER, .framebuffer = baked->fbs[i]};
+      DeletionQueuePush(ren, &ren->deletions, &del);
+    } else
+    {
+      vkDestroyFramebuffer(ren->dev, baked->fbs[i], ren->allocCbs);
+    }
+  }
+
+  if (baked->nFbs != 0)
+  {
+    FREE_ARR(ren->alloc, baked->fbs, VkFramebuffer, baked->nFbs, 
+        MEMORY_TAG_RENDERER);
+  }
+
+  if (baked->renderPass != VK_NULL_HANDLE)
+  {
+    if (deferred)
+    {
+      Deletion del = 
+        {.t = DELETION_RENDER_PASS, .renderPass = baked->renderPass};
+      DeletionQueuePush(ren, &ren->deletions, &del);
+    } else
+    {
+      vkDestroyRenderPass(ren->dev, baked->renderPass, ren->allocCbs);
+    }
+  }
+}
+
+static Err_Code
+CreateThreadPools(Render_Graph *graph)
+{
+  Renderer *ren = graph->ren;
+  VkResult vkErr;
+
+  VkCommandPoolCreateInfo poolInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+    .queueFamilyIndex = ren->queueInfo.graphicsFamily,
+  };
+
+  for (usize i = 0; i < ren->framesInFlight; i++)
+  {
+    for (usize j = 0; j < JobPoolThreadCount(graph->jobs); j++)
+    {
+      Render_Graph_Thread_Pool *pool = &graph->threadPools[i][j];
+
+      pool->buffers = VECTOR_CREATE(ren->alloc, VkCommandBuffer);
+      pool->used = 0;
+
+      vkErr = vkCreateCommandPool(ren->dev, &poolInfo, ren->allocCbs, 
+          &pool->pool);
+      if (vkErr)
+      {
+        return ERR_LIBRARY_FAILURE;
+      }
+    }
+  }
+
+  return ERR_OK;
+}
+
+/* The current frame has finished, so its buffers are free. */
+static void
+ResetThreadPools(Render_Graph *graph)
+{
+  Renderer *ren = graph->ren;
+
+  for (usize i = 0; i < JobPoolThreadCount(graph->jobs); i++)
+  {
+    Render_Graph_Thread_Pool *pool = 
+      &graph->threadPools[ren->currentFrame][i];
+
+    if (pool->used != 0)
+    {
+      vkResetCommandPool(ren->dev, pool->pool, 0);
+      pool->used = 0;
+    }
+  }
+}
+
+/* Waits for each queue's timeline to reach its value, skipping zeros. */
+static Err_Code
+WaitTimelines(Render_Graph *graph,
+              const u64 values[RENDER_GRAPH_QUEUE_COUNT])
+{
+  Renderer *ren = graph->ren;
+  VkSemaphore semaphores[RENDER_GRAPH_QUEUE_COUNT];
+  u64 waitValues[RENDER_GRAPH_QUEUE_COUNT];
+  u32 nWaits = 0;
+  VkResult vkErr;
+
+  for (u32 i = 0; i < RENDER_GRAPH_QUEUE_COUNT; i++)
+  {
+    if (values[i] != 0)
+    {
+      semaphores[nWaits] = graph->timelines[i];
+      waitValues[nWaits++] = values[i];
+    }
+  }
+
+  if (nWaits == 0)
+  {
+    return ERR_OK;
+  }
+
+  VkSemaphoreWaitInfo waitInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .semaphoreCount = nWaits,
+    .pSemaphores = semaphores,
+    .pValues = waitValues,
+  };
+
+  vkErr = vkWaitSemaphores(ren->dev, &waitInfo, UINT64_MAX);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  return ERR_OK;
+}
+
+/* 
+ * Hands out a secondary buffer from thread's pool for this frame.  Called 
+ * before the thread records, as the allocator isn't thread safe.
+ */
+static VkCommandBuffer
+AcquireSecondary(Render_Graph *graph,
+                 u32 thread)
+{
+  Renderer *ren = graph->ren;
+  Render_Graph_Thread_Pool *pool = 
+    &graph->threadPools[ren->currentFrame][thread];
+  VkCommandBuffer buf;
+  VkResult vkErr;
+
+  if (pool->used == pool->buffers.elemsUsed)
+  {
+    VkCommandBufferAllocateInfo allocInfo =
+    {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = pool->pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+      .commandBufferCount = 1,
+    };
+
+    vkErr = vkAllocateCommandBuffers(ren->dev, &allocInfo, &buf);
+    if (vkErr)
+    {
+      return VK_NULL_HANDLE;
+    }
+    VectorPush(&pool->buffers, ren->alloc, &buf);
+  }
+
+  buf = *((VkCommandBuffer *) VectorIdx(&pool->buffers, pool->used++));
+  return buf;
+}
+
+/* One chunk per thread, as long as each gets a worthwhile amount of work. */
+static u32
+CountChunks(Render_Graph *graph,
+            Render_Graph_Pass *pass)
+{
+  u32 nChunks;
+
+  if (pass->chunkFn == NULL || graph->nThreads == 1)
+  {
+    return 1;
+  }
+
+  nChunks = pass->countFn(graph->ren) / MIN_RECORD_CHUNK_UNITS;
+  nChunks = nChunks > graph->nThreads ? graph->nThreads : nChunks;
+  return nChunks == 0 ? 1 : nChunks;
+}
+
+/* 
+ * Records one batch's passes, then releases what the other queue uses next.
+ * The last graphics batch hands the swapchain image to present.
+ */
+static void
+RecordBatch(Render_Graph *graph,
+            Render_Graph_Plan *plan,
+            u32 batchIdx,
+            VkCommandBuffer buf,
+            u32 imageIndex)
+{
+  Render_Graph_Batch *batch = &plan->batches[batchIdx];
+  usize batchEnd = batch->firstPass + batch->nPasses;
+  bool lastGraphics = batch->queue == RENDER_GRAPH_QUEUE_GRAPHICS;
+  i32 slot;
+
+  for (usize i = batch->firstPass, end; i < batchEnd; i = end)
+  {
+    Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, i);
+
+    for (end = i + 1; end < batchEnd; end++)
+    {
+      if (!((Render_Graph_Plan_Pass *) VectorIdx(&plan->passes, end))->merged)
+      {
+        break;
+      }
+    }
+
+    /* A merged run is one render pass, so it can only be timed whole. */
+    PROFILE_BEGIN(baked->pass->name != NULL ? baked->pass->name : "pass");
+    slot = GpuProfilerBegin(graph->ren, &graph->ren->gpuProfiler, buf, 
+        batch->queue, baked->pass);
+
+    RecordBarriers(graph, plan, buf, imageIndex, baked->firstBarrier, 
+        baked->nBarriers);
+
+    /* Passes without attachments record outside of any render pass. */
+    if (baked->renderPass == VK_NULL_HANDLE)
+    {
+      RecordInline(graph, baked->pass, buf);
+    } else
+    {
+      RecordRenderPass(graph, plan, i, end, buf, imageIndex);
+    }
+
+    GpuProfilerEnd(graph->ren, &graph->ren->gpuProfiler, buf, slot);
+    PROFILE_END();
+  }
+
+  RecordBarriers(graph, plan, buf, imageIndex, batch->firstBarrier, 
+      batch->nBarriers);
+
+  for (u32 i = batchIdx + 1; i < plan->nBatches && lastGraphics; i++)
+  {
+    lastGraphics = plan->batches[i].queue != RENDER_GRAPH_QUEUE_GRAPHICS;
+  }
+
+  if (lastGraphics)
+  {
+    RecordBarriers(graph, plan, buf, imageIndex, plan->firstFinalBarrier,
+        plan->nFinalBarriers);
+  }
+}
+
+/* 
+ * Records the baked passes in [first, end), which share a render pass.  If 
+ * any of them is split into chunks, all of them go in secondary command 
+ * buffers, since a subpass can't mix those with inline commands.
+ */
+static void
+RecordRenderPass(Render_Graph *graph,
+                 Render_Graph_Plan *plan,
+                 usize first,
+                 usize end,
+                 VkCommandBuffer buf,
+                 u32 imageIndex)
+{
+  Render_Graph_Plan_Pass *baked = VectorIdx(&plan->passes, first);
+  bool secondary = false;
+
+  for (usize i = first; i < end; i++)
+  {
+    Render_Graph_Plan_Pass *merged = VectorIdx(&plan->passes, i);
+
+    merged->nChunks = CountChunks(graph, merged->pass);
+    secondary |= merged->nChunks > 1;
+  }
+
+  VkRenderPassBeginInfo renderPassInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+    .renderPass = baked->renderPass,
+    .framebuffer = baked->fbs[baked->nFbs > 1 ? imageIndex : 0],
+    .renderArea =
+      {
+        .offset = {0, 0},
+        .extent = baked->extent,
+      },
+    .clearValueCount = baked->nAttachments,
+    .pClearValues = baked->clears,
+  };
+
+  VkCommandBufferInheritanceInfo inheritance =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+    .renderPass = renderPassInfo.renderPass,
+    .subpass = 0,
+    .framebuffer = renderPassInfo.framebuffer,
+  };
+
+  vkCmdBeginRenderPass(buf, &renderPassInfo, secondary 
+      ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS 
+      : VK_SUBPASS_CONTENTS_INLINE);
+
+  for (usize i = first; i < end; i++)
+  {
+    Render_Graph_Plan_Pass *merged = VectorIdx(&plan->passes, i);
+
+    if (secondary)
+    {
+      RecordChunks(graph, merged->pass, buf, &inheritance, merged->nChunks);
+    } else
+    {
+      RecordInline(graph, merged->pass, buf);
+    }
+  }
+
+  vkCmdEndRenderPass(buf);
+}
+
+/* Records pass on the calling thread. */
+static void
+RecordInline(Render_Graph *graph,
+             Render_Graph_Pass *pass,
+             VkCommandBuffer buf)
+{
+  f64 startTime = PlatGetTime();
+  f64 chunkTime;
+
+  if (pass->chunkFn != NULL)
+  {
+    pass->chunkFn(graph->ren, buf, 0, 1);
+  } else
+  {
+    pass->fn(graph->ren, buf);
+  }
+
+  chunkTime = PlatGetTime() - startTime;
+  graph->stats.nChunks++;
+  graph->stats.chunkTime += chunkTime;
+  if (chunkTime > graph->stats.maxChunkTime)
+  {
+    graph->stats.maxChunkTime = chunkTime;
+  }
+}
+
+/* Records pass into secondary buffers and executes them in the subpass. */
+static void
+RecordChunks(Render_Graph *graph,
+             Render_Graph_Pass *pass,
+             VkCommandBuffer buf,
+             const VkCommandBufferInheritanceInfo *inheritance,
+             u32 nChunks)
+{
+  Record_Job job = 
+  {
+    .graph = graph,
+    .pass = pass,
+    .inheritance = *inheritance,
+    .nChunks = nChunks,
+  };
+  u32 nRecorded = 0;
+
+  /* Chunk i runs on worker i, since there are no more chunks than threads. */
+  for (u32 i = 0; i < nChunks; i++)
+  {
+    job.buffers[i] = AcquireSecondary(graph, i);
+    if (job.buffers[i] == VK_NULL_HANDLE)
+    {
+      LOG_ERROR("failed to allocate secondary command buffer");
+      return;
+    }
+  }
+
+  JobPoolRun(graph->jobs, RecordChunk, &job, nChunks);
+
+  for (u32 i = 0; i < nChunks; i++)
+  {
+    if (job.results[i] != VK_SUCCESS)
+    {
+      LOG_ERROR("failed to record secondary command buffer");
+      continue;
+    }
+
+    job.buffers[nRecorded++] = job.buffers[i];
+    graph->stats.chunkTime += job.times[i];
+    if (job.times[i] > graph->stats.maxChunkTime)
+    {
+      graph->stats.maxChunkTime = job.times[i];
+    }
+  }
+  graph->stats.nChunks += nRecorded;
+
+  if (nRecorded != 0)
+  {
+    vkCmdExecuteCommands(buf, nRecorded, job.buffers);
+  }
+}
+
+static void
+RecordChunk(void *ud,
+            u32 chunk,
+            u32 worker)
+{
+  Record_Job *job = (Record_Job *) ud;
+  VkCommandBuffer buf = job->buffers[chunk];
+  f64 startTime = PlatGetTime();
+
+  (void) worker;
+
+  VkCommandBufferBeginInfo beginInfo =
+  {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT 
+      | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+    .pInheritanceInfo = &job->inheritance,
+  };
+
+  job->results[chunk] = vkBeginCommandBuffer(buf, &beginInfo);
+  if (job->results[chunk] != VK_SUCCESS)
+  {
+    return;
+  }
+
+  /* Passes without chunks only get here merged with ones which have them. */
+  PROFILE_ZONE("record chunk")
+  {
+    if (job->pass->chunkFn != NULL)
+    {
+      job->pass->chunkFn(job->graph->ren, buf, chunk, job->nChunks);
+    } else
+    {
+      job->pass->fn(job->graph->ren, buf);
+    }
+  }
+
+  job->results[chunk] = vkEndCommandBuffer(buf);
+  job->times[chunk] = PlatGetTime() - startTime;
+}
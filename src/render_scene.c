@@ -0,0 +1,737 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Retained scene of render objects.
+ */
+
+#include <notte/render_scene.h>
+#include <notte/material.h>
+#include <notte/radix_sort.h>
+
+/* === MACROS === */
+
+#define NO_SLOT UINT32_MAX
+
+/* === PROTOTYPES === */
+
+static Render_Object *LookupObject(Render_Scene *scene,
+    Render_Object_Handle handle);
+static Render_Object *SlotObject(Render_Scene *scene, u32 slot);
+static Err_Code CheckInfo(Renderer *ren, Render_Object_Info *info);
+static void TouchBvh(Renderer *ren, Render_Scene *scene, u32 slot);
+static void MarkStale(Renderer *ren, Render_Scene *scene, Render_Object *obj);
+static void LinkTransform(Renderer *ren, Render_Scene *scene, 
+    Render_Object *obj);
+static void UnlinkTransform(Render_Scene *scene, Render_Object *obj);
+static void StartWorker(Renderer *ren, Render_Scene *scene);
+static void ComputeKeys(Render_Scene *scene, Technique *defaultTech);
+static void ReserveOrder(Renderer *ren, Render_Scene *scene, usize n);
+static void FreeOrder(Renderer *ren, Render_Scene *scene);
+static void StartBuild(Renderer *ren, Render_Scene *scene);
+static void FinishBuild(Renderer *ren, Render_Scene *scene);
+static void RunBuilds(void *ud);
+static f32 PickObject(void *ud, u32 item, Vec3 origin, Vec3 dir, f32 maxT);
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+RenderSceneInit(Renderer *ren,
+                Render_Scene *scene)
+{
+  MemorySet(scene, 0, sizeof(*scene));
+  scene->slots = VECTOR_CREATE(ren->alloc, Render_Object_Slot);
+  scene->objects = VECTOR_CREATE(ren->alloc, Render_Object);
+  scene->freeSlot = NO_SLOT;
+  scene->stale = VECTOR_CREATE(ren->alloc, u32);
+  BvhInit(&scene->bvh, ren->alloc);
+  scene->buildTouched = VECTOR_CREATE(ren->alloc, u32);
+  scene->visible = VECTOR_CREATE(ren->alloc, u32);
+  StartWorker(ren, scene);
+}
+
+void
+RenderSceneDeinit(Renderer *ren,
+                  Render_Scene *scene)
+{
+  /* The worker finishes any build before it sees the quit. */
+  if (scene->buildThread != NULL)
+  {
+    scene->buildQuit = true;
+    SemaphoreSignal(scene->buildStart);
+    ThreadJoin(scene->buildThread);
+    ThreadDestroy(ren->alloc, scene->buildThread);
+    SemaphoreDestroy(ren->alloc, scene->buildStart);
+    MutexDestroy(ren->alloc, scene->buildMutex);
+  }
+
+  if (scene->building)
+  {
+    BvhBuildCancel(&scene->build);
+  }
+
+  if (scene->nTransformObjects != 0)
+  {
+    FREE_ARR(ren->alloc, scene->transformObjects, u32, 
+        scene->nTransformObjects, MEMORY_TAG_RENDERER);
+  }
+
+  VectorDestroy(&scene->slots, ren->alloc);
+  VectorDestroy(&scene->objects, ren->alloc);
+  VectorDestroy(&scene->stale, ren->alloc);
+  BvhDeinit(&scene->bvh);
+  VectorDestroy(&scene->buildTouched, ren->alloc);
+  VectorDestroy(&scene->visible, ren->alloc);
+  FreeOrder(ren, scene);
+}
+
+Err_Code
+RenderSceneAdd(Renderer *ren,
+               Render_Scene *scene,
+               Render_Object_Info *info,
+               Render_Object_Handle *handleOut)
+{
+  Err_Code err;
+  Render_Object_Slot *slot;
+  u32 idx;
+
+  err = CheckInfo(ren, info);
+  if (err)
+  {
+    return err;
+  }
+
+  if (scene->freeSlot != NO_SLOT)
+  {
+    idx = scene->freeSlot;
+    slot = VectorIdx(&scene->slots, idx);
+    scene->freeSlot = slot->dense;
+  } else
+  {
+    Render_Object_Slot newSlot =
+    {
+      .gen = 1,
+    };
+    idx = (u32) scene->slots.elemsUsed;
+    slot = VectorPush(&scene->slots, ren->alloc, &newSlot);
+  }
+
+  Render_Object obj =
+  {
+    .mesh = info->mesh,
+    .material = info->material,
+    .transform = info->transform,
+    .slot = idx,
+  };
+
+  slot->dense = (u32) scene->objects.elemsUsed;
+  Render_Object *added = VectorPush(&scene->objects, ren->alloc, &obj);
+  LinkTransform(ren, scene, added);
+  MarkStale(ren, scene, added);
+  scene->keysStale = true;
+
+  handleOut->idx = idx;
+  handleOut->gen = slot->gen;
+  return ERR_OK;
+}
+
+Err_Code
+RenderSceneUpdate(Renderer *ren,
+                  Render_Scene *scene,
+                  Render_Object_Handle handle,
+                  Render_Object_Info *info)
+{
+  Err_Code err;
+  Render_Object *obj = LookupObject(scene, handle);
+
+  if (obj == NULL)
+  {
+    return ERR_INVALID_USAGE;
+  }
+
+  err = CheckInfo(ren, info);
+  if (err)
+  {
+    return err;
+  }
+
+  if (obj->mesh != info->mesh || obj->material != info->material)
+  {
+    scene->keysStale = true;
+  }
+
+  if (obj->transform != info->transform)
+  {
+    UnlinkTransform(scene, obj);
+    obj->transform = info->transform;
+    LinkTransform(ren, scene, obj);
+  }
+
+  obj->mesh = info->mesh;
+  obj->material = info->material;
+  MarkStale(ren, scene, obj);
+  return ERR_OK;
+}
+
+/* Swaps the last object into the removed one's place. */
+Err_Code
+RenderSceneRemove(Renderer *ren,
+                  Render_Scene *scene,
+                  Render_Object_Handle handle)
+{
+  Render_Object *obj = LookupObject(scene, handle);
+
+  if (obj == NULL)
+  {
+    return ERR_INVALID_USAGE;
+  }
+
+  if (BvhContains(&scene->bvh, handle.idx))
+  {
+    BvhRemove(&scene->bvh, handle.idx);
+    TouchBvh(ren, scene, handle.idx);
+  }
+  UnlinkTransform(scene, obj);
+
+  Render_Object_Slot *slot = VectorIdx(&scene->slots, handle.idx);
+  u32 dense = slot->dense;
+  u32 last = (u32) scene->objects.elemsUsed - 1;
+
+  if (dense != last)
+  {
+    Render_Object *moved = VectorIdx(&scene->objects, last);
+    Render_Object_Slot *movedSlot = VectorIdx(&scene->slots, moved->slot);
+
+    MemoryCopy(obj, moved, sizeof(Render_Object));
+    movedSlot->dense = dense;
+  }
+  scene->objects.elemsUsed--;
+
+  slot->gen++;
+  slot->dense = scene->freeSlot;
+  scene->freeSlot = handle.idx;
+  scene->keysStale = true;
+  return ERR_OK;
+}
+
+/*
+ * With CPU culling, only the visible objects the BVH returns are sorted, so
+ * culling and sorting scale with what is on screen.  Bounds are only 
+ * refreshed for objects which were changed or whose transform moved.
+ */
+void
+RenderScenePrepare(Renderer *ren,
+                   Render_Scene *scene,
+                   Technique *defaultTech,
+                   Vec4 *planes)
+{
+  Transform_Store *transforms = &ren->transforms;
+  usize nObjects = scene->objects.elemsUsed;
+  usize nMoved;
+  const u32 *moved = TransformStoreMoved(transforms, &nMoved);
+
+  FinishBuild(ren, scene);
+
+  for (usize i = 0; i < nMoved; i++)
+  {
+    u32 slot = moved[i] < scene->nTransformObjects 
+      ? scene->transformObjects[moved[i]] : NO_SLOT;
+
+    while (slot != NO_SLOT)
+    {
+      Render_Object *obj = SlotObject(scene, slot);
+
+      MarkStale(ren, scene, obj);
+      slot = obj->nextShared;
+    }
+  }
+
+  u32 *stale = (u32 *) scene->stale.buf;
+  for (usize i = 0; i < scene->stale.elemsUsed; i++)
+  {
+    Render_Object *obj = SlotObject(scene, stale[i]);
+
+    /* Removed, or already refreshed under a reused slot. */
+    if (obj == NULL || !obj->boundsStale)
+    {
+      continue;
+    }
+
+    AabbTransform(obj->mesh->sphere, obj->mesh->extent,
+        transforms->world[obj->transform], &obj->box);
+    BvhUpdate(&scene->bvh, obj->slot, &obj->box);
+    TouchBvh(ren, scene, obj->slot);
+    obj->boundsStale = false;
+  }
+  VectorEmpty(&scene->stale);
+
+  if (scene->keysStale)
+  {
+    ComputeKeys(scene, defaultTech);
+    scene->keysStale = false;
+    scene->orderAll = false;
+  }
+
+  ReserveOrder(ren, scene, nObjects);
+
+  if (planes == NULL)
+  {
+    if (!scene->orderAll)
+    {
+      for (usize i = 0; i < nObjects; i++)
+      {
+        Render_Object *obj = VectorIdx(&scene->objects, i);
+        scene->keys[i] = obj->key;
+        scene->order[i] = (u32) i;
+      }
+
+      RadixSort64(scene->keys, scene->order, scene->tmpKeys,
+          scene->tmpOrder, nObjects);
+      scene->orderAll = true;
+    }
+    scene->nOrder = (u32) nObjects;
+  } else
+  {
+    VectorEmpty(&scene->visible);
+    BvhQueryFrustum(&scene->bvh, planes, &scene->visible);
+
+    u32 *visible = (u32 *) scene->visible.buf;
+    for (usize i = 0; i < scene->visible.elemsUsed; i++)
+    {
+      Render_Object_Slot *slot = VectorIdx(&scene->slots, visible[i]);
+      Render_Object *obj = VectorIdx(&scene->objects, slot->dense);
+
+      scene->keys[i] = obj->key;
+      scene->order[i] = slot->dense;
+    }
+
+    scene->nOrder = (u32) scene->visible.elemsUsed;
+    RadixSort64(scene->keys, scene->order, scene->tmpKeys, scene->tmpOrder,
+        scene->nOrder);
+    scene->orderAll = false;
+  }
+
+  if (!scene->building && BvhWantsRebuild(&scene->bvh))
+  {
+    StartBuild(ren, scene);
+  }
+}
+
+bool
+RenderScenePick(Renderer *ren,
+                Render_Scene *scene,
+                Vec3 origin,
+                Vec3 dir,
+                Render_Object_Handle *handleOut,
+                f32 *distOut)
+{
+  u32 slot;
+  f32 t;
+
+  if (!BvhRaycast(&scene->bvh, origin, dir, INFINITY, PickObject, ren, &slot,
+        &t))
+  {
+    return false;
+  }
+
+  Render_Object_Slot *slotData = VectorIdx(&scene->slots, slot);
+  handleOut->idx = slot;
+  handleOut->gen = slotData->gen;
+  *distOut = t * Vec3Length(dir);
+  return true;
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static Render_Object *
+LookupObject(Render_Scene *scene,
+             Render_Object_Handle handle)
+{
+  if (handle.idx >= scene->slots.elemsUsed)
+  {
+    return NULL;
+  }
+
+  Render_Object_Slot *slot = VectorIdx(&scene->slots, handle.idx);
+  if (slot->gen != handle.gen)
+  {
+    return NULL;
+  }
+
+  return VectorIdx(&scene->objects, slot->dense);
+}
+
+/*
+ * The object living in slot, or NULL.  A free slot's dense is another slot,
+ * which can't point back at it.
+ */
+static Render_Object *
+SlotObject(Render_Scene *scene,
+           u32 slot)
+{
+  Render_Object_Slot *slotData = VectorIdx(&scene->slots, slot);
+  Render_Object *obj;
+
+  if (slotData->dense >= scene->objects.elemsUsed)
+  {
+    return NULL;
+  }
+
+  obj = VectorIdx(&scene->objects, slotData->dense);
+  return obj->slot == slot ? obj : NULL;
+}
+
+static Err_Code
+CheckInfo(Renderer *ren,
+          Render_Object_Info *info)
+{
+  Transform_Store *transforms = &ren->transforms;
+
+  if (info->mesh == NULL || info->transform >= transforms->count
+      || !(transforms->flags[info->transform] & TRANSFORM_FLAG_ALIVE))
+  {
+    return ERR_INVALID_USAGE;
+  }
+
+  return ERR_OK;
+}
+
+/* Records a change the running build, if any, won't have seen. */
+static void
+TouchBvh(Renderer *ren,
+         Render_Scene *scene,
+         u32 slot)
+{
+  if (scene->building)
+  {
+    VectorPush(&scene->buildTouched, ren->alloc, &slot);
+  }
+}
+
+static void
+MarkStale(Renderer *ren,
+          Render_Scene *scene,
+          Render_Object *obj)
+{
+  if (!obj->boundsStale)
+  {
+    obj->boundsStale = true;
+    VectorPush(&scene->stale, ren->alloc, &obj->slot);
+  }
+}
+
+/* Objects are linked by slot, which stays put when the dense array moves. */
+static void
+LinkTransform(Renderer *ren,
+              Render_Scene *scene,
+              Render_Object *obj)
+{
+  u32 n = scene->nTransformObjects;
+
+  if (obj->transform >= n)
+  {
+    u32 newN = n ? n : 64;
+
+    while (newN <= obj->transform)
+    {
+      newN *= 2;
+    }
+
+    scene->transformObjects = n != 0
+      ? RESIZE_ARR(ren->alloc, scene->transformObjects, u32, n, newN, 
+          MEMORY_TAG_RENDERER)
+      : NEW_ARR(ren->alloc, u32, newN, MEMORY_TAG_RENDERER);
+    for (u32 i = n; i < newN; i++)
+    {
+      scene->transformObjects[i] = NO_SLOT;
+    }
+    scene->nTransformObjects = newN;
+  }
+
+  obj->nextShared = scene->transformObjects[obj->transform];
+  scene->transformObjects[obj->transform] = obj->slot;
+}
+
+static void
+UnlinkTransform(Render_Scene *scene,
+                Render_Object *obj)
+{
+  u32 *link = &scene->transformObjects[obj->transform];
+
+  while (*link != obj->slot)
+  {
+    link = &SlotObject(scene, *link)->nextShared;
+  }
+  *link = obj->nextShared;
+}
+
+/* Leaves buildThread NULL if anything fails, so builds run inline. */
+static void
+StartWorker(Renderer *ren,
+            Render_Scene *scene)
+{
+  Err_Code err;
+
+  err = SemaphoreCreate(ren->alloc, &scene->buildStart);
+  if (err)
+  {
+    return;
+  }
+
+  err = MutexCreate(ren->alloc, &scene->buildMutex);
+  if (err)
+  {
+    SemaphoreDestroy(ren->alloc, scene->buildStart);
+    return;
+  }
+
+  err = ThreadCreate(ren->alloc, scene, RunBuilds, &scene->buildThread);
+  if (err)
+  {
+    scene->buildThread = NULL;
+    MutexDestroy(ren->alloc, scene->buildMutex);
+    SemaphoreDestroy(ren->alloc, scene->buildStart);
+  }
+}
+
+/* Techniques are resolved here too, as they only depend on the material. */
+static void
+ComputeKeys(Render_Scene *scene,
+            Technique *defaultTech)
+{
+  for (usize i = 0; i < scene->objects.elemsUsed; i++)
+  {
+    Render_Object *obj = VectorIdx(&scene->objects, i);
+
+    obj->tech = MaterialTechnique(obj->material, RENDER_PASS_GBUFFER,
+        defaultTech);
+    obj->key = SORT_KEY_FIELD(RENDER_PASS_GBUFFER, PASS)
+      | SORT_KEY_FIELD(obj->tech->id, TECH)
+      | SORT_KEY_FIELD(obj->material ? obj->material->id : 0, MATERIAL)
+      | SORT_KEY_FIELD(obj->mesh->id, MESH);
+  }
+}
+
+static void
+ReserveOrder(Renderer *ren,
+             Render_Scene *scene,
+             usize n)
+{
+  u32 capacity = scene->orderCapacity ? scene->orderCapacity : 64;
+
+  if (n <= scene->orderCapacity)
+  {
+    return;
+  }
+
+  while (capacity < n)
+  {
+    capacity *= 2;
+  }
+
+  FreeOrder(ren, scene);
+  scene->keys = NEW_ARR(ren->alloc, u64, capacity, MEMORY_TAG_RENDERER);
+  scene->tmpKeys = NEW_ARR(ren->alloc, u64, capacity, MEMORY_TAG_RENDERER);
+  scene->order = NEW_ARR(ren->alloc, u32, capacity, MEMORY_TAG_RENDERER);
+  scene->tmpOrder = NEW_ARR(ren->alloc, u32, capacity, MEMORY_TAG_RENDERER);
+  scene->orderCapacity = capacity;
+  scene->orderAll = false;
+}
+
+static void
+FreeOrder(Renderer *ren,
+          Render_Scene *scene)
+{
+  u32 capacity = scene->orderCapacity;
+
+  if (capacity == 0)
+  {
+    return;
+  }
+
+  FREE_ARR(ren->alloc, scene->keys, u64, capacity, MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, scene->tmpKeys, u64, capacity, MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, scene->order, u32, capacity, MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, scene->tmpOrder, u32, capacity, MEMORY_TAG_RENDERER);
+  scene->orderCapacity = 0;
+}
+
+static void
+StartBuild(Renderer *ren,
+           Render_Scene *scene)
+{
+  BvhBuildBegin(&scene->bvh, &scene->build);
+  VectorEmpty(&scene->buildTouched);
+
+  if (scene->buildThread == NULL)
+  {
+    BvhBuildRun(&scene->build);
+    BvhBuildAdopt(&scene->bvh, &scene->build);
+    return;
+  }
+
+  scene->building = true;
+  SemaphoreSignal(scene->buildStart);
+}
+
+/*
+ * Adopts a finished build, then brings it up to date by reinserting every
+ * object touched since the build started.
+ */
+static void
+FinishBuild(Renderer *ren,
+            Render_Scene *scene)
+{
+  Bvh *bvh = &scene->bvh;
+  bool done;
+
+  if (!scene->building)
+  {
+    return;
+  }
+
+  MutexAcquire(scene->buildMutex);
+  done = scene->buildDone;
+  scene->buildDone = false;
+  MutexRelease(scene->buildMutex);
+  if (!done)
+  {
+    return;
+  }
+
+  scene->building = false;
+  BvhBuildAdopt(bvh, &scene->build);
+
+  u32 *touched = (u32 *) scene->buildTouched.buf;
+  for (usize i = 0; i < scene->buildTouched.elemsUsed; i++)
+  {
+    u32 slot = touched[i];
+    Render_Object *obj = SlotObject(scene, slot);
+
+    if (BvhContains(bvh, slot))
+    {
+      BvhRemove(bvh, slot);
+    }
+
+    if (obj != NULL && !obj->boundsStale)
+    {
+      BvhInsert(bvh, slot, &obj->box);
+    }
+  }
+  VectorEmpty(&scene->buildTouched);
+}
+
+static void
+RunBuilds(void *ud)
+{
+  Render_Scene *scene = (Render_Scene *) ud;
+
+  while (true)
+  {
+    SemaphoreWait(scene->buildStart);
+    if (scene->buildQuit)
+    {
+      return;
+    }
+
+    BvhBuildRun(&scene->build);
+
+    MutexAcquire(scene->buildMutex);
+    scene->buildDone = true;
+    MutexRelease(scene->buildMutex);
+  }
+}
+
+/*
+ * Tests the ray against the object's triangles in model space if its mesh
+ * kept its positions, otherwise accepts the hit on its box.
+ */
+static f32
+PickObject(void *ud,
+           u32 item,
+           Vec3 origin,
+           Vec3 dir,
+           f32 maxT)
+{
+  Renderer *ren = (Renderer *) ud;
+  Render_Object *obj = SlotObject(&ren->scene, item);
+  Static_Mesh_Cpu_Data data;
+  Mat4 inv;
+  f32 best = -1.0f;
+
+  if (obj == NULL)
+  {
+    return -1.0f;
+  }
+
+  if (RendererGetStaticMeshCpuData(ren, obj->mesh, &data) != ERR_OK)
+  {
+    Vec3 invDir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+    f32 tMin = 0.0f, tMax = maxT;
+
+    for (usize i = 0; i < 3; i++)
+    {
+      f32 t0 = (obj->box.min[i] - origin[i]) * invDir[i];
+      f32 t1 = (obj->box.max[i] - origin[i]) * invDir[i];
+
+      tMin = fmaxf(tMin, fminf(t0, t1));
+      tMax = fminf(tMax, fmaxf(t0, t1));
+    }
+
+    return tMin <= tMax ? tMin : -1.0f;
+  }
+
+  /* An affine transform keeps the ray parameter, so t carries over. */
+  Mat4Inverse(ren->transforms.world[obj->transform], inv);
+  Vec4 o = {origin[0], origin[1], origin[2], 1.0f};
+  Vec4 d = {dir[0], dir[1], dir[2], 0.0f};
+  Mat4MulVec4(inv, o, o);
+  Mat4MulVec4(inv, d, d);
+
+  for (usize i = 0; i + 2 < data.nIndices; i += 3)
+  {
+    const f32 *v[3];
+    Vec3 e1, e2, p, s, q;
+
+    for (usize k = 0; k < 3; k++)
+    {
+      v[k] = (const f32 *) ((const u8 *) data.positions
+          + data.indices[i + k] * data.stride);
+    }
+
+    for (usize k = 0; k < 3; k++)
+    {
+      e1[k] = v[1][k] - v[0][k];
+      e2[k] = v[2][k] - v[0][k];
+      s[k] = o[k] - v[0][k];
+    }
+
+    Vec3Cross(d, e2, p);
+    f32 det = Vec3Dot(e1, p);
+    if (fabsf(det) < 1e-8f)
+    {
+      continue;
+    }
+
+    f32 invDet = 1.0f / det;
+    f32 u = Vec3Dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+    {
+      continue;
+    }
+
+    Vec3Cross(s, e1, q);
+    f32 w = Vec3Dot(d, q) * invDet;
+    if (w < 0.0f || u + w > 1.0f)
+    {
+      continue;
+    }
+
+    f32 t = Vec3Dot(e2, q) * invDet;
+    if (t >= 0.0f && t < maxT && (best < 0.0f || t < best))
+    {
+      best = t;
+    }
+  }
+
+  return best;
+}
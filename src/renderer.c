@@ -4,6 +4,8 @@
  * Vulkan renderer.
  */
 
+#include <float.h>
+
 #include <stb_image.h>
 
 #include <notte/renderer.h>
@@ -13,6 +15,15 @@
 #include <notte/renderer_priv.h>
 #include <notte/material.h>
 #include <notte/render_graph.h>
+#include <notte/deletion_queue.h>
+#include <notte/vk_mem.h>
+#include <notte/geometry_pool.h>
+#include <notte/radix_sort.h>
+#include <notte/gpu_cull.h>
+#include <notte/gpu_profiler.h>
+#include <notte/profile.h>
+#include <notte/render_scene.h>
+#include <notte/offscreen.h>
 
 /* === MACROS === */
 
@@ -21,6 +32,13 @@
 
 #define INIT_DRAW_CALLS_ALLOC 32
 
+/* 
+ * Rebuilt techniques allocate new descriptor sets before their old ones have
+ * left the deletion queue, so the pool needs room for more than one set per 
+ * frame.
+ */
+#define DESCRIPTOR_SETS_PER_FRAME 8
+
 /* === CONSTANTS === */
 
 const char *requiredLayers[] = {
@@ -35,18 +53,23 @@ const char *requiredDeviceExtensions[] = {
   VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
-Vec3 X_AXIS = {1.0f, 0.0f, 0.0f};
-Vec3 Y_AXIS = {0.0f, 1.0f, 0.0f};
-Vec3 Z_AXIS = {0.0f, 0.0f, 1.0f};
-
 /* === PROTOTYPES === */
 
 static void TransformToMatrix(Transform trans, Mat4 out);
-static void DrawTri(Renderer *ren, VkCommandBuffer buf);
+static void DrawTri(Renderer *ren, VkCommandBuffer buf, u32 chunk, 
+    u32 nChunks);
+static u32 CountDrawUnits(Renderer *ren);
+static void GatherChunkStats(Renderer *ren);
+static void SortDrawCalls(Renderer *ren, Technique *defaultTech);
+static void CullDrawCalls(Renderer *ren, Vec4 *planes);
+static void PrepareDraws(Renderer *ren);
+static bool PushDraw(Renderer *ren, Technique *tech, Static_Mesh *mesh, 
+    Material *mat, Mat4 model);
+static void ComputeMeshBounds(Static_Mesh *mesh, 
+    const Static_Mesh_Upload *upload);
+static void DrawSortReserve(Renderer *ren, usize n);
+static void DrawSortDestroy(Renderer *ren);
 static Err_Code StructureRenderGraph(Renderer *ren);
-static Err_Code CreateDepth(Renderer *ren);
-static Err_Code CreateImageView(Renderer *ren, VkImage image, VkFormat format, 
-    VkImageAspectFlags aspectFlags, VkImageView *view);
 static void CopyBufferToImage(Renderer *ren, VkBuffer buffer, VkImage image, 
     u32 w, u32 h);
 static void TransitionImageLayout(Renderer *ren, VkImage image, VkFormat format,
@@ -68,8 +91,14 @@ static Err_Code CreateLogicalDevice(Renderer *ren);
 static Err_Code CreateSwapchain(Renderer *ren, Swapchain *swapchain);
 static void DestroySwapchain(Renderer *ren, Swapchain *swapchain);
 static Err_Code RebuildSwapchain(Renderer *ren);
+static Err_Code RebuildResize(Renderer *ren);
 static void CopyBuffer(Renderer *ren, VkBuffer srcBuffer, VkBuffer dstBuffer, 
     VkDeviceSize size);
+static void CopyStagingToMesh(Renderer *ren, Static_Mesh *mesh);
+static void RetainMeshData(Renderer *ren, Static_Mesh *mesh, 
+    const Static_Vert *verts, const u32 *indices, 
+    Static_Mesh_Retention retention, bool owned);
+static void ReleaseMeshData(Renderer *ren, Static_Mesh *mesh);
 static Err_Code CreateCommandPools(Renderer *ren);
 static void DestroyCommandPools(Renderer *ren);
 static void CameraSetMatrices(Renderer *ren, Camera *cam);
@@ -82,14 +111,52 @@ RendererCreate(Renderer_Create_Info *createInfo,
 {
   Err_Code err;
   Technique *tech;
-  Renderer *ren = NEW(createInfo->alloc, Renderer, MEMORY_TAG_RENDERER);
+  Renderer *ren;
+  static const VkPresentModeKHR presentModes[] =
+  {
+    [PRESENT_MODE_FIFO] = VK_PRESENT_MODE_FIFO_KHR,
+    [PRESENT_MODE_MAILBOX] = VK_PRESENT_MODE_MAILBOX_KHR,
+    [PRESENT_MODE_IMMEDIATE] = VK_PRESENT_MODE_IMMEDIATE_KHR,
+  };
 
+  if ((u32) createInfo->presentMode >= ELEMOF(presentModes))
+  {
+    LOG_ERROR("unknown present mode");
+    return ERR_INVALID_USAGE;
+  }
+
+  ren = NEW(createInfo->alloc, Renderer, MEMORY_TAG_RENDERER);
   ren->win = createInfo->win;
+  ren->headless = createInfo->win == NULL;
+  ren->framesInFlight = createInfo->framesInFlight != 0
+    ? CLAMP(createInfo->framesInFlight, 1, MAX_FRAMES_IN_FLIGHT) 
+    : DEFAULT_FRAMES_IN_FLIGHT;
+  ren->presentMode = presentModes[createInfo->presentMode];
+  ren->lowLatency = createInfo->lowLatency;
+  ren->latencyWait = 0.0;
   ren->allocCbs = NULL;
   ren->alloc = createInfo->alloc;
   ren->fs = createInfo->fs;
+  ren->retainedMeshBytes = 0;
 
   ren->drawCalls = VECTOR_CREATE(ren->alloc, Draw_Call);
+  MemorySet(&ren->drawSort, 0, sizeof(ren->drawSort));
+  MemorySet(&ren->drawStats, 0, sizeof(ren->drawStats));
+  ren->nextMeshId = 0;
+  ren->drawBatches = VECTOR_CREATE(ren->alloc, Draw_Batch);
+  ren->drawGroups = VECTOR_CREATE(ren->alloc, Draw_Group);
+  CullBoundsInit(&ren->cullBounds, ren->alloc);
+  TransformStoreInit(&ren->transforms, ren->alloc);
+  RenderSceneInit(ren, &ren->scene);
+  ren->cull.enabled = createInfo->gpuDriven;
+  FrameStatsInit(&ren->frameStats, createInfo->statsWindow);
+  ren->lastDrawTime = 0.0;
+
+  if (ren->headless && (createInfo->width == 0 || createInfo->height == 0))
+  {
+    LOG_ERROR("headless renderers need a width and height");
+    return ERR_INVALID_USAGE;
+  }
 
   err = CreateInstance(ren);
   if (err)
@@ -98,13 +165,16 @@ RendererCreate(Renderer_Create_Info *createInfo,
   }
   LOG_DEBUG("created vulkan instance");
 
-  err = PlatWindowCreateVulkanSurface(ren->win, ren->vk, ren->allocCbs, 
-      &ren->surface);
-  if (err)
+  if (!ren->headless)
   {
-    return err;
+    err = PlatWindowCreateVulkanSurface(ren->win, ren->vk, ren->allocCbs, 
+        &ren->surface);
+    if (err)
+    {
+      return err;
+    }
+    LOG_DEBUG("created surface");
   }
-  LOG_DEBUG("created surface");
 
   err = SelectPhysicalDevice(ren);
   if (err)
@@ -120,17 +190,23 @@ RendererCreate(Renderer_Create_Info *createInfo,
   }
   LOG_DEBUG("created logical device");
 
-  err = CreateSwapchain(ren, &ren->swapchain);
-  if (err)
+  if (ren->headless)
   {
-    return err;
-  }
-  LOG_DEBUG("created swapchain");
-
-  err = CreateDepth(ren);
-  if (err)  
+    err = OffscreenInit(ren, &ren->offscreen, createInfo->width, 
+        createInfo->height, createInfo->readbackFn, createInfo->readbackUd);
+    if (err)
+    {
+      return err;
+    }
+    LOG_DEBUG("created offscreen images");
+  } else
   {
-    return err;
+    err = CreateSwapchain(ren, &ren->swapchain);
+    if (err)
+    {
+      return err;
+    }
+    LOG_DEBUG("created swapchain");
   }
 
   err = CreateCommandPools(ren);
@@ -147,12 +223,29 @@ RendererCreate(Renderer_Create_Info *createInfo,
   }
   LOG_DEBUG("created descriptor pools");
 
+  err = DeletionQueueInit(ren, &ren->deletions);
+  if (err)
+  {
+    return err;
+  }
+
   err = CreateBuffers(ren);
   if (err)
   {
     return err;
   }
 
+  err = GeometryPoolInit(ren, &ren->geometry, 
+      createInfo->maxStaticVerts ? createInfo->maxStaticVerts 
+                                 : DEFAULT_MAX_STATIC_VERTS,
+      createInfo->maxStaticIndices ? createInfo->maxStaticIndices 
+                                   : DEFAULT_MAX_STATIC_INDICES);
+  if (err)
+  {
+    return err;
+  }
+  LOG_DEBUG("created geometry pool");
+
   err = CreateTextures(ren);
   if (err)
   {
@@ -208,7 +301,23 @@ RendererCreate(Renderer_Create_Info *createInfo,
   }
   LOG_DEBUG("loaded 'materials.bson'");
 
-  err = RenderGraphInit(ren, &ren->graph);
+  err = GpuCullInit(ren, &ren->cull);
+  if (err)
+  {
+    return err;
+  }
+  if (ren->cull.enabled)
+  {
+    LOG_DEBUG("created GPU culling pass");
+  }
+
+  err = GpuProfilerInit(ren, &ren->gpuProfiler);
+  if (err)
+  {
+    return err;
+  }
+
+  err = RenderGraphInit(ren, &ren->graph, createInfo->recordThreads);
   if (err)
   {
     return err;
@@ -231,58 +340,108 @@ RendererDraw(Renderer *ren)
   VkResult vkErr;
   uint32_t imageIndex;
   Err_Code err;
+  f64 startTime = PlatGetTime(), time;
 
-  err = ShaderManagerReload(ren, &ren->shaders);
+  if (ren->lastDrawTime > 0.0)
+  {
+    FrameStatsRecord(&ren->frameStats, FRAME_STAT_CPU_FRAME, 
+        startTime - ren->lastDrawTime);
+  }
+  ren->lastDrawTime = startTime;
+
+  PROFILE_ZONE("reload shaders")
+  {
+    err = ShaderManagerReload(ren, &ren->shaders);
+  }
   if (err)
   {
     return err;
   }
 
-  vkWaitForFences(ren->dev, 1, &ren->graph.inFlightFences[ren->currentFrame], 
-      VK_TRUE, UINT64_MAX);
-  vkErr = vkAcquireNextImageKHR(ren->dev, ren->swapchain.swapchain, UINT64_MAX, 
-      ren->graph.imageAvailableSemaphores[ren->currentFrame], VK_NULL_HANDLE, 
-      &imageIndex);
-  if (vkErr == VK_ERROR_OUT_OF_DATE_KHR)
+  PROFILE_ZONE("wait frame")
   {
-    RebuildResize(ren);
-    return ERR_OK;
-  } else if (vkErr && vkErr != VK_SUBOPTIMAL_KHR)
+    time = PlatGetTime();
+    err = RenderGraphWaitFrame(&ren->graph);
+    FrameStatsRecord(&ren->frameStats, FRAME_STAT_FENCE_WAIT, 
+        PlatGetTime() - time + ren->latencyWait);
+    ren->latencyWait = 0.0;
+  }
+  if (err)
   {
-    return ERR_LIBRARY_FAILURE;
+    return err;
   }
+  GpuProfilerCollect(ren, &ren->gpuProfiler);
+  OffscreenCollect(ren, &ren->offscreen);
+  DeletionQueueFlush(ren, &ren->deletions, ren->currentFrame);
+  UniformArenaReset(&ren->uniforms[ren->currentFrame]);
+  InstanceBufferReset(&ren->instances[ren->currentFrame]);
 
-  vkResetFences(ren->dev, 1, &ren->graph.inFlightFences[ren->currentFrame]);
-
-  vkResetCommandBuffer(ren->graph.commandBuffers[ren->currentFrame], 0);
+  /* Headless renderers have an offscreen image per frame in flight. */
+  if (ren->headless)
+  {
+    imageIndex = ren->currentFrame;
+  } else
+  {
+    PROFILE_ZONE("acquire")
+    {
+      time = PlatGetTime();
+      vkErr = vkAcquireNextImageKHR(ren->dev, ren->swapchain.swapchain, 
+          UINT64_MAX, ren->graph.imageAvailableSemaphores[ren->currentFrame], 
+          VK_NULL_HANDLE, &imageIndex);
+      FrameStatsRecord(&ren->frameStats, FRAME_STAT_ACQUIRE, 
+          PlatGetTime() - time);
+    }
+    if (vkErr == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+      RebuildResize(ren);
+      return ERR_OK;
+    } else if (vkErr && vkErr != VK_SUBOPTIMAL_KHR)
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
+  }
 
-  RenderGraphRecord(&ren->graph, imageIndex);
+  PROFILE_ZONE("prepare draws")
+  {
+    PrepareDraws(ren);
+  }
+  PROFILE_COUNTER("visible draws", ren->drawStats.visible);
+  VkCommandBuffer cullCmd = GpuCullRecord(ren, &ren->cull);
 
-  VkSemaphore waitSemaphores[] = 
-    {ren->graph.imageAvailableSemaphores[ren->currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  VkSemaphore signalSemaphores[] = 
-    {ren->graph.renderFinishedSemaphores[ren->currentFrame]};
+  PROFILE_ZONE("record")
+  {
+    err = RenderGraphRecord(&ren->graph, imageIndex);
+  }
+  if (err)
+  {
+    return err;
+  }
+  GatherChunkStats(ren);
 
-  VkSubmitInfo submitInfo =
+  /* 
+   * Culling and readback are recorded separately, but run first and last in 
+   * the same submission.
+   */
+  PROFILE_ZONE("submit")
   {
-    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = waitSemaphores,
-    .pWaitDstStageMask = waitStages,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &ren->graph.commandBuffers[ren->currentFrame],
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = signalSemaphores,
-  };
+    err = RenderGraphSubmit(&ren->graph, cullCmd, 
+        OffscreenRecordReadback(ren, &ren->offscreen));
+  }
+  if (err)
+  {
+    return err;
+  }
 
-  vkErr = vkQueueSubmit(ren->graphicsQueue, 1, &submitInfo, 
-      ren->graph.inFlightFences[ren->currentFrame]);
-  if (vkErr)
+  if (ren->headless)
   {
-    return ERR_LIBRARY_FAILURE;
+    FrameStatsEndFrame(&ren->frameStats);
+    ren->currentFrame = (ren->currentFrame + 1) % ren->framesInFlight;
+    return ERR_OK;
   }
 
+  VkSemaphore signalSemaphores[] = 
+    {ren->graph.renderFinishedSemaphores[ren->currentFrame]};
+
   VkSwapchainKHR swapchains[] = {ren->swapchain.swapchain};
 
   VkPresentInfoKHR presentInfo =
@@ -295,7 +454,13 @@ RendererDraw(Renderer *ren)
     .pImageIndices= &imageIndex,
   };
 
-  vkErr = vkQueuePresentKHR(ren->presentQueue, &presentInfo);
+  PROFILE_ZONE("present")
+  {
+    time = PlatGetTime();
+    vkErr = vkQueuePresentKHR(ren->presentQueue, &presentInfo);
+    FrameStatsRecord(&ren->frameStats, FRAME_STAT_PRESENT, 
+        PlatGetTime() - time);
+  }
   if (vkErr == VK_ERROR_OUT_OF_DATE_KHR || vkErr == VK_SUBOPTIMAL_KHR)
   {
     RebuildResize(ren);
@@ -304,28 +469,76 @@ RendererDraw(Renderer *ren)
     return ERR_LIBRARY_FAILURE;
   }
 
-  ren->currentFrame = (ren->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  FrameStatsEndFrame(&ren->frameStats);
+  ren->currentFrame = (ren->currentFrame + 1) % ren->framesInFlight;
   return ERR_OK;
 }
 
+Err_Code
+RendererWaitForLatency(Renderer *ren)
+{
+  Err_Code err = ERR_OK;
+  f64 time;
+
+  if (!ren->lowLatency)
+  {
+    return ERR_OK;
+  }
+
+  PROFILE_ZONE("wait latency")
+  {
+    time = PlatGetTime();
+    err = RenderGraphWaitLast(&ren->graph);
+    ren->latencyWait += PlatGetTime() - time;
+  }
+  return err;
+}
+
+Err_Code
+RendererFlushReadbacks(Renderer *ren)
+{
+  if (!ren->headless)
+  {
+    return ERR_OK;
+  }
+
+  return OffscreenFlush(ren, &ren->offscreen);
+}
+
 void 
 RendererDestroy(Renderer *ren)
 {
   /* First finish all GPU work. */
   vkDeviceWaitIdle(ren->dev);
   VectorDestroy(&ren->drawCalls, ren->alloc);
+  VectorDestroy(&ren->drawBatches, ren->alloc);
+  VectorDestroy(&ren->drawGroups, ren->alloc);
+  CullBoundsDeinit(&ren->cullBounds);
+  RenderSceneDeinit(ren, &ren->scene);
+  TransformStoreDeinit(&ren->transforms);
+  DrawSortDestroy(ren);
+  GpuCullDeinit(ren, &ren->cull);
+  GpuProfilerDeinit(ren, &ren->gpuProfiler);
   DestroyBuffers(ren);
 
   DestroyTextures(ren);
   DestroyCommandPools(ren);
+  DeletionQueueDeinit(ren, &ren->deletions);
+  GeometryPoolDeinit(ren, &ren->geometry);
   DestroyDescriptorPool(ren);
   RenderGraphDeinit(&ren->graph);
   MaterialManagerDeinit(ren, &ren->materials);
   EffectManagerDeinit(ren, &ren->effects);
   TechniqueManagerDeinit(ren, &ren->techs);
   ShaderManagerDeinit(ren, &ren->shaders);
-  DestroySwapchain(ren, &ren->swapchain);
-  vkDestroySurfaceKHR(ren->vk, ren->surface, ren->allocCbs);
+  if (ren->headless)
+  {
+    OffscreenDeinit(ren, &ren->offscreen);
+  } else
+  {
+    DestroySwapchain(ren, &ren->swapchain);
+    vkDestroySurfaceKHR(ren->vk, ren->surface, ren->allocCbs);
+  }
   vkDestroyDevice(ren->dev, ren->allocCbs);
   vkDestroyInstance(ren->vk, ren->allocCbs);
   FREE(ren->alloc, ren, Renderer, MEMORY_TAG_RENDERER);
@@ -335,79 +548,155 @@ Err_Code
 RendererCreateStaticMesh(Renderer *ren, 
                          Static_Mesh_Create_Info *createInfo, 
                          Static_Mesh **meshOut)
+{
+  Err_Code err;
+  Static_Mesh_Upload upload = 
+  {
+    .nVerts = createInfo->nVerts,
+    .nIndices = createInfo->nIndices,
+    .retention = createInfo->retention,
+  };
+
+  /* Ownership was handed over, so the arrays are freed even on failure. */
+  err = RendererBeginStaticMesh(ren, &upload);
+  if (err)
+  {
+    if (createInfo->takeOwnership)
+    {
+      FREE_ARR(ren->alloc, (void *) createInfo->verts, Static_Vert, 
+          createInfo->nVerts, MEMORY_TAG_ARRAY);
+      FREE_ARR(ren->alloc, (void *) createInfo->indices, u32, 
+          createInfo->nIndices, MEMORY_TAG_ARRAY);
+    }
+    return err;
+  }
+
+  MemoryCopy(upload.verts, createInfo->verts, 
+      sizeof(Static_Vert) * upload.nVerts);
+  RendererAddStaticMeshBounds(&upload, createInfo->verts, upload.nVerts);
+  MemoryCopy(upload.indices, createInfo->indices, 
+      sizeof(u32) * upload.nIndices);
+
+  /* 
+   * Retain from the caller's arrays rather than letting RendererEndStaticMesh 
+   * read back the write-combined staging memory.
+   */
+  RetainMeshData(ren, upload.mesh, createInfo->verts, createInfo->indices, 
+      createInfo->retention, createInfo->takeOwnership);
+
+  return RendererEndStaticMesh(ren, &upload, meshOut);
+}
+
+Err_Code
+RendererBeginStaticMesh(Renderer *ren,
+                        Static_Mesh_Upload *upload)
 {
   Err_Code err;
   void *data;
   VkResult vkErr;
-  VkBuffer vStagingBuffer, iStagingBuffer;
-  VkDeviceMemory vStagingBufferMemory, iStagingBufferMemory;
   VkDeviceSize vBufferSize, iBufferSize;
 
   Static_Mesh *mesh = NEW(ren->alloc, Static_Mesh, MEMORY_TAG_RENDERER);
 
-  mesh->nVerts = createInfo->nVerts;
-  mesh->nIndices = createInfo->nIndices;
-  Static_Vert *verts = NEW_ARR(ren->alloc, Static_Vert, mesh->nVerts, MEMORY_TAG_ARRAY);
-  MemoryCopy(verts, createInfo->verts, sizeof(Static_Vert) * mesh->nVerts);
-  u32 *indices = NEW_ARR(ren->alloc, u32, mesh->nIndices, MEMORY_TAG_ARRAY);
-  MemoryCopy(indices, createInfo->indices, sizeof(u32) * mesh->nIndices);
-
-  mesh->verts = verts;
-  mesh->indices = indices;
-
+  mesh->nVerts = upload->nVerts;
+  mesh->nIndices = upload->nIndices;
+  mesh->verts = NULL;
+  mesh->positions = NULL;
+  mesh->indices = NULL;
+  mesh->retention = STATIC_MESH_RETAIN_NONE;
+  mesh->retained = false;
+  mesh->retainedBytes = 0;
+  mesh->id = ren->nextMeshId++;
+
+  /* 
+   * Vertices and indices share one staging buffer, so a mesh only costs a 
+   * single host visible allocation and a single mapping.
+   */
   vBufferSize = sizeof(Static_Vert) * mesh->nVerts;
-  err = CreateBuffer(ren, vBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+  iBufferSize = sizeof(u32) * mesh->nIndices;
+  err = CreateBuffer(ren, vBufferSize + iBufferSize, 
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &vStagingBuffer, &vStagingBufferMemory);
+      &mesh->stagingBuffer, &mesh->stagingMemory);
   if (err)
   {
+    FREE(ren->alloc, mesh, Static_Mesh, MEMORY_TAG_RENDERER);
     return err;
   }
 
-  vkMapMemory(ren->dev, vStagingBufferMemory, 0, vBufferSize, 0, &data);
-
-  MemoryCopy(data, mesh->verts, (usize) vBufferSize);
-  vkUnmapMemory(ren->dev, vStagingBufferMemory);
+  vkErr = vkMapMemory(ren->dev, mesh->stagingMemory, 0, 
+      vBufferSize + iBufferSize, 0, &data);
+  if (vkErr)
+  {
+    DestroyBuffer(ren, mesh->stagingBuffer, mesh->stagingMemory);
+    FREE(ren->alloc, mesh, Static_Mesh, MEMORY_TAG_RENDERER);
+    return ERR_LIBRARY_FAILURE;
+  }
 
-  err = CreateBuffer(ren, vBufferSize, 
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->vertexBuffer, 
-      &mesh->vertexMemory);
-  if (err)
+  upload->verts = (Static_Vert *) data;
+  upload->indices = (u32 *) ((u8 *) data + vBufferSize);
+  upload->mesh = mesh;
+  for (usize j = 0; j < 3; j++)
   {
-    return err;
+    upload->min[j] = FLT_MAX;
+    upload->max[j] = -FLT_MAX;
   }
+  return ERR_OK;
+}
 
-  CopyBuffer(ren, vStagingBuffer, mesh->vertexBuffer, vBufferSize);
+void
+RendererAddStaticMeshBounds(Static_Mesh_Upload *upload,
+                            const Static_Vert *verts,
+                            usize nVerts)
+{
+  for (usize i = 0; i < nVerts; i++)
+  {
+    for (usize j = 0; j < 3; j++)
+    {
+      f32 v = verts[i].pos[j];
+      upload->min[j] = v < upload->min[j] ? v : upload->min[j];
+      upload->max[j] = v > upload->max[j] ? v : upload->max[j];
+    }
+  }
+}
 
-  DestroyBuffer(ren, vStagingBuffer, vStagingBufferMemory);
+Err_Code
+RendererEndStaticMesh(Renderer *ren,
+                      Static_Mesh_Upload *upload,
+                      Static_Mesh **meshOut)
+{
+  Err_Code err;
+  Static_Mesh *mesh = upload->mesh;
 
-  iBufferSize = sizeof(u32) * mesh->nIndices;
-  err = CreateBuffer(ren, iBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &iStagingBuffer, &iStagingBufferMemory);
-  if (err)
+  if (!mesh->retained)
   {
-    return err;
+    RetainMeshData(ren, mesh, upload->verts, upload->indices, 
+        upload->retention, false);
   }
 
-  vkMapMemory(ren->dev, iStagingBufferMemory, 0, iBufferSize, 0, &data);
+  ComputeMeshBounds(mesh, upload);
 
-  MemoryCopy(data, mesh->indices, (usize) iBufferSize);
-  vkUnmapMemory(ren->dev, iStagingBufferMemory);
+  vkUnmapMemory(ren->dev, mesh->stagingMemory);
+  upload->verts = NULL;
+  upload->indices = NULL;
 
-  err = CreateBuffer(ren, iBufferSize, 
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->indexBuffer, 
-      &mesh->indexMemory);
+  err = GeometryPoolAlloc(&ren->geometry, mesh->nVerts, mesh->nIndices, 
+      &mesh->vertexOffset, &mesh->firstIndex);
   if (err)
   {
+    LOG_ERROR("static geometry pool exhausted");
+    DestroyBuffer(ren, mesh->stagingBuffer, mesh->stagingMemory);
+    ReleaseMeshData(ren, mesh);
+    FREE(ren->alloc, mesh, Static_Mesh, MEMORY_TAG_RENDERER);
+    upload->mesh = NULL;
     return err;
   }
 
-  CopyBuffer(ren, iStagingBuffer, mesh->indexBuffer, iBufferSize);
+  CopyStagingToMesh(ren, mesh);
 
-  DestroyBuffer(ren, iStagingBuffer, iStagingBufferMemory);
+  DestroyBuffer(ren, mesh->stagingBuffer, mesh->stagingMemory);
+  mesh->stagingBuffer = VK_NULL_HANDLE;
+  mesh->stagingMemory = VK_NULL_HANDLE;
 
   ren->mesh = mesh;
   *meshOut = mesh;
@@ -415,19 +704,77 @@ RendererCreateStaticMesh(Renderer *ren,
   return ERR_OK;
 }
 
+void
+RendererAbortStaticMesh(Renderer *ren,
+                        Static_Mesh_Upload *upload)
+{
+  Static_Mesh *mesh = upload->mesh;
+
+  vkUnmapMemory(ren->dev, mesh->stagingMemory);
+  DestroyBuffer(ren, mesh->stagingBuffer, mesh->stagingMemory);
+  ReleaseMeshData(ren, mesh);
+  FREE(ren->alloc, mesh, Static_Mesh, MEMORY_TAG_RENDERER);
+
+  upload->verts = NULL;
+  upload->indices = NULL;
+  upload->mesh = NULL;
+}
+
 void 
 RendererDestroyStaticMesh(Renderer *ren, 
                           Static_Mesh *mesh)
 {
-  vkDeviceWaitIdle(ren->dev);
-  FREE_ARR(ren->alloc, (void *) mesh->verts, Static_Vert, mesh->nVerts, MEMORY_TAG_ARRAY);
-  FREE_ARR(ren->alloc, (void *) mesh->indices, u32, mesh->nIndices, MEMORY_TAG_ARRAY);
-  DestroyBuffer(ren, mesh->vertexBuffer, mesh->vertexMemory);
-  DestroyBuffer(ren, mesh->indexBuffer, mesh->indexMemory);
+  Deletion del = 
+  {
+    .t = DELETION_STATIC_GEOMETRY,
+    .geometry = 
+    {
+      .vertexOffset = mesh->vertexOffset,
+      .nVerts = mesh->nVerts,
+      .firstIndex = mesh->firstIndex,
+      .nIndices = mesh->nIndices,
+    },
+  };
+
+  ReleaseMeshData(ren, mesh);
+  DeletionQueuePush(ren, &ren->deletions, &del);
 
   FREE(ren->alloc, mesh, Static_Mesh, MEMORY_TAG_RENDERER);
 }
 
+Err_Code
+RendererGetStaticMeshCpuData(Renderer *ren,
+                             Static_Mesh *mesh,
+                             Static_Mesh_Cpu_Data *data)
+{
+  (void) ren;
+
+  switch (mesh->retention)
+  {
+    case STATIC_MESH_RETAIN_NONE:
+      return ERR_INVALID_USAGE;
+    case STATIC_MESH_RETAIN_ALL:
+      data->positions = mesh->verts[0].pos;
+      data->stride = sizeof(Static_Vert);
+      break;
+    case STATIC_MESH_RETAIN_POSITIONS:
+      data->positions = mesh->positions[0];
+      data->stride = sizeof(Vec3);
+      break;
+  }
+
+  data->indices = mesh->indices;
+  data->nVerts = mesh->nVerts;
+  data->nIndices = mesh->nIndices;
+  return ERR_OK;
+}
+
+usize
+RendererGetRetainedMeshBytes(Renderer *ren)
+{
+  return ren->retainedMeshBytes;
+}
+
 void 
 RendererDrawStaticMesh(Renderer *ren, 
                        Static_Mesh *mesh, 
@@ -439,12 +786,197 @@ RendererDrawStaticMesh(Renderer *ren,
     .t = DRAW_CALL_STATIC_MESH,
     .staticMesh = mesh,
     .transform = transform,
+    .transformId = TRANSFORM_ID_NONE,
+    .material = mat,
+  };
+
+  VectorPush(&ren->drawCalls, ren->alloc, &drawCall);
+}
+
+Err_Code
+RendererCreateTransform(Renderer *ren, 
+                        Transform_Id parent, 
+                        Transform_Id *idOut)
+{
+  Transform_Store *store = &ren->transforms;
+
+  if (parent != TRANSFORM_ID_NONE && !TransformStoreIsAlive(store, parent))
+  {
+    LOG_ERROR("parent transform doesn't exist");
+    return ERR_INVALID_USAGE;
+  }
+
+  *idOut = TransformStoreAdd(store, parent);
+  return ERR_OK;
+}
+
+void
+RendererDestroyTransform(Renderer *ren, 
+                         Transform_Id id)
+{
+  if (!TransformStoreIsAlive(&ren->transforms, id))
+  {
+    LOG_ERROR("transform doesn't exist");
+    return;
+  }
+
+  TransformStoreRemove(&ren->transforms, id);
+}
+
+void
+RendererSetTransform(Renderer *ren, 
+                     Transform_Id id, 
+                     Transform trans)
+{
+  Vec3 rot = {
+    DegToRad(trans.rot[0]), 
+    DegToRad(trans.rot[1]), 
+    DegToRad(trans.rot[2]),
+  };
+  Vec4 quat;
+
+  if (!TransformStoreIsAlive(&ren->transforms, id))
+  {
+    LOG_ERROR("transform doesn't exist");
+    return;
+  }
+
+  QuatFromEuler(rot, quat);
+  TransformStoreSet(&ren->transforms, id, trans.pos, quat);
+}
+
+void
+RendererSetTransformScale(Renderer *ren, 
+                          Transform_Id id, 
+                          Vec3 scale)
+{
+  if (!TransformStoreIsAlive(&ren->transforms, id))
+  {
+    LOG_ERROR("transform doesn't exist");
+    return;
+  }
+
+  TransformStoreSetScale(&ren->transforms, id, scale);
+}
+
+void 
+RendererDrawStaticMeshAt(Renderer *ren, 
+                         Static_Mesh *mesh, 
+                         Transform_Id id,
+                         Material *mat)
+{
+  Draw_Call drawCall = 
+  {
+    .t = DRAW_CALL_STATIC_MESH,
+    .staticMesh = mesh,
+    .transformId = id,
     .material = mat,
   };
 
+  if (!TransformStoreIsAlive(&ren->transforms, id))
+  {
+    LOG_ERROR("transform doesn't exist");
+    return;
+  }
+
   VectorPush(&ren->drawCalls, ren->alloc, &drawCall);
 }
 
+Err_Code
+RendererAddRenderObject(Renderer *ren, 
+                        Render_Object_Info *info,
+                        Render_Object_Handle *handleOut)
+{
+  return RenderSceneAdd(ren, &ren->scene, info, handleOut);
+}
+
+Err_Code
+RendererUpdateRenderObject(Renderer *ren, 
+                           Render_Object_Handle handle,
+                           Render_Object_Info *info)
+{
+  return RenderSceneUpdate(ren, &ren->scene, handle, info);
+}
+
+Err_Code
+RendererRemoveRenderObject(Renderer *ren, 
+                           Render_Object_Handle handle)
+{
+  return RenderSceneRemove(ren, &ren->scene, handle);
+}
+
+bool
+RendererPickRenderObject(Renderer *ren,
+                         Vec3 origin,
+                         Vec3 dir,
+                         Render_Object_Handle *handleOut,
+                         f32 *distOut)
+{
+  return RenderScenePick(ren, &ren->scene, origin, dir, handleOut, distOut);
+}
+
+void
+RendererGetCullStats(Renderer *ren, 
+                     u32 *visible, 
+                     u32 *culled)
+{
+  *visible = ren->drawStats.visible;
+  *culled = ren->drawStats.culled;
+}
+
+void
+RendererSetRecordThreads(Renderer *ren,
+                         u32 nThreads)
+{
+  RenderGraphSetThreads(&ren->graph, nThreads);
+}
+
+void
+RendererGetRecordStats(Renderer *ren,
+                       Record_Stats *stats)
+{
+  *stats = ren->graph.stats;
+}
+
+bool
+RendererGetGpuFrameTiming(Renderer *ren,
+                          Gpu_Timing *timing)
+{
+  return GpuTimingGet(&ren->gpuProfiler.frame, "frame", timing);
+}
+
+u32
+RendererGetGpuPassTimings(Renderer *ren,
+                          Gpu_Timing *timings,
+                          u32 maxTimings)
+{
+  return GpuProfilerGetPassTimings(ren, timings, maxTimings);
+}
+
+usize
+RendererDumpGpuTimings(Renderer *ren,
+                       char *buf,
+                       usize size)
+{
+  return GpuProfilerDump(ren, buf, size);
+}
+
+void
+RendererGetFrameStats(Renderer *ren,
+                      Frame_Stat stat,
+                      Frame_Stats_Range range,
+                      Frame_Stat_Summary *summary)
+{
+  FrameStatsGet(&ren->frameStats, stat, range, summary);
+}
+
+usize
+RendererDumpFrameStats(Renderer *ren,
+                       char *buf,
+                       usize size)
+{
+  return FrameStatsDump(&ren->frameStats, buf, size);
+}
 
 Err_Code 
 RendererCreateCamera(Renderer *ren, 
@@ -500,14 +1032,20 @@ RendererLookupMaterial(Renderer *ren,
 
 /* === PRIVATE FUNCTIONS === */
 
+/*
+ * Records chunk of nChunks even parts of the frame's draws.  The parts are
+ * ranges of batches, or of groups when the GPU builds the draws.
+ */
 static void 
 DrawTri(Renderer *ren, 
-        VkCommandBuffer buf)
+        VkCommandBuffer buf,
+        u32 chunk,
+        u32 nChunks)
 {
-  Technique *tech = TechniqueManagerLookup(&ren->techs, STRING_CSTR("tri"));
-
-  vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-      tech->pipeline);
+  Draw_Stats *stats = &ren->chunkStats[chunk];
+  u32 nUnits = CountDrawUnits(ren);
+  u32 first = (u32) ((u64) nUnits * chunk / nChunks);
+  u32 last = (u32) ((u64) nUnits * (chunk + 1) / nChunks);
 
   VkViewport viewport =
   {
@@ -527,53 +1065,404 @@ DrawTri(Renderer *ren,
     .extent = ren->swapchain.extent,
   };
 
-  vkCmdSetScissor(buf, 0, 1, &scissor);
+  vkCmdSetScissor(buf, 0, 1, &scissor);
+
+  GeometryPoolBind(&ren->geometry, buf);
+
+  for (u32 g = 0; g < ren->drawGroups.elemsUsed; g++)
+  {
+    Draw_Group *group = VectorIdx(&ren->drawGroups, g);
+    Technique *tech = group->tech;
+    u32 firstBatch = 0, lastBatch = 0;
+
+    if (ren->cull.active)
+    {
+      if (g < first || g >= last)
+      {
+        continue;
+      }
+    } else
+    {
+      firstBatch = group->firstBatch > first ? group->firstBatch : first;
+      lastBatch = group->firstBatch + group->nBatches;
+      lastBatch = lastBatch < last ? lastBatch : last;
+      if (firstBatch >= lastBatch)
+      {
+        continue;
+      }
+    }
+
+    vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, tech->pipeline);
+    vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        tech->layout, 0, 1, &tech->descriptorSets[ren->currentFrame], 1, 
+        &ren->camOffset);
+    stats->pipelineBinds++;
+    stats->descriptorBinds++;
+
+    if (ren->cull.active)
+    {
+      GpuCullDraw(ren, &ren->cull, buf, g, group);
+      stats->draws++;
+      continue;
+    }
+
+    for (u32 b = firstBatch; b < lastBatch; b++)
+    {
+      Draw_Batch *batch = VectorIdx(&ren->drawBatches, b);
+      Static_Mesh *mesh = batch->mesh;
+
+      vkCmdDrawIndexed(buf, mesh->nIndices, batch->nInstances, 
+          mesh->firstIndex, mesh->vertexOffset, batch->firstInstance);
+      stats->draws++;
+    }
+  }
+}
+
+static u32
+CountDrawUnits(Renderer *ren)
+{
+  return (u32) (ren->cull.active ? ren->drawGroups.elemsUsed 
+      : ren->drawBatches.elemsUsed);
+}
+
+/* Chunks count their binds and draws separately, as they run in parallel. */
+static void
+GatherChunkStats(Renderer *ren)
+{
+  Draw_Stats *stats = &ren->drawStats;
+
+  for (u32 i = 0; i < MAX_RECORD_THREADS; i++)
+  {
+    Draw_Stats *chunk = &ren->chunkStats[i];
+
+    stats->draws += chunk->draws;
+    stats->pipelineBinds += chunk->pipelineBinds;
+    stats->descriptorBinds += chunk->descriptorBinds;
+  }
+}
+
+/*
+ * Turns the frame's draw calls and the retained scene into instanced 
+ * batches, in sort key order and grouped by technique, writing their 
+ * transforms into the frame's instance buffer.  The scene sorts its own
+ * visible objects, so the per-frame draw calls are merged into them rather
+ * than sorted together.
+ * Runs before any recording, so the result can feed both the CPU and the GPU
+ * driven paths.
+ */
+static void
+PrepareDraws(Renderer *ren)
+{
+  Technique *defaultTech = TechniqueManagerLookup(&ren->techs, 
+      STRING_CSTR("tri"));
+  Draw_Sort *sort = &ren->drawSort;
+  Draw_Stats *stats = &ren->drawStats;
+  Render_Scene *scene = &ren->scene;
+  usize nCalls = ren->drawCalls.elemsUsed;
+  usize nObjects = scene->objects.elemsUsed;
+
+  MemorySet(stats, 0, sizeof(*stats));
+  MemorySet(ren->chunkStats, 0, sizeof(ren->chunkStats));
+  TransformStoreUpdate(&ren->transforms);
+  VectorEmpty(&ren->drawBatches);
+  VectorEmpty(&ren->drawGroups);
+  ren->cull.active = false;
+
+  if (ren->cam == NULL || (nCalls == 0 && nObjects == 0))
+  {
+    goto done;
+  }
+
+  Camera_Uniform *camUniform = UniformArenaPush(
+      &ren->uniforms[ren->currentFrame], sizeof(Camera_Uniform), 
+      &ren->camOffset);
+  if (camUniform == NULL)
+  {
+    LOG_ERROR("frame uniform arena exhausted");
+    goto done;
+  }
+  Mat4Copy(ren->cam->view, camUniform->view);
+  Mat4Copy(ren->cam->proj, camUniform->proj);
+
+  Mat4 viewProj;
+  Vec4 planes[6];
+  Mat4Mul(ren->cam->proj, ren->cam->view, viewProj);
+  Mat4FrustumPlanes(viewProj, planes);
+
+  /* With GPU culling the frustum test is left to the GPU. */
+  Vec4 *cpuPlanes = ren->cull.enabled ? NULL : planes;
+
+  DrawSortReserve(ren, nCalls);
+  stats->drawCalls = (u32) (nCalls + nObjects);
+  CullDrawCalls(ren, cpuPlanes);
+  nCalls = ren->drawCalls.elemsUsed;
+  SortDrawCalls(ren, defaultTech);
+
+  RenderScenePrepare(ren, scene, defaultTech, cpuPlanes);
+  stats->visible += scene->nOrder;
+  stats->culled += (u32) nObjects - scene->nOrder;
+
+  usize i = 0, j = 0;
+  while (true)
+  {
+    bool pushed;
+
+    if (j < scene->nOrder && (i == nCalls 
+          || scene->keys[j] <= (sort->keys[i] & ~SORT_KEY_DEPTH_MASK)))
+    {
+      Render_Object *obj = VectorIdx(&scene->objects, scene->order[j++]);
+
+      pushed = PushDraw(ren, obj->tech, obj->mesh, obj->material, 
+          ren->transforms.world[obj->transform]);
+    } else if (i < nCalls)
+    {
+      u32 idx = sort->indices[i++];
+      Draw_Call *call = VectorIdx(&ren->drawCalls, idx);
+
+      pushed = PushDraw(ren, MaterialTechnique(call->material, 
+            RENDER_PASS_GBUFFER, defaultTech), call->staticMesh, 
+          call->material, sort->models[idx]);
+    } else
+    {
+      break;
+    }
+
+    if (!pushed)
+    {
+      LOG_ERROR("frame instance buffer exhausted");
+      break;
+    }
+  }
+
+  GpuCullPrepare(ren, &ren->cull, viewProj);
+
+done:
+  VectorEmpty(&ren->drawCalls);
+}
+
+/*
+ * Appends one instance to the frame's draws.  It joins the last batch if 
+ * that draws the same mesh with the same material, since instances are
+ * allocated contiguously, and otherwise starts a batch, and a group if the
+ * technique changes.
+ */
+static bool
+PushDraw(Renderer *ren, 
+         Technique *tech, 
+         Static_Mesh *mesh, 
+         Material *mat, 
+         Mat4 model)
+{
+  Draw_Batch *batch = ren->drawBatches.elemsUsed == 0 ? NULL 
+    : VectorIdx(&ren->drawBatches, ren->drawBatches.elemsUsed - 1);
+  Draw_Group *group = ren->drawGroups.elemsUsed == 0 ? NULL 
+    : VectorIdx(&ren->drawGroups, ren->drawGroups.elemsUsed - 1);
+  u32 instance;
+
+  Instance_Data *data = InstanceBufferPush(
+      &ren->instances[ren->currentFrame], 1, &instance);
+  if (data == NULL)
+  {
+    return false;
+  }
+  Mat4Copy(model, data->model);
+
+  if (batch == NULL || batch->tech != tech || batch->mesh != mesh 
+      || batch->material != mat)
+  {
+    Draw_Batch newBatch = 
+    {
+      .tech = tech,
+      .mesh = mesh,
+      .material = mat,
+      .firstInstance = instance,
+    };
+    batch = VectorPush(&ren->drawBatches, ren->alloc, &newBatch);
+
+    if (group == NULL || group->tech != tech)
+    {
+      Draw_Group newGroup = 
+      {
+        .tech = tech,
+        .firstBatch = (u32) ren->drawBatches.elemsUsed - 1,
+        .firstInstance = instance,
+      };
+      group = VectorPush(&ren->drawGroups, ren->alloc, &newGroup);
+    }
+    group->nBatches++;
+  }
+
+  batch->nInstances++;
+  group->nInstances++;
+  return true;
+}
+
+/*
+ * Builds every draw call's sort key and radix sorts them, leaving the sorted
+ * keys and draw call indices in ren->drawSort.  Depth is the view space 
+ * distance, bucketed between the camera's near and far planes.
+ */
+static void
+SortDrawCalls(Renderer *ren, 
+              Technique *defaultTech)
+{
+  Draw_Sort *sort = &ren->drawSort;
+  usize nCalls = ren->drawCalls.elemsUsed;
+  Mat4 *view = &ren->cam->view;
+  f32 depthScale = (f32) ((1u << SORT_KEY_DEPTH_BITS) - 1) 
+    / (CAMERA_FAR - CAMERA_NEAR);
+
+  for (usize i = 0; i < nCalls; i++)
+  {
+    Draw_Call *call = VectorIdx(&ren->drawCalls, i);
+    Technique *tech = MaterialTechnique(call->material, RENDER_PASS_GBUFFER,
+        defaultTech);
+    f32 *pos = sort->models[i][3];
+
+    f32 viewZ = (*view)[0][2] * pos[0] + (*view)[1][2] * pos[1] 
+      + (*view)[2][2] * pos[2] + (*view)[3][2];
+    f32 depth = (-viewZ - CAMERA_NEAR) * depthScale;
+    u32 depthBucket;
+    if (depth <= 0.0f)
+    {
+      depthBucket = 0;
+    } else if (depth >= (f32) ((1u << SORT_KEY_DEPTH_BITS) - 1))
+    {
+      depthBucket = (1u << SORT_KEY_DEPTH_BITS) - 1;
+    } else
+    {
+      depthBucket = (u32) depth;
+    }
+
+    call->key = SORT_KEY_FIELD(RENDER_PASS_GBUFFER, PASS)
+      | SORT_KEY_FIELD(tech->id, TECH)
+      | SORT_KEY_FIELD(call->material ? call->material->id : 0, MATERIAL)
+      | SORT_KEY_FIELD(call->staticMesh->id, MESH)
+      | SORT_KEY_FIELD(depthBucket, DEPTH);
+
+    sort->keys[i] = call->key;
+    sort->indices[i] = (u32) i;
+  }
+
+  RadixSort64(sort->keys, sort->indices, sort->tmpKeys, sort->tmpIndices, 
+      nCalls);
+}
+
+/*
+ * Fetches or computes every draw call's model matrix and world space bounds,
+ * and drops the calls which are outside the frustum given by planes, keeping 
+ * ren->drawCalls and the models in ren->drawSort parallel.  With planes NULL
+ * nothing is culled.
+ */
+static void
+CullDrawCalls(Renderer *ren, 
+              Vec4 *planes)
+{
+  Draw_Sort *sort = &ren->drawSort;
+  Draw_Stats *stats = &ren->drawStats;
+  Cull_Bounds *bounds = &ren->cullBounds;
+  usize nCalls = ren->drawCalls.elemsUsed;
+  usize nVisible = 0;
+
+  for (usize i = 0; i < nCalls; i++)
+  {
+    Draw_Call *call = VectorIdx(&ren->drawCalls, i);
+
+    if (call->transformId != TRANSFORM_ID_NONE)
+    {
+      Mat4Copy(ren->transforms.world[call->transformId], sort->models[i]);
+    } else
+    {
+      TransformToMatrix(call->transform, sort->models[i]);
+    }
+  }
 
-  if (ren->cam == NULL)
+  if (planes == NULL)
   {
-    goto skipDraw;
+    stats->visible = (u32) nCalls;
+    stats->culled = 0;
+    return;
   }
 
-  Camera_Uniform camUniform;
-  Mat4Copy(ren->cam->view, camUniform.view);
-  Mat4Copy(ren->cam->proj, camUniform.proj);
+  CullBoundsResize(bounds, nCalls);
+  for (usize i = 0; i < nCalls; i++)
+  {
+    Draw_Call *call = VectorIdx(&ren->drawCalls, i);
+    Static_Mesh *mesh = call->staticMesh;
 
-  void *data;
-  vkMapMemory(ren->dev, ren->uniformMemory[ren->currentFrame], 0, 
-      sizeof(Camera_Uniform), 0, &data);
-  MemoryCopy(data, &camUniform, sizeof(Camera_Uniform));
-  vkUnmapMemory(ren->dev, ren->uniformMemory[ren->currentFrame]);
+    CullBoundsSetTransformed(bounds, i, mesh->sphere, mesh->extent, 
+        mesh->sphere[3], sort->models[i]);
+  }
+
+  FrustumCull(bounds, planes);
 
-  for (usize i = 0; i < ren->drawCalls.elemsUsed; i++)
+  for (usize i = 0; i < nCalls; i++)
   {
-    Draw_Call *call = VectorIdx(&ren->drawCalls, i);
+    if (!bounds->visible[i])
+    {
+      continue;
+    }
 
-    switch (call->t)
+    if (nVisible != i)
     {
-      case DRAW_CALL_STATIC_MESH:
-      {
-        Static_Mesh *mesh = call->staticMesh;
-        Mesh_Push_Constant meshConstants;
-        TransformToMatrix(call->transform, meshConstants.model);
-
-        VkBuffer vertexBuffers[] = {mesh->vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-
-        vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(buf, mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-            tech->layout, 0, 1, &tech->descriptorSets[ren->currentFrame], 0, 
-            NULL);
-        vkCmdPushConstants(buf, tech->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, 
-            sizeof(Mesh_Push_Constant), &meshConstants);
-        vkCmdDrawIndexed(buf, mesh->nIndices, 1, 0, 0, 0);
-      }
+      MemoryCopy(VectorIdx(&ren->drawCalls, nVisible), 
+          VectorIdx(&ren->drawCalls, i), sizeof(Draw_Call));
+      Mat4Copy(sort->models[i], sort->models[nVisible]);
     }
+    nVisible++;
+  }
+
+  ren->drawCalls.elemsUsed = nVisible;
+  stats->visible = (u32) nVisible;
+  stats->culled = (u32) (nCalls - nVisible);
+}
+
+static void
+DrawSortReserve(Renderer *ren, 
+                usize n)
+{
+  Draw_Sort *sort = &ren->drawSort;
+  usize capacity = sort->capacity ? sort->capacity : 64;
+
+  if (n <= sort->capacity)
+  {
+    return;
+  }
+
+  while (capacity < n)
+  {
+    capacity *= 2;
   }
 
-skipDraw:
+  DrawSortDestroy(ren);
+  sort->models = NEW_ARR(ren->alloc, Mat4, capacity, MEMORY_TAG_RENDERER);
+  sort->keys = NEW_ARR(ren->alloc, u64, capacity, MEMORY_TAG_RENDERER);
+  sort->tmpKeys = NEW_ARR(ren->alloc, u64, capacity, MEMORY_TAG_RENDERER);
+  sort->indices = NEW_ARR(ren->alloc, u32, capacity, MEMORY_TAG_RENDERER);
+  sort->tmpIndices = NEW_ARR(ren->alloc, u32, capacity, MEMORY_TAG_RENDERER);
+  sort->capacity = capacity;
+}
 
-  VectorEmpty(&ren->drawCalls);
+static void
+DrawSortDestroy(Renderer *ren)
+{
+  Draw_Sort *sort = &ren->drawSort;
+
+  if (sort->capacity == 0)
+  {
+    return;
+  }
+
+  FREE_ARR(ren->alloc, sort->models, Mat4, sort->capacity, 
+      MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, sort->keys, u64, sort->capacity, MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, sort->tmpKeys, u64, sort->capacity, 
+      MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, sort->indices, u32, sort->capacity, 
+      MEMORY_TAG_RENDERER);
+  FREE_ARR(ren->alloc, sort->tmpIndices, u32, sort->capacity, 
+      MEMORY_TAG_RENDERER);
+  sort->capacity = 0;
 }
 
 static Err_Code 
@@ -588,33 +1477,25 @@ StructureRenderGraph(Renderer *ren)
     return err;
   }
 
-  tri->fn = DrawTri;
+  tri->name = "tri";
+  tri->chunkFn = DrawTri;
+  tri->countFn = CountDrawUnits;
 
-  err = RenderGraphWriteTexture(&ren->graph, tri, swap);
+  /* Only tri uses depth, so it never has to leave tile memory. */
+  err = RenderGraphCreateTexture(&ren->graph, VK_FORMAT_D32_SFLOAT, true, 
+      (VkExtent2D) {0, 0}, &ren->depthTex);
   if (err)
   {
     return err;
   }
 
-  return ERR_OK;
-}
-
-static Err_Code 
-CreateDepth(Renderer *ren)
-{
-  Err_Code err;
-
-  err = CreateImage(ren, ren->swapchain.extent.width, ren->swapchain.extent.height, 
-      VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, 
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ren->depthImage, &ren->depthMemory);
+  err = RenderGraphWriteTexture(&ren->graph, tri, swap);
   if (err)
   {
     return err;
   }
 
-  err = CreateImageView(ren, ren->depthImage, VK_FORMAT_D32_SFLOAT, 
-      VK_IMAGE_ASPECT_DEPTH_BIT, &ren->depthView);
+  err = RenderGraphWriteTexture(&ren->graph, tri, ren->depthTex);
   if (err)
   {
     return err;
@@ -638,24 +1519,30 @@ static Err_Code
 CreateInstance(Renderer *ren)
 {
   VkResult vkErr;
-  u32 totalExtensionCount, platExtensionCount;
+  u32 totalExtensionCount = 0, platExtensionCount = 0;
   const char **extensions;
   VkExtensionProperties *supportedExtensions;
   u32 supportedExtensionCount = 0;
+  VkLayerProperties *supportedLayers;
+  u32 supportedLayerCount = 0;
 
-  if (!PlatWindowGetInstanceExtensions(ren->win, &platExtensionCount, NULL))
+  /* Headless renderers have no surface, so need no extensions for one. */
+  if (!ren->headless)
   {
-    return ERR_LIBRARY_FAILURE;
-  }
+    if (!PlatWindowGetInstanceExtensions(ren->win, &platExtensionCount, NULL))
+    {
+      return ERR_LIBRARY_FAILURE;
+    }
 
-  totalExtensionCount = platExtensionCount + 
-    (sizeof(requiredExtensions) / sizeof(requiredExtensions[0]));
+    totalExtensionCount = platExtensionCount + 
+      (sizeof(requiredExtensions) / sizeof(requiredExtensions[0]));
+  }
 
   extensions = NEW_ARR(ren->alloc, const char *, totalExtensionCount, 
       MEMORY_TAG_ARRAY);
 
-  if (!PlatWindowGetInstanceExtensions(ren->win, &platExtensionCount, 
-        extensions))
+  if (!ren->headless && !PlatWindowGetInstanceExtensions(ren->win, 
+        &platExtensionCount, extensions))
   {
     return ERR_LIBRARY_FAILURE;
   }
@@ -672,19 +1559,49 @@ CreateInstance(Renderer *ren)
   vkEnumerateInstanceExtensionProperties(NULL, &supportedExtensionCount, 
       supportedExtensions);
 
+  /* 
+   * Software implementations on CI machines often come without the 
+   * validation layers.
+   */
+  vkEnumerateInstanceLayerProperties(&supportedLayerCount, NULL);
+  supportedLayers = NEW_ARR(ren->alloc, VkLayerProperties, 
+      supportedLayerCount, MEMORY_TAG_ARRAY);
+  vkEnumerateInstanceLayerProperties(&supportedLayerCount, supportedLayers);
+
+  ren->nLayers = sizeof(requiredLayers) / sizeof(requiredLayers[0]);
+  for (u32 i = 0; i < ren->nLayers; i++)
+  {
+    u32 j;
+
+    for (j = 0; j < supportedLayerCount; j++)
+    {
+      if (strcmp(supportedLayers[j].layerName, requiredLayers[i]) == 0)
+      {
+        break;
+      }
+    }
+
+    if (j == supportedLayerCount)
+    {
+      LOG_WARN_FMT("layer %s isn't available, running without layers", 
+          requiredLayers[i]);
+      ren->nLayers = 0;
+    }
+  }
+
   VkApplicationInfo applicationInfo = {
     .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
     .pApplicationName = "notte",
     .applicationVersion = VK_MAKE_VERSION(0, 0, 1),
     .pEngineName = "notte engine",
     .engineVersion = VK_MAKE_VERSION(0, 0, 1),
-    .apiVersion = VK_API_VERSION_1_0,
+    .apiVersion = VK_API_VERSION_1_3,
   };
 
   VkInstanceCreateInfo createInfo = {
     .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
     .pApplicationInfo = &applicationInfo,
-    .enabledLayerCount = sizeof(requiredLayers) / sizeof(requiredLayers[0]),
+    .enabledLayerCount = ren->nLayers,
     .ppEnabledLayerNames = requiredLayers,
     .enabledExtensionCount = totalExtensionCount,
     .ppEnabledExtensionNames = extensions,
@@ -700,6 +1617,8 @@ CreateInstance(Renderer *ren)
       MEMORY_TAG_ARRAY);
   FREE_ARR(ren->alloc, supportedExtensions, VkExtensionProperties, 
       supportedExtensionCount, MEMORY_TAG_ARRAY);
+  FREE_ARR(ren->alloc, supportedLayers, VkLayerProperties, 
+      supportedLayerCount, MEMORY_TAG_ARRAY);
   return ERR_OK;
 }
 
@@ -714,26 +1633,54 @@ DeviceIsSuitable(Renderer *ren,
   u32 nExtensions;
   VkExtensionProperties *extensions;
   u32 nFormats, nPresentModes;
+  u32 nRequired = ren->headless ? 0 
+    : sizeof(requiredDeviceExtensions) / sizeof(requiredDeviceExtensions[0]);
   VkPhysicalDeviceFeatures supportedFeatures;
+  VkPhysicalDeviceProperties properties;
+
+  /* The render graph synchronizes with vkCmdPipelineBarrier2. */
+  VkPhysicalDeviceVulkan13Features features13 =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+  };
+
+  VkPhysicalDeviceFeatures2 features2 =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &features13,
+  };
+
+  vkGetPhysicalDeviceProperties(dev, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_3)
+  {
+    return false;
+  }
+
+  vkGetPhysicalDeviceFeatures2(dev, &features2);
+  if (!features13.synchronization2)
+  {
+    return false;
+  }
 
   vkEnumerateDeviceExtensionProperties(dev, NULL, &nExtensions, NULL);
   extensions = NEW_ARR(ren->alloc, VkExtensionProperties, nExtensions, 
       MEMORY_TAG_ARRAY);
   vkEnumerateDeviceExtensionProperties(dev, NULL, &nExtensions, extensions);
 
-  vkGetPhysicalDeviceSurfaceFormatsKHR(dev, ren->surface, &nFormats, 
-      NULL);
-
-  vkGetPhysicalDeviceSurfacePresentModesKHR(dev, ren->surface, 
-      &nPresentModes, NULL);
-  if (nFormats == 0 || nPresentModes == 0)
+  if (!ren->headless)
   {
-    return false;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(dev, ren->surface, &nFormats, 
+        NULL);
+
+    vkGetPhysicalDeviceSurfacePresentModesKHR(dev, ren->surface, 
+        &nPresentModes, NULL);
+    if (nFormats == 0 || nPresentModes == 0)
+    {
+      return false;
+    }
   }
 
-  for (u32 i = 0; 
-      i < sizeof(requiredDeviceExtensions) / sizeof(requiredDeviceExtensions[0]);
-      i++)
+  for (u32 i = 0; i < nRequired; i++)
   {
     for (u32 j = 0; j < nExtensions; j++)
     {
@@ -756,9 +1703,19 @@ found:
 
   vkGetPhysicalDeviceQueueFamilyProperties(dev, &nQueueFamilies, queueFamilies);
 
+  info->hasAsyncCompute = false;
   for (u32 i = 0; i < nQueueFamilies; i++)
   {
     VkBool32 presentSupport = false;
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+    /* A family without graphics can run beside the graphics queue. */
+    if (!info->hasAsyncCompute && (flags & VK_QUEUE_COMPUTE_BIT) 
+        && !(flags & VK_QUEUE_GRAPHICS_BIT))
+    {
+      info->computeFamily = i;
+      info->hasAsyncCompute = true;
+    }
 
     if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
     {
@@ -766,6 +1723,11 @@ found:
       hasGraphics = true;
     }
 
+    if (ren->headless)
+    {
+      continue;
+    }
+
     vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, ren->surface, &presentSupport);
     if (presentSupport)
     {
@@ -774,6 +1736,13 @@ found:
     }
   }
 
+  /* Nothing is presented, so the graphics queue stands in. */
+  if (ren->headless)
+  {
+    info->presentFamily = info->graphicsFamily;
+    hasPresent = hasGraphics;
+  }
+
   vkGetPhysicalDeviceFeatures(dev, &supportedFeatures);
 
   FREE_ARR(ren->alloc, queueFamilies, VkQueueFamilyProperties, nQueueFamilies, 
@@ -818,40 +1787,86 @@ CreateLogicalDevice(Renderer *ren)
 {
   VkResult vkErr;
   f32 queuePriority = 1.0f;
-  u32 queueCreateInfoCount;
+  u32 queueCreateInfoCount = 0;
+  VkDeviceQueueCreateInfo queueCreateInfos[3];
+  u32 families[] =
+  {
+    ren->queueInfo.graphicsFamily,
+    ren->queueInfo.presentFamily,
+    ren->queueInfo.computeFamily,
+  };
+  u32 nFamilies = ren->queueInfo.hasAsyncCompute ? 3 : 2;
 
-  VkDeviceQueueCreateInfo queueCreateInfos[] =
+  /* One queue from each distinct family. */
+  for (u32 i = 0; i < nFamilies; i++)
   {
+    u32 j;
+
+    for (j = 0; j < queueCreateInfoCount; j++)
     {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = ren->queueInfo.graphicsFamily,
-      .queueCount = 1,
-      .pQueuePriorities = &queuePriority,
-    },
+      if (queueCreateInfos[j].queueFamilyIndex == families[i])
+      {
+        break;
+      }
+    }
+
+    if (j == queueCreateInfoCount)
     {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = ren->queueInfo.presentFamily,
-      .queueCount = 1,
-      .pQueuePriorities = &queuePriority,
-    },
-  };
+      queueCreateInfos[queueCreateInfoCount++] = (VkDeviceQueueCreateInfo)
+      {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = families[i],
+        .queueCount = 1,
+        .pQueuePriorities = &queuePriority,
+      };
+    }
+  }
 
   VkPhysicalDeviceFeatures deviceFeatures = {0};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
-  queueCreateInfoCount = 
-    ren->queueInfo.graphicsFamily == ren->queueInfo.presentFamily ? 1 : 2;
+  /* 
+   * The render graph orders its queues with timeline semaphores, and the 
+   * GPU profiler resets its queries from the host.
+   */
+  VkPhysicalDeviceVulkan12Features features12 = 
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .hostQueryReset = VK_TRUE,
+    .timelineSemaphore = VK_TRUE,
+  };
+
+  VkPhysicalDeviceVulkan13Features features13 = 
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    .pNext = &features12,
+    .synchronization2 = VK_TRUE,
+  };
+
+  if (ren->cull.enabled && !GpuCullSupported(ren))
+  {
+    LOG_WARN("device can't draw indirect with a count, culling on the CPU");
+    ren->cull.enabled = false;
+  }
+
+  if (ren->cull.enabled)
+  {
+    deviceFeatures.multiDrawIndirect = VK_TRUE;
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+    features12.drawIndirectCount = VK_TRUE;
+  }
 
   VkDeviceCreateInfo createInfo =
   {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .pNext = &features13,
     .pQueueCreateInfos = queueCreateInfos,
     .queueCreateInfoCount = queueCreateInfoCount,
     .pEnabledFeatures = &deviceFeatures,
-    .enabledExtensionCount = 
+    .enabledExtensionCount = ren->headless ? 0 :
       sizeof(requiredDeviceExtensions) / sizeof(requiredDeviceExtensions[0]),
     .ppEnabledExtensionNames = requiredDeviceExtensions,
-    .enabledLayerCount = sizeof(requiredLayers) / sizeof(requiredLayers[0]),
+    .enabledLayerCount = ren->nLayers,
     .ppEnabledLayerNames = requiredLayers,
   };
 
@@ -865,6 +1880,11 @@ CreateLogicalDevice(Renderer *ren)
       &ren->graphicsQueue);
   vkGetDeviceQueue(ren->dev, ren->queueInfo.presentFamily, 0, 
       &ren->presentQueue);
+  if (ren->queueInfo.hasAsyncCompute)
+  {
+    vkGetDeviceQueue(ren->dev, ren->queueInfo.computeFamily, 0, 
+        &ren->computeQueue);
+  }
   return ERR_OK;
 }
 
@@ -912,16 +1932,20 @@ foundFormat:
   vkGetPhysicalDeviceSurfacePresentModesKHR(ren->pDev, ren->surface, 
       &nPresentModes, presentModes);
 
+  /* Every surface can do FIFO. */
+  swapchain->presentMode = VK_PRESENT_MODE_FIFO_KHR;
   for (u32 i = 0; i < nPresentModes; i++)
   {
-    if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) 
+    if (presentModes[i] == ren->presentMode) 
     {
       swapchain->presentMode = presentModes[i];
-      goto foundMailbox;
+      break;
     }
   }
-  swapchain->presentMode = VK_PRESENT_MODE_FIFO_KHR;
-foundMailbox:
+  if (swapchain->presentMode != ren->presentMode)
+  {
+    LOG_WARN("present mode unsupported, falling back to FIFO");
+  }
 
   if (capabilities.currentExtent.width != 0xFFFFFFFF)
   {
@@ -1027,9 +2051,6 @@ DestroySwapchain(Renderer *ren, Swapchain *swapchain)
     vkDestroyImageView(ren->dev, swapchain->imageViews[i], ren->allocCbs);
   }
 
-  DestroyImage(ren, ren->depthImage, ren->depthMemory);
-  vkDestroyImageView(ren->dev, ren->depthView, ren->allocCbs);
-
   FREE_ARR(ren->alloc, swapchain->imageViews, VkImageView, swapchain->nImages, 
       MEMORY_TAG_ARRAY);
   FREE_ARR(ren->alloc, swapchain->images, VkImage, swapchain->nImages, 
@@ -1074,13 +2095,6 @@ RebuildSwapchain(Renderer *ren)
   }
 
   ren->swapchain = new;
-
-  err = CreateDepth(ren);
-  if (err)
-  {
-    return err;
-  }
-  
   return ERR_OK;
 }
 
@@ -1104,6 +2118,206 @@ CopyBuffer(Renderer *ren,
   EndUtilCommands(ren, cmd);
 }
 
+/* 
+ * A bounding sphere around the upload's AABB, centered on it.  It's looser 
+ * than fitting the vertices, but needs no second pass over them.  If the 
+ * caller never added any bounds the mesh gets unbounded ones, so it's never
+ * culled rather than culled by garbage.
+ */
+static void
+ComputeMeshBounds(Static_Mesh *mesh, 
+                  const Static_Mesh_Upload *upload)
+{
+  if (mesh->nVerts == 0)
+  {
+    MemorySet(mesh->sphere, 0, sizeof(mesh->sphere));
+    MemorySet(mesh->extent, 0, sizeof(mesh->extent));
+    return;
+  }
+
+  if (upload->min[0] > upload->max[0] || upload->min[1] > upload->max[1] 
+      || upload->min[2] > upload->max[2])
+  {
+    LOG_WARN("static mesh uploaded without bounds, it won't be culled");
+    MemorySet(mesh->sphere, 0, sizeof(mesh->sphere));
+    mesh->sphere[3] = FLT_MAX;
+    for (usize j = 0; j < 3; j++)
+    {
+      mesh->extent[j] = FLT_MAX;
+    }
+    return;
+  }
+
+  for (usize j = 0; j < 3; j++)
+  {
+    mesh->sphere[j] = (upload->min[j] + upload->max[j]) * 0.5f;
+    mesh->extent[j] = (upload->max[j] - upload->min[j]) * 0.5f;
+  }
+
+  mesh->sphere[3] = sqrtf(mesh->extent[0] * mesh->extent[0] 
+      + mesh->extent[1] * mesh->extent[1] 
+      + mesh->extent[2] * mesh->extent[2]);
+}
+
+/* 
+ * Both copies go into one submission, so a mesh upload only waits once.  
+ * Vulkan doesn't allow empty copy regions, so those are skipped.
+ */
+static void
+CopyStagingToMesh(Renderer *ren,
+                  Static_Mesh *mesh)
+{
+  VkCommandBuffer cmd;
+  VkDeviceSize vBufferSize = sizeof(Static_Vert) * mesh->nVerts;
+
+  if (mesh->nVerts == 0 && mesh->nIndices == 0)
+  {
+    return;
+  }
+
+  cmd = BeginUtilCommands(ren);
+
+  VkBufferCopy vertexRegion = 
+  {
+    .srcOffset = 0,
+    .dstOffset = sizeof(Static_Vert) * (VkDeviceSize) mesh->vertexOffset,
+    .size = vBufferSize,
+  };
+
+  VkBufferCopy indexRegion = 
+  {
+    .srcOffset = vBufferSize,
+    .dstOffset = sizeof(u32) * (VkDeviceSize) mesh->firstIndex,
+    .size = sizeof(u32) * mesh->nIndices,
+  };
+
+  if (vertexRegion.size != 0)
+  {
+    vkCmdCopyBuffer(cmd, mesh->stagingBuffer, ren->geometry.vertexBuffer, 1, 
+        &vertexRegion);
+  }
+  if (indexRegion.size != 0)
+  {
+    vkCmdCopyBuffer(cmd, mesh->stagingBuffer, ren->geometry.indexBuffer, 1, 
+        &indexRegion);
+  }
+
+  EndUtilCommands(ren, cmd);
+}
+
+/* 
+ * Keeps whatever CPU side data 'retention' asks for.  If 'owned' is set the 
+ * source arrays belong to the renderer, and are either adopted or freed.
+ */
+static void
+RetainMeshData(Renderer *ren,
+               Static_Mesh *mesh,
+               const Static_Vert *verts,
+               const u32 *indices,
+               Static_Mesh_Retention retention,
+               bool owned)
+{
+  usize vertBytes = sizeof(Static_Vert) * mesh->nVerts;
+  usize indexBytes = sizeof(u32) * mesh->nIndices;
+
+  mesh->retention = retention;
+  mesh->retained = true;
+
+  if (retention != STATIC_MESH_RETAIN_NONE)
+  {
+    if (owned)
+    {
+      mesh->indices = indices;
+    } else
+    {
+      u32 *indicesCopy = NEW_ARR(ren->alloc, u32, mesh->nIndices, 
+          MEMORY_TAG_ARRAY);
+      MemoryCopy(indicesCopy, indices, indexBytes);
+      mesh->indices = indicesCopy;
+    }
+    mesh->retainedBytes += indexBytes;
+  } else if (owned)
+  {
+    FREE_ARR(ren->alloc, (void *) indices, u32, mesh->nIndices, 
+        MEMORY_TAG_ARRAY);
+  }
+
+  switch (retention)
+  {
+    case STATIC_MESH_RETAIN_NONE:
+    {
+      if (owned)
+      {
+        FREE_ARR(ren->alloc, (void *) verts, Static_Vert, mesh->nVerts, 
+            MEMORY_TAG_ARRAY);
+      }
+      break;
+    }
+    case STATIC_MESH_RETAIN_ALL:
+    {
+      if (owned)
+      {
+        mesh->verts = verts;
+      } else
+      {
+        Static_Vert *vertsCopy = NEW_ARR(ren->alloc, Static_Vert, 
+            mesh->nVerts, MEMORY_TAG_ARRAY);
+        MemoryCopy(vertsCopy, verts, vertBytes);
+        mesh->verts = vertsCopy;
+      }
+      mesh->retainedBytes += vertBytes;
+      break;
+    }
+    case STATIC_MESH_RETAIN_POSITIONS:
+    {
+      Vec3 *positions = NEW_ARR(ren->alloc, Vec3, mesh->nVerts, 
+          MEMORY_TAG_ARRAY);
+      for (usize i = 0; i < mesh->nVerts; i++)
+      {
+        Vec3Copy((f32 *) verts[i].pos, positions[i]);
+      }
+      mesh->positions = positions;
+      mesh->retainedBytes += sizeof(Vec3) * mesh->nVerts;
+
+      if (owned)
+      {
+        FREE_ARR(ren->alloc, (void *) verts, Static_Vert, mesh->nVerts, 
+            MEMORY_TAG_ARRAY);
+      }
+      break;
+    }
+  }
+
+  ren->retainedMeshBytes += mesh->retainedBytes;
+}
+
+static void
+ReleaseMeshData(Renderer *ren,
+                Static_Mesh *mesh)
+{
+  if (mesh->verts != NULL)
+  {
+    FREE_ARR(ren->alloc, (void *) mesh->verts, Static_Vert, mesh->nVerts, 
+        MEMORY_TAG_ARRAY);
+  }
+  if (mesh->positions != NULL)
+  {
+    FREE_ARR(ren->alloc, (void *) mesh->positions, Vec3, mesh->nVerts, 
+        MEMORY_TAG_ARRAY);
+  }
+  if (mesh->indices != NULL)
+  {
+    FREE_ARR(ren->alloc, (void *) mesh->indices, u32, mesh->nIndices, 
+        MEMORY_TAG_ARRAY);
+  }
+
+  ren->retainedMeshBytes -= mesh->retainedBytes;
+  mesh->verts = NULL;
+  mesh->positions = NULL;
+  mesh->indices = NULL;
+  mesh->retainedBytes = 0;
+}
+
 static Err_Code 
 CreateCommandPools(Renderer *ren)
 {
@@ -1136,29 +2350,44 @@ DestroyCommandPools(Renderer *ren)
 static Err_Code 
 CreateBuffers(Renderer *ren)
 {
-  VkDeviceSize bufferSize = sizeof(Camera_Uniform);
-  VkResult err;
+  Err_Code err;
+  usize i;
 
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (i = 0; i < ren->framesInFlight; i++)
   {
-    err = CreateBuffer(ren, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &ren->uniformBuffers[i], &ren->uniformMemory[i]);
+    err = UniformArenaCreate(ren, FRAME_UNIFORM_ARENA_SIZE, &ren->uniforms[i]);
     if (err)
     {
-      return err;
+      goto fail;
+    }
+
+    err = InstanceBufferCreate(ren, MAX_INSTANCES_PER_FRAME, 
+        &ren->instances[i]);
+    if (err)
+    {
+      UniformArenaDestroy(ren, &ren->uniforms[i]);
+      goto fail;
     }
   }
 
   return ERR_OK;
+
+fail:
+  while (i-- > 0)
+  {
+    UniformArenaDestroy(ren, &ren->uniforms[i]);
+    InstanceBufferDestroy(ren, &ren->instances[i]);
+  }
+  return err;
 }
 
 static void
 DestroyBuffers(Renderer *ren)
 {
-  for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  for (usize i = 0; i < ren->framesInFlight; i++)
   {
-    DestroyBuffer(ren, ren->uniformBuffers[i], ren->uniformMemory[i]);
+    UniformArenaDestroy(ren, &ren->uniforms[i]);
+    InstanceBufferDestroy(ren, &ren->instances[i]);
   }
 }
 
@@ -1166,25 +2395,32 @@ static Err_Code
 CreateDescriptorPool(Renderer *ren)
 {
   VkResult vkErr;
+  u32 maxSets = DESCRIPTOR_SETS_PER_FRAME * ren->framesInFlight;
 
-  VkDescriptorPoolSize poolSizes[2] = 
+  VkDescriptorPoolSize poolSizes[3] = 
   {
     {
-      .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .descriptorCount = MAX_FRAMES_IN_FLIGHT
+      .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+      .descriptorCount = maxSets,
     },
     {
       .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-      .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-    }
+      .descriptorCount = maxSets,
+    },
+    {
+      /* Culling sets use four. */
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 4 * maxSets,
+    },
   };
 
   VkDescriptorPoolCreateInfo createInfo = 
   {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-    .poolSizeCount = 2,
+    .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+    .poolSizeCount = 3,
     .pPoolSizes = poolSizes,
-    .maxSets = MAX_FRAMES_IN_FLIGHT,
+    .maxSets = maxSets,
   };
 
   vkErr = vkCreateDescriptorPool(ren->dev, &createInfo, ren->allocCbs, 
@@ -1214,7 +2450,7 @@ CameraSetMatrices(Renderer *ren,
 
   Mat4Perspective(cam->fov,
       ren->swapchain.extent.width / (float) ren->swapchain.extent.height, 
-      0.1f, 10.0f, cam->proj);
+      CAMERA_NEAR, CAMERA_FAR, cam->proj);
   cam->proj[1][1] *= 1.0f;
 }
 
@@ -1230,8 +2466,12 @@ CreateTextures(Renderer *ren)
   Err_Code err;
   VkPhysicalDeviceProperties properties;
 
-  stbi_uc *pixels = stbi_load("../assets/texture.jpg", &width, &height, 
-      &channels, STBI_rgb_alpha);
+  stbi_uc *pixels;
+  PROFILE_ZONE("load texture")
+  {
+    pixels = stbi_load("../assets/texture.jpg", &width, &height, &channels, 
+        STBI_rgb_alpha);
+  }
 
   imageSize = width * height * 4;
 
@@ -1314,41 +2554,6 @@ CreateTextures(Renderer *ren)
 
 }
 
-static Err_Code 
-CreateImageView(Renderer *ren, 
-                VkImage image, 
-                VkFormat format, 
-                VkImageAspectFlags aspectFlags,
-                VkImageView *view)
-{
-  VkResult vkErr;
-
-  VkImageViewCreateInfo viewInfo = 
-  {
-    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-    .image = image,
-    .viewType = VK_IMAGE_VIEW_TYPE_2D,
-    .format = format,
-    .subresourceRange = 
-    {
-      .aspectMask = aspectFlags,
-      .baseMipLevel = 0,
-      .levelCount = 1,
-      .baseArrayLayer = 0,
-      .layerCount = 1,
-    },
-  };
-
-  vkErr = vkCreateImageView(ren->dev, &viewInfo, ren->allocCbs, 
-      view);
-  if (vkErr)
-  {
-    return ERR_LIBRARY_FAILURE;
-  }
-
-  return ERR_OK;
-}
-
 static void 
 DestroyTextures(Renderer *ren)
 {
@@ -1490,11 +2695,12 @@ CopyBufferToImage(Renderer *ren,
 static void
 TransformToMatrix(Transform trans, Mat4 out)
 {
-  Mat4Identity(out);
-  Mat4Translate(out, trans.pos, out);
-  Mat4Rotate(out, DegToRad(trans.rot[0]), X_AXIS, out);
-  Mat4Rotate(out, DegToRad(trans.rot[1]), Y_AXIS, out);
-  Mat4Rotate(out, DegToRad(trans.rot[2]), Z_AXIS, out);
-  return;
+  Vec3 rot = {
+    DegToRad(trans.rot[0]), 
+    DegToRad(trans.rot[1]), 
+    DegToRad(trans.rot[2]),
+  };
+
+  Mat4Compose(trans.pos, rot, out);
 }
 
@@ -5,6 +5,8 @@
  */
 
 #include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 
 #include <notte/string.h>
 
@@ -119,3 +121,21 @@ StringMakeCString(Allocator alloc, String str)
   cStr[str.len] = '\0';
   return cStr;
 }
+
+usize
+StringAppendFmt(char *buf,
+                usize size,
+                usize len,
+                const char *fmt,
+                ...)
+{
+  va_list args;
+  int written;
+
+  va_start(args, fmt);
+  written = vsnprintf(len < size ? buf + len : NULL, 
+      len < size ? size - len : 0, fmt, args);
+  va_end(args);
+
+  return written > 0 ? len + (usize) written : len;
+}
@@ -4,6 +4,10 @@
  * Multithreading.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* For pthread_tryjoin_np. */
+#endif
+
 #include <notte/thread.h>
 
 #ifdef NOTTE_WINDOWS
@@ -25,6 +29,11 @@ struct Mutex
   CRITICAL_SECTION cr;
 };
 
+struct Semaphore
+{
+  HANDLE handle;
+};
+
 /* === PROTOTYPES === */
 
 static DWORD WINAPI ThreadRun(LPVOID *ud);
@@ -48,9 +57,22 @@ ThreadCreate(Allocator alloc, void *ud, Thread_Fn fn, Thread **threadOut)
 void 
 ThreadDestroy(Allocator alloc, Thread *thread)
 {
+  CloseHandle(thread->handle);
   FREE(alloc, thread, Thread, MEMORY_TAG_THREAD);
 }
 
+void
+ThreadJoin(Thread *thread)
+{
+  WaitForSingleObject(thread->handle, INFINITE);
+}
+
+bool
+ThreadIsDone(Thread *thread)
+{
+  return WaitForSingleObject(thread->handle, 0) == WAIT_OBJECT_0;
+}
+
 Err_Code 
 MutexCreate(Allocator alloc, Mutex **mutexOut)
 {
@@ -87,6 +109,41 @@ MutexTryAcquire(Mutex *mutex)
   return TryEnterCriticalSection(&mutex->cr);
 }
 
+Err_Code
+SemaphoreCreate(Allocator alloc, Semaphore **semOut)
+{
+  Semaphore *sem = NEW(alloc, Semaphore, MEMORY_TAG_THREAD);
+
+  sem->handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+  if (sem->handle == NULL)
+  {
+    FREE(alloc, sem, Semaphore, MEMORY_TAG_THREAD);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  *semOut = sem;
+  return ERR_OK;
+}
+
+void
+SemaphoreDestroy(Allocator alloc, Semaphore *sem)
+{
+  CloseHandle(sem->handle);
+  FREE(alloc, sem, Semaphore, MEMORY_TAG_THREAD);
+}
+
+void
+SemaphoreWait(Semaphore *sem)
+{
+  WaitForSingleObject(sem->handle, INFINITE);
+}
+
+void
+SemaphoreSignal(Semaphore *sem)
+{
+  ReleaseSemaphore(sem->handle, 1, NULL);
+}
+
 /* === PRIVATE FUNCTIONS === */
 
 static DWORD WINAPI
@@ -99,4 +156,175 @@ ThreadRun(LPVOID *ud)
   return 0;
 }
 
+#elif defined(NOTTE_LINUX)
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+/* === TYPES === */
+
+struct Thread
+{
+  pthread_t handle;
+  bool joined; /* Only touched by the thread which created it. */
+  void *ud;
+  Thread_Fn fn;
+};
+
+struct Mutex 
+{
+  pthread_mutex_t mutex;
+};
+
+struct Semaphore
+{
+  sem_t sem;
+};
+
+/* === PROTOTYPES === */
+
+static void *ThreadRun(void *ud);
+
+/* === PUBLIC FUNCTIONS === */
+
+Err_Code 
+ThreadCreate(Allocator alloc, void *ud, Thread_Fn fn, Thread **threadOut)
+{
+  Thread *thread = NEW(alloc, Thread, MEMORY_TAG_THREAD);
+
+  thread->fn = fn;
+  thread->ud = ud;
+  thread->joined = false;
+
+  if (pthread_create(&thread->handle, NULL, ThreadRun, thread) != 0)
+  {
+    FREE(alloc, thread, Thread, MEMORY_TAG_THREAD);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  *threadOut = thread;
+  return ERR_OK;
+}
+
+/* Like closing the handle on Windows, a running thread carries on. */
+void 
+ThreadDestroy(Allocator alloc, Thread *thread)
+{
+  if (!thread->joined)
+  {
+    pthread_detach(thread->handle);
+  }
+  FREE(alloc, thread, Thread, MEMORY_TAG_THREAD);
+}
+
+void
+ThreadJoin(Thread *thread)
+{
+  if (!thread->joined)
+  {
+    pthread_join(thread->handle, NULL);
+    thread->joined = true;
+  }
+}
+
+bool
+ThreadIsDone(Thread *thread)
+{
+  if (!thread->joined && pthread_tryjoin_np(thread->handle, NULL) == 0)
+  {
+    thread->joined = true;
+  }
+  return thread->joined;
+}
+
+Err_Code 
+MutexCreate(Allocator alloc, Mutex **mutexOut)
+{
+  Mutex *mutex = NEW(alloc, Mutex, MEMORY_TAG_THREAD);
+
+  if (pthread_mutex_init(&mutex->mutex, NULL) != 0)
+  {
+    FREE(alloc, mutex, Mutex, MEMORY_TAG_THREAD);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  *mutexOut = mutex;
+  return ERR_OK;
+}
+
+void 
+MutexDestroy(Allocator alloc, Mutex *mutex)
+{
+  pthread_mutex_destroy(&mutex->mutex);
+  FREE(alloc, mutex, Mutex, MEMORY_TAG_THREAD);
+}
+
+void 
+MutexAcquire(Mutex *mutex)
+{
+  pthread_mutex_lock(&mutex->mutex);
+}
+
+void 
+MutexRelease(Mutex *mutex)
+{
+  pthread_mutex_unlock(&mutex->mutex);
+}
+
+bool 
+MutexTryAcquire(Mutex *mutex)
+{
+  return pthread_mutex_trylock(&mutex->mutex) == 0;
+}
+
+Err_Code
+SemaphoreCreate(Allocator alloc, Semaphore **semOut)
+{
+  Semaphore *sem = NEW(alloc, Semaphore, MEMORY_TAG_THREAD);
+
+  if (sem_init(&sem->sem, 0, 0) != 0)
+  {
+    FREE(alloc, sem, Semaphore, MEMORY_TAG_THREAD);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  *semOut = sem;
+  return ERR_OK;
+}
+
+void
+SemaphoreDestroy(Allocator alloc, Semaphore *sem)
+{
+  sem_destroy(&sem->sem);
+  FREE(alloc, sem, Semaphore, MEMORY_TAG_THREAD);
+}
+
+/* Signals interrupt the wait, which then carries on. */
+void
+SemaphoreWait(Semaphore *sem)
+{
+  while (sem_wait(&sem->sem) != 0 && errno == EINTR)
+  {
+  }
+}
+
+void
+SemaphoreSignal(Semaphore *sem)
+{
+  sem_post(&sem->sem);
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+static void *
+ThreadRun(void *ud)
+{
+  Thread *thread = (Thread *) ud;
+
+  thread->fn(thread->ud);
+
+  return NULL;
+}
+
 #endif
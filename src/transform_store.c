@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2022 Gavin Ratcliff
+ *
+ * Batched storage of object transforms and their world matrices.
+ */
+
+#include <notte/transform_store.h>
+
+/* === PROTOTYPES === */
+
+static u32 AllocSlot(Transform_Store *store, u32 parent);
+static void Grow(Transform_Store *store);
+static void MarkDirty(Transform_Store *store, u32 id);
+static void UpdateLocal(Transform_Store *store, u32 id);
+static bool AncestorChanged(Transform_Store *store, u32 id);
+static void PropagateFrom(Transform_Store *store, u32 id);
+
+/* === PUBLIC FUNCTIONS === */
+
+void
+TransformStoreInit(Transform_Store *store,
+                   Allocator alloc)
+{
+  MemorySet(store, 0, sizeof(*store));
+  store->alloc = alloc;
+  store->freeSlots = VECTOR_CREATE(alloc, u32);
+  store->dirtyIds = VECTOR_CREATE(alloc, u32);
+  store->moved = VECTOR_CREATE(alloc, u32);
+
+  /* changed[] starts at 0, so nothing reads as changed before an update. */
+  store->update = 1;
+}
+
+void
+TransformStoreDeinit(Transform_Store *store)
+{
+  Allocator alloc = store->alloc;
+  u32 cap = store->capacity;
+
+  VectorDestroy(&store->freeSlots, alloc);
+  VectorDestroy(&store->dirtyIds, alloc);
+  VectorDestroy(&store->moved, alloc);
+  if (cap == 0)
+  {
+    return;
+  }
+
+  FREE_ARR(alloc, store->posX, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->posY, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->posZ, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->rotX, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->rotY, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->rotZ, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->rotW, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->scaleX, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->scaleY, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->scaleZ, f32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->parents, u32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->firstChild, u32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->nextSibling, u32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->flags, u8, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->changed, u32, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->local, Mat4, cap, MEMORY_TAG_ARRAY);
+  FREE_ARR(alloc, store->world, Mat4, cap, MEMORY_TAG_ARRAY);
+}
+
+u32
+TransformStoreAdd(Transform_Store *store,
+                  u32 parent)
+{
+  u32 id = AllocSlot(store, parent);
+
+  store->posX[id] = store->posY[id] = store->posZ[id] = 0.0f;
+  store->rotX[id] = store->rotY[id] = store->rotZ[id] = 0.0f;
+  store->rotW[id] = 1.0f;
+  store->scaleX[id] = store->scaleY[id] = store->scaleZ[id] = 1.0f;
+  store->parents[id] = parent;
+  store->firstChild[id] = TRANSFORM_ID_NONE;
+  store->nextSibling[id] = TRANSFORM_ID_NONE;
+  store->flags[id] = TRANSFORM_FLAG_ALIVE;
+  store->changed[id] = 0;
+  MarkDirty(store, id);
+
+  if (parent != TRANSFORM_ID_NONE)
+  {
+    store->nextSibling[id] = store->firstChild[parent];
+    store->firstChild[parent] = id;
+    store->nParented++;
+  }
+
+  return id;
+}
+
+void
+TransformStoreRemove(Transform_Store *store,
+                     u32 id)
+{
+  if (store->flags[id] & TRANSFORM_FLAG_DIRTY)
+  {
+    store->nDirty--;
+  }
+
+  if (store->parents[id] != TRANSFORM_ID_NONE)
+  {
+    u32 *link = &store->firstChild[store->parents[id]];
+
+    while (*link != id)
+    {
+      link = &store->nextSibling[*link];
+    }
+    *link = store->nextSibling[id];
+    store->nParented--;
+  }
+
+  for (u32 child = store->firstChild[id]; child != TRANSFORM_ID_NONE;)
+  {
+    u32 next = store->nextSibling[child];
+
+    store->parents[child] = TRANSFORM_ID_NONE;
+    store->nextSibling[child] = TRANSFORM_ID_NONE;
+    store->nParented--;
+    MarkDirty(store, child);
+    child = next;
+  }
+
+  store->flags[id] = 0;
+  store->parents[id] = TRANSFORM_ID_NONE;
+  store->firstChild[id] = TRANSFORM_ID_NONE;
+  store->nextSibling[id] = TRANSFORM_ID_NONE;
+  VectorPush(&store->freeSlots, store->alloc, &id);
+}
+
+bool
+TransformStoreIsAlive(const Transform_Store *store,
+                      u32 id)
+{
+  return id < store->count && (store->flags[id] & TRANSFORM_FLAG_ALIVE);
+}
+
+void
+TransformStoreSet(Transform_Store *store,
+                  u32 id,
+                  Vec3 pos,
+                  Vec4 rot)
+{
+  store->posX[id] = pos[0];
+  store->posY[id] = pos[1];
+  store->posZ[id] = pos[2];
+  store->rotX[id] = rot[0];
+  store->rotY[id] = rot[1];
+  store->rotZ[id] = rot[2];
+  store->rotW[id] = rot[3];
+  MarkDirty(store, id);
+}
+
+void
+TransformStoreSetScale(Transform_Store *store,
+                       u32 id,
+                       Vec3 scale)
+{
+  store->scaleX[id] = scale[0];
+  store->scaleY[id] = scale[1];
+  store->scaleZ[id] = scale[2];
+  MarkDirty(store, id);
+}
+
+/* The dirty ids become the moved ones, once EndUpdate has filtered them. */
+bool
+TransformStoreBeginUpdate(Transform_Store *store)
+{
+  Vector dirtyIds = store->dirtyIds;
+
+  store->update++;
+  store->dirtyIds = store->moved;
+  store->moved = dirtyIds;
+  VectorEmpty(&store->dirtyIds);
+
+  if (store->nDirty == 0)
+  {
+    VectorEmpty(&store->moved);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Only touches slots in [first, first + n), so threads can update disjoint
+ * ranges concurrently.
+ */
+void
+TransformStoreUpdateRange(Transform_Store *store,
+                          u32 first,
+                          u32 n)
+{
+  for (u32 i = first; i < first + n; i++)
+  {
+    if (store->flags[i] & TRANSFORM_FLAG_DIRTY)
+    {
+      UpdateLocal(store, i);
+    }
+  }
+}
+
+/*
+ * Each changed transform without a changed ancestor has its subtree 
+ * refreshed top down, so a parent is always final before its children read
+ * it and only the changed subtrees are visited.
+ */
+void
+TransformStoreEndUpdate(Transform_Store *store)
+{
+  u32 *moved = (u32 *) store->moved.buf;
+  usize nMoved = 0;
+
+  /* Ids removed since they were marked dirty never changed. */
+  for (usize i = 0; i < store->moved.elemsUsed; i++)
+  {
+    if (store->changed[moved[i]] == store->update)
+    {
+      moved[nMoved++] = moved[i];
+    }
+  }
+  store->moved.elemsUsed = nMoved;
+
+  store->nDirty = 0;
+  if (store->nParented == 0)
+  {
+    return;
+  }
+
+  /* Subtrees push their children onto moved, past nMoved. */
+  for (usize i = 0; i < nMoved; i++)
+  {
+    u32 id = ((u32 *) store->moved.buf)[i];
+
+    if (!AncestorChanged(store, id))
+    {
+      PropagateFrom(store, id);
+    }
+  }
+}
+
+void
+TransformStoreUpdate(Transform_Store *store)
+{
+  if (!TransformStoreBeginUpdate(store))
+  {
+    return;
+  }
+
+  u32 *dirty = (u32 *) store->moved.buf;
+  for (usize i = 0; i < store->moved.elemsUsed; i++)
+  {
+    if (store->flags[dirty[i]] & TRANSFORM_FLAG_DIRTY)
+    {
+      UpdateLocal(store, dirty[i]);
+    }
+  }
+  TransformStoreEndUpdate(store);
+}
+
+/* === PRIVATE FUNCTIONS === */
+
+/*
+ * Reuses a free slot if one is after parent, otherwise appends, so that
+ * children keep coming after their parents.
+ */
+static u32
+AllocSlot(Transform_Store *store,
+          u32 parent)
+{
+  u32 *freeSlots = (u32 *) store->freeSlots.buf;
+
+  for (usize i = store->freeSlots.elemsUsed; i > 0; i--)
+  {
+    u32 slot = freeSlots[i - 1];
+
+    if (parent == TRANSFORM_ID_NONE || slot > parent)
+    {
+      freeSlots[i - 1] = freeSlots[--store->freeSlots.elemsUsed];
+      return slot;
+    }
+  }
+
+  if (store->count == store->capacity)
+  {
+    Grow(store);
+  }
+
+  return store->count++;
+}
+
+static void
+Grow(Transform_Store *store)
+{
+  Allocator alloc = store->alloc;
+  u32 o = store->capacity;
+  u32 n = o ? o * 2 : 64;
+
+  if (o == 0)
+  {
+    store->posX = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->posY = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->posZ = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->rotX = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->rotY = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->rotZ = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->rotW = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->scaleX = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->scaleY = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->scaleZ = NEW_ARR(alloc, f32, n, MEMORY_TAG_ARRAY);
+    store->parents = NEW_ARR(alloc, u32, n, MEMORY_TAG_ARRAY);
+    store->firstChild = NEW_ARR(alloc, u32, n, MEMORY_TAG_ARRAY);
+    store->nextSibling = NEW_ARR(alloc, u32, n, MEMORY_TAG_ARRAY);
+    store->flags = NEW_ARR(alloc, u8, n, MEMORY_TAG_ARRAY);
+    store->changed = NEW_ARR(alloc, u32, n, MEMORY_TAG_ARRAY);
+    store->local = NEW_ARR(alloc, Mat4, n, MEMORY_TAG_ARRAY);
+    store->world = NEW_ARR(alloc, Mat4, n, MEMORY_TAG_ARRAY);
+  } else
+  {
+    store->posX = RESIZE_ARR(alloc, store->posX, f32, o, n, MEMORY_TAG_ARRAY);
+    store->posY = RESIZE_ARR(alloc, store->posY, f32, o, n, MEMORY_TAG_ARRAY);
+    store->posZ = RESIZE_ARR(alloc, store->posZ, f32, o, n, MEMORY_TAG_ARRAY);
+    store->rotX = RESIZE_ARR(alloc, store->rotX, f32, o, n, MEMORY_TAG_ARRAY);
+    store->rotY = RESIZE_ARR(alloc, store->rotY, f32, o, n, MEMORY_TAG_ARRAY);
+    store->rotZ = RESIZE_ARR(alloc, store->rotZ, f32, o, n, MEMORY_TAG_ARRAY);
+    store->rotW = RESIZE_ARR(alloc, store->rotW, f32, o, n, MEMORY_TAG_ARRAY);
+    store->scaleX = RESIZE_ARR(alloc, store->scaleX, f32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->scaleY = RESIZE_ARR(alloc, store->scaleY, f32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->scaleZ = RESIZE_ARR(alloc, store->scaleZ, f32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->parents = RESIZE_ARR(alloc, store->parents, u32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->firstChild = RESIZE_ARR(alloc, store->firstChild, u32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->nextSibling = RESIZE_ARR(alloc, store->nextSibling, u32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->flags = RESIZE_ARR(alloc, store->flags, u8, o, n,
+        MEMORY_TAG_ARRAY);
+    store->changed = RESIZE_ARR(alloc, store->changed, u32, o, n,
+        MEMORY_TAG_ARRAY);
+    store->local = RESIZE_ARR(alloc, store->local, Mat4, o, n,
+        MEMORY_TAG_ARRAY);
+    store->world = RESIZE_ARR(alloc, store->world, Mat4, o, n,
+        MEMORY_TAG_ARRAY);
+  }
+
+  store->capacity = n;
+}
+
+static void
+MarkDirty(Transform_Store *store,
+          u32 id)
+{
+  if (!(store->flags[id] & TRANSFORM_FLAG_DIRTY))
+  {
+    store->flags[id] |= TRANSFORM_FLAG_DIRTY;
+    store->nDirty++;
+    VectorPush(&store->dirtyIds, store->alloc, &id);
+  }
+}
+
+/* Rebuilds id's local matrix, or its world matrix if it has no parent. */
+static void
+UpdateLocal(Transform_Store *store,
+            u32 id)
+{
+  Vec3 pos = {store->posX[id], store->posY[id], store->posZ[id]};
+  Vec4 rot = {store->rotX[id], store->rotY[id], store->rotZ[id],
+    store->rotW[id]};
+  Vec3 scale = {store->scaleX[id], store->scaleY[id], store->scaleZ[id]};
+
+  Mat4FromTrs(pos, rot, scale, store->parents[id] == TRANSFORM_ID_NONE
+      ? store->world[id] : store->local[id]);
+  store->changed[id] = store->update;
+  store->flags[id] &= ~TRANSFORM_FLAG_DIRTY;
+}
+
+/* 
+ * Whether any of id's ancestors changed this update, in which case id is 
+ * refreshed as part of that ancestor's subtree.
+ */
+static bool
+AncestorChanged(Transform_Store *store,
+                u32 id)
+{
+  for (u32 p = store->parents[id]; p != TRANSFORM_ID_NONE; 
+      p = store->parents[p])
+  {
+    if (store->changed[p] == store->update)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* 
+ * Rebuilds the world matrices of id and everything under it, walking the 
+ * child lists in preorder without a stack.
+ */
+static void
+PropagateFrom(Transform_Store *store,
+              u32 id)
+{
+  u32 node = id;
+
+  if (store->parents[id] == TRANSFORM_ID_NONE)
+  {
+    node = store->firstChild[id];
+  }
+
+  while (node != TRANSFORM_ID_NONE)
+  {
+    Mat4Mul(store->world[store->parents[node]], store->local[node], 
+        store->world[node]);
+    if (store->changed[node] != store->update)
+    {
+      VectorPush(&store->moved, store->alloc, &node);
+      store->changed[node] = store->update;
+    }
+
+    if (store->firstChild[node] != TRANSFORM_ID_NONE)
+    {
+      node = store->firstChild[node];
+      continue;
+    }
+
+    while (node != id && store->nextSibling[node] == TRANSFORM_ID_NONE)
+    {
+      node = store->parents[node];
+    }
+    node = node == id ? TRANSFORM_ID_NONE : store->nextSibling[node];
+  }
+}
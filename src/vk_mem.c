@@ -10,6 +10,8 @@
 
 static uint32_t FindMemoryType(Renderer *ren, uint32_t typeFilter, 
     VkMemoryPropertyFlags props);
+static bool TryFindMemoryType(Renderer *ren, uint32_t typeFilter, 
+    VkMemoryPropertyFlags props, uint32_t *typeOut);
 
 /* === PUBLIC FUNCTIONS === */
 
@@ -129,6 +131,71 @@ CreateImage(Renderer *ren,
   return ERR_OK;
 }
 
+Err_Code 
+CreateImageView(Renderer *ren, 
+                VkImage image, 
+                VkFormat format, 
+                VkImageAspectFlags aspectFlags,
+                VkImageView *view)
+{
+  VkResult vkErr;
+
+  VkImageViewCreateInfo viewInfo = 
+  {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image = image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = format,
+    .subresourceRange = 
+    {
+      .aspectMask = aspectFlags,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+
+  vkErr = vkCreateImageView(ren->dev, &viewInfo, ren->allocCbs, 
+      view);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  return ERR_OK;
+}
+
+Err_Code
+AllocateMemory(Renderer *ren,
+               const VkMemoryRequirements *reqs,
+               VkMemoryPropertyFlags properties,
+               VkDeviceMemory *memoryOut)
+{
+  VkResult vkErr;
+  uint32_t type;
+
+  if (!TryFindMemoryType(ren, reqs->memoryTypeBits, properties, &type))
+  {
+    return ERR_NO_SUITABLE_HARDWARE;
+  }
+
+  VkMemoryAllocateInfo allocInfo = 
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize = reqs->size,
+    .memoryTypeIndex = type,
+  };
+
+  vkErr = vkAllocateMemory(ren->dev, &allocInfo, ren->allocCbs, memoryOut);
+  if (vkErr)
+  {
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  return ERR_OK;
+}
+
 void 
 DestroyImage(Renderer *ren, 
              VkImage image, 
@@ -138,10 +205,157 @@ DestroyImage(Renderer *ren,
   vkFreeMemory(ren->dev, memory, ren->allocCbs);
 }
 
+Err_Code
+UniformArenaCreate(Renderer *ren,
+                   VkDeviceSize size,
+                   Uniform_Arena *arena)
+{
+  Err_Code err;
+  VkResult vkErr;
+  void *data;
+  VkPhysicalDeviceProperties properties;
+
+  vkGetPhysicalDeviceProperties(ren->pDev, &properties);
+
+  err = CreateBuffer(ren, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &arena->buffer, &arena->memory);
+  if (err)
+  {
+    return err;
+  }
+
+  /* Mapped for the arena's whole lifetime. */
+  vkErr = vkMapMemory(ren->dev, arena->memory, 0, size, 0, &data);
+  if (vkErr)
+  {
+    DestroyBuffer(ren, arena->buffer, arena->memory);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  arena->mapped = data;
+  arena->size = size;
+  arena->used = 0;
+  arena->alignment = properties.limits.minUniformBufferOffsetAlignment;
+  return ERR_OK;
+}
+
+void
+UniformArenaDestroy(Renderer *ren,
+                    Uniform_Arena *arena)
+{
+  vkUnmapMemory(ren->dev, arena->memory);
+  DestroyBuffer(ren, arena->buffer, arena->memory);
+  arena->mapped = NULL;
+}
+
+void
+UniformArenaReset(Uniform_Arena *arena)
+{
+  arena->used = 0;
+}
+
+void *
+UniformArenaPush(Uniform_Arena *arena,
+                 VkDeviceSize size,
+                 u32 *offsetOut)
+{
+  /* minUniformBufferOffsetAlignment is always a power of two. */
+  VkDeviceSize offset = (arena->used + arena->alignment - 1) 
+    & ~(arena->alignment - 1);
+
+  if (offset + size > arena->size)
+  {
+    return NULL;
+  }
+
+  arena->used = offset + size;
+  *offsetOut = (u32) offset;
+  return arena->mapped + offset;
+}
+
+Err_Code
+InstanceBufferCreate(Renderer *ren,
+                     u32 capacity,
+                     Instance_Buffer *instances)
+{
+  Err_Code err;
+  VkResult vkErr;
+  void *data;
+  VkDeviceSize size = sizeof(Instance_Data) * (VkDeviceSize) capacity;
+
+  err = CreateBuffer(ren, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &instances->buffer, &instances->memory);
+  if (err)
+  {
+    return err;
+  }
+
+  vkErr = vkMapMemory(ren->dev, instances->memory, 0, size, 0, &data);
+  if (vkErr)
+  {
+    DestroyBuffer(ren, instances->buffer, instances->memory);
+    return ERR_LIBRARY_FAILURE;
+  }
+
+  instances->mapped = data;
+  instances->capacity = capacity;
+  instances->used = 0;
+  return ERR_OK;
+}
+
+void
+InstanceBufferDestroy(Renderer *ren,
+                      Instance_Buffer *instances)
+{
+  vkUnmapMemory(ren->dev, instances->memory);
+  DestroyBuffer(ren, instances->buffer, instances->memory);
+  instances->mapped = NULL;
+}
+
+void
+InstanceBufferReset(Instance_Buffer *instances)
+{
+  instances->used = 0;
+}
+
+Instance_Data *
+InstanceBufferPush(Instance_Buffer *instances,
+                   u32 n,
+                   u32 *firstOut)
+{
+  if (n > instances->capacity - instances->used)
+  {
+    return NULL;
+  }
+
+  *firstOut = instances->used;
+  instances->used += n;
+  return instances->mapped + *firstOut;
+}
+
 /* === PRIVATE FUNCTIONS === */
 
 static uint32_t 
 FindMemoryType(Renderer *ren, uint32_t typeFilter, VkMemoryPropertyFlags props)
+{
+  uint32_t type;
+
+  if (TryFindMemoryType(ren, typeFilter, props, &type))
+  {
+    return type;
+  }
+
+  LOG_ERROR("failed to find suitable memory type");
+  return 0;
+}
+
+static bool
+TryFindMemoryType(Renderer *ren, 
+                  uint32_t typeFilter, 
+                  VkMemoryPropertyFlags props,
+                  uint32_t *typeOut)
 {
   VkPhysicalDeviceMemoryProperties memProperties;
   vkGetPhysicalDeviceMemoryProperties(ren->pDev, &memProperties);
@@ -150,11 +364,11 @@ FindMemoryType(Renderer *ren, uint32_t typeFilter, VkMemoryPropertyFlags props)
   {
     if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & props) == props)
     {
-      return i;
+      *typeOut = i;
+      return true;
     }
   }
 
-  LOG_ERROR("failed to find suitable memory type");
-  return 0;
+  return false;
 }
 